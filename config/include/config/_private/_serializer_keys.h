@@ -22,6 +22,8 @@ namespace config {
     constexpr const char* enableFramerateLimit() noexcept { return "limit_on"; }
     constexpr const char* framerateLimit() noexcept { return "framerate"; }
     constexpr const char* enableFrameSkip() noexcept { return "skip"; }
+    constexpr const char* enableGpuThread() noexcept { return "gpu_thread"; }
+    constexpr const char* enableTiledRasterizer() noexcept { return "tiled_raster"; }
     constexpr const char* precision() noexcept { return "subprec"; }
     constexpr const char* osd() noexcept { return "osd"; }
   }
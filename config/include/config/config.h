@@ -41,6 +41,8 @@ namespace config {
     bool enableFramerateLimit = true;                  ///< Enable framerate limiter (with 'framerateLimit')
     float framerateLimit = autodetectFramerate();      ///< Framerate limit (frames per second / autodetectFramerate())
     bool enableFrameSkip = false;                      ///< Frame skipping mode
+    bool enableGpuThread = false;                      ///< Decode/render GPU commands in a worker thread (emulator thread only copies data)
+    bool enableTiledRasterizer = false;                ///< Rasterize polygons in batches, with screen tiles shared by multiple threads
     OnScreenDisplay osd = OnScreenDisplay::none;       ///< On-screen-display: none / FPS / rendering info
   };
 
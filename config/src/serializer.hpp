@@ -248,6 +248,10 @@ void Serializer::writeGlobalConfigFile(const UnicodeString& configDir, const Vid
     jsonObject.emplace(video::framerateLimit(), SerializableValue(videoCfg.framerateLimit));
   if (videoCfg.enableFrameSkip)
     jsonObject.emplace(video::enableFrameSkip(), SerializableValue((int32_t)videoCfg.enableFrameSkip));
+  if (videoCfg.enableGpuThread)
+    jsonObject.emplace(video::enableGpuThread(), SerializableValue((int32_t)videoCfg.enableGpuThread));
+  if (videoCfg.enableTiledRasterizer)
+    jsonObject.emplace(video::enableTiledRasterizer(), SerializableValue((int32_t)videoCfg.enableTiledRasterizer));
   if (videoCfg.precision != PrecisionMode::standard)
     jsonObject.emplace(video::precision(), SerializableValue((int32_t)videoCfg.precision));
   if (videoCfg.osd != OnScreenDisplay::none)
@@ -414,6 +418,8 @@ void Serializer::readGlobalConfigFile(const UnicodeString& configDir, VideoConfi
   outVideoCfg.enableFramerateLimit = __readInteger<bool>(jsonObject, video::enableFramerateLimit(), false);
   outVideoCfg.framerateLimit = __readFloat(jsonObject, video::framerateLimit(), autodetectFramerate());
   outVideoCfg.enableFrameSkip = __readInteger<bool>(jsonObject, video::enableFrameSkip(), false);
+  outVideoCfg.enableGpuThread = __readInteger<bool>(jsonObject, video::enableGpuThread(), false);
+  outVideoCfg.enableTiledRasterizer = __readInteger<bool>(jsonObject, video::enableTiledRasterizer(), false);
   outVideoCfg.precision = __readInteger(jsonObject, video::precision(), PrecisionMode::standard);
   outVideoCfg.osd = __readInteger(jsonObject, video::osd(), OnScreenDisplay::none);
 
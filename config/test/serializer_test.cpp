@@ -100,6 +100,8 @@ static void __compareCommonConfig(const VideoConfig& r1, const VideoConfig& r2,
   EXPECT_EQ(r1.enableVsync, r2.enableVsync);
   EXPECT_EQ(r1.framerateLimit, r2.framerateLimit);
   EXPECT_EQ(r1.enableFrameSkip, r2.enableFrameSkip);
+  EXPECT_EQ(r1.enableGpuThread, r2.enableGpuThread);
+  EXPECT_EQ(r1.enableTiledRasterizer, r2.enableTiledRasterizer);
   EXPECT_EQ(r1.precision, r2.precision);
   EXPECT_EQ(r1.osd, r2.osd);
 
@@ -199,6 +201,8 @@ TEST_F(SerializerTest, writeReadCommonConfig) {
   inVideoCfg.enableVsync = true;
   inVideoCfg.framerateLimit = 59.94f;
   inVideoCfg.enableFrameSkip = true;
+  inVideoCfg.enableGpuThread = true;
+  inVideoCfg.enableTiledRasterizer = true;
   inVideoCfg.precision = PrecisionMode::subprecision;
   inVideoCfg.osd = OnScreenDisplay::framerate;
   inWindowCfg.monitorId = __UNICODE_STR("\\Display_1 - Generic PnP");
@@ -0,0 +1,101 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+--------------------------------------------------------------------------------
+Description : GP0 command stream scanners - internal use only
+*******************************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <system/force_inline.h>
+#include "display/_private/_vram_kernels.h"
+
+namespace display {
+  static constexpr inline uint32_t polyLineTerminationMask() noexcept { return 0xF000F000u; } ///< Bits compared to detect end of poly-line
+  static constexpr inline uint32_t polyLineTermination() noexcept { return 0x50005000u; }     ///< End of poly-line (after mask)
+
+  /// @brief Verify if a param is a poly-line termination code (usually 0x55555555)
+  static constexpr inline bool isPolyLineTermination(uint32_t param) noexcept {
+    return ((param & polyLineTerminationMask()) == polyLineTermination());
+  }
+
+  // -- termination scan -- ----------------------------------------------------
+
+  /// @brief Find termination code of poly-line in received params (scalar reference)
+  /// @param firstIndex  Index of first param that may be a termination code
+  /// @param stride      2 for shaded poly-lines (termination code instead of vertex color), 1 for flat ones
+  /// @returns Index of termination code (or 'size' if not received yet)
+  static inline int findPolyLineTerminationScalar(const uint32_t* mem, int size, int firstIndex, int stride) noexcept {
+    for (int i = firstIndex; i < size; i += stride) {
+      if (isPolyLineTermination(mem[i]))
+        return i;
+    }
+    return size;
+  }
+
+  // Get index of lowest bit set in comparison mask (mask != 0)
+  static __forceinline int __firstMatchingLane(uint32_t mask) noexcept {
+    int index = 0;
+    for (; (mask & 0x1u) == 0; mask >>= 1)
+      ++index;
+    return index;
+  }
+
+  /// @brief Find termination code of poly-line in received params (vectorized: 4-8 params per comparison)
+  /// @param firstIndex  Index of first param that may be a termination code
+  /// @param stride      2 for shaded poly-lines (termination code instead of vertex color), 1 for flat ones
+  /// @returns Index of termination code (or 'size' if not received yet)
+  /// @remarks Lanes are compared from 'firstIndex': odd lanes are ignored with a lane mask when 'stride' == 2.
+  static inline int findPolyLineTermination(const uint32_t* mem, int size, int firstIndex, int stride) noexcept {
+    int index = firstIndex;
+#   if defined(__DISPLAY_SIMD_AVX2)
+      const __m256i mask256 = _mm256_set1_epi32((int)polyLineTerminationMask());
+      const __m256i termination256 = _mm256_set1_epi32((int)polyLineTermination());
+      const uint32_t laneMask256 = (stride == 2) ? 0x55u : 0xFFu;
+      for (; index + 8 <= size; index += 8) {
+        __m256i params = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)&mem[index]), mask256);
+        uint32_t matches = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(params, termination256)))
+                         & laneMask256;
+        if (matches)
+          return index + __firstMatchingLane(matches);
+      }
+#   endif
+#   if defined(__DISPLAY_SIMD_SSE2)
+      const __m128i mask128 = _mm_set1_epi32((int)polyLineTerminationMask());
+      const __m128i termination128 = _mm_set1_epi32((int)polyLineTermination());
+      const uint32_t laneMask128 = (stride == 2) ? 0x5u : 0xFu;
+      for (; index + 4 <= size; index += 4) {
+        __m128i params = _mm_and_si128(_mm_loadu_si128((const __m128i*)&mem[index]), mask128);
+        uint32_t matches = (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(params, termination128))) & laneMask128;
+        if (matches)
+          return index + __firstMatchingLane(matches);
+      }
+#   elif defined(__DISPLAY_SIMD_NEON)
+      const uint32x4_t mask128 = vdupq_n_u32(polyLineTerminationMask());
+      const uint32x4_t termination128 = vdupq_n_u32(polyLineTermination());
+      const uint16x4_t laneMask128 = vreinterpret_u16_u64(vdup_n_u64((stride == 2) ? 0x0000FFFF0000FFFFuLL : 0xFFFFFFFFFFFFFFFFuLL));
+      for (; index + 4 <= size; index += 4) {
+        uint16x4_t isEqual = vand_u16(vmovn_u32(vceqq_u32(vandq_u32(vld1q_u32(&mem[index]), mask128), termination128)), laneMask128);
+        uint64_t matches = vget_lane_u64(vreinterpret_u64_u16(isEqual), 0); // 16 bits per lane
+        if (matches) {
+          int lane = 0;
+          for (; (matches & 0xFFFFu) == 0; matches >>= 16)
+            ++lane;
+          return index + lane;
+        }
+      }
+#   endif
+    // remaining params: vector loops only stop on block boundaries -> stride alignment preserved
+    return findPolyLineTerminationScalar(mem, size, index, stride);
+  }
+}
@@ -0,0 +1,286 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+--------------------------------------------------------------------------------
+Description : Pixel write stage (semi-transparency + mask bits) - internal use only
+*******************************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <system/force_inline.h>
+#include "display/types.h"
+#include "display/vram.h"
+#include "display/_private/_vram_kernels.h"
+
+// Blending is computed per color component, with each 5-bit component aligned on the top bits of 16-bit lanes
+// (red: <<11, green: <<6, blue: <<1) -> saturation of 15-bit components with unsigned saturating 16-bit operations.
+
+namespace display {
+  // -- scalar reference -- ----------------------------------------------------
+
+  /// @brief Blend two 15-bit colors (STP bits ignored)
+  template <BlendingMode _Mode>
+  static __forceinline uint16_t blendPixel(uint16_t back, uint16_t front) noexcept {
+    uint32_t result = 0;
+    for (uint32_t shift = 0; shift < 15u; shift += 5u) {
+      int32_t backValue = (int32_t)((back >> shift) & 0x1Fu);
+      int32_t frontValue = (int32_t)((front >> shift) & 0x1Fu);
+      int32_t value;
+      switch (_Mode) {
+        case BlendingMode::mean:     value = (backValue + frontValue) >> 1; break;
+        case BlendingMode::add:      value = backValue + frontValue; break;
+        case BlendingMode::subtract: value = backValue - frontValue; break;
+        default:                     value = backValue + (frontValue >> 2); break;
+      }
+      value = (value < 0) ? 0 : ((value > 0x1F) ? 0x1F : value);
+      result |= ((uint32_t)value << shift);
+    }
+    return (uint16_t)result;
+  }
+
+  /// @brief Pixel write stage for 1 pixel (scalar)
+  template <BlendingMode _Mode, bool _IsBlended, bool _IsStpGated, bool _IsMaskChecked>
+  static __forceinline uint16_t writePixel(uint16_t dest, uint16_t color, uint16_t writeMask, uint16_t forceMaskBit) noexcept {
+    uint16_t result = (uint16_t)(color & 0x7FFFu);
+    if (_IsBlended && (!_IsStpGated || (color & vramMaskBit())))
+      result = blendPixel<_Mode>(dest, result);
+    result |= (uint16_t)((color & vramMaskBit()) | forceMaskBit);
+    if (_IsMaskChecked)
+      writeMask &= (uint16_t)~((int16_t)dest >> 15);
+    return (uint16_t)((result & writeMask) | (dest & ~writeMask));
+  }
+
+
+  // -- vector blending -- -----------------------------------------------------
+
+# if defined(__DISPLAY_SIMD_AVX2)
+    template <BlendingMode _Mode>
+    static __forceinline __m256i __blendComponents256(__m256i back, __m256i front) noexcept {
+      switch (_Mode) {
+        case BlendingMode::mean:     return _mm256_add_epi16(_mm256_srli_epi16(back, 1), _mm256_srli_epi16(front, 1));
+        case BlendingMode::add:      return _mm256_adds_epu16(back, front);
+        case BlendingMode::subtract: return _mm256_subs_epu16(back, front);
+        default:                     return _mm256_adds_epu16(back, _mm256_srli_epi16(front, 2));
+      }
+    }
+    template <BlendingMode _Mode>
+    static __forceinline __m256i blendPixels256(__m256i back, __m256i front) noexcept {
+      const __m256i componentMask = _mm256_set1_epi16((short)0xF800);
+      __m256i red = _mm256_and_si256(__blendComponents256<_Mode>(_mm256_slli_epi16(back, 11), _mm256_slli_epi16(front, 11)), componentMask);
+      __m256i green = _mm256_and_si256(__blendComponents256<_Mode>(_mm256_and_si256(_mm256_slli_epi16(back, 6), componentMask),
+                                                                   _mm256_and_si256(_mm256_slli_epi16(front, 6), componentMask)), componentMask);
+      __m256i blue = _mm256_and_si256(__blendComponents256<_Mode>(_mm256_and_si256(_mm256_slli_epi16(back, 1), componentMask),
+                                                                  _mm256_and_si256(_mm256_slli_epi16(front, 1), componentMask)), componentMask);
+      return _mm256_or_si256(_mm256_or_si256(_mm256_srli_epi16(red, 11), _mm256_srli_epi16(green, 6)), _mm256_srli_epi16(blue, 1));
+    }
+# endif
+# if defined(__DISPLAY_SIMD_SSE2)
+    template <BlendingMode _Mode>
+    static __forceinline __m128i __blendComponents128(__m128i back, __m128i front) noexcept {
+      switch (_Mode) {
+        case BlendingMode::mean:     return _mm_add_epi16(_mm_srli_epi16(back, 1), _mm_srli_epi16(front, 1));
+        case BlendingMode::add:      return _mm_adds_epu16(back, front);
+        case BlendingMode::subtract: return _mm_subs_epu16(back, front);
+        default:                     return _mm_adds_epu16(back, _mm_srli_epi16(front, 2));
+      }
+    }
+    template <BlendingMode _Mode>
+    static __forceinline __m128i blendPixels128(__m128i back, __m128i front) noexcept {
+      const __m128i componentMask = _mm_set1_epi16((short)0xF800);
+      __m128i red = _mm_and_si128(__blendComponents128<_Mode>(_mm_slli_epi16(back, 11), _mm_slli_epi16(front, 11)), componentMask);
+      __m128i green = _mm_and_si128(__blendComponents128<_Mode>(_mm_and_si128(_mm_slli_epi16(back, 6), componentMask),
+                                                                _mm_and_si128(_mm_slli_epi16(front, 6), componentMask)), componentMask);
+      __m128i blue = _mm_and_si128(__blendComponents128<_Mode>(_mm_and_si128(_mm_slli_epi16(back, 1), componentMask),
+                                                               _mm_and_si128(_mm_slli_epi16(front, 1), componentMask)), componentMask);
+      return _mm_or_si128(_mm_or_si128(_mm_srli_epi16(red, 11), _mm_srli_epi16(green, 6)), _mm_srli_epi16(blue, 1));
+    }
+# elif defined(__DISPLAY_SIMD_NEON)
+    template <BlendingMode _Mode>
+    static __forceinline uint16x8_t __blendComponents128(uint16x8_t back, uint16x8_t front) noexcept {
+      switch (_Mode) {
+        case BlendingMode::mean:     return vaddq_u16(vshrq_n_u16(back, 1), vshrq_n_u16(front, 1));
+        case BlendingMode::add:      return vqaddq_u16(back, front);
+        case BlendingMode::subtract: return vqsubq_u16(back, front);
+        default:                     return vqaddq_u16(back, vshrq_n_u16(front, 2));
+      }
+    }
+    template <BlendingMode _Mode>
+    static __forceinline uint16x8_t blendPixels128(uint16x8_t back, uint16x8_t front) noexcept {
+      const uint16x8_t componentMask = vdupq_n_u16(0xF800);
+      uint16x8_t red = vandq_u16(__blendComponents128<_Mode>(vshlq_n_u16(back, 11), vshlq_n_u16(front, 11)), componentMask);
+      uint16x8_t green = vandq_u16(__blendComponents128<_Mode>(vandq_u16(vshlq_n_u16(back, 6), componentMask),
+                                                               vandq_u16(vshlq_n_u16(front, 6), componentMask)), componentMask);
+      uint16x8_t blue = vandq_u16(__blendComponents128<_Mode>(vandq_u16(vshlq_n_u16(back, 1), componentMask),
+                                                              vandq_u16(vshlq_n_u16(front, 1), componentMask)), componentMask);
+      return vorrq_u16(vorrq_u16(vshrq_n_u16(red, 11), vshrq_n_u16(green, 6)), vshrq_n_u16(blue, 1));
+    }
+# endif
+
+
+  // -- pixel write stage -- ---------------------------------------------------
+
+  /// @brief Write span of shaded pixels: semi-transparency, STP gating, mask check, forced mask bit
+  /// @param colors     Shaded 15-bit colors + STP bit (textured: texel STP bit, others: 0)
+  /// @param writeMask  Pixels to write (0xFFFF) or to skip (0: transparent texels) -- ignored if !_HasWriteMask
+  /// @remarks - _IsBlended: semi-transparent primitive (blending with destination pixels)
+  ///          - _IsStpGated: only blend pixels with STP bit set (textured primitives)
+  ///          - _IsMaskChecked: don't overwrite destination pixels with mask bit set
+  ///          - _IsZeroTransparent: skip pixels with color 0 (raw texels copied without write mask)
+  ///          - Branchless: all conditions are applied with bitwise selections (8/16 pixels per iteration).
+  template <BlendingMode _Mode, bool _IsBlended, bool _IsStpGated, bool _IsMaskChecked, bool _HasWriteMask,
+            bool _IsZeroTransparent = false>
+  static __forceinline void writePixelSpan(uint16_t* dest, const uint16_t* colors, const uint16_t* writeMask,
+                                           size_t length, uint16_t forceMaskBit) noexcept {
+#   if defined(__DISPLAY_SIMD_AVX2)
+      const __m256i stpBit256 = _mm256_set1_epi16((short)vramMaskBit());
+      const __m256i forced256 = _mm256_set1_epi16((short)forceMaskBit);
+      for (; length >= 16u; length -= 16u, dest += 16, colors += 16) {
+        __m256i destPixels = _mm256_loadu_si256((const __m256i*)dest);
+        __m256i srcPixels = _mm256_loadu_si256((const __m256i*)colors);
+        __m256i stpBits = _mm256_and_si256(srcPixels, stpBit256);
+        __m256i result = _mm256_andnot_si256(stpBit256, srcPixels);
+        if (_IsBlended) {
+          __m256i blended = blendPixels256<_Mode>(destPixels, result);
+          if (_IsStpGated) {
+            __m256i isBlended = _mm256_srai_epi16(srcPixels, 15);
+            result = _mm256_or_si256(_mm256_and_si256(isBlended, blended), _mm256_andnot_si256(isBlended, result));
+          }
+          else
+            result = blended;
+        }
+        result = _mm256_or_si256(result, _mm256_or_si256(stpBits, forced256));
+
+        __m256i isWritten = _mm256_set1_epi16(-1);
+        if (_HasWriteMask) {
+          isWritten = _mm256_loadu_si256((const __m256i*)writeMask);
+          writeMask += 16;
+        }
+        if (_IsZeroTransparent)
+          isWritten = _mm256_andnot_si256(_mm256_cmpeq_epi16(srcPixels, _mm256_setzero_si256()), isWritten);
+        if (_IsMaskChecked)
+          isWritten = _mm256_andnot_si256(_mm256_srai_epi16(destPixels, 15), isWritten);
+        _mm256_storeu_si256((__m256i*)dest, _mm256_or_si256(_mm256_and_si256(isWritten, result),
+                                                            _mm256_andnot_si256(isWritten, destPixels)));
+      }
+#   endif
+#   if defined(__DISPLAY_SIMD_SSE2)
+      const __m128i stpBit = _mm_set1_epi16((short)vramMaskBit());
+      const __m128i forced = _mm_set1_epi16((short)forceMaskBit);
+      for (; length >= 8u; length -= 8u, dest += 8, colors += 8) {
+        __m128i destPixels = _mm_loadu_si128((const __m128i*)dest);
+        __m128i srcPixels = _mm_loadu_si128((const __m128i*)colors);
+        __m128i stpBits = _mm_and_si128(srcPixels, stpBit);
+        __m128i result = _mm_andnot_si128(stpBit, srcPixels);
+        if (_IsBlended) {
+          __m128i blended = blendPixels128<_Mode>(destPixels, result);
+          if (_IsStpGated) {
+            __m128i isBlended = _mm_srai_epi16(srcPixels, 15);
+            result = _mm_or_si128(_mm_and_si128(isBlended, blended), _mm_andnot_si128(isBlended, result));
+          }
+          else
+            result = blended;
+        }
+        result = _mm_or_si128(result, _mm_or_si128(stpBits, forced));
+
+        __m128i isWritten = _mm_set1_epi16(-1);
+        if (_HasWriteMask) {
+          isWritten = _mm_loadu_si128((const __m128i*)writeMask);
+          writeMask += 8;
+        }
+        if (_IsZeroTransparent)
+          isWritten = _mm_andnot_si128(_mm_cmpeq_epi16(srcPixels, _mm_setzero_si128()), isWritten);
+        if (_IsMaskChecked)
+          isWritten = _mm_andnot_si128(_mm_srai_epi16(destPixels, 15), isWritten);
+        _mm_storeu_si128((__m128i*)dest, _mm_or_si128(_mm_and_si128(isWritten, result), _mm_andnot_si128(isWritten, destPixels)));
+      }
+#   elif defined(__DISPLAY_SIMD_NEON)
+      const uint16x8_t stpBit = vdupq_n_u16(vramMaskBit());
+      const uint16x8_t forced = vdupq_n_u16(forceMaskBit);
+      for (; length >= 8u; length -= 8u, dest += 8, colors += 8) {
+        uint16x8_t destPixels = vld1q_u16(dest);
+        uint16x8_t srcPixels = vld1q_u16(colors);
+        uint16x8_t stpBits = vandq_u16(srcPixels, stpBit);
+        uint16x8_t result = vbicq_u16(srcPixels, stpBit);
+        if (_IsBlended) {
+          uint16x8_t blended = blendPixels128<_Mode>(destPixels, result);
+          if (_IsStpGated)
+            result = vbslq_u16(vreinterpretq_u16_s16(vshrq_n_s16(vreinterpretq_s16_u16(srcPixels), 15)), blended, result);
+          else
+            result = blended;
+        }
+        result = vorrq_u16(result, vorrq_u16(stpBits, forced));
+
+        uint16x8_t isWritten = vdupq_n_u16(0xFFFF);
+        if (_HasWriteMask) {
+          isWritten = vld1q_u16(writeMask);
+          writeMask += 8;
+        }
+        if (_IsZeroTransparent)
+          isWritten = vbicq_u16(isWritten, vceqq_u16(srcPixels, vdupq_n_u16(0)));
+        if (_IsMaskChecked)
+          isWritten = vbicq_u16(isWritten, vreinterpretq_u16_s16(vshrq_n_s16(vreinterpretq_s16_u16(destPixels), 15)));
+        vst1q_u16(dest, vbslq_u16(isWritten, result, destPixels));
+      }
+#   endif
+    for (; length; --length, ++dest, ++colors) {
+      uint16_t isWritten = 0xFFFFu;
+      if (_HasWriteMask)
+        isWritten = *(writeMask++);
+      if (_IsZeroTransparent)
+        isWritten &= (uint16_t)-(int16_t)(*colors != 0);
+      *dest = writePixel<_Mode, _IsBlended, _IsStpGated, _IsMaskChecked>(*dest, *colors, isWritten, forceMaskBit);
+    }
+  }
+
+  // ---
+
+  /// @brief Function type of specialized pixel write stages
+  using PixelSpanWriter = void (*)(uint16_t* dest, const uint16_t* colors, const uint16_t* writeMask,
+                                   size_t length, uint16_t forceMaskBit);
+
+  template <BlendingMode _Mode, bool _IsBlended, bool _IsStpGated, bool _IsMaskChecked, bool _HasWriteMask>
+  static void __writePixelSpan(uint16_t* dest, const uint16_t* colors, const uint16_t* writeMask,
+                               size_t length, uint16_t forceMaskBit) noexcept {
+    writePixelSpan<_Mode,_IsBlended,_IsStpGated,_IsMaskChecked,_HasWriteMask>(dest, colors, writeMask, length, forceMaskBit);
+  }
+  template <bool _IsBlended, bool _IsStpGated, bool _IsMaskChecked, bool _HasWriteMask>
+  static inline PixelSpanWriter __getPixelSpanWriter(BlendingMode mode) noexcept {
+    switch (mode) {
+      case BlendingMode::mean:     return __writePixelSpan<BlendingMode::mean,_IsBlended,_IsStpGated,_IsMaskChecked,_HasWriteMask>;
+      case BlendingMode::add:      return __writePixelSpan<BlendingMode::add,_IsBlended,_IsStpGated,_IsMaskChecked,_HasWriteMask>;
+      case BlendingMode::subtract: return __writePixelSpan<BlendingMode::subtract,_IsBlended,_IsStpGated,_IsMaskChecked,_HasWriteMask>;
+      default:                     return __writePixelSpan<BlendingMode::addQuarter,_IsBlended,_IsStpGated,_IsMaskChecked,_HasWriteMask>;
+    }
+  }
+  template <bool _IsBlended, bool _IsStpGated>
+  static inline PixelSpanWriter __getPixelSpanWriter(BlendingMode mode, bool isMaskChecked, bool hasWriteMask) noexcept {
+    if (isMaskChecked)
+      return hasWriteMask ? __getPixelSpanWriter<_IsBlended,_IsStpGated,true,true>(mode)
+                          : __getPixelSpanWriter<_IsBlended,_IsStpGated,true,false>(mode);
+    return hasWriteMask ? __getPixelSpanWriter<_IsBlended,_IsStpGated,false,true>(mode)
+                        : __getPixelSpanWriter<_IsBlended,_IsStpGated,false,false>(mode);
+  }
+
+  /// @brief Select specialized pixel write stage (once per primitive)
+  /// @param isBlended      Semi-transparent primitive
+  /// @param isStpGated     Only blend pixels with STP bit set (textured primitives)
+  /// @param isMaskChecked  Don't overwrite pixels with mask bit set
+  /// @param hasWriteMask   Write mask provided with each span (transparent texels)
+  static inline PixelSpanWriter getPixelSpanWriter(BlendingMode mode, bool isBlended, bool isStpGated,
+                                                   bool isMaskChecked, bool hasWriteMask) noexcept {
+    if (!isBlended) // blending mode and STP gating irrelevant
+      return __getPixelSpanWriter<false,false>(BlendingMode::mean, isMaskChecked, hasWriteMask);
+    return isStpGated ? __getPixelSpanWriter<true,true>(mode, isMaskChecked, hasWriteMask)
+                      : __getPixelSpanWriter<true,false>(mode, isMaskChecked, hasWriteMask);
+  }
+}
@@ -0,0 +1,175 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+--------------------------------------------------------------------------------
+Description : VRAM span kernels (16-bit texel rows) - internal use only
+*******************************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <system/force_inline.h>
+#include "display/types.h"
+
+#if defined(__AVX2__)
+# include <immintrin.h>
+# define __DISPLAY_SIMD_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# include <emmintrin.h>
+# define __DISPLAY_SIMD_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+# include <arm_neon.h>
+# define __DISPLAY_SIMD_NEON 1
+#endif
+
+namespace display {
+  // -- span copy (CPU->VRAM / VRAM->VRAM) -- ----------------------------------
+
+  /// @brief Copy span of texels + force mask bit (if 'forceMaskBit' == vramMaskBit())
+  /// @warning Source and destination must not overlap
+  static __forceinline void copyVramSpan(uint16_t* dest, const uint16_t* src, size_t length, uint16_t forceMaskBit) noexcept {
+    if (forceMaskBit == 0) {
+      memcpy((void*)dest, (const void*)src, length*sizeof(uint16_t));
+      return;
+    }
+#   if defined(__DISPLAY_SIMD_AVX2)
+      const __m256i forced256 = _mm256_set1_epi16((short)forceMaskBit);
+      for (; length >= 16u; length -= 16u, src += 16, dest += 16)
+        _mm256_storeu_si256((__m256i*)dest, _mm256_or_si256(_mm256_loadu_si256((const __m256i*)src), forced256));
+#   endif
+#   if defined(__DISPLAY_SIMD_SSE2)
+      const __m128i forced = _mm_set1_epi16((short)forceMaskBit);
+      for (; length >= 8u; length -= 8u, src += 8, dest += 8)
+        _mm_storeu_si128((__m128i*)dest, _mm_or_si128(_mm_loadu_si128((const __m128i*)src), forced));
+#   elif defined(__DISPLAY_SIMD_NEON)
+      const uint16x8_t forced = vdupq_n_u16(forceMaskBit);
+      for (; length >= 8u; length -= 8u, src += 8, dest += 8)
+        vst1q_u16(dest, vorrq_u16(vld1q_u16(src), forced));
+#   endif
+    for (; length; --length, ++src, ++dest)
+      *dest = (*src | forceMaskBit);
+  }
+
+  /// @brief Copy span of texels, except where destination texels have their mask bit set (write protection)
+  ///        + force mask bit (if 'forceMaskBit' == vramMaskBit())
+  /// @remarks Branchless: destination protection is applied with a bitwise blend
+  /// @warning Source and destination must not overlap
+  static __forceinline void copyVramSpanMasked(uint16_t* dest, const uint16_t* src, size_t length, uint16_t forceMaskBit) noexcept {
+#   if defined(__DISPLAY_SIMD_AVX2)
+      const __m256i forced256 = _mm256_set1_epi16((short)forceMaskBit);
+      for (; length >= 16u; length -= 16u, src += 16, dest += 16) {
+        __m256i destPixels = _mm256_loadu_si256((const __m256i*)dest);
+        __m256i isProtected = _mm256_srai_epi16(destPixels, 15); // mask bit -> 0xFFFF / 0x0000
+        __m256i srcPixels = _mm256_or_si256(_mm256_loadu_si256((const __m256i*)src), forced256);
+        _mm256_storeu_si256((__m256i*)dest, _mm256_or_si256(_mm256_and_si256(isProtected, destPixels),
+                                                            _mm256_andnot_si256(isProtected, srcPixels)));
+      }
+#   endif
+#   if defined(__DISPLAY_SIMD_SSE2)
+      const __m128i forced = _mm_set1_epi16((short)forceMaskBit);
+      for (; length >= 8u; length -= 8u, src += 8, dest += 8) {
+        __m128i destPixels = _mm_loadu_si128((const __m128i*)dest);
+        __m128i isProtected = _mm_srai_epi16(destPixels, 15); // mask bit -> 0xFFFF / 0x0000
+        __m128i srcPixels = _mm_or_si128(_mm_loadu_si128((const __m128i*)src), forced);
+        _mm_storeu_si128((__m128i*)dest, _mm_or_si128(_mm_and_si128(isProtected, destPixels),
+                                                      _mm_andnot_si128(isProtected, srcPixels)));
+      }
+#   elif defined(__DISPLAY_SIMD_NEON)
+      const uint16x8_t forced = vdupq_n_u16(forceMaskBit);
+      for (; length >= 8u; length -= 8u, src += 8, dest += 8) {
+        uint16x8_t destPixels = vld1q_u16(dest);
+        uint16x8_t isProtected = vreinterpretq_u16_s16(vshrq_n_s16(vreinterpretq_s16_u16(destPixels), 15));
+        vst1q_u16(dest, vbslq_u16(isProtected, destPixels, vorrq_u16(vld1q_u16(src), forced)));
+      }
+#   endif
+    for (; length; --length, ++src, ++dest) {
+      uint16_t isProtected = (uint16_t)((int16_t)*dest >> 15);
+      *dest = (uint16_t)((*dest & isProtected) | ((*src | forceMaskBit) & ~isProtected));
+    }
+  }
+
+  /// @brief Copy span of texels in reverse order: dest[i] = src[length - 1 - i] (horizontally flipped sprites)
+  /// @warning Source and destination must not overlap
+  static __forceinline void copyVramSpanReversed(uint16_t* dest, const uint16_t* src, size_t length) noexcept {
+#   if defined(__DISPLAY_SIMD_AVX2)
+      const __m256i reverseMask = _mm256_setr_epi8(14,15,12,13,10,11,8,9,6,7,4,5,2,3,0,1, 14,15,12,13,10,11,8,9,6,7,4,5,2,3,0,1);
+      for (; length >= 16u; length -= 16u, dest += 16) {
+        __m256i texels = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)&src[length - 16u]), reverseMask);
+        _mm256_storeu_si256((__m256i*)dest, _mm256_permute4x64_epi64(texels, 0x4E)); // swap 128-bit lanes
+      }
+#   endif
+#   if defined(__DISPLAY_SIMD_SSE2)
+      for (; length >= 8u; length -= 8u, dest += 8) {
+        __m128i texels = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&src[length - 8u]), 0x1B);
+        texels = _mm_shufflehi_epi16(_mm_shufflelo_epi16(texels, 0xB1), 0xB1);
+        _mm_storeu_si128((__m128i*)dest, texels);
+      }
+#   elif defined(__DISPLAY_SIMD_NEON)
+      for (; length >= 8u; length -= 8u, dest += 8) {
+        uint16x8_t texels = vrev64q_u16(vld1q_u16(&src[length - 8u]));
+        vst1q_u16(dest, vcombine_u16(vget_high_u16(texels), vget_low_u16(texels)));
+      }
+#   endif
+    for (; length; --length, ++dest)
+      *dest = src[length - 1u];
+  }
+
+  // ---
+
+  /// @brief Fill span of texels with a color (GP0(0x02))
+  /// @remarks 'dest' must be aligned on 16 texels (32 bytes) and 'length' must be a multiple of 16 (hardware fill granularity)
+  static __forceinline void fillVramSpan(uint16_t* dest, size_t length, uint16_t color) noexcept {
+#   if defined(__DISPLAY_SIMD_AVX2)
+      const __m256i color256 = _mm256_set1_epi16((short)color);
+      for (; length >= 16u; length -= 16u, dest += 16)
+        _mm256_store_si256((__m256i*)dest, color256);
+#   elif defined(__DISPLAY_SIMD_SSE2)
+      const __m128i color128 = _mm_set1_epi16((short)color);
+      for (; length >= 16u; length -= 16u, dest += 16) {
+        _mm_store_si128((__m128i*)dest, color128);
+        _mm_store_si128((__m128i*)(dest + 8), color128);
+      }
+#   elif defined(__DISPLAY_SIMD_NEON)
+      const uint16x8_t color128 = vdupq_n_u16(color);
+      for (; length >= 16u; length -= 16u, dest += 16) {
+        vst1q_u16(dest, color128);
+        vst1q_u16(dest + 8, color128);
+      }
+#   endif
+    for (; length; --length, ++dest)
+      *dest = color;
+  }
+
+  /// @brief Copy span of texels into a VRAM line, starting at 'destX' (wraps around at the right edge of VRAM)
+  /// @remarks 'length' must not exceed VRAM width
+  /// @warning Source and destination must not overlap
+  template <bool _CheckMask>
+  static __forceinline void copyVramSpanWrapped(uint16_t* destRow, unsigned long destX, const uint16_t* src,
+                                                unsigned long length, uint16_t forceMaskBit) noexcept {
+    unsigned long firstLength = vramWidth() - destX;
+    if (firstLength > length)
+      firstLength = length;
+
+    if (_CheckMask) {
+      copyVramSpanMasked(destRow + (intptr_t)destX, src, firstLength, forceMaskBit);
+      if (firstLength < length)
+        copyVramSpanMasked(destRow, src + (intptr_t)firstLength, length - firstLength, forceMaskBit); // wrap around
+    }
+    else {
+      copyVramSpan(destRow + (intptr_t)destX, src, firstLength, forceMaskBit);
+      if (firstLength < length)
+        copyVramSpan(destRow, src + (intptr_t)firstLength, length - firstLength, forceMaskBit); // wrap around
+    }
+  }
+}
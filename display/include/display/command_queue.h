@@ -0,0 +1,125 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace display {
+  /// @brief GP0 command queue processed by a worker thread (threaded GPU mode)
+  /// @remarks - Command words are copied into a lock-free single-producer/single-consumer ring buffer:
+  ///            the producer (emulator thread) only copies data, the worker thread decodes/renders it.
+  ///          - The worker receives contiguous blocks of words, in submission order: a block may split a command
+  ///            at any word boundary (the consumer must be resumable, such as 'Gp0Parser').
+  ///          - Control words (GP1 commands) can be pushed between command words: they're received by a separate
+  ///            consumer, in submission order with command words (blocks are split at each control word).
+  ///          - Waiting is spin-then-park: a short busy loop (low latency for frequent sync points),
+  ///            then the waiting thread sleeps until the other thread reports progress.
+  ///          - The producer must call 'sync' before accessing any resource used by the consumer
+  ///            (status register, VRAM, parser, draw list...).
+  /// @warning 'push' and 'sync' must always be called from the same thread (single producer).
+  class CommandQueue final {
+  public:
+    /// @brief Command block consumer (called in worker thread)
+    using Consumer = void (*)(void* context, uint32_t* words, int size);
+    /// @brief Control word consumer (called in worker thread)
+    using ControlConsumer = void (*)(void* context, uint32_t value);
+
+    /// @brief Create command queue + start worker thread
+    /// @param capacity  Size of ring buffer (words) -- rounded up to a power of 2
+    /// @throws std::system_error if the thread can't be started
+    CommandQueue(Consumer consumer, ControlConsumer controlConsumer, void* context, size_t capacity = defaultCapacity());
+    /// @brief Create command queue without control words + start worker thread
+    CommandQueue(Consumer consumer, void* context, size_t capacity = defaultCapacity())
+      : CommandQueue(consumer, nullptr, context, capacity) {}
+    /// @brief Process remaining commands + stop worker thread
+    ~CommandQueue() noexcept;
+
+    CommandQueue(const CommandQueue&) = delete;
+    CommandQueue(CommandQueue&&) = delete;
+    CommandQueue& operator=(const CommandQueue&) = delete;
+    CommandQueue& operator=(CommandQueue&&) = delete;
+
+    static constexpr inline size_t defaultCapacity() noexcept { return 0x40000u; } ///< Default ring size: 1 MB of words
+    static constexpr inline size_t controlCapacity() noexcept { return 64u; } ///< Max number of unprocessed control words
+    static constexpr inline unsigned spinCount() noexcept { return 4096u; } ///< Busy loop iterations before parking a thread
+
+    // -- operations --
+
+    /// @brief Copy command words into ring buffer (waits for free space if the ring is full)
+    /// @remarks Blocks larger than capacity are transmitted in several parts.
+    void push(const uint32_t* words, size_t size) noexcept;
+    /// @brief Push control word, processed after all command words pushed before it (waits if too many are pending)
+    /// @warning Requires a control consumer.
+    void pushControl(uint32_t value) noexcept;
+    /// @brief Fence: wait until all pushed words (and control words) have been processed by the worker thread
+    void sync() noexcept;
+
+    // -- accessors --
+
+    inline size_t capacity() const noexcept { return this->_mask + 1u; } ///< Size of ring buffer (words)
+    /// @brief Number of words not yet processed by the worker thread
+    inline size_t pendingSize() const noexcept {
+      return this->_head.load(std::memory_order_acquire) - this->_tail.load(std::memory_order_acquire);
+    }
+    /// @brief Number of control words not yet processed by the worker thread
+    inline size_t pendingControlCount() const noexcept {
+      return this->_controlHead.load(std::memory_order_acquire) - this->_controlTail.load(std::memory_order_acquire);
+    }
+    /// @brief Verify if all pushed words (and control words) were processed
+    inline bool isEmpty() const noexcept { return (pendingSize() == 0 && pendingControlCount() == 0); }
+
+  private:
+    struct ControlEntry final {
+      size_t position; // value of '_head' when pushed (processed once all previous words are processed)
+      uint32_t value;
+    };
+
+    void _runWorker() noexcept;
+    bool _waitForData(size_t tail, size_t controlTail) noexcept;
+    void _waitForProgress(size_t maxPendingSize, size_t maxPendingControls) noexcept;
+    inline bool _isPending(size_t tail, size_t controlTail) const noexcept {
+      return (this->_head.load(std::memory_order_acquire) != tail || this->_controlHead.load(std::memory_order_acquire) != controlTail);
+    }
+
+  private:
+    std::unique_ptr<uint32_t[]> _buffer;
+    size_t _mask = 0;
+    Consumer _consumer = nullptr;
+    ControlConsumer _controlConsumer = nullptr;
+    void* _context = nullptr;
+    std::unique_ptr<ControlEntry[]> _controls;
+
+    // indexes in separate cache lines (avoid false sharing between producer and worker)
+    std::atomic<size_t> _head{ 0 };        // end of pushed words (written by producer)
+    std::atomic<size_t> _controlHead{ 0 }; // end of pushed control words (written by producer)
+    char _headPadding[64 - 2*sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> _tail{ 0 };        // end of processed words (written by worker)
+    std::atomic<size_t> _controlTail{ 0 }; // end of processed control words (written by worker)
+    char _tailPadding[64 - 2*sizeof(std::atomic<size_t>)];
+
+    std::atomic<bool> _isWorkerParked{ false };
+    std::atomic<bool> _isProducerParked{ false };
+    std::atomic<bool> _isStopping{ false };
+    std::mutex _lock;
+    std::condition_variable _dataPushed;
+    std::condition_variable _dataProcessed;
+    std::thread _worker;
+  };
+}
@@ -13,21 +13,102 @@ GNU General Public License for more details (LICENSE file).
 *******************************************************************************/
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+# include <xmmintrin.h>
+# define __prefetchDmaChainNode(address) _mm_prefetch((const char*)(address), _MM_HINT_T0)
+#elif defined(__GNUC__) || defined(__clang__)
+# define __prefetchDmaChainNode(address) __builtin_prefetch((const void*)(address), 0, 3)
+#else
+# define __prefetchDmaChainNode(address)
+#endif
 
 namespace display {
   static constexpr inline unsigned long psxBiosSize() noexcept { return 0x10000u; }      ///< PS1 BIOS size (reserved in RAM)
   static constexpr inline unsigned long psxRamSize() noexcept { return 0x200000u; }      ///< RAM memory of standard PS1
   static constexpr inline unsigned long znArcadeRamSize() noexcept { return 0x800000u; } ///< Maximum RAM memory of ZN-2 arcades
 
+  /// @brief Non-empty data block of a DMA linked list
+  struct DmaChainSpan final {
+    uint32_t* data = nullptr; ///< First word of block (GP0 commands/data)
+    int size = 0;             ///< Number of words (1-255)
+  };
+
+  /// @brief Visited nodes of DMA linked lists (exact loop detection for 'DmaChainIterator')
+  /// @remarks - One bit per 4-byte aligned address of RAM (64 KB for PS1, 256 KB for ZN arcades), allocated once.
+  ///          - Only words modified since the last clear are reset (dirty-word list): cost of clearing is O(visited nodes).
+  ///          - Not thread-safe: one map per thread iterating DMA chains.
+  template <unsigned long _MaxRamSize>
+  class DmaChainVisitMap final {
+  public:
+    /// @brief Allocate empty map
+    /// @throws std::bad_alloc on allocation failure
+    DmaChainVisitMap()
+      : _bits(new uint64_t[wordCount()]()) {
+      this->_dirtyWords.reserve(wordCount()); // never reallocated when visiting nodes
+    }
+    DmaChainVisitMap(const DmaChainVisitMap<_MaxRamSize>&) = delete;
+    DmaChainVisitMap(DmaChainVisitMap<_MaxRamSize>&&) noexcept = default;
+    DmaChainVisitMap& operator=(const DmaChainVisitMap<_MaxRamSize>&) = delete;
+    DmaChainVisitMap& operator=(DmaChainVisitMap<_MaxRamSize>&&) noexcept = default;
+    ~DmaChainVisitMap() noexcept = default;
+
+    /// @brief Number of 64-bit words in bitset (one bit per 4-byte address)
+    static constexpr inline size_t wordCount() noexcept { return (size_t)(_MaxRamSize >> 2) / 64u; }
+
+    /// @brief Mark node address as visited
+    /// @param address  4-byte aligned address, lower than '_MaxRamSize'
+    /// @returns True if the node wasn't visited yet, false if it was already visited (loop)
+    inline bool visit(unsigned long address) noexcept {
+      uint64_t& word = this->_bits[(size_t)(address >> 8)]; // (address / 4) / 64
+      const uint64_t bit = ((uint64_t)1u << ((address >> 2) & 0x3Fu));
+      if (word & bit)
+        return false;
+      if (word == 0)
+        this->_dirtyWords.push_back((uint32_t)(address >> 8));
+      word |= bit;
+      return true;
+    }
+    /// @brief Reset visited nodes (only modified words)
+    inline void clear() noexcept {
+      for (uint32_t wordIndex : this->_dirtyWords)
+        this->_bits[wordIndex] = 0;
+      this->_dirtyWords.clear();
+    }
+
+    inline size_t dirtyWordCount() const noexcept { return this->_dirtyWords.size(); } ///< Number of words modified since last clear
+
+  private:
+    std::unique_ptr<uint64_t[]> _bits;
+    std::vector<uint32_t> _dirtyWords; // indexes of non-zero words
+  };
+
+  // ---
+
   /// @brief Direct-memory-access linked list iterator
-  /// @remarks Iterates through DMA linked list (protected against endless loops)
+  /// @remarks - Iterates through DMA linked list (protected against endless loops)
+  ///          - Default loop protection is heuristic (history of previous indexes + max counter).
+  ///            With a visit map, loop detection is exact: the iteration stops on the first revisited node.
+  ///          - Bulk mode ('readSpans'): collects non-empty blocks of the chain into an array, for a single dispatch loop
+  ///            (ordering tables mostly contain empty nodes: they're skipped without returning to the caller).
   template <unsigned long _MaxRamSize>
   class DmaChainIterator final {
   public:
     DmaChainIterator(unsigned long* baseAddress, unsigned long index) noexcept
       : _baseAddress((uint32_t*)baseAddress),
         _index((baseAddress != nullptr) ? index : endIndexBits()) {}
+    /// @brief Create iterator with exact loop detection
+    /// @param visitMap  Map of visited nodes (cleared on iterator creation) -- must be kept alive during iteration
+    DmaChainIterator(unsigned long* baseAddress, unsigned long index, DmaChainVisitMap<_MaxRamSize>& visitMap) noexcept
+      : _baseAddress((uint32_t*)baseAddress),
+        _index((baseAddress != nullptr) ? index : endIndexBits()),
+        _visitMap(&visitMap) {
+      visitMap.clear();
+    }
 
     DmaChainIterator() = default;
     DmaChainIterator(const DmaChainIterator<_MaxRamSize>&) = default;
@@ -36,6 +117,8 @@ namespace display {
 
     /// @brief Lowest bits of termination block index (false address to indicate end of chain)
     static constexpr inline unsigned long endIndexBits() noexcept { return 0xFFFFFFu; } // xxFFFFFF
+    /// @brief Verify if a block index is the termination symbol (not an address: never read nor prefetched)
+    static constexpr inline bool isEndIndex(unsigned long index) noexcept { return ((index & endIndexBits()) == endIndexBits()); }
     /// @brief Mask to limit addresses below max and with 4-byte alignment (ex: if max RAM size is 0x200000: mask is 0x1FFFFC)
     static constexpr inline unsigned long addressMask() noexcept { return _MaxRamSize - 4u; }
     /// @brief Max number of indexes to iterate = max 4-byte blocks = (max memory / 4) + ending block
@@ -47,18 +130,75 @@ namespace display {
     /// @returns Success (true) or end of chain (false)
     /// @warning Some blocks may have a size of 0: always verify 'if(blockSize>0)' before using memory block.
     inline bool readNext(unsigned long** outMemBlock, int& outBlockSize) noexcept {
-      if ((this->_index & endIndexBits()) == endIndexBits()) // xxFFFFFF == end symbol
+      uint32_t* currentBlock = _readNode();
+      if (currentBlock == nullptr)
         return false;
+
+      *outMemBlock = (unsigned long*)(currentBlock + 1);
+      outBlockSize = static_cast<int>((*currentBlock >> 24) & 0xFF);
+      return true;
+    }
+
+    /// @brief Get address and size of next non-empty data blocks (bulk mode: empty blocks are skipped)
+    /// @param outSpans  Array of spans to fill (at least 'maxSpans' items)
+    /// @returns Number of spans stored in 'outSpans': if lower than 'maxSpans', the end of the chain was reached
+    ///          (otherwise, call again to read next blocks)
+    /// @remarks The data of each span is prefetched: consuming spans right after reading them is recommended.
+    inline size_t readSpans(DmaChainSpan* outSpans, size_t maxSpans) noexcept {
+      size_t count = 0;
+      while (count < maxSpans) {
+        uint32_t* currentBlock = _readNode();
+        if (currentBlock == nullptr)
+          break;
+
+        int blockSize = static_cast<int>((*currentBlock >> 24) & 0xFF);
+        if (blockSize) {
+          __prefetchDmaChainNode(currentBlock + 1);
+          outSpans[count].data = currentBlock + 1;
+          outSpans[count].size = blockSize;
+          ++count;
+        }
+      }
+      return count;
+    }
+
+  private:
+    // Read header of current block + move to next index (or nullptr if end of chain / loop detected)
+    // -> next block header prefetched while the caller processes current block (pointer chasing)
+    inline uint32_t* _readNode() noexcept {
+      if (isEndIndex(this->_index))
+        return nullptr;
       this->_index &= addressMask(); // ignore bits out of range
 
       // prevent endless loops
+      if (this->_visitMap != nullptr) {
+        if (!this->_visitMap->visit(this->_index)) { // exact detection: stop on first revisited node
+          this->_index = endIndexBits();
+          return nullptr;
+        }
+      }
+      else if (!_updateLoopHistory()) {
+        this->_index = endIndexBits();
+        return nullptr;
+      }
+
+      // read current block header + move to next index (for next call)
+      uint32_t* currentBlock = &_baseAddress[this->_index >> 2];
+      this->_index = *currentBlock;
+      if (!isEndIndex(this->_index)) // end symbol masked as an address would point at the end of RAM: not prefetched
+        __prefetchDmaChainNode(&_baseAddress[(this->_index & addressMask()) >> 2]);
+      return currentBlock;
+    }
+
+    // Heuristic loop detection: verify if current index was recently visited + store it
+    // returns: false if a loop is detected (or max counter reached)
+    inline bool _updateLoopHistory() noexcept {
       if (++(this->_counter) > maxCounter()
       ||  this->_index == this->_prevIndexes.slow
       ||  this->_index == this->_prevIndexes.lower
-      ||  this->_index == this->_prevIndexes.greater) {
-        this->_index = endIndexBits();
+      ||  this->_index == this->_prevIndexes.greater)
         return false;
-      }
+
       // previous addresses, to detect loops (great for small loops and ordered chains) // inspired by Peops sources
       if (this->_index < this->_prevIndexes.latest)
         this->_prevIndexes.lower = this->_index;
@@ -73,13 +213,6 @@ namespace display {
         else
           this->_prevIndexes.slow = this->_index;
       }
-
-      // read current value + size
-      uint32_t* currentBlock = &_baseAddress[this->_index >> 2];
-      *outMemBlock = (unsigned long*)(currentBlock + 1);
-      outBlockSize = static_cast<int>((*currentBlock >> 24) & 0xFF);
-
-      this->_index = *currentBlock; // move to next index (for next call)
       return true;
     }
 
@@ -94,5 +227,6 @@ namespace display {
     uint32_t* _baseAddress = nullptr;
     unsigned long _index = endIndexBits();
     uint32_t _counter = 0;
+    DmaChainVisitMap<_MaxRamSize>* _visitMap = nullptr; // exact loop detection (if not null)
   };
 }
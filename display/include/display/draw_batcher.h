@@ -0,0 +1,122 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "display/rasterizer.h"
+#include "display/draw_list.h"
+
+namespace display {
+  /// @brief Geometry type of draw call
+  enum class DrawTopology : uint32_t {
+    triangleList = 0,      ///< Indexed triangles (triangles + quads split in two triangles)
+    lineList = 1,          ///< Vertex range: 2 vertices per line
+    rectangleInstances = 2 ///< Vertex range: 1 vertex (+ size) per rectangle instance
+  };
+
+  /// @brief Primitive ordering of draw calls
+  enum class DrawOrder : uint32_t {
+    submission = 0, ///< Strict submission order (no depth test needed)
+    stateSorted = 1 ///< Opaque primitives first, grouped by render state + order-dependent primitives in submission order
+                    ///  (all batches must be depth-tested with primitive depth: 'greater' test + depth write)
+  };
+
+  /// @brief Draw call: consecutive primitives sharing the same render state
+  struct DrawBatch final {
+    DrawTopology topology = DrawTopology::triangleList;
+    uint32_t stateIndex = 0;     ///< Render state (draw list state of first primitive)
+    uint32_t firstPrimitive = 0; ///< Index of first primitive in draw order ('DrawBatcher::order')
+    uint32_t primitiveCount = 0; ///< Number of primitives
+    uint32_t first = 0;          ///< Indexed: first index in index buffer / others: first vertex in vertex streams
+    uint32_t count = 0;          ///< Indexed: number of indices / others: number of vertices
+    bool isIndexed = false;      ///< Index buffer range (triangles, or any topology in state-sorted order:
+                                 ///  lines: 2 indices per line, rectangles: 1 index (first vertex) per instance)
+    bool isReordered = false;    ///< Opaque primitives drawn before order-dependent ones (state-sorted order)
+  };
+
+  /// @brief Batching statistics (since last reset)
+  struct DrawBatchStats final {
+    uint64_t frameCount = 0;              ///< Number of batched frames (draw lists)
+    uint64_t batchCount = 0;              ///< Total number of draw calls
+    uint64_t primitiveCount = 0;          ///< Total number of batched primitives
+    uint64_t reorderedPrimitiveCount = 0; ///< Total number of opaque primitives reordered by render state
+    uint32_t lastFrameBatchCount = 0;     ///< Draw calls of last frame
+    uint32_t lastFramePrimitiveCount = 0; ///< Primitives of last frame
+
+    inline double batchesPerFrame() const noexcept { return frameCount ? (double)batchCount / (double)frameCount : 0.0; }
+    inline double primitivesPerBatch() const noexcept { return batchCount ? (double)primitiveCount / (double)batchCount : 0.0; }
+  };
+
+  // ---
+
+  /// @brief Draw call batching of decoded primitives (hardware renderer)
+  /// @remarks - Consecutive primitives are merged into a single draw call until the render state really changes:
+  ///            texture page, CLUT, blending mode, mask settings, draw area, texture window, or geometry type.
+  ///          - Unused attributes are ignored (no texture: texture page/CLUT/window, direct colors: CLUT,
+  ///            opaque: blending mode, flat/gouraud shading handled by vertex colors).
+  ///          - Submission order: order is preserved (required by semi-transparency and mask bits).
+  ///          - State-sorted order: opaque primitives (no blending, no mask test/write) are grouped by render state and
+  ///            drawn first, then order-dependent primitives are drawn in submission order. All batches are depth-tested
+  ///            with the painter's order depth of primitives: the result is identical to submission order, with far
+  ///            fewer state changes in texture-heavy scenes.
+  ///          - Draw list barriers (VRAM writes between primitives) split the frame into segments: primitives are only
+  ///            batched/sorted within a segment, and segments are drawn in submission order.
+  class DrawBatcher final {
+  public:
+    DrawBatcher() = default;
+    DrawBatcher(const DrawBatcher&) = default;
+    DrawBatcher(DrawBatcher&&) noexcept = default;
+    DrawBatcher& operator=(const DrawBatcher&) = default;
+    DrawBatcher& operator=(DrawBatcher&&) noexcept = default;
+    ~DrawBatcher() noexcept = default;
+
+    /// @brief Build draw calls for all primitives of a draw list (one frame) + update statistics
+    /// @throws std::bad_alloc on allocation failure
+    void build(const DrawList& drawList, DrawOrder order = DrawOrder::submission);
+
+    /// @brief Verify if two render states can be drawn with the same draw call
+    static bool isSameRenderState(const RasterState& lhs, const RasterState& rhs) noexcept;
+
+    // -- accessors --
+
+    inline const std::vector<DrawBatch>& batches() const noexcept { return this->_batches; } ///< Draw calls of last frame
+    inline const std::vector<uint32_t>& indices() const noexcept { return this->_indices; } ///< Index buffer of last frame
+    inline const std::vector<uint32_t>& order() const noexcept { return this->_order; }     ///< Draw order of primitives (draw list indices)
+    /// @brief Index of first batch drawn after each barrier of the draw list (barrier must be applied before this batch)
+    inline const std::vector<uint32_t>& barrierBatches() const noexcept { return this->_barrierBatches; }
+
+    inline const DrawBatchStats& stats() const noexcept { return this->_stats; } ///< Batching statistics
+    inline void resetStats() noexcept { this->_stats = DrawBatchStats{}; }
+
+  private:
+    void _findStateGroups(const DrawList& drawList);
+    uint32_t _sortOpaquePrimitives(const DrawList& drawList, uint32_t begin, uint32_t end);
+    void _appendBatches(const DrawList& drawList, uint32_t orderBegin, uint32_t orderEnd, bool isIndexed, bool isReordered);
+
+  private:
+    std::vector<DrawBatch> _batches;
+    std::vector<uint32_t> _indices;
+    std::vector<uint32_t> _order;
+    std::vector<uint32_t> _barrierBatches;
+    std::vector<uint32_t> _stateGroups; // render state group of each draw list state (sorting)
+    std::vector<uint32_t> _groupStates; // first draw list state of each render state group (sorting)
+    std::vector<uint32_t> _nextGroups;  // next render state group with the same hash (sorting: hash collisions)
+    std::unordered_map<uint64_t, uint32_t> _groupIndex; // render state hash -> first group with this hash (sorting)
+    std::vector<uint32_t> _keyOffsets;  // counting sort offsets per group/topology (sorting)
+    DrawBatchStats _stats;
+  };
+}
@@ -0,0 +1,195 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "display/types.h"
+#include "display/vram.h"
+#include "display/rasterizer.h"
+
+namespace display {
+  /// @brief Type of decoded primitive
+  enum class DrawPrimitiveType : uint32_t {
+    triangle = 0, ///< 3 vertices
+    quad = 1,     ///< 4 vertices: (v0,v1,v2) + (v1,v2,v3)
+    line = 2,     ///< 2 vertices (poly-lines: one primitive per segment)
+    rectangle = 3 ///< 1 vertex (top-left corner) + size
+  };
+
+  /// @brief Decoded primitive (vertices stored in vertex streams of draw list)
+  struct DrawPrimitive final {
+    uint32_t firstVertex = 0;  ///< Index of first vertex in vertex streams
+    uint32_t stateIndex = 0;   ///< Index of draw state (rendering attributes)
+    uint32_t depth = 0;        ///< Painter's order depth: 1 to N in submission order (later primitives: greater depth)
+    DrawPrimitiveType type = DrawPrimitiveType::triangle;
+    uint16_t width = 0;        ///< Rectangle width (other types: 0)
+    uint16_t height = 0;       ///< Rectangle height (other types: 0)
+  };
+
+  /// @brief Type of draw list barrier
+  enum class DrawBarrierType : uint32_t {
+    vramWrite = 0, ///< VRAM area modified outside of primitives (fill, copy, CPU->VRAM transfer)
+    clear = 1      ///< Render target area cleared with a color (fill covering entire display/draw area)
+  };
+
+  /// @brief Barrier between primitives: VRAM modification that must be applied in submission order
+  /// @remarks Primitives are never reordered/batched across a barrier (textures or pixels may differ on each side).
+  struct DrawBarrier final {
+    uint32_t primitiveIndex = 0; ///< Index of first primitive added after the barrier (== number of primitives before it)
+    DrawBarrierType type = DrawBarrierType::vramWrite;
+    Rectangle area;              ///< Modified VRAM area (inclusive boundaries -- may exceed VRAM size: wraps around)
+    uint32_t color = 0;          ///< Clear color (24-bit GP0 format -- only for 'clear' barriers)
+  };
+
+  /// @brief Culling statistics (since last reset)
+  struct DrawCullStats final {
+    uint64_t primitiveCount = 0;  ///< Total number of tested primitives
+    uint64_t degenerateCount = 0; ///< Primitives culled for zero area (collinear/merged vertices, empty rectangles)
+    uint64_t outsideCount = 0;    ///< Primitives culled for being entirely outside of draw area
+    uint64_t oversizedCount = 0;  ///< Polygons/lines culled for exceeding max size (1023x511: ignored by hardware)
+
+    inline uint64_t culledCount() const noexcept { return degenerateCount + outsideCount + oversizedCount; }
+  };
+
+  // ---
+
+  /// @brief Per-frame list of decoded primitives, with structure-of-arrays vertex streams (x, y, color, u, v)
+  /// @remarks - Draw states (rendering attributes, texture page, CLUT, command options) are stored once per change:
+  ///            consecutive primitives with identical attributes share the same state index.
+  ///          - Vertex coords are stored as raw GP0 words when primitives are added, then decoded by batches
+  ///            (11-bit sign extension + draw offset, with SIMD) when the draw offset changes or before reading streams.
+  ///          - Vertex streams are only valid after 'decodeVertices' (or any consumer calling it).
+  ///          - Each primitive receives a monotonically increasing depth when added (painter's order): opaque primitives
+  ///            can be reordered by render state if depth-tested, as long as order-dependent ones keep submission order.
+  ///          - Horizontal runs of grid tiles (tilemaps) can be merged into a single rectangle ('mergeRectangle').
+  ///          - VRAM writes between primitives (fill/copy/transfer) are recorded as barriers ('addBarrier'):
+  ///            consumers may only reorder/merge primitives within segments between barriers.
+  class DrawList final {
+  public:
+    DrawList() = default;
+    DrawList(const DrawList&) = default;
+    DrawList(DrawList&&) noexcept = default;
+    DrawList& operator=(const DrawList&) = default;
+    DrawList& operator=(DrawList&&) noexcept = default;
+    ~DrawList() noexcept = default;
+
+    // -- operations --
+
+    /// @brief Add primitive and reserve its vertices (to fill with 'setVertex')
+    /// @param drawOffset  Draw offset applied to vertices of primitive
+    /// @returns Index of first vertex of primitive
+    uint32_t addPrimitive(DrawPrimitiveType type, const RasterState& state, uint32_t vertexCount,
+                          const Point& drawOffset, uint16_t width = 0, uint16_t height = 0);
+    /// @brief Set vertex reserved by 'addPrimitive'
+    /// @param coords  Raw GP0 vertex param (X: bits 0-10 / Y: bits 16-26, signed)
+    inline void setVertex(uint32_t index, uint32_t coords, uint32_t color, uint32_t u = 0, uint32_t v = 0) noexcept {
+      this->_coords[index] = coords;
+      this->_colors[index] = color & 0xFFFFFFu;
+      this->_u[index] = (uint8_t)u;
+      this->_v[index] = (uint8_t)v;
+    }
+
+    /// @brief Add barrier after current primitives (VRAM modified outside of primitives)
+    /// @param area   Modified VRAM area (inclusive boundaries)
+    /// @param color  Clear color (24-bit GP0 format -- only for 'clear' barriers)
+    void addBarrier(DrawBarrierType type, const Rectangle& area, uint32_t color = 0);
+
+    /// @brief Merge rectangle with last primitive if they form a horizontal run (tilemaps):
+    ///        same draw state/color/height/row, adjacent positions, contiguous texture coords (if textured, not flipped)
+    /// @param coords  Raw GP0 vertex param of top-left corner
+    /// @returns True if last primitive was extended (nothing to add), false if the rectangle must be added normally
+    bool mergeRectangle(const RasterState& state, const Point& drawOffset, uint32_t coords, uint32_t color,
+                        uint32_t u, uint32_t v, uint16_t width, uint16_t height) noexcept;
+
+    /// @brief Decode pending vertex coords (sign extension + draw offset)
+    void decodeVertices() noexcept;
+    /// @brief Remove all primitives (start of new frame) -- allocated memory is kept
+    void clear() noexcept;
+    /// @brief Remove primitives that can't produce any pixel (degenerate, outside of draw area, over max size)
+    ///        + update culling statistics (vertices are decoded if needed)
+    /// @remarks - Bounding boxes/areas are computed for 8 primitives at once (SIMD).
+    ///          - Submission order (and depth) of remaining primitives is preserved, barrier positions are updated.
+    ///          - Quads are only culled if both of their triangles are degenerate/oversized (same as rasterizer).
+    void cullPrimitives() noexcept;
+
+    /// @brief Rasterize primitives in range [first; end[ with software rasterizer (immediate rendering)
+    template <unsigned long _Height>
+    void rasterize(Vram<_Height>& vram, size_t first, size_t end) noexcept;
+
+    /// @brief Verify if the result of a primitive depends on primitives drawn before it (blending / mask bit test or write)
+    /// @remarks Order-dependent primitives must keep submission order, others may be reordered with a depth test.
+    static inline bool isOrderDependent(const RasterState& state) noexcept {
+      return (state.isSemiTransparent || state.checkMask || state.forceMaskBit);
+    }
+    /// @brief Convert primitive depth to normalized depth value ]0;1[ (for 'greater' depth test)
+    static inline float toNormalizedDepth(uint32_t depth, size_t primitiveCount) noexcept {
+      return (float)depth / (float)(primitiveCount + 1u);
+    }
+
+    /// @brief Decode vertex coords: 11-bit sign extension + draw offset (vectorized: 4-8 vertices per iteration)
+    static void decodeVertexCoords(const uint32_t* coords, size_t count, const Point& drawOffset,
+                                   int32_t* outX, int32_t* outY) noexcept;
+
+    // -- accessors --
+
+    inline bool empty() const noexcept { return this->_primitives.empty(); }       ///< Verify if list is empty
+    inline size_t size() const noexcept { return this->_primitives.size(); }       ///< Number of primitives
+    inline size_t vertexCount() const noexcept { return this->_coords.size(); }    ///< Number of vertices
+    inline size_t stateCount() const noexcept { return this->_states.size(); }     ///< Number of distinct consecutive states
+    inline size_t barrierCount() const noexcept { return this->_barriers.size(); } ///< Number of barriers
+    inline bool isDecoded() const noexcept { return (this->_decodedCount == this->_coords.size()); } ///< Vertex streams up-to-date
+
+    inline size_t mergedTileCount() const noexcept { return this->_mergedTileCount; } ///< Rectangles merged into runs (current frame)
+
+    inline const DrawCullStats& cullStats() const noexcept { return this->_cullStats; } ///< Culling statistics
+    inline void resetCullStats() noexcept { this->_cullStats = DrawCullStats{}; }
+
+    inline const DrawPrimitive& primitive(size_t index) const noexcept { return this->_primitives[index]; }
+    inline const DrawPrimitive* primitives() const noexcept { return this->_primitives.data(); }
+    inline const RasterState& state(size_t index) const noexcept { return this->_states[index]; }
+    inline const DrawBarrier& barrier(size_t index) const noexcept { return this->_barriers[index]; }
+
+    inline const int32_t* x() const noexcept { return this->_x.data(); }        ///< Decoded X coords (absolute VRAM coords)
+    inline const int32_t* y() const noexcept { return this->_y.data(); }        ///< Decoded Y coords (absolute VRAM coords)
+    inline const uint32_t* colors() const noexcept { return this->_colors.data(); } ///< 24-bit vertex colors
+    inline const uint8_t* u() const noexcept { return this->_u.data(); }        ///< Texture coords X
+    inline const uint8_t* v() const noexcept { return this->_v.data(); }        ///< Texture coords Y
+
+    /// @brief Read decoded vertex (software rasterizer format)
+    inline void readVertex(uint32_t index, RasterVertex& outVertex) const noexcept {
+      outVertex.x = (long)this->_x[index];
+      outVertex.y = (long)this->_y[index];
+      outVertex.color = this->_colors[index];
+      outVertex.u = (uint32_t)this->_u[index];
+      outVertex.v = (uint32_t)this->_v[index];
+    }
+
+  private:
+    std::vector<DrawPrimitive> _primitives;
+    std::vector<RasterState> _states;
+    std::vector<DrawBarrier> _barriers;
+    std::vector<uint32_t> _coords; // raw GP0 vertex params
+    std::vector<int32_t> _x;
+    std::vector<int32_t> _y;
+    std::vector<uint32_t> _colors;
+    std::vector<uint8_t> _u;
+    std::vector<uint8_t> _v;
+    size_t _decodedCount = 0; // number of vertices with decoded coords
+    size_t _mergedTileCount = 0;
+    Point _drawOffset;        // draw offset of pending vertices
+    DrawCullStats _cullStats;
+  };
+}
@@ -0,0 +1,44 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "display/types.h"
+
+namespace display {
+  /// @brief Settings of pixel write stage (semi-transparency + mask bits)
+  struct PixelWriteMode final {
+    BlendingMode blendingMode = BlendingMode::mean; ///< Semi-transparency mode
+    uint16_t forceMaskBit = 0;      ///< Mask bit to set on each pixel (0 or vramMaskBit())
+    bool isSemiTransparent = false; ///< Blend pixels with destination
+    bool isStpGated = false;        ///< Only blend pixels with STP bit set (textured primitives)
+    bool checkMask = false;         ///< Don't overwrite pixels with mask bit
+  };
+
+  /// @brief Pixel write stage of software rendering (last stage of each rasterized pixel)
+  /// @remarks - Semi-transparency: 15-bit blending with saturation (mean/add/subtract/add-quarter).
+  ///          - Branchless vector implementation (8 or 16 pixels per iteration), specialized for each mode
+  ///            (the rasterizer selects a specialized stage once per primitive).
+  class PixelWriter final {
+  public:
+    PixelWriter() = delete;
+
+    /// @brief Write span of shaded pixels into a VRAM row (or upscaled target row)
+    /// @param colors     Shaded 15-bit colors + STP bit (textured: texel STP bit, others: 0) -> STP bit copied in destination
+    /// @param writeMask  Pixels to write (0xFFFF) or to skip (0: transparent texels) -- nullptr to write all pixels
+    static void writeSpan(uint16_t* dest, const uint16_t* colors, const uint16_t* writeMask,
+                          size_t length, const PixelWriteMode& mode) noexcept;
+  };
+}
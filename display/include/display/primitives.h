@@ -14,26 +14,122 @@ GNU General Public License for more details (LICENSE file).
 #pragma once
 
 #include <cstdint>
+#include <memory>
+#include "display/rasterizer.h"
+#include "display/draw_list.h"
+#include "display/texture_cache.h"
+#include "display/vram_transfer.h"
 
 namespace display {
   class StatusRegister;
   class Renderer;
+  template <unsigned long _Height> class Vram;
+  class TiledRasterizer;
 
-  class Primitives final {
+  static constexpr inline int maxGp0CommandLength() noexcept { return 12; } ///< Max length of fixed-size GP0 commands (words)
+
+  /// @brief Poly-line being received (variable length, until termination code): segments drawn when each vertex arrives
+  struct PolyLineStream final {
+    RasterState state;          ///< Rendering attributes (read with first segment)
+    RasterVertex lastVertex;    ///< End point of previous segment
+    uint32_t lastCoords = 0;    ///< Raw GP0 coords of previous end point (draw list recording)
+    uint32_t nextColor = 0;     ///< Shaded: color of next vertex (already received)
+    bool hasNextColor = false;  ///< Shaded: next param is a vertex (color already received)
+    bool isShaded = false;      ///< Gouraud-shaded poly-line (color before each vertex)
+    bool isSkipped = false;     ///< Frame skipping: params consumed without drawing
+    bool isActive = false;      ///< Poly-line in progress (next params are vertices)
+  };
+
+  /// @brief GP0 command statistics (since last reset)
+  struct Gp0ParserStats final {
+    uint64_t attributeCount = 0;          ///< Rendering attribute commands received (GP0(0xE1-0xE6))
+    uint64_t redundantAttributeCount = 0; ///< Attribute commands eliminated (same state as current one)
+    uint64_t texturedQuadCount = 0;       ///< Flat textured quads received (GP0(0x2C-0x2F))
+    uint64_t spriteQuadCount = 0;         ///< Textured quads drawn as sprites (axis-aligned, 1:1 texture mapping)
+  };
+
+  /// @brief Resumable GP0 command stream parser (data blocks may split commands at any word boundary)
+  /// @remarks - Complete commands are decoded directly from the caller's data block:
+  ///            only the words of a command split between two blocks are copied (max 'maxGp0CommandLength()').
+  ///          - Each parser owns its state (partial command, poly-line, CPU->VRAM transfer) and its rendering resources
+  ///            (decoded textures, tile-binned rasterizer)
+  ///            -> several command streams can be decoded in the same process (one parser per stream).
+  class Gp0Parser final {
   public:
-    Primitives() = delete;
+    Gp0Parser();
+    Gp0Parser(const Gp0Parser&) = delete;
+    Gp0Parser(Gp0Parser&&) = delete; // tiled rasterizer bound to texture cache
+    Gp0Parser& operator=(const Gp0Parser&) = delete;
+    Gp0Parser& operator=(Gp0Parser&&) = delete;
+    ~Gp0Parser() noexcept;
+
+    /// @brief Clear pending command data (partial command, poly-line, CPU->VRAM transfer)
+    void clear() noexcept;
+
+    /// @brief Run GP0 rendering command (drawing & rendering attributes), or resume partial command
+    /// @param isFrameSkipped  Ignore drawing commands (rendering attributes and transfers are still processed)
+    /// @returns Size used by current command (== size if the command is incomplete: resumed with next data block)
+    template <unsigned long _VramHeight>
+    int runCommand(StatusRegister& status, Renderer& renderer, Vram<_VramHeight>& vram,
+                   uint32_t* mem, int size, bool isFrameSkipped) noexcept;
+    /// @brief Run all GP0 commands and image data of a data block (DMA block) in a single dispatch loop
+    /// @remarks Equivalent to calling 'runCommand'/'writeVramData' until the block is consumed, but complete fixed-size
+    ///          commands are dispatched without per-command stream state checks. Incomplete commands are stored.
+    template <unsigned long _VramHeight>
+    void runBuffer(StatusRegister& status, Renderer& renderer, Vram<_VramHeight>& vram,
+                   uint32_t* mem, int size, bool isFrameSkipped) noexcept;
+
+    /// @brief Copy image data of pending CPU -> VRAM transfer (GP0(0xA0)) into VRAM
+    /// @remarks If no transfer is pending (or when the transfer is complete), data write mode is reset to 'command'.
+    /// @returns Size used by current transfer (0 if no transfer pending)
+    template <unsigned long _VramHeight>
+    int writeVramData(StatusRegister& status, Vram<_VramHeight>& vram, const uint32_t* mem, int size) noexcept;
+
+    // -- command state --
+
+    /// @brief Verify if a command is incomplete (waiting for next data block)
+    inline bool isCommandPending() const noexcept { return (this->_pendingLength != 0 || this->_polyLine.isActive); }
+
+    inline VramTransfer& vramTransfer() noexcept { return this->_vramTransfer; } ///< CPU -> VRAM transfer (started by GP0(0xA0))
+    inline const VramTransfer& vramTransfer() const noexcept { return this->_vramTransfer; }
+    /// @brief Record decoded primitives into a draw list (in addition to immediate rendering) -- nullptr to disable
+    /// @remarks The list isn't cleared by the parser: the owner consumes/clears it once per frame.
+    inline void setDrawList(DrawList* drawList) noexcept { this->_drawList = drawList; }
+    inline DrawList* drawList() const noexcept { return this->_drawList; } ///< Draw list receiving decoded primitives (or nullptr)
+
+    inline Gp0ParserStats& stats() noexcept { return this->_stats; } ///< Command statistics
+    inline const Gp0ParserStats& stats() const noexcept { return this->_stats; }
+    inline void resetStats() noexcept { this->_stats = Gp0ParserStats{}; }
 
-    /// @brief Clear pending command data buffer
-    static void clearCommandBuffer() noexcept;
+    inline PolyLineStream& polyLine() noexcept { return this->_polyLine; } ///< Poly-line in progress (started by GP0(0x48/0x58))
+    inline const PolyLineStream& polyLine() const noexcept { return this->_polyLine; }
 
-    /// @brief Run GP0 rendering command (drawing & rendering attributes)
-    /// @returns Size used by current command
-    static int runGp0Command(StatusRegister& status, Renderer& renderer,
-                             uint32_t* mem, int size, bool isFrameSkipped) noexcept;
+    // -- rendering resources --
 
+    /// @brief Enable tile-binned multi-threaded rasterization of polygons (replaces any existing backend)
+    /// @param workerCount  Number of worker threads (in addition to emulator thread)
+    /// @remarks Polygons are then drawn in batches: 'flushPrimitives' must be called before reading/displaying VRAM content.
+    /// @throws std::system_error if threads can't be created
+    void enableTiledRasterizer(unsigned workerCount);
+    /// @brief Disable tile-binned rasterization (pending primitives are dropped: flush them first)
+    void disableTiledRasterizer() noexcept;
+    /// @brief Rasterize pending polygons into the VRAM used to draw them (no effect if the tile-binned rasterizer isn't enabled)
+    void flushPrimitives() noexcept;
+    inline TiledRasterizer* tiledRasterizer() noexcept { return this->_tiledRasterizer.get(); } ///< Tile-binned rasterizer (or nullptr)
 
+    /// @brief Cache of decoded texture pages used by textured primitives (statistics, memory usage)
+    /// @remarks Must be cleared when VRAM is reallocated.
+    inline TextureCache& textureCache() noexcept { return this->_textureCache; }
+    inline const TextureCache& textureCache() const noexcept { return this->_textureCache; }
 
-    static unsigned long imgWidth__TMP;//TODO: replace with VRAM reader/writer
-    static unsigned long imgHeight__TMP;
+  private:
+    uint32_t _pendingParams[maxGp0CommandLength()]; // words of partial command (received in previous data blocks)
+    int _pendingLength = 0;
+    PolyLineStream _polyLine;
+    VramTransfer _vramTransfer;
+    DrawList* _drawList = nullptr;
+    Gp0ParserStats _stats;
+    TextureCache _textureCache;
+    std::unique_ptr<TiledRasterizer> _tiledRasterizer;
   };
 }
@@ -0,0 +1,218 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "display/types.h"
+#include "display/vram.h"
+
+namespace display {
+  static constexpr inline long maxPolygonWidth() noexcept { return 1023; }  ///< Max horizontal distance between vertices of a polygon
+  static constexpr inline long maxPolygonHeight() noexcept { return 511; }  ///< Max vertical distance between vertices of a polygon
+  static constexpr inline long rasterBlockSize() noexcept { return 8; }     ///< Size of pixel blocks used for coverage tests (8x8)
+  static constexpr inline long maxRasterScale() noexcept { return 8; }      ///< Max internal resolution factor of raster targets
+
+  /// @brief Vertex of rasterized primitive
+  struct RasterVertex final {
+    long x = 0;          ///< Absolute X coord in VRAM (draw offset included)
+    long y = 0;          ///< Absolute Y coord in VRAM (draw offset included)
+    uint32_t color = 0;  ///< 24-bit color (red: bits 0-7, green: bits 8-15, blue: bits 16-23)
+    uint32_t u = 0;      ///< Texture coord X (0-255)
+    uint32_t v = 0;      ///< Texture coord Y (0-255)
+  };
+
+  /// @brief Draw state of rasterized primitive (rendering attributes + command options)
+  struct RasterState final {
+    Rectangle clipArea;         ///< Visible area (draw area: inclusive boundaries)
+    TextureWindow textureWindow;///< Texture window (repeated texture area)
+    long texpageX = 0;          ///< Texture page base X (texels)
+    long texpageY = 0;          ///< Texture page base Y (lines)
+    long clutX = 0;             ///< Color lookup table X (texels)
+    long clutY = 0;             ///< Color lookup table Y (lines)
+    TextureColorMode colorMode = TextureColorMode::lookupTable4bit; ///< Texture color mode
+    BlendingMode blendingMode = BlendingMode::mean;                 ///< Semi-transparency mode
+    uint16_t forceMaskBit = 0;      ///< Mask bit to set on each pixel (0 or vramMaskBit())
+    bool checkMask = false;         ///< Don't overwrite pixels with mask bit
+    bool isTextured = false;        ///< Textured primitive
+    bool isRawTexture = false;      ///< Texture colors not modulated by vertex colors
+    bool isShaded = false;          ///< Gouraud shading (interpolated vertex colors)
+    bool isSemiTransparent = false; ///< Semi-transparency (textured: only for texels with STP bit)
+    bool isDithered = false;        ///< 24-bit -> 15-bit dithering (only for shaded/modulated pixels)
+    bool isTextureFlipX = false;    ///< Rectangles only: texture coords decremented horizontally (flipped sprites)
+    bool isTextureFlipY = false;    ///< Rectangles only: texture coords decremented vertically (flipped sprites)
+    const uint16_t* decodedTexture = nullptr; ///< Optional decoded texture page (256x256, see TextureCache) -> replaces VRAM/CLUT reads
+  };
+
+  /// @brief Destination of rasterized pixels: VRAM (native resolution) or upscaled framebuffer
+  /// @remarks Upscaled targets use coords multiplied by internal resolution factors (textures are still read in VRAM).
+  struct RasterTarget final {
+    uint16_t* pixels = nullptr; ///< First pixel of target
+    size_t rowLength = 0;       ///< Number of pixels per line (stride)
+    long width = 0;             ///< Target width (VRAM width * scaleX)
+    long height = 0;            ///< Target height (VRAM height * scaleY)
+    long scaleX = 1;            ///< Internal resolution factor X (1 - maxRasterScale)
+    long scaleY = 1;            ///< Internal resolution factor Y (1 - maxRasterScale)
+  };
+
+  // ---
+
+  /// @brief Software rasterizer (reference implementation of PS1 polygon rules)
+  /// @remarks - Pixels are sampled at integer coords, with top-left fill convention (right/bottom edges excluded).
+  ///          - Coverage: fixed-point half-space edge functions, evaluated by 8x8 blocks
+  ///            (trivial reject/accept per block, SIMD lanes for partial blocks).
+  ///          - Attributes (colors, texture coords) are evaluated with fixed-point plane equations
+  ///            -> results don't depend on traversal order or clip area (bit-identical with any tiling).
+  ///          - Polygons exceeding max size (1023x511) are ignored (same as hardware).
+  ///          - Rectangles (tiles, sprites): dedicated blitter without edge functions nor attribute planes,
+  ///            specialized for each combination of write options.
+  ///          - Lines: fixed-point stepping along major axis (both end points drawn), with horizontal runs of shallow lines
+  ///            sent to the pixel write stage as spans.
+  class Rasterizer final {
+  public:
+    Rasterizer() = delete;
+
+    /// @brief Draw triangle in VRAM (+ report modified area)
+    template <unsigned long _Height>
+    static void drawTriangle(Vram<_Height>& vram, const RasterState& state,
+                             const RasterVertex& v0, const RasterVertex& v1, const RasterVertex& v2) noexcept {
+      Rectangle drawnArea;
+      if (rasterizeTriangle(vram, nativeTarget(vram), state, v0, v1, v2, fullTargetArea(nativeTarget(vram)), drawnArea)) {
+        vram.markDirty((unsigned long)drawnArea.leftX, (unsigned long)drawnArea.topY,
+                       (unsigned long)(drawnArea.rightX - drawnArea.leftX + 1), (unsigned long)(drawnArea.bottomY - drawnArea.topY + 1));
+      }
+    }
+    /// @brief Draw quad in VRAM, as two triangles: (v0,v1,v2) + (v1,v2,v3) -> same as hardware
+    template <unsigned long _Height>
+    static void drawQuad(Vram<_Height>& vram, const RasterState& state, const RasterVertex* vertices) noexcept {
+      drawTriangle(vram, state, vertices[0], vertices[1], vertices[2]);
+      drawTriangle(vram, state, vertices[1], vertices[2], vertices[3]);
+    }
+
+    /// @brief Draw axis-aligned rectangle in VRAM, with flat color and 1:1 texture mapping (+ report modified area)
+    template <unsigned long _Height>
+    static void drawRectangle(Vram<_Height>& vram, const RasterState& state, const RasterVertex& topLeft,
+                              long width, long height) noexcept {
+      Rectangle drawnArea;
+      if (rasterizeRectangle(vram, nativeTarget(vram), state, topLeft, width, height, fullTargetArea(nativeTarget(vram)), drawnArea)) {
+        vram.markDirty((unsigned long)drawnArea.leftX, (unsigned long)drawnArea.topY,
+                       (unsigned long)(drawnArea.rightX - drawnArea.leftX + 1), (unsigned long)(drawnArea.bottomY - drawnArea.topY + 1));
+      }
+    }
+
+    /// @brief Draw line in VRAM (+ report modified area)
+    template <unsigned long _Height>
+    static void drawLine(Vram<_Height>& vram, const RasterState& state, const RasterVertex& v0, const RasterVertex& v1) noexcept {
+      Rectangle drawnArea;
+      if (rasterizeLine(nativeTarget(vram), state, v0, v1, fullTargetArea(nativeTarget(vram)), drawnArea)) {
+        vram.markDirty((unsigned long)drawnArea.leftX, (unsigned long)drawnArea.topY,
+                       (unsigned long)(drawnArea.rightX - drawnArea.leftX + 1), (unsigned long)(drawnArea.bottomY - drawnArea.topY + 1));
+      }
+    }
+
+    /// @brief Rasterize triangle into any target, without modification tracking
+    /// @param textures    VRAM containing texture pages and color lookup tables
+    /// @param targetArea  Additional clipping area in target coords (ex: tile), inclusive boundaries
+    /// @param outArea     Bounding box of drawn area in target coords (only set if the function returns true)
+    /// @returns True if pixels may have been drawn
+    /// @remarks Thread-safe if target areas don't overlap and if textures aren't modified during the call.
+    ///          Results don't depend on 'targetArea' (splitting a triangle in several areas gives the same pixels).
+    template <unsigned long _Height>
+    static bool rasterizeTriangle(const Vram<_Height>& textures, const RasterTarget& target, const RasterState& state,
+                                  const RasterVertex& v0, const RasterVertex& v1, const RasterVertex& v2,
+                                  const Rectangle& targetArea, Rectangle& outArea) noexcept;
+    /// @brief Rasterize axis-aligned rectangle into any target, without modification tracking (sprites, tiles)
+    /// @param topLeft     Top-left corner (native coords), with flat color and texture coords of first texel
+    /// @param targetArea  Additional clipping area in target coords, inclusive boundaries
+    /// @param outArea     Bounding box of drawn area in target coords (only set if the function returns true)
+    /// @returns True if pixels may have been drawn
+    /// @remarks - Same pixels as a quad with identical corners and 1:1 texture mapping, without coverage tests
+    ///            (area clipped once, then blitted row by row). Shading is ignored.
+    ///          - Texture coords wrap around (8-bit), and are decremented instead of incremented if flipped.
+    ///          - Rows of direct-color/decoded textures (native resolution, no texture window) are copied with vector loads/stores.
+    template <unsigned long _Height>
+    static bool rasterizeRectangle(const Vram<_Height>& textures, const RasterTarget& target, const RasterState& state,
+                                   const RasterVertex& topLeft, long width, long height,
+                                   const Rectangle& targetArea, Rectangle& outArea) noexcept;
+    /// @brief Rasterize untextured line into any target, without modification tracking
+    /// @param targetArea  Additional clipping area in target coords, inclusive boundaries
+    /// @param outArea     Bounding box of drawn area in target coords (only set if the function returns true)
+    /// @returns True if pixels may have been drawn
+    /// @remarks Same rules as hardware: both end points drawn, colors interpolated along major axis (if shaded),
+    ///          dithering only for shaded lines. Upscaled targets: each native pixel covers scaleX*scaleY pixels.
+    static bool rasterizeLine(const RasterTarget& target, const RasterState& state, const RasterVertex& v0,
+                              const RasterVertex& v1, const Rectangle& targetArea, Rectangle& outArea) noexcept;
+
+    /// @brief Get native-resolution target to draw directly in VRAM
+    template <unsigned long _Height>
+    static inline RasterTarget nativeTarget(Vram<_Height>& vram) noexcept {
+      RasterTarget target;
+      target.pixels = vram.pixels();
+      target.rowLength = vram.width();
+      target.width = (long)vram.width();
+      target.height = (long)vram.height();
+      return target;
+    }
+    /// @brief Get area covering an entire target (inclusive boundaries)
+    static inline Rectangle fullTargetArea(const RasterTarget& target) noexcept {
+      return Rectangle{ 0, target.width - 1, 0, target.height - 1 };
+    }
+
+    /// @brief Get VRAM area of texture page read by textured primitive
+    /// @remarks Horizontal wrap-around is reported as full VRAM width.
+    static inline Rectangle getTexturePageArea(const RasterState& state) noexcept {
+      long pageWidth = 256;
+      if (state.colorMode == TextureColorMode::lookupTable4bit)
+        pageWidth = 64;
+      else if (state.colorMode == TextureColorMode::lookupTable8bit)
+        pageWidth = 128;
+      return _wrapAreaWidth(Rectangle{ state.texpageX, state.texpageX + pageWidth - 1, state.texpageY, state.texpageY + 255 });
+    }
+    /// @brief Get VRAM area of color lookup table read by textured primitive (single row -- empty area for direct colors)
+    /// @remarks Horizontal wrap-around is reported as full VRAM width.
+    ///          Page and lookup table must be checked separately: lookup tables are usually stored far from their page
+    ///          (ex: below the framebuffer), so a bounding box of both would cover most of VRAM.
+    static inline Rectangle getLookupTableArea(const RasterState& state) noexcept {
+      long clutWidth;
+      if (state.colorMode == TextureColorMode::lookupTable4bit)
+        clutWidth = 16;
+      else if (state.colorMode == TextureColorMode::lookupTable8bit)
+        clutWidth = 256;
+      else
+        return Rectangle{ 0,-1,0,-1 };
+      return _wrapAreaWidth(Rectangle{ state.clutX, state.clutX + clutWidth - 1, state.clutY, state.clutY });
+    }
+
+    /// @brief Verify if a triangle exceeds max polygon size (ignored by hardware)
+    static inline bool isTriangleTooLarge(const RasterVertex& v0, const RasterVertex& v1, const RasterVertex& v2) noexcept {
+      return (_distance(v0.x, v1.x) > maxPolygonWidth() || _distance(v1.x, v2.x) > maxPolygonWidth() || _distance(v0.x, v2.x) > maxPolygonWidth()
+           || _distance(v0.y, v1.y) > maxPolygonHeight()|| _distance(v1.y, v2.y) > maxPolygonHeight()|| _distance(v0.y, v2.y) > maxPolygonHeight());
+    }
+
+    /// @brief Verify if a line exceeds max size (ignored by hardware)
+    static inline bool isLineTooLarge(const RasterVertex& v0, const RasterVertex& v1) noexcept {
+      return (_distance(v0.x, v1.x) > maxPolygonWidth() || _distance(v0.y, v1.y) > maxPolygonHeight());
+    }
+
+  private:
+    static constexpr inline long _distance(long a, long b) noexcept { return (a >= b) ? a - b : b - a; }
+    static inline Rectangle _wrapAreaWidth(Rectangle area) noexcept {
+      if (area.rightX >= (long)vramWidth()) {
+        area.leftX = 0;
+        area.rightX = (long)vramWidth() - 1;
+      }
+      return area;
+    }
+  };
+}
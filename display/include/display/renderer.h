@@ -14,7 +14,10 @@ GNU General Public License for more details (LICENSE file).
 #pragma once
 
 # include "config/config.h"
+# include "display/types.h"
 # include "display/viewport.h"
+# include "display/draw_list.h"
+# include "display/draw_batcher.h"
 #if defined(_WINDOWS) && defined(_VIDEO_D3D11_SUPPORT)
 # include <video/d3d11/renderer.h>
 # include <video/d3d11/depth_stencil_buffer.h>
@@ -45,8 +48,26 @@ namespace display {
 
     void swapBuffers(bool useVsync);
 
+    /// @brief Clear area of render target with a color (fill command covering entire display/draw area)
+    /// @param vramArea  Cleared area in VRAM coords (inclusive boundaries)
+    /// @param color     24-bit color (GP0 format: red bits 0-7, green bits 8-15, blue bits 16-23)
+    /// @returns True if the render target was cleared (false: VRAM area must be uploaded instead)
+    bool clearRenderTarget(const Rectangle& vramArea, uint32_t color) noexcept;
+    /// @brief Draw decoded primitives of a frame (one draw call per batch of primitives sharing the same render state)
+    /// @remarks - Vertex coords of the draw list are decoded if needed, and invisible primitives are culled
+    ///            (the list isn't cleared).
+    ///          - Opaque primitives are grouped by render state and depth-tested (painter's order depth).
+    ///          - Draw list barriers (clears, VRAM writes) are applied in submission order, between batches.
+    void drawPrimitives(DrawList& drawList) noexcept;
+
+    /// @brief Draw call batching statistics (batches per frame, primitives per batch)
+    const DrawBatchStats& batchStats() const noexcept { return this->_batcher.stats(); }
+
     const config::RendererProfile& configProfile() const noexcept { return this->_config; }
       
+  private:
+    void _drawBatches(const DrawList& drawList, size_t firstBatch, size_t endBatch) noexcept;
+
   private:
     std::shared_ptr<pandora::video::d3d11::Renderer> _renderer = nullptr;
     renderer_api::SwapChain _swapChain;
@@ -56,5 +77,6 @@ namespace display {
     renderer_api::BlendStateArray<4> _blendStates;
     renderer_api::Viewport _viewport;
     config::RendererProfile _config;
+    DrawBatcher _batcher;
   };
 }
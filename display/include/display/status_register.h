@@ -33,6 +33,7 @@ namespace display {
     requestGpuInfo        = 0x10u  ///< Request GPU info (GPU type, draw area/offset, texture window...) -> into GPUREAD register
   };
   static constexpr inline size_t controlCommandNumber() noexcept { return 0x40u; } ///< Max number of GP1 commands
+  static constexpr inline size_t attributeCommandNumber() noexcept { return 6u; } ///< Number of GP0 rendering attribute commands (0xE1-0xE6)
 
   /// @brief GPU info to read (in GPU info request)
   /// @remarks If the value is none of these, the previous GPUREAD value must be kept.
@@ -100,13 +101,24 @@ namespace display {
     //          -> acts as if area within texture window was repeated throughout texture page
     inline const TextureWindow& getTextureWindow() const noexcept { return this->_textureWindow; }
 
+    /// @brief Verify if a rendering attribute command (GP0(0xE1-0xE6)) would leave current state unchanged
+    /// @remarks Params are compared with the latest command of the same type. The history is reset when the same state is
+    ///          modified by other means (GPU reset, save-state, GPU type) -- textured polygons record their texture page.
+    inline bool isRedundantAttribute(unsigned long gdata) const noexcept {
+      size_t index = (size_t)(getGp0CommandId(gdata) - 0xE1u);
+      return (index < attributeCommandNumber() && this->_attributeHistory[index] == (uint32_t)(gdata & 0xFFFFFFu));
+    }
+
 
     // -- hardware info & transfer mode -- -------------------------------------
 
     /// @brief GPU info request (GP1(0x10)) -> store result in GPUREAD register
     void requestGpuInfo(unsigned long params) noexcept;
     /// @brief Manually set GPUSTAT register (when loading save-state)
-    inline void setStatusControlRegister(unsigned long value) noexcept { this->_statusControlRegister = value; }
+    inline void setStatusControlRegister(unsigned long value) noexcept {
+      this->_statusControlRegister = value;
+      _resetAttributeHistory();
+    }
     /// @brief Manually store value in GPUREAD register (during DMA or when loading save-state)
     inline void setGpuReadBuffer(unsigned long buffer) noexcept { this->_gpuReadBuffer = buffer; }
 
@@ -114,6 +126,7 @@ namespace display {
     inline void setGpuType(GpuVersion hwVersion, unsigned long vramHeight) noexcept {
       this->_gpuType = hwVersion;
       this->_vramHeight = vramHeight;
+      _resetAttributeHistory();
     }
     /// @brief Get hardware version
     inline GpuVersion getGpuVersion() const noexcept { return this->_gpuType; }
@@ -274,6 +287,10 @@ namespace display {
     /// @remarks Texture page XY, semi-transparency, colors: only used for lines, rectangles, untextured-polygons
     ///          (textured polygon commands have their own texpage attribute)
     void setTexturePageMode(unsigned long params) noexcept;
+    /// @brief Set texture page attribute of a textured polygon (upper 16 bits of second texture coord param)
+    /// @remarks Same as GP0(0xE1) for texture page base, semi-transparency, colors and texture disable bit
+    ///          (dithering, draw-to-display and flip settings are not affected).
+    void setPolygonTexturePage(unsigned long texpage) noexcept;
     /// @brief Set texture window settings: repeat cropped texture area (GP0(0xE2))
     // @remarks Texture coord transform:  texcoord = (texcoord & ~(sizeMask)) | (offset & sizeMask);
     //          -> acts as if area within texture window was repeated throughout texture page
@@ -285,6 +302,14 @@ namespace display {
       this->_statusControlRegister &= ~((unsigned long)StatusBits::enableMask | (unsigned long)StatusBits::forceSetMaskBit);
       this->_statusControlRegister |= ((params << bitOffset_forceSetMaskBit())
                                       & ((unsigned long)StatusBits::enableMask | (unsigned long)StatusBits::forceSetMaskBit));
+      this->_attributeHistory[5] = (uint32_t)(params & 0xFFFFFFu);
+    }
+
+  private:
+    static constexpr inline uint32_t unknownAttribute() noexcept { return 0xFFFFFFFFu; }   // no 24-bit params can match it
+    inline void _resetAttributeHistory() noexcept {
+      for (size_t i = 0; i < attributeCommandNumber(); ++i)
+        this->_attributeHistory[i] = unknownAttribute();
     }
 
   private:
@@ -299,6 +324,8 @@ namespace display {
     unsigned long _texpageBaseX = 0;
     unsigned long _texpageBaseY = 0;
     TextureWindow _textureWindow;
+    uint32_t _attributeHistory[attributeCommandNumber()] { unknownAttribute(), unknownAttribute(), unknownAttribute(),
+                                                           unknownAttribute(), unknownAttribute(), unknownAttribute() };
 
     bool _isTextureFlipX = false;
     bool _isTextureFlipY = false;
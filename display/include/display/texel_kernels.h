@@ -0,0 +1,63 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace display {
+  /// @brief Instruction set used by texel conversion kernels
+  enum class KernelInstructionSet : uint32_t {
+    scalar = 0, ///< Portable C++ (reference)
+    ssse3  = 1, ///< x86: SSE2 + byte shuffles (4-bit lookup tables in registers)
+    avx2   = 2, ///< x86: 256-bit vectors + gathers (8-bit lookup tables)
+    neon   = 3  ///< ARM64: 128-bit vectors + table lookups
+  };
+
+  /// @brief Texel conversion kernels (texture upload, texture decoding, display scanout)
+  /// @remarks - The best instruction set supported by the CPU is selected at runtime (on first use).
+  ///          - Source texels use VRAM format: BGR555 + STP bit (bit 15). Texel 0x0000 is fully transparent.
+  ///          - STP masks are optional (nullptr to ignore): one byte per texel, 0xFF if STP bit set, 0 otherwise.
+  ///          - Buffers don't need any alignment, and lengths don't need to be multiples of vector sizes.
+  class TexelKernels final {
+  public:
+    TexelKernels() = delete;
+
+    /// @brief Expand packed 4-bit color indexes through 16-entry lookup table
+    /// @param indexes       Packed indexes (4 indexes per VRAM texel, first index in lowest bits)
+    /// @param length        Number of VRAM texels in 'indexes' -> 'outTexels' receives 4*length texels
+    /// @param lookupTable   16 lookup table entries (CLUT)
+    static void expandLookupTable4bit(const uint16_t* indexes, size_t length, const uint16_t* lookupTable, uint16_t* outTexels) noexcept;
+    /// @brief Expand packed 8-bit color indexes through 256-entry lookup table
+    /// @param indexes       Packed indexes (2 indexes per VRAM texel, first index in lowest bits)
+    /// @param length        Number of VRAM texels in 'indexes' -> 'outTexels' receives 2*length texels
+    /// @param lookupTable   256 lookup table entries (CLUT)
+    static void expandLookupTable8bit(const uint16_t* indexes, size_t length, const uint16_t* lookupTable, uint16_t* outTexels) noexcept;
+
+    /// @brief Convert BGR555 texels to RGBA8888 (red in lowest byte, alpha 0 for transparent texels, 0xFF for others)
+    static void convertToRgba8888(const uint16_t* texels, size_t length, uint32_t* outPixels, uint8_t* outStpMask = nullptr) noexcept;
+    /// @brief Convert BGR555 texels to RGBA5551 (red in highest bits, alpha bit 0 for transparent texels, 1 for others)
+    static void convertToRgba5551(const uint16_t* texels, size_t length, uint16_t* outPixels, uint8_t* outStpMask = nullptr) noexcept;
+
+    // -- instruction set --
+
+    /// @brief Get instruction set used by kernels
+    static KernelInstructionSet instructionSet() noexcept;
+    /// @brief Verify if an instruction set is supported by current CPU (and by current build)
+    static bool isSupported(KernelInstructionSet instructionSet) noexcept;
+    /// @brief Force instruction set used by kernels (tests, benchmarks)
+    /// @returns False if the instruction set isn't supported (current selection not modified)
+    static bool setInstructionSet(KernelInstructionSet instructionSet) noexcept;
+  };
+}
@@ -0,0 +1,112 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include "display/types.h"
+#include "display/vram.h"
+
+namespace display {
+  static constexpr inline unsigned long decodedTextureSize() noexcept { return 256u; } ///< Width/height of decoded texture pages (texels)
+  static constexpr inline size_t decodedTextureBytes() noexcept { ///< Memory size of a decoded texture page
+    return (size_t)decodedTextureSize()*decodedTextureSize()*sizeof(uint16_t);
+  }
+  static constexpr inline size_t defaultTextureCacheBudget() noexcept { return 16u*1024u*1024u; } ///< Default memory budget (128 pages)
+
+  /// @brief Texture cache statistics
+  struct TextureCacheStats final {
+    uint64_t hits = 0;          ///< Valid texture found in cache
+    uint64_t misses = 0;        ///< Texture decoded (not found, or outdated)
+    uint64_t invalidations = 0; ///< Outdated textures (texture page or lookup table modified since decoding) -> included in misses
+    uint64_t evictions = 0;     ///< Least-recently-used textures removed to respect memory budget
+  };
+
+  /// @brief Cache of decoded texture pages (4-bit/8-bit lookup tables resolved, 15-bit pages copied)
+  /// @remarks - Decoded pages contain 256x256 texels in VRAM format (BGR555 + STP bit, 0 == transparent),
+  ///            addressed by texture coords: texel(u,v) = texels[v*256 + u] -> no CLUT access when drawing.
+  ///          - Entries are identified by texture page, color mode and lookup table position,
+  ///            and validated with VRAM generation stamps (re-decoded if their VRAM area was modified):
+  ///            texture page and lookup table are validated separately (lookup table row: 64x16 block stamps).
+  ///          - Memory budget with least-recently-used eviction. Entries used during current batch are never evicted
+  ///            (pointers remain valid until next call to 'beginBatch' or 'clear'), so the budget may be exceeded temporarily.
+  class TextureCache final {
+  public:
+    /// @brief Create texture cache
+    /// @param budgetBytes  Max memory size of decoded pages (at least 1 page is always allowed)
+    TextureCache(size_t budgetBytes = defaultTextureCacheBudget());
+    TextureCache(const TextureCache&) = delete;
+    TextureCache(TextureCache&&) = default;
+    TextureCache& operator=(const TextureCache&) = delete;
+    TextureCache& operator=(TextureCache&&) = default;
+    ~TextureCache() noexcept = default;
+
+    // -- operations --
+
+    /// @brief Get decoded texture page (decode it if not cached or outdated)
+    /// @param texpageX/texpageY  Texture page base coords in VRAM
+    /// @param clutX/clutY        Color lookup table coords in VRAM (ignored with direct colors)
+    /// @returns 256x256 decoded texels (valid until next call to 'beginBatch' or 'clear')
+    template <unsigned long _Height>
+    const uint16_t* getTexture(const Vram<_Height>& vram, long texpageX, long texpageY, TextureColorMode colorMode,
+                               long clutX, long clutY);
+
+    /// @brief Start new batch of primitives -> textures used previously can be evicted
+    inline void beginBatch() noexcept { ++(this->_batchId); }
+    /// @brief Remove all entries (statistics are not affected)
+    void clear() noexcept;
+
+    // -- accessors --
+
+    inline size_t size() const noexcept { return this->_entries.size(); } ///< Number of cached textures
+    inline size_t capacity() const noexcept { return this->_maxEntries; } ///< Max number of cached textures (memory budget)
+    inline size_t memoryUsage() const noexcept { return this->_entries.size()*decodedTextureBytes(); } ///< Memory used by decoded pages
+
+    inline const TextureCacheStats& stats() const noexcept { return this->_stats; } ///< Get statistics
+    inline void resetStats() noexcept { this->_stats = TextureCacheStats{}; }      ///< Reset statistics
+
+    /// @brief Build unique identifier of a texture (lookup table ignored with direct colors)
+    static inline uint64_t toTextureKey(long texpageX, long texpageY, TextureColorMode colorMode, long clutX, long clutY) noexcept {
+      uint64_t key = (uint64_t)(texpageX & 0x3FF) | ((uint64_t)(texpageY & 0x3FF) << 10)
+                   | ((uint64_t)colorMode << 33); // color mode: bits 7-8 -> 40-41
+      if (colorMode == TextureColorMode::lookupTable4bit || colorMode == TextureColorMode::lookupTable8bit)
+        key |= ((uint64_t)(clutX & 0x3FF) << 20) | ((uint64_t)(clutY & 0x3FF) << 30);
+      return key;
+    }
+
+  private:
+    struct Entry final {
+      uint64_t key = 0;
+      uint64_t generation = 0;   // VRAM write counter during decoding
+      uint64_t batchId = 0;      // latest batch using the entry
+      const void* source = nullptr; // decoded VRAM instance
+      std::unique_ptr<uint16_t[]> texels = nullptr;
+    };
+    using EntryList = std::list<Entry>; // most recently used first
+
+    template <unsigned long _Height>
+    bool _isEntryValid(const Entry& entry, const Vram<_Height>& vram, long texpageX, long texpageY,
+                       TextureColorMode colorMode, long clutX, long clutY) const noexcept;
+
+  private:
+    EntryList _entries;
+    std::unordered_map<uint64_t, EntryList::iterator> _index;
+    size_t _maxEntries = 1;
+    uint64_t _batchId = 1;
+    TextureCacheStats _stats;
+  };
+}
@@ -0,0 +1,137 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "display/types.h"
+#include "display/vram.h"
+#include "display/rasterizer.h"
+#include "display/texture_cache.h"
+
+namespace display {
+  /// @brief Tile-binned multi-threaded rasterization backend
+  /// @remarks - Primitives are binned into 64x64 screen tiles (target coords) instead of being drawn immediately.
+  ///          - On flush, tiles are distributed to a pool of worker threads (+ calling thread):
+  ///            each tile is processed by a single thread, with primitives in submission order
+  ///            -> results are bit-identical with single-threaded rasterization (semi-transparency, mask bits).
+  ///          - Pending primitives are automatically flushed when a new primitive reads texture data written by pending
+  ///            primitives (or overwrites texture data they read), and when the target or VRAM changes.
+  ///          - The owner must call 'flush' before any other VRAM access (transfers, fill/copy, display, readback).
+  ///          - If a texture cache is set, decoded textures are resolved on flush (in calling thread), then shared by workers.
+  class TiledRasterizer final {
+  public:
+    /// @brief Create rasterization backend
+    /// @param workerCount  Number of worker threads (in addition to calling thread) -- 0 to rasterize in calling thread only
+    TiledRasterizer(unsigned workerCount = defaultWorkerCount());
+    ~TiledRasterizer() noexcept;
+
+    TiledRasterizer(const TiledRasterizer&) = delete;
+    TiledRasterizer(TiledRasterizer&&) = delete;
+    TiledRasterizer& operator=(const TiledRasterizer&) = delete;
+    TiledRasterizer& operator=(TiledRasterizer&&) = delete;
+
+    static constexpr inline long tileSize() noexcept { return 64; } ///< Width/height of screen tiles (target coords)
+    static unsigned defaultWorkerCount() noexcept; ///< Number of hardware threads - 1
+
+    // -- operations --
+
+    /// @brief Add triangle to pending primitives
+    /// @param vram    VRAM containing textures (flushed automatically if a hazard is detected)
+    /// @param target  Destination of pixels (native VRAM target or upscaled framebuffer)
+    /// @throws std::bad_alloc on allocation failure (triangle not added)
+    template <unsigned long _Height>
+    void drawTriangle(Vram<_Height>& vram, const RasterTarget& target, const RasterState& state,
+                      const RasterVertex& v0, const RasterVertex& v1, const RasterVertex& v2);
+    /// @brief Add quad to pending primitives, as two triangles: (v0,v1,v2) + (v1,v2,v3)
+    /// @throws std::bad_alloc on allocation failure (first triangle may be added)
+    template <unsigned long _Height>
+    inline void drawQuad(Vram<_Height>& vram, const RasterTarget& target, const RasterState& state, const RasterVertex* vertices) {
+      drawTriangle(vram, target, state, vertices[0], vertices[1], vertices[2]);
+      drawTriangle(vram, target, state, vertices[1], vertices[2], vertices[3]);
+    }
+
+    /// @brief Rasterize all pending primitives (+ report modified areas, for native VRAM target)
+    /// @remarks Textures are read in the VRAM used when the primitives were added.
+    inline void flush() noexcept {
+      if (!this->_commands.empty())
+        this->_flushBoundVram(*this);
+    }
+
+    /// @brief Set cache of decoded textures used on flush (or nullptr to read textures in VRAM)
+    /// @warning The cache must not be used by other threads during flush
+    inline void setTextureCache(TextureCache* cache) noexcept { this->_textureCache = cache; }
+
+    // -- accessors --
+
+    inline bool isEmpty() const noexcept { return this->_commands.empty(); } ///< Verify if no primitive is pending
+    inline size_t pendingCount() const noexcept { return this->_commands.size(); } ///< Number of pending triangles
+    inline unsigned workerCount() const noexcept { return (unsigned)this->_workers.size(); } ///< Number of worker threads
+
+  private:
+    struct TriangleCommand final {
+      RasterState state;
+      RasterVertex vertices[3];
+    };
+    using TileRasterizer = void (*)(TiledRasterizer&, size_t);
+    using VramFlusher = void (*)(TiledRasterizer&);
+
+    void _resizeBins(const RasterTarget& target);
+    bool _isHazard(const RasterState& state, const Rectangle& nativeArea) const noexcept;
+    void _rasterizeTiles(TileRasterizer rasterizer, const void* textures) noexcept;
+    void _runWorker() noexcept;
+    void _processTiles() noexcept;
+    void _clear() noexcept;
+
+    template <unsigned long _Height>
+    void _flush(Vram<_Height>& vram) noexcept;
+    template <unsigned long _Height>
+    static void _flushVram(TiledRasterizer& parent) noexcept { parent._flush(*reinterpret_cast<Vram<_Height>*>(parent._boundVram)); }
+    template <unsigned long _Height>
+    static void _rasterizeTile(TiledRasterizer& parent, size_t tileIndex) noexcept;
+
+  private:
+    std::vector<TriangleCommand> _commands;
+    std::vector<std::vector<uint32_t> > _bins; // command indexes of each tile
+    std::vector<uint32_t> _activeTiles;        // indexes of tiles with commands
+    std::vector<Rectangle> _drawnAreas;        // drawn area of each active tile (target coords)
+    std::vector<char> _isTileDrawn;
+    RasterTarget _target;
+    void* _boundVram = nullptr;              // VRAM used by pending primitives (textures + native target)
+    VramFlusher _flushBoundVram = nullptr;   // flush function matching type of '_boundVram'
+    TextureCache* _textureCache = nullptr;
+    size_t _tileCountX = 0;
+    size_t _tileCountY = 0;
+
+    Rectangle _pendingWriteArea{ 0,-1,0,-1 };   // native coords (empty if rightX < leftX)
+    Rectangle _pendingPageReadArea{ 0,-1,0,-1 };// native coords - texture pages read by pending primitives
+    Rectangle _pendingClutReadArea{ 0,-1,0,-1 };// native coords - lookup tables read by pending primitives
+
+    std::vector<std::thread> _workers;
+    std::mutex _lock;
+    std::condition_variable _jobStarted;
+    std::condition_variable _jobFinished;
+    std::atomic<size_t> _nextTile{ 0 };
+    TileRasterizer _currentRasterizer = nullptr;
+    const void* _currentTextures = nullptr;
+    uint64_t _jobId = 0;
+    unsigned _runningWorkers = 0;
+    bool _isStopping = false;
+  };
+}
@@ -137,6 +137,7 @@ namespace display {
     arcadeGpu1  = 1,  ///< Standard arcade GPU (close to PS1 GPU)
     arcadeGpu2   = 2  ///< Special arcade GPU
   };
+  constexpr inline unsigned long vramWidth() noexcept { return 1024; }          ///< VRAM width (texels) - same for all GPU types
   constexpr inline unsigned long psxVramHeight() noexcept { return 512; }       ///< Standard GPU VRAM height (texels)
   constexpr inline unsigned long znArcadeVramHeight() noexcept { return 1024; } ///< Special arcade GPU VRAM height (texels)
   constexpr inline unsigned long maxLightgunCursors() noexcept { return 8u; }   ///< Max number of lightgun cursors
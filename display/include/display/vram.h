@@ -0,0 +1,247 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include "display/types.h"
+
+namespace display {
+  static constexpr inline size_t vramAlignment() noexcept { return 64u; }          ///< Memory alignment of VRAM rows (cache line)
+  static constexpr inline unsigned long vramPageWidth() noexcept { return 64u; }    ///< Texture page width (16-bit texels)
+  static constexpr inline unsigned long vramPageHeight() noexcept { return 256u; }  ///< Texture page height (lines)
+  static constexpr inline unsigned long vramRowBandHeight() noexcept { return 16u; }///< Height of row bands used for modification tracking
+  static constexpr inline uint16_t vramMaskBit() noexcept { return 0x8000u; }       ///< Mask bit of texels (write protection / semi-transparency)
+
+  /// @brief Video memory (16-bit texels) + modification tracking
+  /// @remarks - Standard PS1 GPU: 1024x512 / special arcade GPU (ZiNc): 1024x1024.
+  ///          - Modified regions are tracked per texture page (64x256) and per row band (16 lines):
+  ///            * dirty flags: bit-maps, set on each write, cleared by the consumer (uploader, readback...);
+  ///            * generation stamps: value of write counter during latest write of each page / 64x16 block (never cleared)
+  ///              -> caches only need to compare a few stamps to know if a region changed.
+  ///          - Coordinates out of range wrap around (same as hardware).
+  template <unsigned long _Height>
+  class Vram final {
+  public:
+    static_assert(_Height == psxVramHeight() || _Height == znArcadeVramHeight(), "Vram: unsupported VRAM height");
+    static_assert(_Height / vramRowBandHeight() <= 64u, "Vram: tracking bit-maps limited to 64 bits");
+
+    /// @brief Allocate video memory (all texels set to 0)
+    /// @throws bad_alloc on failure
+    Vram()
+      : _buffer(new uint16_t[width()*_Height + (vramAlignment() / sizeof(uint16_t))]) {
+      this->_pixels = (uint16_t*)(((uintptr_t)this->_buffer.get() + (vramAlignment() - 1u)) & ~(uintptr_t)(vramAlignment() - 1u));
+      memset((void*)this->_pixels, 0, sizeInBytes());
+      memset((void*)this->_pageGenerations, 0, sizeof(this->_pageGenerations));
+      memset((void*)this->_blockGenerations, 0, sizeof(this->_blockGenerations));
+    }
+
+    Vram(const Vram<_Height>&) = delete;
+    Vram(Vram<_Height>&& rhs) noexcept
+      : _buffer(std::move(rhs._buffer)), _pixels(rhs._pixels),
+        _dirtyPages(rhs._dirtyPages), _dirtyRowBands(rhs._dirtyRowBands), _generation(rhs._generation) {
+      memcpy((void*)this->_pageGenerations, (void*)rhs._pageGenerations, sizeof(this->_pageGenerations));
+      memcpy((void*)this->_blockGenerations, (void*)rhs._blockGenerations, sizeof(this->_blockGenerations));
+      rhs._pixels = nullptr;
+    }
+    Vram& operator=(const Vram<_Height>&) = delete;
+    Vram& operator=(Vram<_Height>&& rhs) noexcept {
+      this->_buffer = std::move(rhs._buffer);
+      this->_pixels = rhs._pixels;
+      this->_dirtyPages = rhs._dirtyPages;
+      this->_dirtyRowBands = rhs._dirtyRowBands;
+      this->_generation = rhs._generation;
+      memcpy((void*)this->_pageGenerations, (void*)rhs._pageGenerations, sizeof(this->_pageGenerations));
+      memcpy((void*)this->_blockGenerations, (void*)rhs._blockGenerations, sizeof(this->_blockGenerations));
+      rhs._pixels = nullptr;
+      return *this;
+    }
+    ~Vram() noexcept = default;
+
+    // -- accessors --
+
+    static constexpr inline unsigned long width() noexcept { return vramWidth(); } ///< VRAM width (texels)
+    static constexpr inline unsigned long height() noexcept { return _Height; }    ///< VRAM height (texels)
+    static constexpr inline size_t sizeInBytes() noexcept { return width()*_Height*sizeof(uint16_t); } ///< Total size of pixel data
+
+    static constexpr inline unsigned long pageColumns() noexcept { return width() / vramPageWidth(); }  ///< Texture pages per line (16)
+    static constexpr inline unsigned long pageRows() noexcept { return _Height / vramPageHeight(); }    ///< Texture pages per column (2 / 4)
+    static constexpr inline unsigned long pageCount() noexcept { return pageColumns()*pageRows(); }     ///< Total number of texture pages
+    static constexpr inline unsigned long rowBandCount() noexcept { return _Height / vramRowBandHeight(); } ///< Total number of row bands
+
+    /// @brief Get index of texture page containing a texel
+    static constexpr inline unsigned long pageIndex(unsigned long x, unsigned long y) noexcept {
+      return (((y & (_Height - 1u)) / vramPageHeight()) * pageColumns()) + ((x & (width() - 1u)) / vramPageWidth());
+    }
+
+    /// @brief Get pixel data (line by line, 1024 texels per line)
+    inline uint16_t* pixels() noexcept { return this->_pixels; }
+    inline const uint16_t* pixels() const noexcept { return this->_pixels; } ///< Read pixel data
+    /// @brief Get first texel of a line (wraps around if out of range)
+    inline uint16_t* row(unsigned long y) noexcept { return &(this->_pixels[(y & (_Height - 1u))*width()]); }
+    inline const uint16_t* row(unsigned long y) const noexcept { return &(this->_pixels[(y & (_Height - 1u))*width()]); } ///< Read line
+    /// @brief Read texel value (wraps around if out of range)
+    inline uint16_t read(unsigned long x, unsigned long y) const noexcept { return row(y)[x & (width() - 1u)]; }
+
+
+    // -- modification tracking --
+
+    /// @brief Report modification of a rectangle (wraps around if out of range) -> set dirty flags + update generation stamps
+    /// @remarks Must be called after any write into pixel data (width/height are limited to VRAM size)
+    void markDirty(unsigned long x, unsigned long y, unsigned long areaWidth, unsigned long areaHeight) noexcept {
+      if (areaWidth == 0 || areaHeight == 0)
+        return;
+      uint64_t pageBits = regionPageBits(x, y, areaWidth, areaHeight);
+      uint64_t rowBandBits = regionRowBandBits(y, areaHeight);
+      this->_dirtyPages |= pageBits;
+      this->_dirtyRowBands |= rowBandBits;
+      _stampRegion(x, areaWidth, pageBits, rowBandBits);
+    }
+    /// @brief Report modification of a rectangle already applied on the renderer side (ex: render-target clear)
+    ///        -> only update generation stamps (no dirty flags: the region doesn't need to be uploaded)
+    void markSynchronized(unsigned long x, unsigned long y, unsigned long areaWidth, unsigned long areaHeight) noexcept {
+      if (areaWidth == 0 || areaHeight == 0)
+        return;
+      _stampRegion(x, areaWidth, regionPageBits(x, y, areaWidth, areaHeight), regionRowBandBits(y, areaHeight));
+    }
+    /// @brief Report modification of entire VRAM (ex: after loading a save-state)
+    void markAllDirty() noexcept { markDirty(0, 0, width(), _Height); }
+
+    /// @brief Verify if a rectangle was modified since latest call to 'clearDirtyFlags' - O(1)
+    /// @remarks Conservative: may report a clean region as dirty if its page and its row band were modified by other writes.
+    inline bool isRegionDirty(unsigned long x, unsigned long y, unsigned long areaWidth, unsigned long areaHeight) const noexcept {
+      return ((this->_dirtyPages & regionPageBits(x, y, areaWidth, areaHeight)) != 0
+           && (this->_dirtyRowBands & regionRowBandBits(y, areaHeight)) != 0);
+    }
+    /// @brief Verify if a texture page was modified since latest call to 'clearDirtyFlags'
+    inline bool isPageDirty(unsigned long pageX, unsigned long pageY) const noexcept {
+      return (this->_dirtyPages & (1uLL << (pageY*pageColumns() + pageX)));
+    }
+    /// @brief Get bit-map of modified texture pages (bit index == 'pageIndex')
+    inline uint64_t dirtyPages() const noexcept { return this->_dirtyPages; }
+    /// @brief Get bit-map of modified row bands (bit index == line / 'vramRowBandHeight')
+    inline uint64_t dirtyRowBands() const noexcept { return this->_dirtyRowBands; }
+    /// @brief Reset dirty flags (after consuming modifications) -> generation stamps are not affected
+    inline void clearDirtyFlags() noexcept { this->_dirtyPages = this->_dirtyRowBands = 0; }
+
+    /// @brief Get current write counter value (incremented on each modification)
+    inline uint64_t generation() const noexcept { return this->_generation; }
+    /// @brief Get generation stamp of a texture page (value of write counter during latest modification of the page)
+    inline uint64_t pageGeneration(unsigned long index) const noexcept { return this->_pageGenerations[index]; }
+    /// @brief Get generation stamp of a block (page column in a row band: 64x16 texels)
+    inline uint64_t blockGeneration(unsigned long pageX, unsigned long rowBand) const noexcept {
+      return this->_blockGenerations[rowBand*pageColumns() + pageX];
+    }
+    /// @brief Get most recent generation stamp among texture pages overlapping a rectangle
+    /// @remarks To know if a region changed: store 'generation()' when reading it, then verify if regionGeneration(...) > stored value.
+    ///          Cost proportional to number of pages overlapped (1 to 4 pages for a texture page/CLUT).
+    uint64_t regionGeneration(unsigned long x, unsigned long y, unsigned long areaWidth, unsigned long areaHeight) const noexcept {
+      uint64_t latest = 0;
+      const uint64_t* it = this->_pageGenerations;
+      for (uint64_t pageBits = regionPageBits(x, y, areaWidth, areaHeight); pageBits; pageBits >>= 1, ++it) {
+        if ((pageBits & 0x1u) && *it > latest)
+          latest = *it;
+      }
+      return latest;
+    }
+    /// @brief Get most recent generation stamp among blocks (64x16) overlapping a rectangle
+    /// @remarks Finer than 'regionGeneration' for thin regions (lookup tables): writes in the same texture page
+    ///          but in other lines (ex: framebuffer drawn above lookup tables) are ignored.
+    uint64_t regionBlockGeneration(unsigned long x, unsigned long y, unsigned long areaWidth, unsigned long areaHeight) const noexcept {
+      uint64_t latest = 0;
+      const uint64_t columnBits = regionColumnBits(x, areaWidth);
+      const uint64_t* rowIt = this->_blockGenerations;
+      for (uint64_t rowBandBits = regionRowBandBits(y, areaHeight); rowBandBits; rowBandBits >>= 1, rowIt += pageColumns()) {
+        if (rowBandBits & 0x1u) {
+          const uint64_t* it = rowIt;
+          for (uint64_t bits = columnBits; bits; bits >>= 1, ++it) {
+            if ((bits & 0x1u) && *it > latest)
+              latest = *it;
+          }
+        }
+      }
+      return latest;
+    }
+
+    // -- tracking helpers --
+
+    /// @brief Get bit-map of texture pages overlapping a rectangle (wraps around if out of range)
+    static inline uint64_t regionPageBits(unsigned long x, unsigned long y, unsigned long areaWidth, unsigned long areaHeight) noexcept {
+      y &= (_Height - 1u);
+      uint64_t columnBits = regionColumnBits(x, areaWidth);
+      uint64_t rowBits = _wrappedRangeBits(y / vramPageHeight(), _blockCount(y, areaHeight, vramPageHeight()), pageRows());
+
+      uint64_t pageBits = 0;
+      for (unsigned long pageY = 0; rowBits; rowBits >>= 1, ++pageY) {
+        if (rowBits & 0x1u)
+          pageBits |= (columnBits << (pageY*pageColumns()));
+      }
+      return pageBits;
+    }
+    /// @brief Get bit-map of page columns overlapping a range of texels (wraps around if out of range)
+    static inline uint64_t regionColumnBits(unsigned long x, unsigned long areaWidth) noexcept {
+      x &= (width() - 1u);
+      return _wrappedRangeBits(x / vramPageWidth(), _blockCount(x, areaWidth, vramPageWidth()), pageColumns());
+    }
+    /// @brief Get bit-map of row bands overlapping a range of lines (wraps around if out of range)
+    static inline uint64_t regionRowBandBits(unsigned long y, unsigned long areaHeight) noexcept {
+      y &= (_Height - 1u);
+      return _wrappedRangeBits(y / vramRowBandHeight(), _blockCount(y, areaHeight, vramRowBandHeight()), rowBandCount());
+    }
+
+  private:
+    // increment write counter + store its value in generation stamps of pages/blocks
+    inline void _stampRegion(unsigned long x, unsigned long areaWidth, uint64_t pageBits, uint64_t rowBandBits) noexcept {
+      uint64_t generation = ++(this->_generation);
+      for (uint64_t* it = this->_pageGenerations; pageBits; pageBits >>= 1, ++it) {
+        if (pageBits & 0x1u)
+          *it = generation;
+      }
+      const uint64_t columnBits = regionColumnBits(x, areaWidth);
+      for (uint64_t* rowIt = this->_blockGenerations; rowBandBits; rowBandBits >>= 1, rowIt += pageColumns()) {
+        if (rowBandBits & 0x1u) {
+          uint64_t* it = rowIt;
+          for (uint64_t bits = columnBits; bits; bits >>= 1, ++it) {
+            if (bits & 0x1u)
+              *it = generation;
+          }
+        }
+      }
+    }
+    // number of blocks of a size overlapped by a range
+    static constexpr inline unsigned long _blockCount(unsigned long offset, unsigned long length, unsigned long blockSize) noexcept {
+      return (length != 0) ? ((offset + length - 1u) / blockSize) - (offset / blockSize) + 1u : 0;
+    }
+    // bit-map of 'count' consecutive bits, starting at 'first', wrapping around after 'total' bits
+    static inline uint64_t _wrappedRangeBits(unsigned long first, unsigned long count, unsigned long total) noexcept {
+      if (count >= total)
+        return (total >= 64u) ? ~(uint64_t)0 : (((uint64_t)1 << total) - 1u);
+      if (first + count <= total)
+        return ((((uint64_t)1 << count) - 1u) << first);
+      return ((((uint64_t)1 << (total - first)) - 1u) << first) | (((uint64_t)1 << (first + count - total)) - 1u);
+    }
+
+  private:
+    std::unique_ptr<uint16_t[]> _buffer = nullptr;
+    uint16_t* _pixels = nullptr; // aligned pointer in '_buffer'
+
+    uint64_t _dirtyPages = 0;
+    uint64_t _dirtyRowBands = 0;
+    uint64_t _generation = 0;
+    uint64_t _pageGenerations[(vramWidth() / vramPageWidth()) * (_Height / vramPageHeight())];
+    uint64_t _blockGenerations[(vramWidth() / vramPageWidth()) * (_Height / vramRowBandHeight())]; // page columns * row bands
+  };
+}
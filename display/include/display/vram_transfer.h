@@ -0,0 +1,70 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include "display/vram.h"
+
+namespace display {
+  /// @brief CPU -> VRAM image transfer (GP0(0xA0)) - resumable cursor
+  /// @remarks - Image data is received as 32-bit words (2 texels per word), in one or more data blocks:
+  ///            the transfer may be split at any word boundary (DMA blocks), and is resumed with the next block.
+  ///          - Texels are packed continuously (no padding between lines: with odd widths, a word may overlap two lines).
+  ///            Only the last word may be padded (if the total number of texels is odd).
+  ///          - Destination area wraps around VRAM edges.
+  ///          - Mask settings (GP0(0xE6)) are applied to every texel.
+  class VramTransfer final {
+  public:
+    VramTransfer() = default;
+    VramTransfer(const VramTransfer&) = default;
+    VramTransfer& operator=(const VramTransfer&) = default;
+    ~VramTransfer() noexcept = default;
+
+    /// @brief Prepare new transfer, based on GP0(0xA0) params
+    /// @param destination  Second word of command: destination coords in VRAM (x: bits 0-9 / y: bits 16-25)
+    /// @param size         Third word of command: width/height (0 values == max size)
+    /// @param vramHeight   VRAM height of current GPU type
+    void start(unsigned long destination, unsigned long size, unsigned long vramHeight) noexcept;
+    /// @brief Interrupt current transfer (if any)
+    inline void cancel() noexcept { this->_remainingPixels = 0; }
+
+    /// @brief Copy next data block into VRAM + report modified area
+    /// @param forceMaskBit  Mask bit value to set on each texel (0 or vramMaskBit()) -> GP0(0xE6)
+    /// @param checkMask     Protect destination texels with mask bit (don't overwrite them) -> GP0(0xE6)
+    /// @returns Number of words used by current transfer (<= size): if lower than size, the transfer is complete
+    ///          and remaining words must be processed as GP0 commands.
+    template <unsigned long _Height>
+    int write(Vram<_Height>& vram, const uint32_t* mem, int size, uint16_t forceMaskBit, bool checkMask) noexcept;
+
+    // -- accessors --
+
+    inline bool isActive() const noexcept { return (this->_remainingPixels != 0); } ///< Verify if a transfer is pending
+    inline unsigned long x() const noexcept { return this->_x; }           ///< Destination left coord
+    inline unsigned long y() const noexcept { return this->_y; }           ///< Destination top coord
+    inline unsigned long width() const noexcept { return this->_width; }   ///< Destination area width
+    inline unsigned long height() const noexcept { return this->_height; } ///< Destination area height
+    inline unsigned long currentRow() const noexcept { return this->_row; }       ///< Next line to write (relative to 'y')
+    inline unsigned long currentColumn() const noexcept { return this->_column; } ///< Next texel to write in line (relative to 'x')
+    inline unsigned long remainingPixels() const noexcept { return this->_remainingPixels; } ///< Texels not received yet
+
+  private:
+    unsigned long _x = 0;
+    unsigned long _y = 0;
+    unsigned long _width = 0;
+    unsigned long _height = 0;
+    unsigned long _row = 0;
+    unsigned long _column = 0;
+    unsigned long _remainingPixels = 0;
+  };
+}
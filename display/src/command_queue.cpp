@@ -0,0 +1,174 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "display/command_queue.h"
+
+using namespace display;
+
+
+// -- worker thread -- ---------------------------------------------------------
+
+CommandQueue::CommandQueue(Consumer consumer, ControlConsumer controlConsumer, void* context, size_t capacity)
+  : _consumer(consumer),
+    _controlConsumer(controlConsumer),
+    _context(context) {
+  size_t ringSize = 64u;
+  while (ringSize < capacity)
+    ringSize <<= 1;
+  this->_buffer.reset(new uint32_t[ringSize]);
+  this->_mask = ringSize - 1u;
+  this->_controls.reset(new ControlEntry[controlCapacity()]);
+
+  this->_worker = std::thread([this]() { _runWorker(); });
+}
+
+CommandQueue::~CommandQueue() noexcept {
+  {
+    std::lock_guard<std::mutex> guard(this->_lock);
+    this->_isStopping.store(true);
+  }
+  this->_dataPushed.notify_one();
+  this->_worker.join(); // remaining commands are processed before exiting
+}
+
+// ---
+
+// Worker thread loop: wait for data -> process contiguous block (or control word) -> report progress
+void CommandQueue::_runWorker() noexcept {
+  while (true) {
+    size_t tail = this->_tail.load(std::memory_order_relaxed);
+    size_t head = this->_head.load(std::memory_order_acquire);
+    const size_t controlTail = this->_controlTail.load(std::memory_order_relaxed);
+    if (controlTail != this->_controlHead.load(std::memory_order_acquire)) {
+      const ControlEntry& control = this->_controls[controlTail & (controlCapacity() - 1u)];
+      if (control.position == tail) { // all words pushed before control word processed
+        this->_controlConsumer(this->_context, control.value);
+        this->_controlTail.store(controlTail + 1u); // seq_cst: ordered with 'isProducerParked' check
+        if (this->_isProducerParked.load()) {
+          std::lock_guard<std::mutex> guard(this->_lock);
+          this->_dataProcessed.notify_one();
+        }
+        continue;
+      }
+      if (head - tail > control.position - tail) // stop before control word (rest processed after it)
+        head = control.position;
+    }
+    if (head == tail) {
+      if (!_waitForData(tail, controlTail))
+        return;
+      continue;
+    }
+
+    size_t offset = (tail & this->_mask);
+    size_t length = head - tail;
+    if (length > capacity() - offset) // stop at the end of the ring (rest processed with next block)
+      length = capacity() - offset;
+    this->_consumer(this->_context, &(this->_buffer[offset]), (int)length);
+
+    this->_tail.store(tail + length); // seq_cst: ordered with 'isProducerParked' check
+    if (this->_isProducerParked.load()) {
+      std::lock_guard<std::mutex> guard(this->_lock);
+      this->_dataProcessed.notify_one();
+    }
+  }
+}
+
+// Wait until new words (or control words) are pushed (spin, then park)
+// returns: false if the queue is stopping and no data is left
+bool CommandQueue::_waitForData(size_t tail, size_t controlTail) noexcept {
+  for (unsigned spin = 0; spin < spinCount(); ++spin) {
+    if (_isPending(tail, controlTail))
+      return true;
+    if (this->_isStopping.load(std::memory_order_relaxed))
+      return _isPending(tail, controlTail);
+  }
+
+  std::unique_lock<std::mutex> guard(this->_lock);
+  this->_isWorkerParked.store(true); // seq_cst: a push after this point sees the flag, or is seen by the predicate
+  this->_dataPushed.wait(guard, [this, tail, controlTail]() {
+    return (this->_head.load() != tail || this->_controlHead.load() != controlTail || this->_isStopping.load());
+  });
+  this->_isWorkerParked.store(false);
+  return _isPending(tail, controlTail);
+}
+
+
+// -- producer -- --------------------------------------------------------------
+
+// Wait until the number of unprocessed words/control words is lower or equal to 'maxPendingSize'/'maxPendingControls'
+// (spin, then park)
+void CommandQueue::_waitForProgress(size_t maxPendingSize, size_t maxPendingControls) noexcept {
+  const size_t head = this->_head.load(std::memory_order_relaxed);
+  const size_t controlHead = this->_controlHead.load(std::memory_order_relaxed);
+  for (unsigned spin = 0; spin < spinCount(); ++spin) {
+    if (head - this->_tail.load(std::memory_order_acquire) <= maxPendingSize
+    &&  controlHead - this->_controlTail.load(std::memory_order_acquire) <= maxPendingControls)
+      return;
+  }
+
+  std::unique_lock<std::mutex> guard(this->_lock);
+  this->_isProducerParked.store(true); // seq_cst: progress after this point sees the flag, or is seen by the predicate
+  this->_dataProcessed.wait(guard, [this, head, controlHead, maxPendingSize, maxPendingControls]() {
+    return (head - this->_tail.load() <= maxPendingSize && controlHead - this->_controlTail.load() <= maxPendingControls);
+  });
+  this->_isProducerParked.store(false);
+}
+
+void CommandQueue::push(const uint32_t* words, size_t size) noexcept {
+  while (size) {
+    size_t head = this->_head.load(std::memory_order_relaxed);
+    size_t freeSize = capacity() - (head - this->_tail.load(std::memory_order_acquire));
+    if (freeSize == 0) { // ring full -> wait for worker
+      _waitForProgress(capacity() - 1u, controlCapacity());
+      continue;
+    }
+
+    size_t offset = (head & this->_mask);
+    size_t length = (size < freeSize) ? size : freeSize;
+    if (length > capacity() - offset) // copy until the end of the ring (rest copied at the beginning)
+      length = capacity() - offset;
+    memcpy((void*)&(this->_buffer[offset]), (const void*)words, length*sizeof(uint32_t));
+
+    this->_head.store(head + length); // seq_cst: ordered with 'isWorkerParked' check
+    if (this->_isWorkerParked.load()) {
+      std::lock_guard<std::mutex> guard(this->_lock);
+      this->_dataPushed.notify_one();
+    }
+    words += length;
+    size -= length;
+  }
+}
+
+void CommandQueue::pushControl(uint32_t value) noexcept {
+  const size_t controlHead = this->_controlHead.load(std::memory_order_relaxed);
+  if (controlHead - this->_controlTail.load(std::memory_order_acquire) >= controlCapacity()) // full -> wait for worker
+    _waitForProgress(capacity(), controlCapacity() - 1u);
+
+  ControlEntry& control = this->_controls[controlHead & (controlCapacity() - 1u)];
+  control.position = this->_head.load(std::memory_order_relaxed);
+  control.value = value;
+  this->_controlHead.store(controlHead + 1u); // seq_cst: ordered with 'isWorkerParked' check
+  if (this->_isWorkerParked.load()) {
+    std::lock_guard<std::mutex> guard(this->_lock);
+    this->_dataPushed.notify_one();
+  }
+}
+
+void CommandQueue::sync() noexcept {
+  if (this->_head.load(std::memory_order_relaxed) != this->_tail.load(std::memory_order_acquire)
+  ||  this->_controlHead.load(std::memory_order_relaxed) != this->_controlTail.load(std::memory_order_acquire))
+    _waitForProgress(0, 0);
+}
@@ -0,0 +1,247 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#include <cstddef>
+#include <cstdint>
+#include "display/draw_batcher.h"
+
+using namespace display;
+
+
+// -- helpers -- ---------------------------------------------------------------
+
+static inline DrawTopology __toTopology(DrawPrimitiveType type) noexcept {
+  switch (type) {
+    case DrawPrimitiveType::line:      return DrawTopology::lineList;
+    case DrawPrimitiveType::rectangle: return DrawTopology::rectangleInstances;
+    default:                           return DrawTopology::triangleList;
+  }
+}
+
+// Hash of render state attributes compared by 'isSameRenderState' (equal states -> equal hashes)
+static inline void __mixHash(uint64_t& hash, uint64_t value) noexcept {
+  hash = (hash ^ value) * 0x100000001B3uLL; // FNV-1a step (per attribute)
+}
+static uint64_t __hashRenderState(const RasterState& state) noexcept {
+  uint64_t hash = 0xCBF29CE484222325uLL;
+  __mixHash(hash, (uint64_t)state.clipArea.leftX);
+  __mixHash(hash, (uint64_t)state.clipArea.rightX);
+  __mixHash(hash, (uint64_t)state.clipArea.topY);
+  __mixHash(hash, (uint64_t)state.clipArea.bottomY);
+  __mixHash(hash, (uint64_t)state.forceMaskBit | ((uint64_t)state.checkMask << 16) | ((uint64_t)state.isDithered << 17)
+                | ((uint64_t)state.isSemiTransparent << 18) | ((uint64_t)state.isTextured << 19));
+  if (state.isSemiTransparent)
+    __mixHash(hash, (uint64_t)state.blendingMode);
+
+  if (state.isTextured) {
+    __mixHash(hash, (uint64_t)state.texpageX | ((uint64_t)state.texpageY << 16) | ((uint64_t)state.colorMode << 32)
+                  | ((uint64_t)state.isRawTexture << 40) | ((uint64_t)state.isTextureFlipX << 41)
+                  | ((uint64_t)state.isTextureFlipY << 42) | ((uint64_t)state.textureWindow.isEnabled << 43));
+    if (state.textureWindow.isEnabled) {
+      __mixHash(hash, (uint64_t)state.textureWindow.offsetX | ((uint64_t)state.textureWindow.offsetY << 16)
+                    | ((uint64_t)state.textureWindow.maskWidth << 32) | ((uint64_t)state.textureWindow.maskHeight << 48));
+    }
+    if (state.colorMode == TextureColorMode::lookupTable4bit || state.colorMode == TextureColorMode::lookupTable8bit)
+      __mixHash(hash, (uint64_t)state.clutX | ((uint64_t)state.clutY << 32));
+  }
+  return hash;
+}
+
+// ---
+
+// Verify if two render states can be drawn with the same draw call
+bool DrawBatcher::isSameRenderState(const RasterState& lhs, const RasterState& rhs) noexcept {
+  if (lhs.clipArea.leftX != rhs.clipArea.leftX || lhs.clipArea.rightX != rhs.clipArea.rightX
+  ||  lhs.clipArea.topY != rhs.clipArea.topY || lhs.clipArea.bottomY != rhs.clipArea.bottomY
+  ||  lhs.forceMaskBit != rhs.forceMaskBit || lhs.checkMask != rhs.checkMask
+  ||  lhs.isDithered != rhs.isDithered
+  ||  lhs.isSemiTransparent != rhs.isSemiTransparent || lhs.isTextured != rhs.isTextured)
+    return false;
+  if (lhs.isSemiTransparent && lhs.blendingMode != rhs.blendingMode)
+    return false;
+
+  if (lhs.isTextured) { // texture attributes only used by textured primitives
+    if (lhs.texpageX != rhs.texpageX || lhs.texpageY != rhs.texpageY || lhs.colorMode != rhs.colorMode
+    ||  lhs.isRawTexture != rhs.isRawTexture || lhs.isTextureFlipX != rhs.isTextureFlipX || lhs.isTextureFlipY != rhs.isTextureFlipY
+    ||  lhs.textureWindow.isEnabled != rhs.textureWindow.isEnabled)
+      return false;
+    if (lhs.textureWindow.isEnabled
+    && (lhs.textureWindow.offsetX != rhs.textureWindow.offsetX || lhs.textureWindow.offsetY != rhs.textureWindow.offsetY
+    ||  lhs.textureWindow.maskWidth != rhs.textureWindow.maskWidth || lhs.textureWindow.maskHeight != rhs.textureWindow.maskHeight))
+      return false;
+    if ((lhs.colorMode == TextureColorMode::lookupTable4bit || lhs.colorMode == TextureColorMode::lookupTable8bit)
+    && (lhs.clutX != rhs.clutX || lhs.clutY != rhs.clutY))
+      return false; // CLUT only used by 4-bit/8-bit textures
+  }
+  return true;
+}
+
+
+// -- batching -- --------------------------------------------------------------
+
+#define __DRAW_TOPOLOGY_COUNT  3u
+#define __NO_STATE_GROUP       0xFFFFFFFFu
+
+// Identify render state groups (identical render states of opaque primitives)
+void DrawBatcher::_findStateGroups(const DrawList& drawList) {
+  this->_stateGroups.assign(drawList.stateCount(), __NO_STATE_GROUP);
+  this->_groupStates.clear();
+  this->_nextGroups.clear();
+  this->_groupIndex.clear();
+  for (uint32_t stateIndex = 0; stateIndex < (uint32_t)drawList.stateCount(); ++stateIndex) {
+    const RasterState& state = drawList.state(stateIndex);
+    if (DrawList::isOrderDependent(state))
+      continue;
+
+    // find group with same hash + same render state (hash collisions chained)
+    const uint32_t newGroup = (uint32_t)this->_groupStates.size();
+    auto entry = this->_groupIndex.emplace(__hashRenderState(state), newGroup);
+    uint32_t group = entry.first->second;
+    if (!entry.second) {
+      while (!isSameRenderState(drawList.state(this->_groupStates[group]), state)) {
+        if (this->_nextGroups[group] == __NO_STATE_GROUP) {
+          this->_nextGroups[group] = newGroup;
+          group = newGroup;
+          break;
+        }
+        group = this->_nextGroups[group];
+      }
+    }
+    if (group == newGroup) {
+      this->_groupStates.push_back(stateIndex);
+      this->_nextGroups.push_back(__NO_STATE_GROUP);
+    }
+    this->_stateGroups[stateIndex] = group;
+  }
+}
+
+// Sort opaque primitives of range [begin; end[ by render state / topology (stable: painter's order kept in each group),
+// then append order-dependent primitives in submission order -> returns number of opaque primitives
+uint32_t DrawBatcher::_sortOpaquePrimitives(const DrawList& drawList, uint32_t begin, uint32_t end) {
+  // counting sort by group + topology
+  const DrawPrimitive* primitives = drawList.primitives();
+  this->_keyOffsets.assign(this->_groupStates.size()*__DRAW_TOPOLOGY_COUNT + 1u, 0);
+  this->_keyOffsets[0] = begin;
+  for (const DrawPrimitive* it = &primitives[begin]; it < &primitives[end]; ++it) {
+    const uint32_t group = this->_stateGroups[it->stateIndex];
+    if (group != __NO_STATE_GROUP)
+      ++(this->_keyOffsets[group*__DRAW_TOPOLOGY_COUNT + (uint32_t)__toTopology(it->type) + 1u]);
+  }
+  for (size_t key = 1u; key < this->_keyOffsets.size(); ++key)
+    this->_keyOffsets[key] += this->_keyOffsets[key - 1u];
+  const uint32_t opaqueCount = this->_keyOffsets.back() - begin;
+
+  uint32_t orderDependentIndex = begin + opaqueCount;
+  for (uint32_t i = begin; i < end; ++i) {
+    const uint32_t group = this->_stateGroups[primitives[i].stateIndex];
+    if (group != __NO_STATE_GROUP)
+      this->_order[this->_keyOffsets[group*__DRAW_TOPOLOGY_COUNT + (uint32_t)__toTopology(primitives[i].type)]++] = i;
+    else
+      this->_order[orderDependentIndex++] = i;
+  }
+  return opaqueCount;
+}
+
+// Create draw calls for a range of draw order
+void DrawBatcher::_appendBatches(const DrawList& drawList, uint32_t orderBegin, uint32_t orderEnd,
+                                 bool isIndexed, bool isReordered) {
+  DrawBatch* batch = nullptr;
+  uint32_t batchStateIndex = 0;
+  for (uint32_t i = orderBegin; i < orderEnd; ++i) {
+    const DrawPrimitive* primitive = &drawList.primitive(this->_order[i]);
+    const DrawTopology topology = __toTopology(primitive->type);
+
+    // new draw call on real state change only (same state index: identical attributes)
+    // + vertex range batches: only if vertices are contiguous (culled primitives leave gaps in vertex streams)
+    if (batch == nullptr || batch->topology != topology
+    || (primitive->stateIndex != batchStateIndex
+        && !isSameRenderState(drawList.state(batchStateIndex), drawList.state(primitive->stateIndex)))
+    || (!batch->isIndexed && primitive->firstVertex != batch->first + batch->count)) {
+      DrawBatch newBatch;
+      newBatch.topology = topology;
+      newBatch.stateIndex = primitive->stateIndex;
+      newBatch.firstPrimitive = i;
+      newBatch.isIndexed = (isIndexed || topology == DrawTopology::triangleList);
+      newBatch.isReordered = isReordered;
+      newBatch.first = newBatch.isIndexed ? (uint32_t)this->_indices.size() : primitive->firstVertex;
+      this->_batches.push_back(newBatch);
+      batch = &this->_batches.back();
+      batchStateIndex = primitive->stateIndex;
+    }
+    ++(batch->primitiveCount);
+
+    const uint32_t vertex = primitive->firstVertex;
+    switch (primitive->type) {
+      case DrawPrimitiveType::triangle:
+        this->_indices.insert(this->_indices.end(), { vertex, vertex + 1u, vertex + 2u });
+        batch->count += 3u;
+        break;
+      case DrawPrimitiveType::quad: // (v0,v1,v2) + (v1,v2,v3)
+        this->_indices.insert(this->_indices.end(), { vertex, vertex + 1u, vertex + 2u, vertex + 1u, vertex + 2u, vertex + 3u });
+        batch->count += 6u;
+        break;
+      case DrawPrimitiveType::line:
+        if (batch->isIndexed)
+          this->_indices.insert(this->_indices.end(), { vertex, vertex + 1u });
+        batch->count += 2u;
+        break;
+      default:
+        if (batch->isIndexed)
+          this->_indices.push_back(vertex);
+        batch->count += 1u;
+        break;
+    }
+  }
+}
+
+// Build draw calls for all primitives of a draw list (one frame) + update statistics
+void DrawBatcher::build(const DrawList& drawList, DrawOrder order) {
+  this->_batches.clear();
+  this->_indices.clear();
+
+  this->_barrierBatches.clear();
+
+  const size_t primitiveCount = drawList.size();
+  this->_order.resize(primitiveCount);
+  if (order == DrawOrder::stateSorted)
+    _findStateGroups(drawList);
+
+  // segments between barriers (VRAM writes): primitives never sorted/batched across them
+  uint32_t segmentBegin = 0;
+  for (size_t barrierIndex = 0; barrierIndex <= drawList.barrierCount(); ++barrierIndex) {
+    const uint32_t segmentEnd = (barrierIndex < drawList.barrierCount())
+                              ? drawList.barrier(barrierIndex).primitiveIndex : (uint32_t)primitiveCount;
+    if (segmentEnd > segmentBegin) {
+      if (order == DrawOrder::stateSorted) {
+        const uint32_t opaqueCount = _sortOpaquePrimitives(drawList, segmentBegin, segmentEnd);
+        _appendBatches(drawList, segmentBegin, segmentBegin + opaqueCount, true, true);
+        _appendBatches(drawList, segmentBegin + opaqueCount, segmentEnd, true, false);
+        this->_stats.reorderedPrimitiveCount += opaqueCount;
+      }
+      else {
+        for (uint32_t i = segmentBegin; i < segmentEnd; ++i)
+          this->_order[i] = i;
+        _appendBatches(drawList, segmentBegin, segmentEnd, false, false);
+      }
+      segmentBegin = segmentEnd;
+    }
+    if (barrierIndex < drawList.barrierCount())
+      this->_barrierBatches.push_back((uint32_t)this->_batches.size());
+  }
+
+  this->_stats.lastFrameBatchCount = (uint32_t)this->_batches.size();
+  this->_stats.lastFramePrimitiveCount = (uint32_t)primitiveCount;
+  this->_stats.batchCount += this->_batches.size();
+  this->_stats.primitiveCount += primitiveCount;
+  ++(this->_stats.frameCount);
+}
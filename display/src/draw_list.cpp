@@ -0,0 +1,500 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include "display/_private/_vram_kernels.h"
+#include "display/draw_list.h"
+
+using namespace display;
+
+
+// -- helpers -- ---------------------------------------------------------------
+
+// Compare rendering attributes of two draw states (decoded textures are resolved by consumers)
+static inline bool __isSameState(const RasterState& lhs, const RasterState& rhs) noexcept {
+  return (lhs.clipArea.leftX == rhs.clipArea.leftX && lhs.clipArea.rightX == rhs.clipArea.rightX
+       && lhs.clipArea.topY == rhs.clipArea.topY && lhs.clipArea.bottomY == rhs.clipArea.bottomY
+       && lhs.textureWindow.offsetX == rhs.textureWindow.offsetX && lhs.textureWindow.offsetY == rhs.textureWindow.offsetY
+       && lhs.textureWindow.maskWidth == rhs.textureWindow.maskWidth && lhs.textureWindow.maskHeight == rhs.textureWindow.maskHeight
+       && lhs.textureWindow.isEnabled == rhs.textureWindow.isEnabled
+       && lhs.texpageX == rhs.texpageX && lhs.texpageY == rhs.texpageY
+       && lhs.clutX == rhs.clutX && lhs.clutY == rhs.clutY
+       && lhs.colorMode == rhs.colorMode && lhs.blendingMode == rhs.blendingMode
+       && lhs.forceMaskBit == rhs.forceMaskBit && lhs.checkMask == rhs.checkMask
+       && lhs.isTextured == rhs.isTextured && lhs.isRawTexture == rhs.isRawTexture
+       && lhs.isShaded == rhs.isShaded && lhs.isSemiTransparent == rhs.isSemiTransparent
+       && lhs.isDithered == rhs.isDithered
+       && lhs.isTextureFlipX == rhs.isTextureFlipX && lhs.isTextureFlipY == rhs.isTextureFlipY);
+}
+
+
+// -- vertex decoding -- -------------------------------------------------------
+
+// Decode vertex coords: 11-bit sign extension + draw offset
+void DrawList::decodeVertexCoords(const uint32_t* coords, size_t count, const Point& drawOffset,
+                                  int32_t* outX, int32_t* outY) noexcept {
+# if defined(__DISPLAY_SIMD_AVX2)
+    const __m256i offsetX256 = _mm256_set1_epi32((int)drawOffset.x);
+    const __m256i offsetY256 = _mm256_set1_epi32((int)drawOffset.y);
+    for (; count >= 8u; count -= 8u, coords += 8, outX += 8, outY += 8) {
+      __m256i params = _mm256_loadu_si256((const __m256i*)coords);
+      _mm256_storeu_si256((__m256i*)outX, _mm256_add_epi32(_mm256_srai_epi32(_mm256_slli_epi32(params, 21), 21), offsetX256));
+      _mm256_storeu_si256((__m256i*)outY, _mm256_add_epi32(_mm256_srai_epi32(_mm256_slli_epi32(params, 5), 21), offsetY256));
+    }
+# endif
+# if defined(__DISPLAY_SIMD_SSE2)
+    const __m128i offsetX = _mm_set1_epi32((int)drawOffset.x);
+    const __m128i offsetY = _mm_set1_epi32((int)drawOffset.y);
+    for (; count >= 4u; count -= 4u, coords += 4, outX += 4, outY += 4) {
+      __m128i params = _mm_loadu_si128((const __m128i*)coords);
+      _mm_storeu_si128((__m128i*)outX, _mm_add_epi32(_mm_srai_epi32(_mm_slli_epi32(params, 21), 21), offsetX));
+      _mm_storeu_si128((__m128i*)outY, _mm_add_epi32(_mm_srai_epi32(_mm_slli_epi32(params, 5), 21), offsetY));
+    }
+# elif defined(__DISPLAY_SIMD_NEON)
+    const int32x4_t offsetX = vdupq_n_s32((int32_t)drawOffset.x);
+    const int32x4_t offsetY = vdupq_n_s32((int32_t)drawOffset.y);
+    for (; count >= 4u; count -= 4u, coords += 4, outX += 4, outY += 4) {
+      int32x4_t params = vreinterpretq_s32_u32(vld1q_u32(coords));
+      vst1q_s32(outX, vaddq_s32(vshrq_n_s32(vshlq_n_s32(params, 21), 21), offsetX));
+      vst1q_s32(outY, vaddq_s32(vshrq_n_s32(vshlq_n_s32(params, 5), 21), offsetY));
+    }
+# endif
+  for (; count; --count, ++coords, ++outX, ++outY) {
+    *outX = ((int32_t)(*coords << 21) >> 21) + (int32_t)drawOffset.x;
+    *outY = ((int32_t)(*coords << 5) >> 21) + (int32_t)drawOffset.y;
+  }
+}
+
+// Decode pending vertex coords (sign extension + draw offset)
+void DrawList::decodeVertices() noexcept {
+  const size_t pendingCount = this->_coords.size() - this->_decodedCount;
+  if (pendingCount) {
+    decodeVertexCoords(&this->_coords[this->_decodedCount], pendingCount, this->_drawOffset,
+                       &this->_x[this->_decodedCount], &this->_y[this->_decodedCount]);
+    this->_decodedCount = this->_coords.size();
+  }
+}
+
+
+// -- culling -- ---------------------------------------------------------------
+
+// Vertices/clip areas of 8 primitives (triangle A: vertices 0-1-2 / triangle B: vertices 1-2-3)
+struct CullLanes final {
+  alignas(32) int32_t x[4][8];
+  alignas(32) int32_t y[4][8];
+  alignas(32) int32_t clip[4][8];   // draw area: left, right, top, bottom (inclusive)
+  alignas(32) int32_t checkArea[8]; // -1: zero-area primitive culled (polygons/rectangles, not lines)
+  alignas(32) int32_t hasSecond[8]; // -1: triangle B drawn (quads/rectangles)
+};
+// Culled lanes (bit per primitive)
+struct CullMasks final {
+  uint32_t oversized = 0;
+  uint32_t degenerate = 0;
+  uint32_t outside = 0;
+};
+
+#if defined(__DISPLAY_SIMD_SSE2)
+  // Cull 4 primitives (lanes 'offset' to 'offset+3')
+  static inline void __cullPrimitiveLanes4(const CullLanes& lanes, int offset, CullMasks& outMasks) noexcept {
+    __m128i x[4], y[4];
+    for (int i = 0; i < 4; ++i) {
+      x[i] = _mm_load_si128((const __m128i*)&lanes.x[i][offset]);
+      y[i] = _mm_load_si128((const __m128i*)&lanes.y[i][offset]);
+    }
+    const __m128i maxWidth = _mm_set1_epi32((int)maxPolygonWidth()), minWidth = _mm_set1_epi32(-(int)maxPolygonWidth());
+    const __m128i maxHeight = _mm_set1_epi32((int)maxPolygonHeight()), minHeight = _mm_set1_epi32(-(int)maxPolygonHeight());
+#   define __IS_OVERSIZED(dx, dy) _mm_or_si128(_mm_or_si128(_mm_cmpgt_epi32(dx, maxWidth), _mm_cmplt_epi32(dx, minWidth)), \
+                                               _mm_or_si128(_mm_cmpgt_epi32(dy, maxHeight), _mm_cmplt_epi32(dy, minHeight)))
+    const __m128i dx01 = _mm_sub_epi32(x[1], x[0]), dx02 = _mm_sub_epi32(x[2], x[0]), dx12 = _mm_sub_epi32(x[2], x[1]);
+    const __m128i dx13 = _mm_sub_epi32(x[3], x[1]), dx23 = _mm_sub_epi32(x[3], x[2]);
+    const __m128i dy01 = _mm_sub_epi32(y[1], y[0]), dy02 = _mm_sub_epi32(y[2], y[0]), dy12 = _mm_sub_epi32(y[2], y[1]);
+    const __m128i dy13 = _mm_sub_epi32(y[3], y[1]), dy23 = _mm_sub_epi32(y[3], y[2]);
+    const __m128i oversizedA = _mm_or_si128(_mm_or_si128(__IS_OVERSIZED(dx01, dy01), __IS_OVERSIZED(dx02, dy02)), __IS_OVERSIZED(dx12, dy12));
+    const __m128i oversizedB = _mm_or_si128(_mm_or_si128(__IS_OVERSIZED(dx12, dy12), __IS_OVERSIZED(dx13, dy13)), __IS_OVERSIZED(dx23, dy23));
+#   undef __IS_OVERSIZED
+
+    // area (float: exact for polygons within size limit -> no 32-bit multiply with SSE2)
+    const __m128 areaA = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(dx01), _mm_cvtepi32_ps(dy02)), _mm_mul_ps(_mm_cvtepi32_ps(dy01), _mm_cvtepi32_ps(dx02)));
+    const __m128 areaB = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(dx12), _mm_cvtepi32_ps(dy13)), _mm_mul_ps(_mm_cvtepi32_ps(dy12), _mm_cvtepi32_ps(dx13)));
+    const __m128i checkArea = _mm_load_si128((const __m128i*)&lanes.checkArea[offset]);
+    const __m128i hasSecond = _mm_load_si128((const __m128i*)&lanes.hasSecond[offset]);
+    const __m128i isDroppedA = _mm_or_si128(oversizedA, _mm_and_si128(checkArea, _mm_castps_si128(_mm_cmpeq_ps(areaA, _mm_setzero_ps()))));
+    const __m128i isDroppedB = _mm_or_si128(_mm_andnot_si128(hasSecond, _mm_set1_epi32(-1)),
+                                            _mm_or_si128(oversizedB, _mm_and_si128(checkArea, _mm_castps_si128(_mm_cmpeq_ps(areaB, _mm_setzero_ps())))));
+    const __m128i isCulled = _mm_and_si128(isDroppedA, isDroppedB);
+    const __m128i isOversized = _mm_and_si128(isCulled, _mm_or_si128(oversizedA, _mm_and_si128(hasSecond, oversizedB)));
+
+    // bounding box outside of draw area
+    const __m128i clipLeft = _mm_load_si128((const __m128i*)&lanes.clip[0][offset]);
+    const __m128i clipRight = _mm_load_si128((const __m128i*)&lanes.clip[1][offset]);
+    const __m128i clipTop = _mm_load_si128((const __m128i*)&lanes.clip[2][offset]);
+    const __m128i clipBottom = _mm_load_si128((const __m128i*)&lanes.clip[3][offset]);
+    __m128i isLeft = _mm_cmplt_epi32(x[0], clipLeft), isRight = _mm_cmpgt_epi32(x[0], clipRight);
+    __m128i isAbove = _mm_cmplt_epi32(y[0], clipTop), isBelow = _mm_cmpgt_epi32(y[0], clipBottom);
+    for (int i = 1; i < 4; ++i) {
+      isLeft = _mm_and_si128(isLeft, _mm_cmplt_epi32(x[i], clipLeft));
+      isRight = _mm_and_si128(isRight, _mm_cmpgt_epi32(x[i], clipRight));
+      isAbove = _mm_and_si128(isAbove, _mm_cmplt_epi32(y[i], clipTop));
+      isBelow = _mm_and_si128(isBelow, _mm_cmpgt_epi32(y[i], clipBottom));
+    }
+    const __m128i isOutside = _mm_or_si128(_mm_or_si128(isLeft, isRight), _mm_or_si128(isAbove, isBelow));
+
+    const uint32_t culledBits = (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(isCulled));
+    const uint32_t oversizedBits = (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(isOversized));
+    outMasks.oversized |= (oversizedBits << offset);
+    outMasks.degenerate |= ((culledBits & ~oversizedBits) << offset);
+    outMasks.outside |= (((uint32_t)_mm_movemask_ps(_mm_castsi128_ps(isOutside)) & ~culledBits) << offset);
+  }
+#elif defined(__DISPLAY_SIMD_NEON)
+  static inline uint32_t __toLaneBits(uint32x4_t mask) noexcept {
+    const uint32_t laneBitsValues[4] = { 1u, 2u, 4u, 8u };
+    const uint32x4_t bits = vandq_u32(mask, vld1q_u32(laneBitsValues));
+    return (vgetq_lane_u32(bits, 0) | vgetq_lane_u32(bits, 1) | vgetq_lane_u32(bits, 2) | vgetq_lane_u32(bits, 3));
+  }
+  // Cull 4 primitives (lanes 'offset' to 'offset+3')
+  static inline void __cullPrimitiveLanes4(const CullLanes& lanes, int offset, CullMasks& outMasks) noexcept {
+    int32x4_t x[4], y[4];
+    for (int i = 0; i < 4; ++i) {
+      x[i] = vld1q_s32(&lanes.x[i][offset]);
+      y[i] = vld1q_s32(&lanes.y[i][offset]);
+    }
+    const int32x4_t maxWidth = vdupq_n_s32((int32_t)maxPolygonWidth()), maxHeight = vdupq_n_s32((int32_t)maxPolygonHeight());
+#   define __IS_OVERSIZED(dx, dy) vorrq_u32(vcgtq_s32(vabsq_s32(dx), maxWidth), vcgtq_s32(vabsq_s32(dy), maxHeight))
+    const int32x4_t dx01 = vsubq_s32(x[1], x[0]), dx02 = vsubq_s32(x[2], x[0]), dx12 = vsubq_s32(x[2], x[1]);
+    const int32x4_t dx13 = vsubq_s32(x[3], x[1]), dx23 = vsubq_s32(x[3], x[2]);
+    const int32x4_t dy01 = vsubq_s32(y[1], y[0]), dy02 = vsubq_s32(y[2], y[0]), dy12 = vsubq_s32(y[2], y[1]);
+    const int32x4_t dy13 = vsubq_s32(y[3], y[1]), dy23 = vsubq_s32(y[3], y[2]);
+    const uint32x4_t oversizedA = vorrq_u32(vorrq_u32(__IS_OVERSIZED(dx01, dy01), __IS_OVERSIZED(dx02, dy02)), __IS_OVERSIZED(dx12, dy12));
+    const uint32x4_t oversizedB = vorrq_u32(vorrq_u32(__IS_OVERSIZED(dx12, dy12), __IS_OVERSIZED(dx13, dy13)), __IS_OVERSIZED(dx23, dy23));
+#   undef __IS_OVERSIZED
+
+    const int32x4_t zero = vdupq_n_s32(0);
+    const uint32x4_t isZeroA = vceqq_s32(vsubq_s32(vmulq_s32(dx01, dy02), vmulq_s32(dy01, dx02)), zero);
+    const uint32x4_t isZeroB = vceqq_s32(vsubq_s32(vmulq_s32(dx12, dy13), vmulq_s32(dy12, dx13)), zero);
+    const uint32x4_t checkArea = vreinterpretq_u32_s32(vld1q_s32(&lanes.checkArea[offset]));
+    const uint32x4_t hasSecond = vreinterpretq_u32_s32(vld1q_s32(&lanes.hasSecond[offset]));
+    const uint32x4_t isCulled = vandq_u32(vorrq_u32(oversizedA, vandq_u32(checkArea, isZeroA)),
+                                          vorrq_u32(vmvnq_u32(hasSecond), vorrq_u32(oversizedB, vandq_u32(checkArea, isZeroB))));
+    const uint32x4_t isOversized = vandq_u32(isCulled, vorrq_u32(oversizedA, vandq_u32(hasSecond, oversizedB)));
+
+    const int32x4_t clipLeft = vld1q_s32(&lanes.clip[0][offset]), clipRight = vld1q_s32(&lanes.clip[1][offset]);
+    const int32x4_t clipTop = vld1q_s32(&lanes.clip[2][offset]), clipBottom = vld1q_s32(&lanes.clip[3][offset]);
+    uint32x4_t isLeft = vcltq_s32(x[0], clipLeft), isRight = vcgtq_s32(x[0], clipRight);
+    uint32x4_t isAbove = vcltq_s32(y[0], clipTop), isBelow = vcgtq_s32(y[0], clipBottom);
+    for (int i = 1; i < 4; ++i) {
+      isLeft = vandq_u32(isLeft, vcltq_s32(x[i], clipLeft));
+      isRight = vandq_u32(isRight, vcgtq_s32(x[i], clipRight));
+      isAbove = vandq_u32(isAbove, vcltq_s32(y[i], clipTop));
+      isBelow = vandq_u32(isBelow, vcgtq_s32(y[i], clipBottom));
+    }
+    const uint32x4_t isOutside = vorrq_u32(vorrq_u32(isLeft, isRight), vorrq_u32(isAbove, isBelow));
+
+    const uint32_t culledBits = __toLaneBits(isCulled);
+    const uint32_t oversizedBits = __toLaneBits(isOversized);
+    outMasks.oversized |= (oversizedBits << offset);
+    outMasks.degenerate |= ((culledBits & ~oversizedBits) << offset);
+    outMasks.outside |= ((__toLaneBits(isOutside) & ~culledBits) << offset);
+  }
+#endif
+
+// Cull 8 primitives: bounding boxes + areas of triangles A/B
+static inline void __cullPrimitiveLanes(const CullLanes& lanes, CullMasks& outMasks) noexcept {
+# if defined(__DISPLAY_SIMD_AVX2)
+    __m256i x[4], y[4];
+    for (int i = 0; i < 4; ++i) {
+      x[i] = _mm256_load_si256((const __m256i*)lanes.x[i]);
+      y[i] = _mm256_load_si256((const __m256i*)lanes.y[i]);
+    }
+    const __m256i maxWidth = _mm256_set1_epi32((int)maxPolygonWidth()), maxHeight = _mm256_set1_epi32((int)maxPolygonHeight());
+#   define __IS_OVERSIZED(dx, dy) _mm256_or_si256(_mm256_cmpgt_epi32(_mm256_abs_epi32(dx), maxWidth), \
+                                                  _mm256_cmpgt_epi32(_mm256_abs_epi32(dy), maxHeight))
+    const __m256i dx01 = _mm256_sub_epi32(x[1], x[0]), dx02 = _mm256_sub_epi32(x[2], x[0]), dx12 = _mm256_sub_epi32(x[2], x[1]);
+    const __m256i dx13 = _mm256_sub_epi32(x[3], x[1]), dx23 = _mm256_sub_epi32(x[3], x[2]);
+    const __m256i dy01 = _mm256_sub_epi32(y[1], y[0]), dy02 = _mm256_sub_epi32(y[2], y[0]), dy12 = _mm256_sub_epi32(y[2], y[1]);
+    const __m256i dy13 = _mm256_sub_epi32(y[3], y[1]), dy23 = _mm256_sub_epi32(y[3], y[2]);
+    const __m256i oversizedA = _mm256_or_si256(_mm256_or_si256(__IS_OVERSIZED(dx01, dy01), __IS_OVERSIZED(dx02, dy02)), __IS_OVERSIZED(dx12, dy12));
+    const __m256i oversizedB = _mm256_or_si256(_mm256_or_si256(__IS_OVERSIZED(dx12, dy12), __IS_OVERSIZED(dx13, dy13)), __IS_OVERSIZED(dx23, dy23));
+#   undef __IS_OVERSIZED
+
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i isZeroA = _mm256_cmpeq_epi32(_mm256_sub_epi32(_mm256_mullo_epi32(dx01, dy02), _mm256_mullo_epi32(dy01, dx02)), zero);
+    const __m256i isZeroB = _mm256_cmpeq_epi32(_mm256_sub_epi32(_mm256_mullo_epi32(dx12, dy13), _mm256_mullo_epi32(dy12, dx13)), zero);
+    const __m256i checkArea = _mm256_load_si256((const __m256i*)lanes.checkArea);
+    const __m256i hasSecond = _mm256_load_si256((const __m256i*)lanes.hasSecond);
+    const __m256i isCulled = _mm256_and_si256(_mm256_or_si256(oversizedA, _mm256_and_si256(checkArea, isZeroA)),
+                                              _mm256_or_si256(_mm256_andnot_si256(hasSecond, _mm256_set1_epi32(-1)),
+                                                              _mm256_or_si256(oversizedB, _mm256_and_si256(checkArea, isZeroB))));
+    const __m256i isOversized = _mm256_and_si256(isCulled, _mm256_or_si256(oversizedA, _mm256_and_si256(hasSecond, oversizedB)));
+
+    const __m256i clipLeft = _mm256_load_si256((const __m256i*)lanes.clip[0]);
+    const __m256i clipRight = _mm256_load_si256((const __m256i*)lanes.clip[1]);
+    const __m256i clipTop = _mm256_load_si256((const __m256i*)lanes.clip[2]);
+    const __m256i clipBottom = _mm256_load_si256((const __m256i*)lanes.clip[3]);
+    const __m256i minX = _mm256_min_epi32(_mm256_min_epi32(x[0], x[1]), _mm256_min_epi32(x[2], x[3]));
+    const __m256i maxX = _mm256_max_epi32(_mm256_max_epi32(x[0], x[1]), _mm256_max_epi32(x[2], x[3]));
+    const __m256i minY = _mm256_min_epi32(_mm256_min_epi32(y[0], y[1]), _mm256_min_epi32(y[2], y[3]));
+    const __m256i maxY = _mm256_max_epi32(_mm256_max_epi32(y[0], y[1]), _mm256_max_epi32(y[2], y[3]));
+    const __m256i isOutside = _mm256_or_si256(_mm256_or_si256(_mm256_cmpgt_epi32(clipLeft, maxX), _mm256_cmpgt_epi32(minX, clipRight)),
+                                              _mm256_or_si256(_mm256_cmpgt_epi32(clipTop, maxY), _mm256_cmpgt_epi32(minY, clipBottom)));
+
+    const uint32_t culledBits = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(isCulled));
+    outMasks.oversized = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(isOversized));
+    outMasks.degenerate = (culledBits & ~outMasks.oversized);
+    outMasks.outside = ((uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(isOutside)) & ~culledBits);
+# elif defined(__DISPLAY_SIMD_SSE2) || defined(__DISPLAY_SIMD_NEON)
+    __cullPrimitiveLanes4(lanes, 0, outMasks);
+    __cullPrimitiveLanes4(lanes, 4, outMasks);
+# else
+    for (uint32_t lane = 0; lane < 8u; ++lane) {
+      const int32_t* x[4] = { &lanes.x[0][lane], &lanes.x[1][lane], &lanes.x[2][lane], &lanes.x[3][lane] };
+      const int32_t* y[4] = { &lanes.y[0][lane], &lanes.y[1][lane], &lanes.y[2][lane], &lanes.y[3][lane] };
+      bool isOversized[2], isDropped[2];
+      for (int tri = 0; tri < 2; ++tri) { // triangle A: 0-1-2 / B: 1-2-3
+        const int32_t ax = *x[tri], ay = *y[tri], bx = *x[tri + 1], by = *y[tri + 1], cx = *x[tri + 2], cy = *y[tri + 2];
+        isOversized[tri] = (abs(bx - ax) > (int32_t)maxPolygonWidth() || abs(cx - ax) > (int32_t)maxPolygonWidth()
+                         || abs(cx - bx) > (int32_t)maxPolygonWidth() || abs(by - ay) > (int32_t)maxPolygonHeight()
+                         || abs(cy - ay) > (int32_t)maxPolygonHeight() || abs(cy - by) > (int32_t)maxPolygonHeight());
+        isDropped[tri] = (isOversized[tri] || (lanes.checkArea[lane] && (bx - ax)*(cy - ay) == (by - ay)*(cx - ax)));
+      }
+      const bool hasSecond = (lanes.hasSecond[lane] != 0);
+      if (isDropped[0] && (!hasSecond || isDropped[1])) {
+        if (isOversized[0] || (hasSecond && isOversized[1]))
+          outMasks.oversized |= (1u << lane);
+        else
+          outMasks.degenerate |= (1u << lane);
+        continue;
+      }
+      bool isLeft = true, isRight = true, isAbove = true, isBelow = true;
+      for (int i = 0; i < 4; ++i) {
+        isLeft &= (*x[i] < lanes.clip[0][lane]);
+        isRight &= (*x[i] > lanes.clip[1][lane]);
+        isAbove &= (*y[i] < lanes.clip[2][lane]);
+        isBelow &= (*y[i] > lanes.clip[3][lane]);
+      }
+      if (isLeft || isRight || isAbove || isBelow)
+        outMasks.outside |= (1u << lane);
+    }
+# endif
+}
+
+// Count culled lanes
+static inline uint64_t __countLanes(uint32_t laneBits) noexcept {
+  laneBits = laneBits - ((laneBits >> 1) & 0x55u);
+  laneBits = (laneBits & 0x33u) + ((laneBits >> 2) & 0x33u);
+  return (uint64_t)((laneBits + (laneBits >> 4)) & 0x0Fu);
+}
+
+// ---
+
+// Remove primitives that can't produce any pixel + update culling statistics
+void DrawList::cullPrimitives() noexcept {
+  decodeVertices();
+
+  CullLanes lanes;
+  const int32_t* x = this->_x.data();
+  const int32_t* y = this->_y.data();
+  DrawPrimitive* primitives = this->_primitives.data();
+  const size_t primitiveCount = this->_primitives.size();
+  size_t keptCount = 0;
+  DrawBarrier* barrier = this->_barriers.data();
+  DrawBarrier* barrierEnd = barrier + this->_barriers.size();
+  for (size_t first = 0; first < primitiveCount; first += 8u) {
+    const uint32_t laneCount = (primitiveCount - first >= 8u) ? 8u : (uint32_t)(primitiveCount - first);
+
+    // gather vertices + clip areas (unused vertices: copies of previous ones / unused lanes: copies of first lane)
+    for (uint32_t lane = 0; lane < 8u; ++lane) {
+      const DrawPrimitive& primitive = primitives[first + ((lane < laneCount) ? lane : 0)];
+      const uint32_t vertex = primitive.firstVertex;
+      int32_t* laneX[4] = { &lanes.x[0][lane], &lanes.x[1][lane], &lanes.x[2][lane], &lanes.x[3][lane] };
+      int32_t* laneY[4] = { &lanes.y[0][lane], &lanes.y[1][lane], &lanes.y[2][lane], &lanes.y[3][lane] };
+      switch (primitive.type) {
+        case DrawPrimitiveType::triangle:
+          *laneX[0] = x[vertex]; *laneX[1] = x[vertex + 1u]; *laneX[2] = *laneX[3] = x[vertex + 2u];
+          *laneY[0] = y[vertex]; *laneY[1] = y[vertex + 1u]; *laneY[2] = *laneY[3] = y[vertex + 2u];
+          lanes.checkArea[lane] = -1;
+          lanes.hasSecond[lane] = 0;
+          break;
+        case DrawPrimitiveType::quad:
+          for (uint32_t i = 0; i < 4u; ++i) {
+            *laneX[i] = x[vertex + i];
+            *laneY[i] = y[vertex + i];
+          }
+          lanes.checkArea[lane] = lanes.hasSecond[lane] = -1;
+          break;
+        case DrawPrimitiveType::line:
+          *laneX[0] = x[vertex]; *laneX[1] = *laneX[2] = *laneX[3] = x[vertex + 1u];
+          *laneY[0] = y[vertex]; *laneY[1] = *laneY[2] = *laneY[3] = y[vertex + 1u];
+          lanes.checkArea[lane] = lanes.hasSecond[lane] = 0;
+          break;
+        default: // rectangle (corners: exclusive right/bottom -> conservative)
+          *laneX[0] = *laneX[2] = x[vertex];
+          *laneX[1] = *laneX[3] = x[vertex] + (int32_t)primitive.width;
+          *laneY[0] = *laneY[1] = y[vertex];
+          *laneY[2] = *laneY[3] = y[vertex] + (int32_t)primitive.height;
+          lanes.checkArea[lane] = lanes.hasSecond[lane] = -1;
+          break;
+      }
+      const Rectangle& clipArea = this->_states[primitive.stateIndex].clipArea;
+      lanes.clip[0][lane] = (int32_t)clipArea.leftX;
+      lanes.clip[1][lane] = (int32_t)clipArea.rightX;
+      lanes.clip[2][lane] = (int32_t)clipArea.topY;
+      lanes.clip[3][lane] = (int32_t)clipArea.bottomY;
+    }
+
+    CullMasks masks;
+    __cullPrimitiveLanes(lanes, masks);
+    const uint32_t laneMask = (1u << laneCount) - 1u;
+    masks.oversized &= laneMask;
+    masks.degenerate &= laneMask;
+    masks.outside &= laneMask;
+    this->_cullStats.oversizedCount += __countLanes(masks.oversized);
+    this->_cullStats.degenerateCount += __countLanes(masks.degenerate);
+    this->_cullStats.outsideCount += __countLanes(masks.outside);
+
+    // stable compaction of remaining primitives
+    const uint32_t culledBits = (masks.oversized | masks.degenerate | masks.outside);
+    for (uint32_t lane = 0; lane < laneCount; ++lane) {
+      for (; barrier < barrierEnd && barrier->primitiveIndex <= (uint32_t)(first + lane); ++barrier)
+        barrier->primitiveIndex = (uint32_t)keptCount;
+      if ((culledBits & (1u << lane)) == 0)
+        primitives[keptCount++] = primitives[first + lane];
+    }
+  }
+  for (; barrier < barrierEnd; ++barrier) // barriers after last primitive
+    barrier->primitiveIndex = (uint32_t)keptCount;
+  this->_cullStats.primitiveCount += primitiveCount;
+  this->_primitives.resize(keptCount);
+}
+
+
+// -- draw list -- -------------------------------------------------------------
+
+// Add primitive and reserve its vertices
+uint32_t DrawList::addPrimitive(DrawPrimitiveType type, const RasterState& state, uint32_t vertexCount,
+                                const Point& drawOffset, uint16_t width, uint16_t height) {
+  if (drawOffset.x != this->_drawOffset.x || drawOffset.y != this->_drawOffset.y) { // pending vertices use previous offset
+    decodeVertices();
+    this->_drawOffset = drawOffset;
+  }
+  if (this->_states.empty() || !__isSameState(this->_states.back(), state))
+    this->_states.push_back(state);
+
+  DrawPrimitive primitive;
+  primitive.firstVertex = (uint32_t)this->_coords.size();
+  primitive.stateIndex = (uint32_t)this->_states.size() - 1u;
+  primitive.depth = (uint32_t)this->_primitives.size() + 1u; // painter's order (0: cleared depth)
+  primitive.type = type;
+  primitive.width = width;
+  primitive.height = height;
+  this->_primitives.push_back(primitive);
+
+  const size_t vertexEnd = this->_coords.size() + vertexCount;
+  this->_coords.resize(vertexEnd);
+  this->_x.resize(vertexEnd);
+  this->_y.resize(vertexEnd);
+  this->_colors.resize(vertexEnd);
+  this->_u.resize(vertexEnd);
+  this->_v.resize(vertexEnd);
+  return primitive.firstVertex;
+}
+
+// Add barrier after current primitives (VRAM modified outside of primitives)
+void DrawList::addBarrier(DrawBarrierType type, const Rectangle& area, uint32_t color) {
+  DrawBarrier barrier;
+  barrier.primitiveIndex = (uint32_t)this->_primitives.size();
+  barrier.type = type;
+  barrier.area = area;
+  barrier.color = color & 0xFFFFFFu;
+  this->_barriers.push_back(barrier);
+}
+
+// Merge rectangle with last primitive if they form a horizontal run (tilemaps)
+bool DrawList::mergeRectangle(const RasterState& state, const Point& drawOffset, uint32_t coords, uint32_t color,
+                              uint32_t u, uint32_t v, uint16_t width, uint16_t height) noexcept {
+  if (this->_primitives.empty() || drawOffset.x != this->_drawOffset.x || drawOffset.y != this->_drawOffset.y
+  || (!this->_barriers.empty() && (size_t)this->_barriers.back().primitiveIndex == this->_primitives.size())) // not across barrier
+    return false;
+  DrawPrimitive& last = this->_primitives.back();
+  if (last.type != DrawPrimitiveType::rectangle || last.height != height
+  || (size_t)last.stateIndex + 1u != this->_states.size() || !__isSameState(this->_states.back(), state))
+    return false;
+
+  const uint32_t vertex = last.firstVertex;
+  const uint32_t lastCoords = this->_coords[vertex];
+  if (((int32_t)(coords << 21) >> 21) != ((int32_t)(lastCoords << 21) >> 21) + (int32_t)last.width // next position
+  || ((coords ^ lastCoords) & 0x07FF0000u) != 0                                                   // same row
+  || (color & 0xFFFFFFu) != this->_colors[vertex]
+  || (long)last.width + (long)width > maxPolygonWidth())
+    return false;
+  if (state.isTextured // contiguous texture coords (within 8-bit range, not flipped)
+  && (state.isTextureFlipX || (uint32_t)this->_u[vertex] + last.width != u || (uint32_t)this->_v[vertex] != v || u + width > 256u))
+    return false;
+
+  last.width = (uint16_t)(last.width + width);
+  ++(this->_mergedTileCount);
+  return true;
+}
+
+// Remove all primitives (start of new frame) -- allocated memory is kept
+void DrawList::clear() noexcept {
+  this->_primitives.clear();
+  this->_states.clear();
+  this->_barriers.clear();
+  this->_coords.clear();
+  this->_x.clear();
+  this->_y.clear();
+  this->_colors.clear();
+  this->_u.clear();
+  this->_v.clear();
+  this->_decodedCount = 0;
+  this->_mergedTileCount = 0;
+}
+
+// ---
+
+// Rasterize primitives in range with software rasterizer
+template <unsigned long _Height>
+void DrawList::rasterize(Vram<_Height>& vram, size_t first, size_t end) noexcept {
+  decodeVertices();
+  RasterVertex vertices[4];
+  for (size_t i = first; i < end; ++i) {
+    const DrawPrimitive& primitive = this->_primitives[i];
+    const RasterState& state = this->_states[primitive.stateIndex];
+    switch (primitive.type) {
+      case DrawPrimitiveType::triangle:
+        for (uint32_t vertex = 0; vertex < 3u; ++vertex)
+          readVertex(primitive.firstVertex + vertex, vertices[vertex]);
+        Rasterizer::drawTriangle(vram, state, vertices[0], vertices[1], vertices[2]);
+        break;
+      case DrawPrimitiveType::quad:
+        for (uint32_t vertex = 0; vertex < 4u; ++vertex)
+          readVertex(primitive.firstVertex + vertex, vertices[vertex]);
+        Rasterizer::drawQuad(vram, state, vertices);
+        break;
+      case DrawPrimitiveType::line:
+        readVertex(primitive.firstVertex, vertices[0]);
+        readVertex(primitive.firstVertex + 1u, vertices[1]);
+        Rasterizer::drawLine(vram, state, vertices[0], vertices[1]);
+        break;
+      case DrawPrimitiveType::rectangle: // sprite/tile (1:1 texture mapping)
+        readVertex(primitive.firstVertex, vertices[0]);
+        Rasterizer::drawRectangle(vram, state, vertices[0], (long)primitive.width, (long)primitive.height);
+        break;
+      default: break;
+    }
+  }
+}
+template void DrawList::rasterize<psxVramHeight()>(Vram<psxVramHeight()>&, size_t, size_t) noexcept;
+template void DrawList::rasterize<znArcadeVramHeight()>(Vram<znArcadeVramHeight()>&, size_t, size_t) noexcept;
@@ -0,0 +1,27 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#include <cstddef>
+#include <cstdint>
+#include "display/_private/_pixel_write.h"
+#include "display/pixel_writer.h"
+
+using namespace display;
+
+
+void PixelWriter::writeSpan(uint16_t* dest, const uint16_t* colors, const uint16_t* writeMask,
+                            size_t length, const PixelWriteMode& mode) noexcept {
+  PixelSpanWriter writer = getPixelSpanWriter(mode.blendingMode, mode.isSemiTransparent, mode.isStpGated,
+                                              mode.checkMask, (writeMask != nullptr));
+  writer(dest, colors, writeMask, length, mode.forceMaskBit);
+}
@@ -13,17 +13,35 @@ GNU General Public License for more details (LICENSE file).
 *******************************************************************************/
 #include <cstddef>
 #include <cstring>
+#include <memory>
+#include <new>
+#include <system/align.h>
 #include <system/preprocessor_tools.h>
 #include "display/status_register.h"
 #include "display/renderer.h"
+#include "display/vram.h"
+#include "display/vram_transfer.h"
+#include "display/rasterizer.h"
+#include "display/texture_cache.h"
+#include "display/tiled_rasterizer.h"
+#include "display/_private/_vram_kernels.h"
+#include "display/_private/_command_scan.h"
 #include "display/primitives.h"
 #if !defined(_CPP_REVISION) || _CPP_REVISION != 14
 # define __if_constexpr if constexpr
 #else
 # define __if_constexpr if
 #endif
-#define __MAX_GP0_PARAMS_LENGTH 0xFF
-#define __MAX_INT32 0x7FFFFFFF
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+# include <xmmintrin.h>
+# define __prefetchGp0Params(address) _mm_prefetch((const char*)(address), _MM_HINT_T0)
+#elif defined(__GNUC__) || defined(__clang__)
+# define __prefetchGp0Params(address) __builtin_prefetch((const void*)(address), 0, 3)
+#else
+# define __prefetchGp0Params(address)
+#endif
+#define __GP0_PREFETCH_DISTANCE 16 // words (one cache line ahead: bigger than longest fixed-size command)
 
 using namespace display;
 
@@ -50,122 +68,573 @@ static constexpr inline bool hasGp0CommandBit(Gp0DrawCmdBit id, Gp0DrawCmdBit bi
 
 // -- GP0 commands - general -- ------------------------------------------------
 
-static void clearTextureCache(StatusRegister&, Renderer&, uint32_t*) noexcept {
+// -> decoded textures are validated with VRAM generation stamps: modified textures are already re-decoded when used
+template <unsigned long _VramHeight>
+static void clearTextureCache(Gp0Parser&, StatusRegister&, Renderer&, Vram<_VramHeight>&, uint32_t*) noexcept {}
+
+// Verify if a fill area contains an entire rectangle (inclusive boundaries)
+static inline bool __isAreaFilled(unsigned long x, unsigned long y, unsigned long width, unsigned long height,
+                                  long leftX, long topY, long rightX, long bottomY) noexcept {
+  return (rightX >= leftX && bottomY >= topY
+       && (long)x <= leftX && rightX < (long)(x + width)
+       && (long)y <= topY && bottomY < (long)(y + height));
+}
+
+// Record VRAM write between primitives in draw list (primitives are never reordered/batched across it)
+static inline void __recordVramWrite(DrawList* drawList, unsigned long x, unsigned long y,
+                                     unsigned long width, unsigned long height) noexcept {
+  if (drawList != nullptr) {
+    try {
+      drawList->addBarrier(DrawBarrierType::vramWrite, Rectangle{ (long)x, (long)(x + width - 1u), (long)y, (long)(y + height - 1u) });
+    }
+    catch (...) {} // allocation failure -> barrier not recorded
+  }
+}
 
+// Record render target clear in draw list -> returns false if not recorded (no draw list / allocation failure)
+static inline bool __recordVramClear(DrawList* drawList, const Rectangle& area, uint32_t color) noexcept {
+  if (drawList != nullptr) {
+    try {
+      drawList->addBarrier(DrawBarrierType::clear, area, color);
+      return true;
+    }
+    catch (...) {}
+  }
+  return false;
 }
 
-static void fillVramRectangle(StatusRegister&, Renderer&, uint32_t*) noexcept {
+// Fill rectangle in VRAM with a color (not affected by mask settings, draw area and draw offset)
+template <unsigned long _VramHeight>
+static void fillVramRectangle(Gp0Parser& parser, StatusRegister& status, Renderer& renderer, Vram<_VramHeight>& vram, uint32_t* params) noexcept {
+  parser.flushPrimitives();
+  unsigned long x = ((unsigned long)params[1] & 0x3F0u);                                    // rounded to 16 texels
+  unsigned long y = (((unsigned long)params[1] >> 16) & (_VramHeight - 1u));
+  unsigned long width = ((((unsigned long)params[2] & 0x3FFu) + 0xFu) & ~(unsigned long)0xFu); // rounded to 16 texels
+  unsigned long height = (((unsigned long)params[2] >> 16) & (_VramHeight - 1u));
+  if (width == 0 || height == 0)
+    return;
+  uint16_t color = (uint16_t)( (((unsigned long)params[0] >> 3) & 0x1Fu)           // red
+                             | (((unsigned long)params[0] >> 6) & 0x3E0u)          // green
+                             | (((unsigned long)params[0] >> 9) & 0x7C00u) );      // blue
+
+  // fill lines (x and width are multiples of 16 -> wrap-around segments remain aligned)
+  unsigned long firstLength = vramWidth() - x;
+  if (firstLength > width)
+    firstLength = width;
+  for (unsigned long row = y; row < y + height; ++row) {
+    uint16_t* destRow = vram.row(row);
+    fillVramSpan(destRow + (intptr_t)x, firstLength, color);
+    if (firstLength < width)
+      fillVramSpan(destRow, width - firstLength, color); // wrap around
+  }
 
+  // full-screen clear (entire display area or draw area) -> single render-target clear (no upload needed),
+  // recorded in draw list if available (applied in submission order, between previous and next primitives)
+  // -> marked dirty if the clear couldn't be recorded nor applied by the renderer (VRAM area uploaded instead)
+  const DisplayState& displayState = status.getDisplayState();
+  const Rectangle& drawArea = displayState.drawArea;
+  Rectangle displayArea{ displayState.displayOrigin.x, displayState.displayOrigin.x + displayState.displayAreaSize.x - 1,
+                         displayState.displayOrigin.y, displayState.displayOrigin.y + displayState.displayAreaSize.y - 1 };
+  if (x + width <= vramWidth() && y + height <= _VramHeight // no wrap-around
+  && (__isAreaFilled(x, y, width, height, displayArea.leftX, displayArea.topY, displayArea.rightX, displayArea.bottomY)
+  ||  __isAreaFilled(x, y, width, height, drawArea.leftX, drawArea.topY, drawArea.rightX, drawArea.bottomY) )) {
+    const Rectangle clearArea{ (long)x, (long)(x + width - 1u), (long)y, (long)(y + height - 1u) };
+    if (__recordVramClear(parser.drawList(), clearArea, (uint32_t)params[0])
+    ||  renderer.clearRenderTarget(clearArea, (uint32_t)params[0] & 0xFFFFFFu))
+      vram.markSynchronized(x, y, width, height);
+    else
+      vram.markDirty(x, y, width, height);
+  }
+  else {
+    vram.markDirty(x, y, width, height);
+    __recordVramWrite(parser.drawList(), x, y, width, height);
+  }
 }
 
-static void requestIrq1(StatusRegister& status, Renderer&, uint32_t*) noexcept {
+template <unsigned long _VramHeight>
+static void requestIrq1(Gp0Parser&, StatusRegister& status, Renderer&, Vram<_VramHeight>&, uint32_t*) noexcept {
   status.setIrq1();
 }
 
 
 // -- GP0 commands - primitives -- ---------------------------------------------
 
-template <Gp0DrawCmdBit _CmdId>
-static void drawTriangle(StatusRegister&, Renderer&, uint32_t*) noexcept {
-  __if_constexpr (hasGp0CommandBit(_CmdId, Gp0DrawCmdBit::textured)) {
+// Sign-extend 11-bit vertex coords + apply draw offset
+static inline void __readVertexCoords(const StatusRegister& status, uint32_t param, RasterVertex& outVertex) noexcept {
+  const Point& drawOffset = status.getDisplayState().drawOffset;
+  outVertex.x = (long)((int32_t)(param << 21) >> 21) + drawOffset.x;
+  outVertex.y = (long)((int32_t)(param << 5) >> 21) + drawOffset.y;
+}
 
+// Read rendering attributes used by primitives
+template <unsigned long _VramHeight, Gp0DrawCmdBit _CmdId>
+static inline void __readRasterState(const StatusRegister& status, RasterState& outState) noexcept {
+  outState.clipArea = status.getDisplayState().drawArea;
+  outState.textureWindow = status.getTextureWindow();
+  outState.texpageX = status.getTexpageBaseX();
+  outState.texpageY = status.getTexpageBaseY();
+  if (status.getGpuVersion() != GpuVersion::arcadeGpu2) {
+    outState.colorMode = (TextureColorMode)status.readStatus(StatusBits::texturePageColors);
+    outState.blendingMode = (BlendingMode)status.readStatus(StatusBits::semiTransparency);
+    outState.isDithered = status.readStatus<bool>(StatusBits::dithering);
   }
   else {
-    
+    outState.colorMode = (TextureColorMode)(status.readStatus(StatusBits::arcade2_texturePageColors) >> 2);
+    outState.blendingMode = (BlendingMode)(status.readStatus(StatusBits::arcade2_semiTransparency) >> 2);
+    outState.isDithered = false;
   }
+  outState.forceMaskBit = status.readStatus(StatusBits::forceSetMaskBit) ? vramMaskBit() : 0;
+  outState.checkMask = status.readStatus<bool>(StatusBits::enableMask);
+
+  outState.isTextured = (hasGp0CommandBit(_CmdId, Gp0DrawCmdBit::textured) && !status.areTexturesDisabled());
+  outState.isRawTexture = hasGp0CommandBit(_CmdId, Gp0DrawCmdBit::noTextureBlending);
+  outState.isShaded = hasGp0CommandBit(_CmdId, Gp0DrawCmdBit::shaded);
+  outState.isSemiTransparent = hasGp0CommandBit(_CmdId, Gp0DrawCmdBit::semiTransparent);
 }
 
-template <Gp0DrawCmdBit _CmdId>
-static void drawQuad(StatusRegister&, Renderer&, uint32_t*) noexcept {
-  __if_constexpr (hasGp0CommandBit(_CmdId, Gp0DrawCmdBit::textured)) {
+// Read polygon vertices + rendering attributes (texture page attribute of textured polygons updates status register)
+template <unsigned long _VramHeight, Gp0DrawCmdBit _CmdId, size_t _VertexCount>
+static inline void __readPolygon(StatusRegister& status, const uint32_t* params,
+                                 RasterState& outState, RasterVertex* outVertices) noexcept {
+  constexpr const size_t colorLength = hasGp0CommandBit(_CmdId, Gp0DrawCmdBit::shaded) ? 1 : 0;
+  constexpr const size_t texCoordLength = hasGp0CommandBit(_CmdId, Gp0DrawCmdBit::textured) ? 1 : 0;
+  constexpr const size_t vertexLength = colorLength + 1u + texCoordLength;
+  const uint32_t* vertexParams = params + (intptr_t)(1u - colorLength); // flat: color only in first param
 
+  __if_constexpr (hasGp0CommandBit(_CmdId, Gp0DrawCmdBit::textured)) {
+    status.setPolygonTexturePage((unsigned long)(vertexParams[vertexLength + colorLength + 1u] >> 16));
   }
-  else {
-    
+  __readRasterState<_VramHeight,_CmdId>(status, outState);
+
+  for (size_t i = 0; i < _VertexCount; ++i, vertexParams += (intptr_t)vertexLength) {
+    RasterVertex& vertex = outVertices[i];
+    vertex.color = (colorLength ? vertexParams[0] : params[0]) & 0xFFFFFFu;
+    __readVertexCoords(status, vertexParams[colorLength], vertex);
+    __if_constexpr (hasGp0CommandBit(_CmdId, Gp0DrawCmdBit::textured)) {
+      vertex.u = (vertexParams[colorLength + 1u] & 0xFFu);
+      vertex.v = ((vertexParams[colorLength + 1u] >> 8) & 0xFFu);
+    }
+  }
+  __if_constexpr (hasGp0CommandBit(_CmdId, Gp0DrawCmdBit::textured)) {
+    uint32_t clut = (params[2] >> 16);
+    outState.clutX = (long)((clut & 0x3Fu) << 4);
+    outState.clutY = (long)((clut >> 6) & (_VramHeight - 1u));
   }
 }
 
-// ---
-
-static constexpr inline bool isGp0PolyLineTermination(uint32_t param) noexcept {
-  return ((param & 0xF000F000) == 0x50005000);
+// Record polygon in draw list (raw vertex params -> vertex streams)
+template <Gp0DrawCmdBit _CmdId, size_t _VertexCount>
+static inline void __recordPolygon(DrawList& drawList, const StatusRegister& status, const RasterState& state,
+                                   const uint32_t* params) noexcept {
+  constexpr const size_t colorLength = hasGp0CommandBit(_CmdId, Gp0DrawCmdBit::shaded) ? 1 : 0;
+  constexpr const size_t texCoordLength = hasGp0CommandBit(_CmdId, Gp0DrawCmdBit::textured) ? 1 : 0;
+  constexpr const size_t vertexLength = colorLength + 1u + texCoordLength;
+  const uint32_t* vertexParams = params + (intptr_t)(1u - colorLength);
+  try {
+    uint32_t index = drawList.addPrimitive((_VertexCount == 3) ? DrawPrimitiveType::triangle : DrawPrimitiveType::quad,
+                                           state, (uint32_t)_VertexCount, status.getDisplayState().drawOffset);
+    for (size_t i = 0; i < _VertexCount; ++i, ++index, vertexParams += (intptr_t)vertexLength) {
+      uint32_t texCoords = texCoordLength ? vertexParams[colorLength + 1u] : 0;
+      drawList.setVertex(index, vertexParams[colorLength], colorLength ? vertexParams[0] : params[0],
+                         (texCoords & 0xFFu), ((texCoords >> 8) & 0xFFu));
+    }
+  }
+  catch (...) {} // allocation failure -> primitive not recorded (still rendered)
 }
 
-template <Gp0DrawCmdBit _CmdId>
-static void drawLine(StatusRegister&, Renderer&, uint32_t*) noexcept {
-
+// Verify if two areas overlap (empty areas never overlap)
+static inline bool __intersects(const Rectangle& a, const Rectangle& b) noexcept {
+  return (a.leftX <= a.rightX && b.leftX <= b.rightX
+       && a.leftX <= b.rightX && b.leftX <= a.rightX && a.topY <= b.bottomY && b.topY <= a.bottomY);
 }
 
-template <Gp0DrawCmdBit _CmdId>
-static void drawPolyLine(StatusRegister&, Renderer&, uint32_t*) noexcept {
+// Use decoded texture page for immediate rendering (except if the polygon is drawn over its own texture page or lookup table)
+template <unsigned long _VramHeight, size_t _VertexCount>
+static inline void __resolveTexture(TextureCache& textureCache, const Vram<_VramHeight>& vram,
+                                    RasterState& state, const RasterVertex* vertices) noexcept {
+  Rectangle area{ vertices[0].x, vertices[0].x, vertices[0].y, vertices[0].y };
+  for (size_t i = 1; i < _VertexCount; ++i) {
+    if (vertices[i].x < area.leftX)
+      area.leftX = vertices[i].x;
+    else if (vertices[i].x > area.rightX)
+      area.rightX = vertices[i].x;
+    if (vertices[i].y < area.topY)
+      area.topY = vertices[i].y;
+    else if (vertices[i].y > area.bottomY)
+      area.bottomY = vertices[i].y;
+  }
+  if (__intersects(area, Rasterizer::getTexturePageArea(state)) || __intersects(area, Rasterizer::getLookupTableArea(state)))
+    return; // feedback loop -> read texels in VRAM while drawing
 
+  textureCache.beginBatch();
+  try {
+    state.decodedTexture = textureCache.getTexture(vram, state.texpageX, state.texpageY, state.colorMode, state.clutX, state.clutY);
+  }
+  catch (...) {} // allocation failure -> read texels in VRAM
 }
 
-// ---
+// Add triangle to pending primitives of tiled rasterizer (allocation failure -> flush + draw directly)
+template <unsigned long _VramHeight>
+static inline void __drawTiledTriangle(Gp0Parser& parser, Vram<_VramHeight>& vram, const RasterState& state,
+                                       const RasterVertex* vertices) noexcept {
+  try {
+    parser.tiledRasterizer()->drawTriangle(vram, Rasterizer::nativeTarget(vram), state, vertices[0], vertices[1], vertices[2]);
+  }
+  catch (...) {
+    parser.flushPrimitives(); // keep drawing order
+    RasterState directState = state;
+    if (directState.isTextured)
+      __resolveTexture<_VramHeight,3>(parser.textureCache(), vram, directState, vertices);
+    Rasterizer::drawTriangle(vram, directState, vertices[0], vertices[1], vertices[2]);
+  }
+}
 
-template <Gp0DrawCmdBit _CmdId>
-static void drawCustomTile(StatusRegister&, Renderer&, uint32_t*) noexcept {
-  __if_constexpr (hasGp0CommandBit(_CmdId, Gp0DrawCmdBit::textured)) {
+template <unsigned long _VramHeight, Gp0DrawCmdBit _CmdId>
+static void drawTriangle(Gp0Parser& parser, StatusRegister& status, Renderer&, Vram<_VramHeight>& vram, uint32_t* params) noexcept {
+  RasterState state;
+  RasterVertex vertices[3];
+  __readPolygon<_VramHeight,_CmdId,3>(status, params, state, vertices);
+  if (parser.drawList() != nullptr)
+    __recordPolygon<_CmdId,3>(*parser.drawList(), status, state, params);
+  if (parser.tiledRasterizer() != nullptr)
+    __drawTiledTriangle(parser, vram, state, vertices);
+  else {
+    if (state.isTextured)
+      __resolveTexture<_VramHeight,3>(parser.textureCache(), vram, state, vertices);
+    Rasterizer::drawTriangle(vram, state, vertices[0], vertices[1], vertices[2]);
+  }
+}
 
+// Find top-left corner of textured quad drawn as axis-aligned sprite (1:1 texture mapping: texture coord deltas == position deltas)
+// returns: index of top-left vertex (or -1 if the quad isn't a sprite)
+static inline int __findSpriteCorner(const RasterVertex* vertices, long& outWidth, long& outHeight) noexcept {
+  const RasterVertex& v0 = vertices[0];
+  const RasterVertex& v3 = vertices[3]; // opposite corner (whatever the diagonal of both triangles)
+  if (v0.x == v3.x || v0.y == v3.y
+  || !((vertices[1].x == v3.x && vertices[1].y == v0.y && vertices[2].x == v0.x && vertices[2].y == v3.y)
+    || (vertices[1].x == v0.x && vertices[1].y == v3.y && vertices[2].x == v3.x && vertices[2].y == v0.y)))
+    return -1;
+  const long offsetU = (long)v0.u - v0.x;
+  const long offsetV = (long)v0.v - v0.y;
+  for (int i = 1; i < 4; ++i) {
+    if ((long)vertices[i].u - vertices[i].x != offsetU || (long)vertices[i].v - vertices[i].y != offsetV)
+      return -1;
   }
-  else {
-    
+  outWidth = (v3.x > v0.x) ? v3.x - v0.x : v0.x - v3.x;
+  outHeight = (v3.y > v0.y) ? v3.y - v0.y : v0.y - v3.y;
+  if (outWidth > maxPolygonWidth() || outHeight > maxPolygonHeight())
+    return -1; // ignored by hardware -> polygon path
+
+  int corner = 0;
+  for (int i = 1; i < 4; ++i) {
+    if (vertices[i].x <= vertices[corner].x && vertices[i].y <= vertices[corner].y)
+      corner = i;
   }
+  return corner;
 }
 
-template <Gp0DrawCmdBit _CmdId>
-static void drawTile1x1(StatusRegister&, Renderer&, uint32_t*) noexcept {
-  __if_constexpr (hasGp0CommandBit(_CmdId, Gp0DrawCmdBit::textured)) {
+// Record textured quad drawn as sprite in draw list (rectangle primitive: top-left vertex + size)
+static inline void __recordSprite(DrawList& drawList, const StatusRegister& status, const RasterState& state,
+                                  const uint32_t* params, int corner, long width, long height) noexcept {
+  const uint32_t* vertexParams = &params[1 + 2*corner]; // flat textured: color, (coords, texture coords) * 4
+  try {
+    uint32_t index = drawList.addPrimitive(DrawPrimitiveType::rectangle, state, 1u, status.getDisplayState().drawOffset,
+                                           (uint16_t)width, (uint16_t)height);
+    drawList.setVertex(index, vertexParams[0], params[0], (vertexParams[1] & 0xFFu), ((vertexParams[1] >> 8) & 0xFFu));
+  }
+  catch (...) {} // allocation failure -> primitive not recorded (still rendered)
+}
+
+template <unsigned long _VramHeight, Gp0DrawCmdBit _CmdId>
+static void drawQuad(Gp0Parser& parser, StatusRegister& status, Renderer&, Vram<_VramHeight>& vram, uint32_t* params) noexcept {
+  RasterState state;
+  RasterVertex vertices[4];
+  __readPolygon<_VramHeight,_CmdId,4>(status, params, state, vertices);
+
+  // flat textured sprite -> rectangle path (no edge functions, no texture coord gradients)
+  __if_constexpr (hasGp0CommandBit(_CmdId, Gp0DrawCmdBit::textured) && !hasGp0CommandBit(_CmdId, Gp0DrawCmdBit::shaded)) {
+    Gp0ParserStats& stats = parser.stats();
+    ++stats.texturedQuadCount;
+    long width, height;
+    const int corner = __findSpriteCorner(vertices, width, height);
+    if (corner >= 0) {
+      ++stats.spriteQuadCount;
+      if (parser.drawList() != nullptr)
+        __recordSprite(*parser.drawList(), status, state, params, corner, width, height);
+      parser.flushPrimitives(); // sprites not binned -> keep drawing order
+      if (state.isTextured)
+        __resolveTexture<_VramHeight,4>(parser.textureCache(), vram, state, vertices);
+      Rasterizer::drawRectangle(vram, state, vertices[corner], width, height);
+      return;
+    }
+  }
 
+  if (parser.drawList() != nullptr)
+    __recordPolygon<_CmdId,4>(*parser.drawList(), status, state, params);
+  if (parser.tiledRasterizer() != nullptr) { // two triangles: (v0,v1,v2) + (v1,v2,v3)
+    __drawTiledTriangle(parser, vram, state, vertices);
+    __drawTiledTriangle(parser, vram, state, &vertices[1]);
   }
   else {
-    
+    if (state.isTextured)
+      __resolveTexture<_VramHeight,4>(parser.textureCache(), vram, state, vertices);
+    Rasterizer::drawQuad(vram, state, vertices);
   }
 }
 
-template <Gp0DrawCmdBit _CmdId>
-static void drawTile8x8(StatusRegister&, Renderer&, uint32_t*) noexcept {
-  __if_constexpr (hasGp0CommandBit(_CmdId, Gp0DrawCmdBit::textured)) {
+// ---
 
+// Read line end points + rendering attributes (flat: color,v0,v1 / shaded: color0,v0,color1,v1)
+template <unsigned long _VramHeight, Gp0DrawCmdBit _CmdId>
+static inline void __readLine(const StatusRegister& status, const uint32_t* params,
+                              RasterState& outState, RasterVertex* outVertices) noexcept {
+  constexpr const size_t colorLength = hasGp0CommandBit(_CmdId, Gp0DrawCmdBit::shaded) ? 1 : 0;
+  __readRasterState<_VramHeight,_CmdId>(status, outState);
+
+  outVertices[0].color = params[0] & 0xFFFFFFu;
+  __readVertexCoords(status, params[1], outVertices[0]);
+  outVertices[1].color = (colorLength ? params[2] : params[0]) & 0xFFFFFFu;
+  __readVertexCoords(status, params[2u + colorLength], outVertices[1]);
+}
+
+// Record line segment in draw list
+static inline void __recordLine(DrawList& drawList, const StatusRegister& status, const RasterState& state,
+                                uint32_t coords0, uint32_t color0, uint32_t coords1, uint32_t color1) noexcept {
+  try {
+    uint32_t index = drawList.addPrimitive(DrawPrimitiveType::line, state, 2u, status.getDisplayState().drawOffset);
+    drawList.setVertex(index, coords0, color0);
+    drawList.setVertex(index + 1u, coords1, color1);
   }
-  else {
-    
+  catch (...) {} // allocation failure -> primitive not recorded (still rendered)
+}
+
+template <unsigned long _VramHeight, Gp0DrawCmdBit _CmdId>
+static void drawLine(Gp0Parser& parser, StatusRegister& status, Renderer&, Vram<_VramHeight>& vram, uint32_t* params) noexcept {
+  RasterState state;
+  RasterVertex vertices[2];
+  __readLine<_VramHeight,_CmdId>(status, params, state, vertices);
+  if (parser.drawList() != nullptr) {
+    constexpr const size_t endPointIndex = hasGp0CommandBit(_CmdId, Gp0DrawCmdBit::shaded) ? 3 : 2;
+    __recordLine(*parser.drawList(), status, state, params[1], vertices[0].color, params[endPointIndex], vertices[1].color);
   }
+  parser.flushPrimitives(); // lines not binned -> keep drawing order
+  Rasterizer::drawLine(vram, state, vertices[0], vertices[1]);
+}
+
+// Draw first segment of poly-line + wait for next vertices (variable length, see 'continuePolyLine')
+template <unsigned long _VramHeight, Gp0DrawCmdBit _CmdId>
+static void drawPolyLine(Gp0Parser& parser, StatusRegister& status, Renderer&, Vram<_VramHeight>& vram, uint32_t* params) noexcept {
+  PolyLineStream& polyLine = parser.polyLine();
+  RasterVertex vertices[2];
+  __readLine<_VramHeight,_CmdId>(status, params, polyLine.state, vertices);
+  parser.flushPrimitives();
+  Rasterizer::drawLine(vram, polyLine.state, vertices[0], vertices[1]);
+
+  polyLine.lastCoords = params[hasGp0CommandBit(_CmdId, Gp0DrawCmdBit::shaded) ? 3 : 2];
+  if (parser.drawList() != nullptr)
+    __recordLine(*parser.drawList(), status, polyLine.state, params[1], vertices[0].color, polyLine.lastCoords, vertices[1].color);
+  polyLine.lastVertex = vertices[1];
+  polyLine.hasNextColor = false;
+  polyLine.isShaded = hasGp0CommandBit(_CmdId, Gp0DrawCmdBit::shaded);
+  polyLine.isSkipped = false;
+  polyLine.isActive = true;
+}
+// Skip first segment of poly-line (frame skipping) + ignore next vertices
+static inline void __skipPolyLine(PolyLineStream& polyLine, bool isShaded) noexcept {
+  polyLine.hasNextColor = false;
+  polyLine.isShaded = isShaded;
+  polyLine.isSkipped = true;
+  polyLine.isActive = true;
 }
 
-template <Gp0DrawCmdBit _CmdId>
-static void drawTile16x16(StatusRegister&, Renderer&, uint32_t*) noexcept {
+// ---
+
+// Read rectangle top-left vertex + size + rendering attributes (custom size: read in params / fixed size: 'inOutWidth/Height')
+template <unsigned long _VramHeight, Gp0DrawCmdBit _CmdId, bool _IsCustomSize>
+static inline void __readRectangle(const StatusRegister& status, const uint32_t* params, RasterState& outState,
+                                   RasterVertex& outTopLeft, uint16_t& inOutWidth, uint16_t& inOutHeight) noexcept {
+  constexpr const size_t texCoordLength = hasGp0CommandBit(_CmdId, Gp0DrawCmdBit::textured) ? 1 : 0;
+  __if_constexpr (_IsCustomSize) {
+    inOutWidth = (uint16_t)(params[2u + texCoordLength] & 0x3FFu);
+    inOutHeight = (uint16_t)((params[2u + texCoordLength] >> 16) & 0x1FFu);
+  }
+  __readRasterState<_VramHeight,_CmdId>(status, outState);
+  outState.isDithered = false; // rectangles are never dithered
+
+  outTopLeft.color = params[0] & 0xFFFFFFu;
+  __readVertexCoords(status, params[1], outTopLeft);
   __if_constexpr (hasGp0CommandBit(_CmdId, Gp0DrawCmdBit::textured)) {
+    outTopLeft.u = (params[2] & 0xFFu);
+    outTopLeft.v = ((params[2] >> 8) & 0xFFu);
+    outState.clutX = (long)((params[2] >> 12) & 0x3F0u);
+    outState.clutY = (long)((params[2] >> 22) & (_VramHeight - 1u));
+    if (outState.isTextured) {
+      outState.isTextureFlipX = status.isTextureFlipX();
+      outState.isTextureFlipY = status.isTextureFlipY();
+    }
+  }
+}
 
+// Record rectangle in draw list (raw vertex param + size)
+template <Gp0DrawCmdBit _CmdId, bool _IsCustomSize>
+static inline void __recordRectangle(DrawList& drawList, const StatusRegister& status, const RasterState& state,
+                                     const uint32_t* params, uint16_t width, uint16_t height) noexcept {
+  const uint32_t texCoords = hasGp0CommandBit(_CmdId, Gp0DrawCmdBit::textured) ? params[2] : 0;
+  __if_constexpr (!_IsCustomSize) { // grid tiles (8x8/16x16) -> merge runs of tilemaps
+    if (width >= 8u && drawList.mergeRectangle(state, status.getDisplayState().drawOffset, params[1], params[0],
+                                               (texCoords & 0xFFu), ((texCoords >> 8) & 0xFFu), width, height))
+      return;
   }
-  else {
+  try {
+    uint32_t index = drawList.addPrimitive(DrawPrimitiveType::rectangle, state, 1u, status.getDisplayState().drawOffset,
+                                           width, height);
+    drawList.setVertex(index, params[1], params[0], (texCoords & 0xFFu), ((texCoords >> 8) & 0xFFu));
+  }
+  catch (...) {} // allocation failure -> primitive not recorded (still rendered)
+}
 
+// Draw rectangle with rectangle blitter (no edge functions: flat fill or 1:1 texture copy)
+template <unsigned long _VramHeight, Gp0DrawCmdBit _CmdId, bool _IsCustomSize>
+static inline void __drawRectangle(Gp0Parser& parser, StatusRegister& status, Vram<_VramHeight>& vram,
+                                   const uint32_t* params, uint16_t width, uint16_t height) noexcept {
+  RasterState state;
+  RasterVertex topLeft;
+  __readRectangle<_VramHeight,_CmdId,_IsCustomSize>(status, params, state, topLeft, width, height);
+  if (parser.drawList() != nullptr)
+    __recordRectangle<_CmdId,_IsCustomSize>(*parser.drawList(), status, state, params, width, height);
+  if (width == 0 || height == 0)
+    return;
+
+  parser.flushPrimitives(); // rectangles not binned -> keep drawing order
+  if (state.isTextured) {
+    RasterVertex corners[2] = { topLeft, topLeft };
+    corners[1].x += (long)width - 1;
+    corners[1].y += (long)height - 1;
+    __resolveTexture<_VramHeight,2>(parser.textureCache(), vram, state, corners);
   }
+  Rasterizer::drawRectangle(vram, state, topLeft, (long)width, (long)height);
+}
+
+template <unsigned long _VramHeight, Gp0DrawCmdBit _CmdId>
+static void drawCustomTile(Gp0Parser& parser, StatusRegister& status, Renderer&, Vram<_VramHeight>& vram, uint32_t* params) noexcept {
+  __drawRectangle<_VramHeight,_CmdId,true>(parser, status, vram, params, 0, 0);
+}
+
+template <unsigned long _VramHeight, Gp0DrawCmdBit _CmdId>
+static void drawTile1x1(Gp0Parser& parser, StatusRegister& status, Renderer&, Vram<_VramHeight>& vram, uint32_t* params) noexcept {
+  __drawRectangle<_VramHeight,_CmdId,false>(parser, status, vram, params, 1, 1);
+}
+
+template <unsigned long _VramHeight, Gp0DrawCmdBit _CmdId>
+static void drawTile8x8(Gp0Parser& parser, StatusRegister& status, Renderer&, Vram<_VramHeight>& vram, uint32_t* params) noexcept {
+  __drawRectangle<_VramHeight,_CmdId,false>(parser, status, vram, params, 8, 8);
+}
+
+template <unsigned long _VramHeight, Gp0DrawCmdBit _CmdId>
+static void drawTile16x16(Gp0Parser& parser, StatusRegister& status, Renderer&, Vram<_VramHeight>& vram, uint32_t* params) noexcept {
+  __drawRectangle<_VramHeight,_CmdId,false>(parser, status, vram, params, 16, 16);
 }
 
 
 // -- GP0 commands - framebuffer data transfers -- -----------------------------
 
-unsigned long Primitives::imgWidth__TMP = 0;//TODO: replace with VRAM reader/writer
-unsigned long Primitives::imgHeight__TMP = 0;
+// Read span of VRAM line (horizontal wrap-around)
+static inline void __readVramSpan(const uint16_t* srcRow, unsigned long srcX, unsigned long width, uint16_t* outTexels) noexcept {
+  unsigned long firstLength = vramWidth() - srcX;
+  if (firstLength >= width)
+    memcpy((void*)outTexels, (const void*)(srcRow + (intptr_t)srcX), width*sizeof(uint16_t));
+  else {
+    memcpy((void*)outTexels, (const void*)(srcRow + (intptr_t)srcX), firstLength*sizeof(uint16_t));
+    memcpy((void*)&outTexels[firstLength], (const void*)srcRow, (width - firstLength)*sizeof(uint16_t));
+  }
+}
+
+// Copy lines of VRAM rectangle (source/destination may overlap, coords wrap around)
+template <unsigned long _VramHeight, bool _CheckMask>
+static inline void __copyVramLines(Vram<_VramHeight>& vram, unsigned long srcX, unsigned long srcY,
+                                   unsigned long destX, unsigned long destY, unsigned long width,
+                                   unsigned long height, uint16_t forceMaskBit) noexcept {
+  // destination lines below source lines (overlap) -> copy bottom-up, to read each line before it's overwritten
+  unsigned long verticalDistance = (destY - srcY) & (_VramHeight - 1u);
+  bool isBottomUp = (verticalDistance != 0 && verticalDistance < height);
+  intptr_t rowStep = isBottomUp ? -1 : 1;
+
+  // vertical wrap-around overlapping at both ends: first source lines are also overwritten by last destination lines
+  // (wrapped) before being read, whatever the direction -> save them in a temporary buffer before copying bottom-up
+  std::unique_ptr<uint16_t[]> savedLines;
+  unsigned long savedLineCount = 0;
+  if (isBottomUp && _VramHeight - verticalDistance < height) {
+    savedLineCount = height + verticalDistance - _VramHeight;
+    savedLines.reset(new(std::nothrow) uint16_t[savedLineCount*width]);
+    if (savedLines != nullptr) {
+      for (unsigned long line = 0; line < savedLineCount; ++line)
+        __readVramSpan(vram.row(srcY + line), srcX, width, &savedLines[line*width]);
+    }
+    else // allocation failure -> lines overwritten before being read
+      savedLineCount = 0;
+  }
+  if (isBottomUp) {
+    srcY += height - 1u;
+    destY += height - 1u;
+  }
+
+  bool isDirectCopy = (srcX + width <= vramWidth() && destX + width <= vramWidth() && verticalDistance != 0);
+  __align_prefix(32) uint16_t lineBuffer[vramWidth()] __align_suffix(32);
 
-static void copyVramRectangle(StatusRegister&, Renderer&, uint32_t*) noexcept {
+  for (; height; --height, srcY += (unsigned long)rowStep, destY += (unsigned long)rowStep) {
+    const uint16_t* srcRow = vram.row(srcY);
+    uint16_t* destRow = vram.row(destY);
 
+    if (height <= savedLineCount) // saved source line (bottom-up: current line index == height - 1)
+      copyVramSpanWrapped<_CheckMask>(destRow, destX, &savedLines[(height - 1u)*width], width, forceMaskBit);
+    else if (isDirectCopy) { // distinct lines, no wrap-around -> vectorized copy
+      if (_CheckMask)
+        copyVramSpanMasked(destRow + (intptr_t)destX, srcRow + (intptr_t)srcX, width, forceMaskBit);
+      else
+        copyVramSpan(destRow + (intptr_t)destX, srcRow + (intptr_t)srcX, width, forceMaskBit);
+    }
+    else { // same line (overlap) or wrap-around -> read entire source span before writing
+      __readVramSpan(srcRow, srcX, width, lineBuffer);
+      copyVramSpanWrapped<_CheckMask>(destRow, destX, lineBuffer, width, forceMaskBit);
+    }
+  }
 }
 
-static void writeVramRectangle(StatusRegister& status, Renderer&, uint32_t* params) noexcept {
-  ++params;
-  //unsigned long x = (*params & 0x3FFu);
-  //unsigned long y = (status.getGpuVramHeight() == display::psxVramHeight()) ? ((*params >> 16) & 0x1FFu) : ((*params >> 16) & 0x3FFu);
+// Copy rectangle within VRAM
+template <unsigned long _VramHeight>
+static void copyVramRectangle(Gp0Parser& parser, StatusRegister& status, Renderer&, Vram<_VramHeight>& vram, uint32_t* params) noexcept {
+  parser.flushPrimitives();
+  unsigned long srcX = ((unsigned long)params[1] & (vramWidth() - 1u));
+  unsigned long srcY = (((unsigned long)params[1] >> 16) & (_VramHeight - 1u));
+  unsigned long destX = ((unsigned long)params[2] & (vramWidth() - 1u));
+  unsigned long destY = (((unsigned long)params[2] >> 16) & (_VramHeight - 1u));
+  unsigned long width = (((unsigned long)params[3] - 1u) & (vramWidth() - 1u)) + 1u;          // 0 -> max width
+  unsigned long height = ((((unsigned long)params[3] >> 16) - 1u) & (_VramHeight - 1u)) + 1u; // 0 -> max height
+
+  uint16_t forceMaskBit = status.readStatus(StatusBits::forceSetMaskBit) ? vramMaskBit() : 0;
+  if (status.readStatus<bool>(StatusBits::enableMask))
+    __copyVramLines<_VramHeight,true>(vram, srcX, srcY, destX, destY, width, height, forceMaskBit);
+  else if (srcX != destX || srcY != destY || forceMaskBit)
+    __copyVramLines<_VramHeight,false>(vram, srcX, srcY, destX, destY, width, height, forceMaskBit);
+  else
+    return; // copy to itself without mask settings -> no change
 
-  ++params;
-  Primitives::imgWidth__TMP = ((*params - 1u) & 0x3FFu) + 1u;
-  Primitives::imgHeight__TMP = (((*params >> 16) - 1u) & 0x1FFu) + 1u;
+  vram.markDirty(destX, destY, width, height);
+  __recordVramWrite(parser.drawList(), destX, destY, width, height);
+}
 
+template <unsigned long _VramHeight>
+static void writeVramRectangle(Gp0Parser& parser, StatusRegister& status, Renderer&, Vram<_VramHeight>&, uint32_t* params) noexcept {
+  parser.flushPrimitives();
+  VramTransfer& transfer = parser.vramTransfer();
+  transfer.start((unsigned long)params[1], (unsigned long)params[2], status.getGpuVramHeight());
   status.setDataWriteMode(display::DataTransfer::vramTransfer);
+  __recordVramWrite(parser.drawList(), transfer.x(), transfer.y(), transfer.width(), transfer.height()); // before any following primitive
 }
 
-static void readVramRectangle(StatusRegister& status, Renderer&, uint32_t*) noexcept {
+template <unsigned long _VramHeight>
+static void readVramRectangle(Gp0Parser& parser, StatusRegister& status, Renderer&, Vram<_VramHeight>&, uint32_t*) noexcept {
+  parser.flushPrimitives();
   status.setDataReadMode(display::DataTransfer::vramTransfer);
   status.setVramReadPending();
 }
@@ -173,58 +642,81 @@ static void readVramRectangle(StatusRegister& status, Renderer&, uint32_t*) noex
 
 // -- GP0 commands - rendering attributes -- -----------------------------------
 
-static void setTexturePage(StatusRegister& status , Renderer&, uint32_t* params) noexcept {
-  status.setTexturePageMode((unsigned long)*params);
+// Verify if a rendering attribute command changes current state (redundant commands are eliminated + counted)
+static inline bool __isAttributeChanged(Gp0Parser& parser, const StatusRegister& status, uint32_t param) noexcept {
+  Gp0ParserStats& stats = parser.stats();
+  ++stats.attributeCount;
+  if (status.isRedundantAttribute((unsigned long)param)) {
+    ++stats.redundantAttributeCount;
+    return false;
+  }
+  return true;
+}
+
+template <unsigned long _VramHeight>
+static void setTexturePage(Gp0Parser& parser, StatusRegister& status, Renderer&, Vram<_VramHeight>&, uint32_t* params) noexcept {
+  if (__isAttributeChanged(parser, status, *params))
+    status.setTexturePageMode((unsigned long)*params);
 }
 
-static void setTextureWindow(StatusRegister& status, Renderer&, uint32_t* params) noexcept {
-  status.setTextureWindow((unsigned long)*params);
+template <unsigned long _VramHeight>
+static void setTextureWindow(Gp0Parser& parser, StatusRegister& status, Renderer&, Vram<_VramHeight>&, uint32_t* params) noexcept {
+  if (__isAttributeChanged(parser, status, *params))
+    status.setTextureWindow((unsigned long)*params);
 }
 
-static void setDrawAreaOrigin(StatusRegister& status, Renderer&, uint32_t* params) noexcept {
-  status.setDrawAreaOrigin((unsigned long)*params);
+template <unsigned long _VramHeight>
+static void setDrawAreaOrigin(Gp0Parser& parser, StatusRegister& status, Renderer&, Vram<_VramHeight>&, uint32_t* params) noexcept {
+  if (__isAttributeChanged(parser, status, *params))
+    status.setDrawAreaOrigin((unsigned long)*params);
 }
 
-static void setDrawAreaEnd(StatusRegister& status, Renderer&, uint32_t* params) noexcept {
-  status.setDrawAreaEnd((unsigned long)*params);
+template <unsigned long _VramHeight>
+static void setDrawAreaEnd(Gp0Parser& parser, StatusRegister& status, Renderer&, Vram<_VramHeight>&, uint32_t* params) noexcept {
+  if (__isAttributeChanged(parser, status, *params))
+    status.setDrawAreaEnd((unsigned long)*params);
 }
 
-static void setDrawOffset(StatusRegister& status, Renderer&, uint32_t* params) noexcept {
-  status.setDrawOffset((unsigned long)*params);
+template <unsigned long _VramHeight>
+static void setDrawOffset(Gp0Parser& parser, StatusRegister& status, Renderer&, Vram<_VramHeight>&, uint32_t* params) noexcept {
+  if (__isAttributeChanged(parser, status, *params))
+    status.setDrawOffset((unsigned long)*params);
 }
 
-static void setMaskBit(StatusRegister& status, Renderer&, uint32_t* params) noexcept {
-  status.setMaskBit((unsigned long)*params);
+template <unsigned long _VramHeight>
+static void setMaskBit(Gp0Parser& parser, StatusRegister& status, Renderer&, Vram<_VramHeight>&, uint32_t* params) noexcept {
+  if (__isAttributeChanged(parser, status, *params))
+    status.setMaskBit((unsigned long)*params);
 }
 
 
 // -- GP0 command table (primitives + rendering attributes) -- -----------------
 
+template <unsigned long _VramHeight>
 struct Gp0Command final {
-  void (*runner)(StatusRegister&, Renderer&, uint32_t* params) noexcept;
+  void (*runner)(Gp0Parser&, StatusRegister&, Renderer&, Vram<_VramHeight>&, uint32_t* params) noexcept;
   int paramsLength;
 };
 
-#define NOP Gp0Command({ nullptr, 1 })
-#define CMD_4X(baseId, idMask, runner, size)  { runner <(Gp0DrawCmdBit)( baseId    & idMask)>, size }, \
-                                              { runner <(Gp0DrawCmdBit)((baseId+1) & idMask)>, size }, \
-                                              { runner <(Gp0DrawCmdBit)((baseId+2) & idMask)>, size }, \
-                                              { runner <(Gp0DrawCmdBit)((baseId+3) & idMask)>, size }
+#define NOP Gp0Command<_VramHeight>({ nullptr, 1 })
+#define CMD(runner, size) Gp0Command<_VramHeight>({ runner <_VramHeight>, size })
+#define CMD_4X(baseId, idMask, runner, size)  { runner <_VramHeight,(Gp0DrawCmdBit)( baseId    & idMask)>, size }, \
+                                              { runner <_VramHeight,(Gp0DrawCmdBit)((baseId+1) & idMask)>, size }, \
+                                              { runner <_VramHeight,(Gp0DrawCmdBit)((baseId+2) & idMask)>, size }, \
+                                              { runner <_VramHeight,(Gp0DrawCmdBit)((baseId+3) & idMask)>, size }
 #define CMD_8X(baseId, idMask, runner, size)  CMD_4X(baseId,idMask,runner,size),CMD_4X(baseId+4,idMask,runner,size)
 
-uint32_t g_truncatedParams[__MAX_GP0_PARAMS_LENGTH+1];
-int g_truncatedParamsLength = 0;
-
 // ---
 
-static constexpr const Gp0Command g_gp0CommandTable[0x100] = {
+template <unsigned long _VramHeight>
+static constexpr const Gp0Command<_VramHeight> g_gp0CommandTable[0x100] = {
   // 0x00: general
   NOP,
-  { clearTextureCache, 1 },
-  { fillVramRectangle, 3 },
+  CMD(clearTextureCache, 1),
+  CMD(fillVramRectangle, 3),
   _P_DUPLICATE_16X_COMMA(NOP),
   _P_DUPLICATE_12X_COMMA(NOP), 
-  { requestIrq1, 1 },
+  CMD(requestIrq1, 1),
 
   // 0x20: draw polygons (triangles/quads)
   CMD_4X(0x20, __GP0_POLY_CMD_BIT_MASK,          drawTriangle, 4),
@@ -238,9 +730,9 @@ static constexpr const Gp0Command g_gp0CommandTable[0x100] = {
 
   // 0x40: draw lines
   CMD_8X(0x40, __GP0_LINE_CMD_BIT_MASK, drawLine, 3),
-  CMD_8X(0x48, __GP0_LINE_CMD_BIT_MASK, drawPolyLine, __MAX_GP0_PARAMS_LENGTH-1),
+  CMD_8X(0x48, __GP0_LINE_CMD_BIT_MASK, drawPolyLine, 3), // + variable length
   CMD_8X(0x50, __GP0_LINE_CMD_BIT_MASK, drawLine, 4),
-  CMD_8X(0x58, __GP0_LINE_CMD_BIT_MASK, drawPolyLine, __MAX_GP0_PARAMS_LENGTH),
+  CMD_8X(0x58, __GP0_LINE_CMD_BIT_MASK, drawPolyLine, 4), // + variable length
 
   // 0x60: draw tiles (rectangles/sprites)
   CMD_4X(0x60, __GP0_TILE_CMD_BIT_MASK,          drawCustomTile, 3),
@@ -253,18 +745,18 @@ static constexpr const Gp0Command g_gp0CommandTable[0x100] = {
   CMD_4X(0x7C, __GP0_TILE_CMD_BIT_MASK_TEXTURED, drawTile16x16, 3),
 
   // 0x80: framebuffer data transfers
-  _P_DUPLICATE_32X_COMMA(Gp0Command({ copyVramRectangle, 4 })),
-  _P_DUPLICATE_32X_COMMA(Gp0Command({ writeVramRectangle, 3 })),
-  _P_DUPLICATE_32X_COMMA(Gp0Command({ readVramRectangle, 3 })),
+  _P_DUPLICATE_32X_COMMA(CMD(copyVramRectangle, 4)),
+  _P_DUPLICATE_32X_COMMA(CMD(writeVramRectangle, 3)),
+  _P_DUPLICATE_32X_COMMA(CMD(readVramRectangle, 3)),
 
   // 0xE0: rendering attributes
   NOP,
-  { setTexturePage, 1 },
-  { setTextureWindow, 1 },
-  { setDrawAreaOrigin, 1 },
-  { setDrawAreaEnd, 1 },
-  { setDrawOffset, 1 },
-  { setMaskBit, 1 },
+  CMD(setTexturePage, 1),
+  CMD(setTextureWindow, 1),
+  CMD(setDrawAreaOrigin, 1),
+  CMD(setDrawAreaEnd, 1),
+  CMD(setDrawOffset, 1),
+  CMD(setMaskBit, 1),
   NOP,
   _P_DUPLICATE_8X_COMMA(NOP),
 
@@ -278,95 +770,195 @@ static inline bool canGp0CommandBeSkipped(uint32_t firstMemBlock) noexcept { //
   firstMemBlock &= 0xFF000000u;
   return (firstMemBlock >= 0x20000000u && firstMemBlock < 0x80000000u);
 }
-static constexpr inline bool isGp0PolyLineCommand(int maxSize) noexcept { // verify if a command is a poly-line
-  return (maxSize >= __MAX_GP0_PARAMS_LENGTH-1);
+static constexpr inline bool isGp0PolyLineCommand(unsigned long commandId) noexcept { // verify if a command is a poly-line
+  return ((commandId & 0xE8u) == 0x48u);
 }
-static constexpr inline bool isGp0ShadedPolyLine(int maxSize) noexcept {  // verify if poly-line is gouraud-shaded
-  return (maxSize == __MAX_GP0_PARAMS_LENGTH);
+static constexpr inline bool isGp0StreamCommand(unsigned long commandId) noexcept { // verify if a command starts stream data
+  return (isGp0PolyLineCommand(commandId) || (commandId & 0xE0u) == 0xA0u);         // (poly-line / CPU -> VRAM transfer)
+}
+static constexpr inline bool isGp0ShadedPolyLine(unsigned long commandId) noexcept {  // verify if poly-line is gouraud-shaded
+  return ((commandId & (unsigned long)Gp0DrawCmdBit::shaded) != 0);
 }
 
-// Get remaining length of poly-line params (variable length)
-// - memSize:       array size of 'mem'.
-// - maxSize:       maximum total length of poly-line params.
-// - existingSize:  length of poly-line params already read (from previous call(s)).
-// - returns: actual length remaining (or __MAX_INT32 if termination not found and max size not reached).
-static inline int getPolyLineRemLength(uint32_t* mem, int memSize, int maxSize, int existingSize) {
-  if (maxSize < existingSize)
-    return 0;
-  int length = maxSize - existingSize; // if no termination found and enough memSize, use maxSize
-
-  uint32_t* endOfMem;
-  if (memSize < length) {
-    length = __MAX_INT32; // memSize too small: if no termination found, maxSize won't be reached
-    endOfMem = mem + (intptr_t)memSize;
-  }
-  else
-    endOfMem = mem + (intptr_t)length;
-
-  if (isGp0ShadedPolyLine(maxSize)) {
-    intptr_t memMinSize = (existingSize < 4) ? 4 - (intptr_t)existingSize : 0;
-    for (uint32_t* it = mem + memMinSize; it < endOfMem; it += 2) {
-      if (isGp0PolyLineTermination(*it)) {
-        length = (static_cast<int>((const char*)it - (const char*)mem) / (int)sizeof(*mem)) + 1;
-        break;
-      }
-    }
+// Draw poly-line segments of received vertices
+// returns: size used by poly-line (params + termination code)
+template <unsigned long _VramHeight>
+static int continuePolyLine(PolyLineStream& polyLine, DrawList* drawList, const StatusRegister& status,
+                            Vram<_VramHeight>& vram, const uint32_t* mem, int size) noexcept {
+  const int stride = polyLine.isShaded ? 2 : 1;
+  const int endIndex = findPolyLineTermination(mem, size, (polyLine.isShaded && polyLine.hasNextColor) ? 1 : 0, stride);
+
+  if (polyLine.isSkipped) { // frame skipping -> only keep track of color/vertex order
+    if (polyLine.isShaded && (endIndex & 0x1))
+      polyLine.hasNextColor = !polyLine.hasNextColor;
   }
   else {
-    intptr_t memMinSize = (existingSize < 3) ? 3 - (intptr_t)existingSize : 0;
-    for (uint32_t* it = mem + memMinSize; it < endOfMem; ++it) {
-      if (isGp0PolyLineTermination(*it)) {
-        length = (static_cast<int>((const char*)it - (const char*)mem) / (int)sizeof(*mem)) + 1;
-        break;
+    for (int i = 0; i < endIndex; ++i) {
+      if (polyLine.isShaded && !polyLine.hasNextColor) {
+        polyLine.nextColor = mem[i] & 0xFFFFFFu;
+        polyLine.hasNextColor = true;
+        continue;
       }
+      RasterVertex vertex;
+      vertex.color = polyLine.isShaded ? polyLine.nextColor : polyLine.lastVertex.color;
+      __readVertexCoords(status, mem[i], vertex);
+      polyLine.hasNextColor = false;
+
+      Rasterizer::drawLine(vram, polyLine.state, polyLine.lastVertex, vertex);
+      if (drawList != nullptr)
+        __recordLine(*drawList, status, polyLine.state, polyLine.lastCoords, polyLine.lastVertex.color, mem[i], vertex.color);
+      polyLine.lastVertex = vertex;
+      polyLine.lastCoords = mem[i];
     }
   }
-  return length;
+
+  if (endIndex < size) { // termination code found
+    polyLine.isActive = false;
+    return endIndex + 1;
+  }
+  return size;
+}
+
+
+// -- GP0 command parser -- ----------------------------------------------------
+
+Gp0Parser::Gp0Parser() = default;
+Gp0Parser::~Gp0Parser() noexcept = default;
+
+// Enable/disable tile-binned multi-threaded rasterization
+void Gp0Parser::enableTiledRasterizer(unsigned workerCount) {
+  this->_tiledRasterizer.reset(new TiledRasterizer(workerCount));
+  this->_tiledRasterizer->setTextureCache(&(this->_textureCache));
+}
+void Gp0Parser::disableTiledRasterizer() noexcept {
+  this->_tiledRasterizer.reset();
 }
 
+// Rasterize pending primitives (tiled rasterizer)
+void Gp0Parser::flushPrimitives() noexcept {
+  if (this->_tiledRasterizer != nullptr)
+    this->_tiledRasterizer->flush();
+}
 
-// -- GP0 command interface -- -------------------------------------------------
+// ---
 
-// Clear pending command data buffer
-void Primitives::clearCommandBuffer() noexcept {
-  g_truncatedParamsLength = 0;
-  //TODO: clear current VRAM transfer ???
+// Clear pending command data (partial command, poly-line, CPU -> VRAM transfer)
+void Gp0Parser::clear() noexcept {
+  this->_pendingLength = 0;
+  this->_polyLine.isActive = false;
+  this->_vramTransfer.cancel();
 }
 
 // Run GP0 rendering command (drawing & rendering attributes)
 // returns: size used by current command
-int Primitives::runGp0Command(StatusRegister& status, Renderer& renderer,
-                              uint32_t* mem, int size, bool isFrameSkipped) noexcept {
-  const auto& command = (g_truncatedParamsLength == 0)
-                      ? g_gp0CommandTable[StatusRegister::getGp0CommandId((unsigned long)*mem)]
-                      : g_gp0CommandTable[StatusRegister::getGp0CommandId((unsigned long)*g_truncatedParams)];
+template <unsigned long _VramHeight>
+int Gp0Parser::runCommand(StatusRegister& status, Renderer& renderer, Vram<_VramHeight>& vram,
+                          uint32_t* mem, int size, bool isFrameSkipped) noexcept {
+  if (this->_polyLine.isActive) // next vertices of poly-line (variable length)
+    return continuePolyLine(this->_polyLine, this->_drawList, status, vram, mem, size);
+
+  const unsigned long commandId = (this->_pendingLength == 0)
+                                ? StatusRegister::getGp0CommandId((unsigned long)*mem)
+                                : StatusRegister::getGp0CommandId((unsigned long)*this->_pendingParams);
+  const auto& command = g_gp0CommandTable<_VramHeight>[commandId];
 
   if (command.runner != nullptr) { // implemented operation
-    int remainingLength = (isGp0PolyLineCommand(command.paramsLength))
-                        ? getPolyLineRemLength(mem, size, command.paramsLength, g_truncatedParamsLength) // variable length
-                        : command.paramsLength - g_truncatedParamsLength; // fixed length
+    int remainingLength = command.paramsLength - this->_pendingLength; // fixed length (poly-line: first segment)
 
-    // full command / end of truncated command
+    // full command / end of partial command
     if (remainingLength <= size) {
-      if (g_truncatedParamsLength > 0) {
-        memcpy(&g_truncatedParams[g_truncatedParamsLength], mem, remainingLength*sizeof(uint32_t));
-        mem = &g_truncatedParams[0];
-        g_truncatedParamsLength = 0;
+      if (this->_pendingLength > 0) { // split command -> copy remaining words after pending words
+        memcpy(&this->_pendingParams[this->_pendingLength], mem, remainingLength*sizeof(uint32_t));
+        mem = &this->_pendingParams[0];
+        this->_pendingLength = 0;
       }
+      // else: decoded directly from caller's data block
 
       if (!isFrameSkipped || !canGp0CommandBeSkipped(*mem))
-        command.runner(status, renderer, mem);
+        command.runner(*this, status, renderer, vram, mem);
+      else if (isGp0PolyLineCommand(commandId))
+        __skipPolyLine(this->_polyLine, isGp0ShadedPolyLine(commandId));
       size = remainingLength;
     }
-    // truncated -> store current data blocks
+    // partial command -> store received words (until next data block)
     else {
-      memcpy(&g_truncatedParams[g_truncatedParamsLength], mem, size*sizeof(uint32_t));
-      g_truncatedParamsLength += size;
+      memcpy(&this->_pendingParams[this->_pendingLength], mem, size*sizeof(uint32_t));
+      this->_pendingLength += size;
     }
   }
   else { // NOP -> ignore
-    g_truncatedParamsLength = 0;
+    this->_pendingLength = 0;
     size = 1;
   }
   return size;
 }
+template int Gp0Parser::runCommand<psxVramHeight()>(StatusRegister&, Renderer&, Vram<psxVramHeight()>&,
+                                                    uint32_t*, int, bool) noexcept;
+template int Gp0Parser::runCommand<znArcadeVramHeight()>(StatusRegister&, Renderer&, Vram<znArcadeVramHeight()>&,
+                                                         uint32_t*, int, bool) noexcept;
+
+// Run all GP0 commands and image data of a data block (DMA block)
+template <unsigned long _VramHeight>
+void Gp0Parser::runBuffer(StatusRegister& status, Renderer& renderer, Vram<_VramHeight>& vram,
+                          uint32_t* mem, int size, bool isFrameSkipped) noexcept {
+  const uint32_t* const end = mem + (intptr_t)size;
+  while (mem < end) {
+    // stream state (CPU -> VRAM transfer, split command, poly-line) -> resumable single-command path
+    if (status.getDataWriteMode() == DataTransfer::vramTransfer) {
+      mem += (intptr_t)writeVramData(status, vram, mem, (int)(end - mem));
+      continue;
+    }
+    if (this->_pendingLength != 0 || this->_polyLine.isActive) {
+      mem += (intptr_t)runCommand(status, renderer, vram, mem, (int)(end - mem), isFrameSkipped);
+      continue;
+    }
+
+    // complete fixed-size commands -> dispatched in place, without any stream state check
+    const Gp0Command<_VramHeight>* commandTable = g_gp0CommandTable<_VramHeight>;
+    do {
+      if (end - mem > __GP0_PREFETCH_DISTANCE)
+        __prefetchGp0Params(mem + __GP0_PREFETCH_DISTANCE);
+
+      const unsigned long commandId = StatusRegister::getGp0CommandId((unsigned long)*mem);
+      const Gp0Command<_VramHeight>& command = commandTable[commandId];
+      if (command.runner == nullptr) { // NOP -> ignore
+        ++mem;
+        continue;
+      }
+      if (command.paramsLength > (int)(end - mem)) { // partial command -> store received words (until next data block)
+        this->_pendingLength = (int)(end - mem);
+        memcpy(this->_pendingParams, mem, (size_t)this->_pendingLength*sizeof(uint32_t));
+        return;
+      }
+
+      if (!isFrameSkipped || !canGp0CommandBeSkipped(*mem))
+        command.runner(*this, status, renderer, vram, mem);
+      else if (isGp0PolyLineCommand(commandId))
+        __skipPolyLine(this->_polyLine, isGp0ShadedPolyLine(commandId));
+      mem += (intptr_t)command.paramsLength;
+
+      if (isGp0StreamCommand(commandId)) // poly-line / CPU -> VRAM transfer started -> back to stream path
+        break;
+    } while (mem < end);
+  }
+}
+template void Gp0Parser::runBuffer<psxVramHeight()>(StatusRegister&, Renderer&, Vram<psxVramHeight()>&,
+                                                    uint32_t*, int, bool) noexcept;
+template void Gp0Parser::runBuffer<znArcadeVramHeight()>(StatusRegister&, Renderer&, Vram<znArcadeVramHeight()>&,
+                                                         uint32_t*, int, bool) noexcept;
+
+// ---
+
+// Copy image data of pending CPU -> VRAM transfer into VRAM
+// returns: size used by current transfer
+template <unsigned long _VramHeight>
+int Gp0Parser::writeVramData(StatusRegister& status, Vram<_VramHeight>& vram, const uint32_t* mem, int size) noexcept {
+  int transferSize = this->_vramTransfer.write(vram, mem, size,
+                                               status.readStatus(StatusBits::forceSetMaskBit) ? vramMaskBit() : 0,
+                                               status.readStatus<bool>(StatusBits::enableMask));
+  if (!this->_vramTransfer.isActive()) // transfer complete (or no transfer) -> back to GP0 commands
+    status.setDataWriteMode(display::DataTransfer::command);
+  return transferSize;
+}
+template int Gp0Parser::writeVramData<psxVramHeight()>(StatusRegister&, Vram<psxVramHeight()>&, const uint32_t*, int) noexcept;
+template int Gp0Parser::writeVramData<znArcadeVramHeight()>(StatusRegister&, Vram<znArcadeVramHeight()>&, const uint32_t*, int) noexcept;
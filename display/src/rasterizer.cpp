@@ -0,0 +1,1189 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "display/_private/_vram_kernels.h"
+#include "display/_private/_pixel_write.h"
+#include "display/vram.h"
+#include "display/rasterizer.h"
+#if !defined(_CPP_REVISION) || _CPP_REVISION != 14
+# define __if_constexpr if constexpr
+#else
+# define __if_constexpr if
+#endif
+
+using namespace display;
+
+
+// -- triangle setup -- --------------------------------------------------------
+
+#define __ATTRIBUTE_FRACTION_BITS 16
+#define __ATTRIBUTE_HALF          (1 << (__ATTRIBUTE_FRACTION_BITS - 1))
+
+// Half-space edge function: E(x,y) = a*x + b*y + c -> pixel inside edge if E >= 0
+struct EdgeFunction final {
+  int32_t a;
+  int32_t b;
+  int32_t c;
+};
+// Attribute plane equation (fixed-point): A(x,y) = base + dx*(x - originX) + dy*(y - originY)
+struct AttributePlane final {
+  int64_t base;
+  int32_t dx;
+  int32_t dy;
+};
+enum class Attribute : size_t {
+  red = 0,
+  green = 1,
+  blue = 2,
+  u = 3,
+  v = 4,
+  count = 5
+};
+
+struct TriangleSetup final {
+  EdgeFunction edges[3];
+  AttributePlane attributes[(size_t)Attribute::count];
+  long originX;
+  long originY;
+  bool useDithering;
+};
+
+// ---
+
+// Edge from 'from' to 'to' (counter-clockwise triangle, with Y axis going down)
+// -> top-left rule: pixels exactly on right/bottom edges are excluded (bias of -1 for edges that aren't top/left)
+static inline EdgeFunction __createEdge(const RasterVertex& from, const RasterVertex& to) noexcept {
+  EdgeFunction edge;
+  edge.a = -(int32_t)(to.y - from.y);
+  edge.b = (int32_t)(to.x - from.x);
+  edge.c = -(edge.a * (int32_t)from.x + edge.b * (int32_t)from.y);
+  bool isTopLeft = (edge.a > 0 || (edge.a == 0 && edge.b > 0));
+  if (!isTopLeft)
+    edge.c -= 1;
+  return edge;
+}
+
+// Compute gradients of an attribute over triangle surface (rounded to nearest)
+// (numerators may be negative: scaled with a multiplication, as left-shifting them is undefined)
+static inline AttributePlane __createPlane(int32_t value0, int32_t value1, int32_t value2,
+                                           int32_t deltaX1, int32_t deltaY1, int32_t deltaX2, int32_t deltaY2, int64_t area) noexcept {
+  int64_t numeratorX = ((int64_t)(value1 - value0)*deltaY2 - (int64_t)(value2 - value0)*deltaY1) * ((int64_t)1 << __ATTRIBUTE_FRACTION_BITS);
+  int64_t numeratorY = ((int64_t)(value2 - value0)*deltaX1 - (int64_t)(value1 - value0)*deltaX2) * ((int64_t)1 << __ATTRIBUTE_FRACTION_BITS);
+  AttributePlane plane;
+  plane.base = ((int64_t)value0 << __ATTRIBUTE_FRACTION_BITS) + __ATTRIBUTE_HALF;
+  plane.dx = (int32_t)((numeratorX + ((numeratorX >= 0) ? area/2 : -area/2)) / area);
+  plane.dy = (int32_t)((numeratorY + ((numeratorY >= 0) ? area/2 : -area/2)) / area);
+  return plane;
+}
+
+static inline int32_t __colorComponent(uint32_t color, Attribute component) noexcept {
+  return (int32_t)((color >> ((size_t)component << 3)) & 0xFFu);
+}
+
+// Prepare edge functions + attribute planes
+// returns: false if triangle is empty (degenerate)
+static inline bool __setupTriangle(const RasterState& state, const RasterVertex* v0, const RasterVertex* v1,
+                                   const RasterVertex* v2, TriangleSetup& outSetup) noexcept {
+  int64_t area = (int64_t)(v1->x - v0->x)*(v2->y - v0->y) - (int64_t)(v2->x - v0->x)*(v1->y - v0->y);
+  if (area == 0)
+    return false;
+  if (area < 0) { // clockwise -> reverse order
+    const RasterVertex* swapped = v1;
+    v1 = v2;
+    v2 = swapped;
+    area = -area;
+  }
+  outSetup.edges[0] = __createEdge(*v0, *v1);
+  outSetup.edges[1] = __createEdge(*v1, *v2);
+  outSetup.edges[2] = __createEdge(*v2, *v0);
+
+  outSetup.originX = v0->x;
+  outSetup.originY = v0->y;
+  int32_t deltaX1 = (int32_t)(v1->x - v0->x);
+  int32_t deltaY1 = (int32_t)(v1->y - v0->y);
+  int32_t deltaX2 = (int32_t)(v2->x - v0->x);
+  int32_t deltaY2 = (int32_t)(v2->y - v0->y);
+
+  for (size_t i = 0; i <= (size_t)Attribute::blue; ++i) {
+    if (state.isShaded) {
+      outSetup.attributes[i] = __createPlane(__colorComponent(v0->color, (Attribute)i), __colorComponent(v1->color, (Attribute)i),
+                                             __colorComponent(v2->color, (Attribute)i), deltaX1, deltaY1, deltaX2, deltaY2, area);
+    }
+    else { // flat -> color of first vertex
+      outSetup.attributes[i].base = ((int64_t)__colorComponent(v0->color, (Attribute)i) << __ATTRIBUTE_FRACTION_BITS) + __ATTRIBUTE_HALF;
+      outSetup.attributes[i].dx = outSetup.attributes[i].dy = 0;
+    }
+  }
+  if (state.isTextured) {
+    outSetup.attributes[(size_t)Attribute::u] = __createPlane((int32_t)v0->u, (int32_t)v1->u, (int32_t)v2->u,
+                                                              deltaX1, deltaY1, deltaX2, deltaY2, area);
+    outSetup.attributes[(size_t)Attribute::v] = __createPlane((int32_t)v0->v, (int32_t)v1->v, (int32_t)v2->v,
+                                                              deltaX1, deltaY1, deltaX2, deltaY2, area);
+  }
+  outSetup.useDithering = (state.isDithered && (state.isShaded || (state.isTextured && !state.isRawTexture)));
+  return true;
+}
+
+
+// -- span pipelines -- --------------------------------------------------------
+
+#define __SPAN_CHUNK_SIZE 64L // pixels shaded before each call to pixel write stage
+
+// Span pipeline ID - bitmap components (one specialized span function per combination)
+enum class SpanPipelineBit : uint32_t {
+  shaded          = 0x1,  ///< Gouraud shading (interpolated colors)
+  dithered        = 0x2,  ///< 24-bit -> 15-bit dithering (only for shaded/modulated pixels)
+  checkMask       = 0x4,  ///< Don't overwrite pixels with mask bit
+  semiTransparent = 0x8,  ///< Blending with existing pixels
+  blendingMode    = 0x30, ///< Semi-transparency mode (BlendingMode >> 1)
+  textured        = 0x40, ///< Textured primitive
+  rawTexture      = 0x80, ///< Texture colors not modulated
+  textureWindow   = 0x100,///< Texture window (repeated texture area)
+  texelSource     = 0x600 ///< Texel source: 4-bit lookup table / 8-bit lookup table / direct color / decoded page
+};
+#define __SPAN_PIPELINE_COUNT        0x800u
+#define __SPAN_BLENDING_MODE_SHIFT   1
+#define __SPAN_TEXEL_SOURCE_SHIFT    9
+#define __SPAN_TEXEL_SOURCE_DECODED  0x3u
+
+static constexpr inline bool __hasSpanPipelineBit(uint32_t id, SpanPipelineBit bit) noexcept {
+  return ((id & (uint32_t)bit) == (uint32_t)bit);
+}
+
+// Remove options without effect (same pipeline for equivalent combinations)
+static constexpr inline uint32_t __toCanonicalPipelineId(uint32_t id) noexcept {
+  if (!__hasSpanPipelineBit(id, SpanPipelineBit::semiTransparent))
+    id &= ~(uint32_t)SpanPipelineBit::blendingMode;
+  if (!__hasSpanPipelineBit(id, SpanPipelineBit::textured))
+    id &= ~((uint32_t)SpanPipelineBit::rawTexture | (uint32_t)SpanPipelineBit::textureWindow | (uint32_t)SpanPipelineBit::texelSource);
+  else if (__hasSpanPipelineBit(id, SpanPipelineBit::rawTexture))
+    id &= ~((uint32_t)SpanPipelineBit::shaded | (uint32_t)SpanPipelineBit::dithered);
+  if (!__hasSpanPipelineBit(id, SpanPipelineBit::shaded) // dithering only for shaded/modulated pixels
+  && (!__hasSpanPipelineBit(id, SpanPipelineBit::textured) || __hasSpanPipelineBit(id, SpanPipelineBit::rawTexture)))
+    id &= ~(uint32_t)SpanPipelineBit::dithered;
+  return id;
+}
+
+// Texel source of textured primitive: 4-bit lookup table (0) / 8-bit lookup table (1) / direct colors (2) / decoded page
+static inline uint32_t __toTexelSource(const RasterState& state) noexcept {
+  if (state.decodedTexture != nullptr)
+    return __SPAN_TEXEL_SOURCE_DECODED;
+  if (state.colorMode == TextureColorMode::lookupTable4bit)
+    return 0;
+  if (state.colorMode == TextureColorMode::lookupTable8bit)
+    return 1;
+  return 2; // direct colors (+ reserved mode)
+}
+static inline bool __hasTextureWindow(const TextureWindow& window) noexcept {
+  return (window.offsetX || window.offsetY || window.maskWidth < 256 || window.maskHeight < 256);
+}
+
+// Select span pipeline of a primitive
+static inline uint32_t __toPipelineId(const RasterState& state, bool useDithering) noexcept {
+  uint32_t id = 0;
+  if (state.isShaded)
+    id |= (uint32_t)SpanPipelineBit::shaded;
+  if (useDithering)
+    id |= (uint32_t)SpanPipelineBit::dithered;
+  if (state.checkMask)
+    id |= (uint32_t)SpanPipelineBit::checkMask;
+  if (state.isSemiTransparent)
+    id |= (uint32_t)SpanPipelineBit::semiTransparent | ((uint32_t)state.blendingMode >> __SPAN_BLENDING_MODE_SHIFT);
+  if (state.isTextured) {
+    id |= (uint32_t)SpanPipelineBit::textured;
+    if (state.isRawTexture)
+      id |= (uint32_t)SpanPipelineBit::rawTexture;
+    if (__hasTextureWindow(state.textureWindow))
+      id |= (uint32_t)SpanPipelineBit::textureWindow;
+    id |= (__toTexelSource(state) << __SPAN_TEXEL_SOURCE_SHIFT);
+  }
+  return __toCanonicalPipelineId(id);
+}
+
+
+// -- pixel shading -- ---------------------------------------------------------
+
+// 4x4 dithering offsets (applied to 8-bit components before 15-bit conversion)
+static const int32_t g_ditherMatrix[4][4] = {
+  { -4,  0, -3,  1 },
+  {  2, -2,  3, -1 },
+  { -3,  1, -4,  0 },
+  {  3, -1,  2, -2 }
+};
+
+static inline int32_t __clampComponent(int32_t value, int32_t maxValue) noexcept {
+  return (value < 0) ? 0 : ((value > maxValue) ? maxValue : value);
+}
+static inline uint16_t __toColor15bit(int32_t red, int32_t green, int32_t blue) noexcept {
+  return (uint16_t)((__clampComponent(red, 0xFF) >> 3) | ((__clampComponent(green, 0xFF) >> 3) << 5)
+                  | ((__clampComponent(blue, 0xFF) >> 3) << 10));
+}
+
+// Read texel from texture page (decoded page / color lookup table / direct color)
+template <unsigned long _Height, uint32_t _TexelSource, bool _HasTextureWindow>
+static __forceinline uint16_t __readTexel(const Vram<_Height>& vram, const RasterState& state, uint32_t u, uint32_t v) noexcept {
+  __if_constexpr (_HasTextureWindow) {
+    u = (u & (uint32_t)(state.textureWindow.maskWidth - 1)) | (uint32_t)state.textureWindow.offsetX;
+    v = (v & (uint32_t)(state.textureWindow.maskHeight - 1)) | (uint32_t)state.textureWindow.offsetY;
+  }
+  __if_constexpr (_TexelSource == __SPAN_TEXEL_SOURCE_DECODED) { // decoded texture page (lookup table already resolved)
+    return state.decodedTexture[((v & 0xFFu) << 8) | (u & 0xFFu)];
+  }
+  else __if_constexpr (_TexelSource == 0) { // 4-bit lookup table
+    uint16_t indexes = vram.read((unsigned long)state.texpageX + (u >> 2), (unsigned long)state.texpageY + v);
+    return vram.read((unsigned long)state.clutX + ((indexes >> ((u & 0x3u) << 2)) & 0xFu), (unsigned long)state.clutY);
+  }
+  else __if_constexpr (_TexelSource == 1) { // 8-bit lookup table
+    uint16_t indexes = vram.read((unsigned long)state.texpageX + (u >> 1), (unsigned long)state.texpageY + v);
+    return vram.read((unsigned long)state.clutX + ((indexes >> ((u & 0x1u) << 3)) & 0xFFu), (unsigned long)state.clutY);
+  }
+  else {
+    return vram.read((unsigned long)state.texpageX + u, (unsigned long)state.texpageY + v);
+  }
+}
+
+// Draw horizontal span of triangle (x0 <= x <= x1, target coords) -- specialized for each pipeline ID
+template <unsigned long _Height, uint32_t _PipelineId>
+static void __drawSpan(const Vram<_Height>& textures, const RasterTarget& target, const RasterState& state,
+                       const TriangleSetup& setup, long y, long x0, long x1) noexcept {
+  constexpr bool isShaded = __hasSpanPipelineBit(_PipelineId, SpanPipelineBit::shaded);
+  constexpr bool isDithered = __hasSpanPipelineBit(_PipelineId, SpanPipelineBit::dithered);
+  constexpr bool isMaskChecked = __hasSpanPipelineBit(_PipelineId, SpanPipelineBit::checkMask);
+  constexpr bool isBlended = __hasSpanPipelineBit(_PipelineId, SpanPipelineBit::semiTransparent);
+  constexpr BlendingMode blendingMode = (BlendingMode)((_PipelineId & (uint32_t)SpanPipelineBit::blendingMode) << __SPAN_BLENDING_MODE_SHIFT);
+  constexpr bool isTextured = __hasSpanPipelineBit(_PipelineId, SpanPipelineBit::textured);
+  constexpr bool isRawTexture = __hasSpanPipelineBit(_PipelineId, SpanPipelineBit::rawTexture);
+  constexpr bool hasTextureWindow = __hasSpanPipelineBit(_PipelineId, SpanPipelineBit::textureWindow);
+  constexpr uint32_t texelSource = (_PipelineId & (uint32_t)SpanPipelineBit::texelSource) >> __SPAN_TEXEL_SOURCE_SHIFT;
+  // interpolated attributes: [red, green, blue] if shaded + [u, v] if textured
+  constexpr size_t firstAttribute = isShaded ? (size_t)Attribute::red : (size_t)Attribute::u;
+  constexpr size_t endAttribute = isTextured ? (size_t)Attribute::count : (size_t)Attribute::blue + 1u;
+
+  // attribute values at first pixel (absolute evaluation -> same values whatever the tile/block order)
+  int32_t values[(size_t)Attribute::count];
+  for (size_t i = 0; i < (size_t)Attribute::count; ++i) {
+    const AttributePlane& plane = setup.attributes[i];
+    values[i] = (isShaded || i >= (size_t)Attribute::u)
+              ? (int32_t)(plane.base + (int64_t)plane.dx*(x0 - setup.originX) + (int64_t)plane.dy*(y - setup.originY))
+              : (int32_t)plane.base; // flat: constant color
+  }
+  uint16_t* destRow = target.pixels + (size_t)y*target.rowLength;
+
+  // dithering based on native coords: pattern of 4*scaleX pixels
+  int32_t ditherLine[4*maxRasterScale()];
+  long ditherLength = 0, ditherIndex = 0;
+  __if_constexpr (isDithered) {
+    const int32_t* ditherRow = g_ditherMatrix[(y / target.scaleY) & 0x3];
+    ditherLength = 4*target.scaleX;
+    for (long i = 0; i < ditherLength; ++i)
+      ditherLine[i] = ditherRow[i / target.scaleX];
+    ditherIndex = x0 % ditherLength;
+  }
+
+  // shade chunks of pixels, then send them to pixel write stage
+  uint16_t colors[__SPAN_CHUNK_SIZE];
+  uint16_t writeMask[__SPAN_CHUNK_SIZE]; // transparent texels -> 0
+  __if_constexpr (!isTextured && !isShaded) { // flat color -> same pixels for whole span
+    const uint16_t color = __toColor15bit(values[0] >> __ATTRIBUTE_FRACTION_BITS, values[1] >> __ATTRIBUTE_FRACTION_BITS,
+                                          values[2] >> __ATTRIBUTE_FRACTION_BITS);
+    long chunkLength = (x1 - x0 + 1 < __SPAN_CHUNK_SIZE) ? x1 - x0 + 1 : __SPAN_CHUNK_SIZE;
+    for (long i = 0; i < chunkLength; ++i)
+      colors[i] = color;
+  }
+
+  for (long chunkX = x0; chunkX <= x1; chunkX += __SPAN_CHUNK_SIZE) {
+    const long chunkLength = (x1 - chunkX + 1 < __SPAN_CHUNK_SIZE) ? x1 - chunkX + 1 : __SPAN_CHUNK_SIZE;
+    __if_constexpr (isTextured || isShaded) {
+      for (long i = 0; i < chunkLength; ++i) {
+        int32_t red = __clampComponent(values[(size_t)Attribute::red] >> __ATTRIBUTE_FRACTION_BITS, 0xFF);
+        int32_t green = __clampComponent(values[(size_t)Attribute::green] >> __ATTRIBUTE_FRACTION_BITS, 0xFF);
+        int32_t blue = __clampComponent(values[(size_t)Attribute::blue] >> __ATTRIBUTE_FRACTION_BITS, 0xFF);
+        uint32_t texU = 0, texV = 0;
+        __if_constexpr (isTextured) {
+          texU = (uint32_t)__clampComponent(values[(size_t)Attribute::u] >> __ATTRIBUTE_FRACTION_BITS, 0xFF);
+          texV = (uint32_t)__clampComponent(values[(size_t)Attribute::v] >> __ATTRIBUTE_FRACTION_BITS, 0xFF);
+        }
+        for (size_t attr = firstAttribute; attr < endAttribute; ++attr)
+          values[attr] += setup.attributes[attr].dx;
+
+        int32_t dither = 0;
+        __if_constexpr (isDithered) {
+          dither = ditherLine[ditherIndex];
+          ditherIndex = (ditherIndex + 1 < ditherLength) ? ditherIndex + 1 : 0;
+        }
+        __if_constexpr (isTextured) {
+          uint16_t texel = __readTexel<_Height,texelSource,hasTextureWindow>(textures, state, texU, texV);
+          writeMask[i] = (uint16_t)-(int16_t)(texel != 0); // texel 0 -> fully transparent
+
+          __if_constexpr (isRawTexture) {
+            colors[i] = texel;
+          }
+          else { // modulation: (texel * color) / 128 -> computed with 8-bit precision (for dithering)
+            red = (((int32_t)(texel & 0x1Fu) * red) >> 4) + dither;
+            green = (((int32_t)((texel >> 5) & 0x1Fu) * green) >> 4) + dither;
+            blue = (((int32_t)((texel >> 10) & 0x1Fu) * blue) >> 4) + dither;
+            colors[i] = (uint16_t)(__toColor15bit(red, green, blue) | (texel & vramMaskBit()));
+          }
+        }
+        else {
+          colors[i] = __toColor15bit(red + dither, green + dither, blue + dither);
+        }
+      }
+    }
+    writePixelSpan<blendingMode,isBlended,isTextured,isMaskChecked,isTextured>(&destRow[chunkX], colors, writeMask,
+                                                                               (size_t)chunkLength, state.forceMaskBit);
+  }
+}
+
+// ---
+
+template <unsigned long _Height>
+using SpanPipeline = void (*)(const Vram<_Height>&, const RasterTarget&, const RasterState&,
+                              const TriangleSetup&, long, long, long) noexcept;
+
+#define SPAN(id)      __drawSpan<_Height, __toCanonicalPipelineId(id)>
+#define SPAN_4X(id)   SPAN(id), SPAN((id)+1u), SPAN((id)+2u), SPAN((id)+3u)
+#define SPAN_16X(id)  SPAN_4X(id), SPAN_4X((id)+4u), SPAN_4X((id)+8u), SPAN_4X((id)+12u)
+#define SPAN_64X(id)  SPAN_16X(id), SPAN_16X((id)+16u), SPAN_16X((id)+32u), SPAN_16X((id)+48u)
+#define SPAN_256X(id) SPAN_64X(id), SPAN_64X((id)+64u), SPAN_64X((id)+128u), SPAN_64X((id)+192u)
+
+// Specialized span functions, indexed by pipeline ID (equivalent combinations share the same function)
+template <unsigned long _Height>
+static constexpr const SpanPipeline<_Height> g_spanPipelines[__SPAN_PIPELINE_COUNT] = {
+  SPAN_256X(0x000u), SPAN_256X(0x100u), // 4-bit lookup table (or untextured)
+  SPAN_256X(0x200u), SPAN_256X(0x300u), // 8-bit lookup table
+  SPAN_256X(0x400u), SPAN_256X(0x500u), // direct colors
+  SPAN_256X(0x600u), SPAN_256X(0x700u)  // decoded texture page
+};
+
+
+// -- coverage -- --------------------------------------------------------------
+
+// Get index of lowest/highest bit set in 8-bit coverage mask (mask != 0)
+static inline long __firstCoveredPixel(uint32_t mask) noexcept {
+  long index = 0;
+  for (; (mask & 0x1u) == 0; mask >>= 1)
+    ++index;
+  return index;
+}
+static inline long __lastCoveredPixel(uint32_t mask) noexcept {
+  long index = 7;
+  for (; (mask & 0x80u) == 0; mask <<= 1)
+    --index;
+  return index;
+}
+
+// Edge values of 8 consecutive pixels of a block line (lanes: x+0 to x+7)
+struct EdgeLanes final {
+# if defined(__DISPLAY_SIMD_AVX2)
+    __m256i steps[3]; // a*{0..7}
+# elif defined(__DISPLAY_SIMD_SSE2)
+    __m128i lowSteps[3];  // a*{0..3}
+    __m128i highSteps[3]; // a*{4..7}
+# elif defined(__DISPLAY_SIMD_NEON)
+    int32x4_t lowSteps[3];
+    int32x4_t highSteps[3];
+# else
+    int32_t steps[3][8];
+# endif
+};
+
+static inline void __initEdgeLanes(const EdgeFunction* edges, EdgeLanes& outLanes) noexcept {
+  for (int i = 0; i < 3; ++i) {
+    int32_t a = edges[i].a;
+#   if defined(__DISPLAY_SIMD_AVX2)
+      outLanes.steps[i] = _mm256_setr_epi32(0, a, 2*a, 3*a, 4*a, 5*a, 6*a, 7*a);
+#   elif defined(__DISPLAY_SIMD_SSE2)
+      outLanes.lowSteps[i] = _mm_setr_epi32(0, a, 2*a, 3*a);
+      outLanes.highSteps[i] = _mm_setr_epi32(4*a, 5*a, 6*a, 7*a);
+#   elif defined(__DISPLAY_SIMD_NEON)
+      const int32_t low[4] = { 0, a, 2*a, 3*a };
+      const int32_t high[4] = { 4*a, 5*a, 6*a, 7*a };
+      outLanes.lowSteps[i] = vld1q_s32(low);
+      outLanes.highSteps[i] = vld1q_s32(high);
+#   else
+      for (int lane = 0; lane < 8; ++lane)
+        outLanes.steps[i][lane] = a*lane;
+#   endif
+  }
+}
+
+// Compute coverage mask of 8 pixels (bit set if pixel inside all edges)
+static inline uint32_t __computeCoverage(const EdgeLanes& lanes, int32_t edge0, int32_t edge1, int32_t edge2) noexcept {
+# if defined(__DISPLAY_SIMD_AVX2)
+    __m256i outside = _mm256_or_si256(_mm256_or_si256(_mm256_add_epi32(_mm256_set1_epi32(edge0), lanes.steps[0]),
+                                                      _mm256_add_epi32(_mm256_set1_epi32(edge1), lanes.steps[1])),
+                                      _mm256_add_epi32(_mm256_set1_epi32(edge2), lanes.steps[2])); // sign bit set if outside any edge
+    return (~(uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(outside)) & 0xFFu);
+# elif defined(__DISPLAY_SIMD_SSE2)
+    __m128i e0 = _mm_set1_epi32(edge0), e1 = _mm_set1_epi32(edge1), e2 = _mm_set1_epi32(edge2);
+    __m128i lowOutside = _mm_or_si128(_mm_or_si128(_mm_add_epi32(e0, lanes.lowSteps[0]), _mm_add_epi32(e1, lanes.lowSteps[1])),
+                                      _mm_add_epi32(e2, lanes.lowSteps[2]));
+    __m128i highOutside = _mm_or_si128(_mm_or_si128(_mm_add_epi32(e0, lanes.highSteps[0]), _mm_add_epi32(e1, lanes.highSteps[1])),
+                                       _mm_add_epi32(e2, lanes.highSteps[2]));
+    uint32_t outsideBits = (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(lowOutside))
+                         | ((uint32_t)_mm_movemask_ps(_mm_castsi128_ps(highOutside)) << 4);
+    return (~outsideBits & 0xFFu);
+# elif defined(__DISPLAY_SIMD_NEON)
+    int32x4_t e0 = vdupq_n_s32(edge0), e1 = vdupq_n_s32(edge1), e2 = vdupq_n_s32(edge2);
+    int32x4_t lowOutside = vorrq_s32(vorrq_s32(vaddq_s32(e0, lanes.lowSteps[0]), vaddq_s32(e1, lanes.lowSteps[1])),
+                                     vaddq_s32(e2, lanes.lowSteps[2]));
+    int32x4_t highOutside = vorrq_s32(vorrq_s32(vaddq_s32(e0, lanes.highSteps[0]), vaddq_s32(e1, lanes.highSteps[1])),
+                                      vaddq_s32(e2, lanes.highSteps[2]));
+    const int32_t laneBitsValues[4] = { 1, 2, 4, 8 };
+    const int32x4_t laneBits = vld1q_s32(laneBitsValues);
+    int32x4_t lowBits = vandq_s32(vshrq_n_s32(lowOutside, 31), laneBits);
+    int32x4_t highBits = vandq_s32(vshrq_n_s32(highOutside, 31), laneBits);
+    uint32_t outsideBits = (uint32_t)(vgetq_lane_s32(lowBits, 0) | vgetq_lane_s32(lowBits, 1) | vgetq_lane_s32(lowBits, 2) | vgetq_lane_s32(lowBits, 3))
+                         | ((uint32_t)(vgetq_lane_s32(highBits, 0) | vgetq_lane_s32(highBits, 1) | vgetq_lane_s32(highBits, 2) | vgetq_lane_s32(highBits, 3)) << 4);
+    return (~outsideBits & 0xFFu);
+# else
+    uint32_t coverage = 0;
+    for (int lane = 0; lane < 8; ++lane) {
+      if (((edge0 + lanes.steps[0][lane]) | (edge1 + lanes.steps[1][lane]) | (edge2 + lanes.steps[2][lane])) >= 0)
+        coverage |= (1u << lane);
+    }
+    return coverage;
+# endif
+}
+
+
+// -- triangle rasterization -- ------------------------------------------------
+
+// Scale vertex coords to target resolution
+static inline RasterVertex __scaleVertex(const RasterVertex& vertex, const RasterTarget& target) noexcept {
+  RasterVertex scaled = vertex;
+  scaled.x *= target.scaleX;
+  scaled.y *= target.scaleY;
+  return scaled;
+}
+
+template <unsigned long _Height>
+bool Rasterizer::rasterizeTriangle(const Vram<_Height>& textures, const RasterTarget& target, const RasterState& state,
+                                   const RasterVertex& nativeV0, const RasterVertex& nativeV1, const RasterVertex& nativeV2,
+                                   const Rectangle& targetArea, Rectangle& outArea) noexcept {
+  if (isTriangleTooLarge(nativeV0, nativeV1, nativeV2)) // size limit based on native coords
+    return false;
+  const RasterVertex v0 = __scaleVertex(nativeV0, target);
+  const RasterVertex v1 = __scaleVertex(nativeV1, target);
+  const RasterVertex v2 = __scaleVertex(nativeV2, target);
+
+  // bounding box, clipped to draw area (scaled) + target area
+  long minX = (v0.x < v1.x) ? ((v0.x < v2.x) ? v0.x : v2.x) : ((v1.x < v2.x) ? v1.x : v2.x);
+  long maxX = (v0.x > v1.x) ? ((v0.x > v2.x) ? v0.x : v2.x) : ((v1.x > v2.x) ? v1.x : v2.x);
+  long minY = (v0.y < v1.y) ? ((v0.y < v2.y) ? v0.y : v2.y) : ((v1.y < v2.y) ? v1.y : v2.y);
+  long maxY = (v0.y > v1.y) ? ((v0.y > v2.y) ? v0.y : v2.y) : ((v1.y > v2.y) ? v1.y : v2.y);
+  if (minX < state.clipArea.leftX*target.scaleX)
+    minX = state.clipArea.leftX*target.scaleX;
+  if (maxX > (state.clipArea.rightX + 1)*target.scaleX - 1)
+    maxX = (state.clipArea.rightX + 1)*target.scaleX - 1;
+  if (minY < state.clipArea.topY*target.scaleY)
+    minY = state.clipArea.topY*target.scaleY;
+  if (maxY > (state.clipArea.bottomY + 1)*target.scaleY - 1)
+    maxY = (state.clipArea.bottomY + 1)*target.scaleY - 1;
+  if (minX < targetArea.leftX)
+    minX = targetArea.leftX;
+  if (maxX > targetArea.rightX)
+    maxX = targetArea.rightX;
+  if (minY < targetArea.topY)
+    minY = targetArea.topY;
+  if (maxY > targetArea.bottomY)
+    maxY = targetArea.bottomY;
+  if (minX < 0)
+    minX = 0;
+  if (maxX >= target.width)
+    maxX = target.width - 1;
+  if (minY < 0)
+    minY = 0;
+  if (maxY >= target.height)
+    maxY = target.height - 1;
+  if (minX > maxX || minY > maxY)
+    return false;
+
+  TriangleSetup setup;
+  if (!__setupTriangle(state, &v0, &v1, &v2, setup))
+    return false;
+  EdgeLanes lanes;
+  __initEdgeLanes(setup.edges, lanes);
+  const SpanPipeline<_Height> drawSpan = g_spanPipelines<_Height>[__toPipelineId(state, setup.useDithering)];
+
+  // corner offsets to get min/max value of each edge function within a block
+  const int32_t blockMax = (int32_t)rasterBlockSize() - 1;
+  int32_t maxOffsets[3], minOffsets[3];
+  for (int i = 0; i < 3; ++i) {
+    const EdgeFunction& edge = setup.edges[i];
+    maxOffsets[i] = ((edge.a > 0) ? edge.a*blockMax : 0) + ((edge.b > 0) ? edge.b*blockMax : 0);
+    minOffsets[i] = ((edge.a < 0) ? edge.a*blockMax : 0) + ((edge.b < 0) ? edge.b*blockMax : 0);
+  }
+
+  bool isDrawn = false;
+  long rowStarts[rasterBlockSize()];
+  long rowEnds[rasterBlockSize()];
+  for (long blockY = (minY & ~(rasterBlockSize() - 1)); blockY <= maxY; blockY += rasterBlockSize()) {
+    for (long row = 0; row < rasterBlockSize(); ++row) {
+      rowStarts[row] = maxX + 1;
+      rowEnds[row] = minX - 1;
+    }
+    long firstRow = (blockY < minY) ? minY - blockY : 0;
+    long lastRow = (blockY + rasterBlockSize() - 1 > maxY) ? maxY - blockY : rasterBlockSize() - 1;
+
+    // classify blocks of current band + store covered range of each line (convex shape -> contiguous)
+    for (long blockX = (minX & ~(rasterBlockSize() - 1)); blockX <= maxX; blockX += rasterBlockSize()) {
+      int32_t blockEdges[3];
+      bool isRejected = false, isAccepted = true;
+      for (int i = 0; i < 3; ++i) {
+        const EdgeFunction& edge = setup.edges[i];
+        blockEdges[i] = edge.a*(int32_t)blockX + edge.b*(int32_t)blockY + edge.c;
+        if (blockEdges[i] + maxOffsets[i] < 0)
+          isRejected = true;
+        if (blockEdges[i] + minOffsets[i] < 0)
+          isAccepted = false;
+      }
+      if (isRejected)
+        continue;
+
+      long blockStart = (blockX < minX) ? minX : blockX;
+      long blockEnd = (blockX + rasterBlockSize() - 1 > maxX) ? maxX : blockX + rasterBlockSize() - 1;
+      if (isAccepted) { // entire block covered
+        for (long row = firstRow; row <= lastRow; ++row) {
+          if (blockStart < rowStarts[row])
+            rowStarts[row] = blockStart;
+          if (blockEnd > rowEnds[row])
+            rowEnds[row] = blockEnd;
+        }
+      }
+      else { // partial coverage -> test 8 pixels per line
+        uint32_t columnMask = ((0xFFu << (blockStart - blockX)) & (0xFFu >> (blockX + rasterBlockSize() - 1 - blockEnd)));
+        for (long row = firstRow; row <= lastRow; ++row) {
+          uint32_t coverage = __computeCoverage(lanes, blockEdges[0] + setup.edges[0].b*(int32_t)row,
+                                                       blockEdges[1] + setup.edges[1].b*(int32_t)row,
+                                                       blockEdges[2] + setup.edges[2].b*(int32_t)row) & columnMask;
+          if (coverage) {
+            long start = blockX + __firstCoveredPixel(coverage);
+            long end = blockX + __lastCoveredPixel(coverage);
+            if (start < rowStarts[row])
+              rowStarts[row] = start;
+            if (end > rowEnds[row])
+              rowEnds[row] = end;
+          }
+        }
+      }
+    }
+
+    // draw lines of current band
+    for (long row = firstRow; row <= lastRow; ++row) {
+      if (rowStarts[row] <= rowEnds[row]) {
+        drawSpan(textures, target, state, setup, blockY + row, rowStarts[row], rowEnds[row]);
+        isDrawn = true;
+      }
+    }
+  }
+
+  if (isDrawn)
+    outArea = Rectangle{ minX, maxX, minY, maxY };
+  return isDrawn;
+}
+
+template bool Rasterizer::rasterizeTriangle<psxVramHeight()>(const Vram<psxVramHeight()>&, const RasterTarget&, const RasterState&,
+                                                             const RasterVertex&, const RasterVertex&, const RasterVertex&,
+                                                             const Rectangle&, Rectangle&) noexcept;
+template bool Rasterizer::rasterizeTriangle<znArcadeVramHeight()>(const Vram<znArcadeVramHeight()>&, const RasterTarget&, const RasterState&,
+                                                                  const RasterVertex&, const RasterVertex&, const RasterVertex&,
+                                                                  const Rectangle&, Rectangle&) noexcept;
+
+
+// -- rectangle rasterization -- -----------------------------------------------
+
+#define __BLIT_CHUNK_SIZE 256L // pixels blitted before each call to pixel write stage (one texture row)
+
+// Rectangle blitter ID - bitmap components (one specialized blitter per combination)
+enum class BlitPipelineBit : uint32_t {
+  checkMask       = 0x1,  ///< Don't overwrite pixels with mask bit
+  semiTransparent = 0x2,  ///< Blending with existing pixels
+  blendingMode    = 0xC,  ///< Semi-transparency mode (BlendingMode >> 3)
+  textured        = 0x10, ///< Textured rectangle
+  rawTexture      = 0x20, ///< Texture colors not modulated
+  dithered        = 0x40  ///< 24-bit -> 15-bit dithering (modulated sprites drawn with polygon commands)
+};
+#define __BLIT_PIPELINE_COUNT       0x80u
+#define __BLIT_BLENDING_MODE_SHIFT  3
+
+static constexpr inline bool __hasBlitPipelineBit(uint32_t id, BlitPipelineBit bit) noexcept {
+  return ((id & (uint32_t)bit) == (uint32_t)bit);
+}
+
+// Remove options without effect (same blitter for equivalent combinations)
+static constexpr inline uint32_t __toCanonicalBlitId(uint32_t id) noexcept {
+  if (!__hasBlitPipelineBit(id, BlitPipelineBit::semiTransparent))
+    id &= ~(uint32_t)BlitPipelineBit::blendingMode;
+  if (!__hasBlitPipelineBit(id, BlitPipelineBit::textured))
+    id &= ~((uint32_t)BlitPipelineBit::rawTexture | (uint32_t)BlitPipelineBit::dithered);
+  else if (__hasBlitPipelineBit(id, BlitPipelineBit::rawTexture))
+    id &= ~(uint32_t)BlitPipelineBit::dithered;
+  return id;
+}
+
+// Select blitter of a rectangle
+static inline uint32_t __toBlitPipelineId(const RasterState& state, bool useDithering) noexcept {
+  uint32_t id = 0;
+  if (state.checkMask)
+    id |= (uint32_t)BlitPipelineBit::checkMask;
+  if (state.isSemiTransparent)
+    id |= (uint32_t)BlitPipelineBit::semiTransparent | ((uint32_t)state.blendingMode >> __BLIT_BLENDING_MODE_SHIFT);
+  if (state.isTextured) {
+    id |= (uint32_t)BlitPipelineBit::textured;
+    if (state.isRawTexture)
+      id |= (uint32_t)BlitPipelineBit::rawTexture;
+  }
+  if (useDithering)
+    id |= (uint32_t)BlitPipelineBit::dithered;
+  return __toCanonicalBlitId(id);
+}
+
+// Rectangle setup: flat color + texture coords stepped per target pixel (fixed-point, negative steps if flipped)
+struct RectangleSetup final {
+  long originX;          // top-left corner (target coords)
+  long originY;
+  int64_t baseU;         // texture coords of top-left pixel
+  int64_t baseV;
+  int32_t stepU;         // texture coord delta per target pixel
+  int32_t stepV;
+  int32_t red;           // flat color components
+  int32_t green;
+  int32_t blue;
+  uint32_t texelSource;  // see '__toTexelSource'
+  bool hasTextureWindow;
+  bool isContiguous;     // 1 texel per pixel, read in direct-color/decoded rows -> rows copied as contiguous runs
+};
+
+// ---
+
+// Read texels of a rectangle row (texture coords at each target pixel)
+template <unsigned long _Height, uint32_t _TexelSource, bool _HasTextureWindow>
+static void __gatherTexels(const Vram<_Height>& textures, const RasterState& state, int64_t u, int32_t stepU,
+                           uint32_t v, long length, uint16_t* outTexels) noexcept {
+  for (long i = 0; i < length; ++i, u += stepU)
+    outTexels[i] = __readTexel<_Height,_TexelSource,_HasTextureWindow>(textures, state, (uint32_t)(u >> __ATTRIBUTE_FRACTION_BITS) & 0xFFu, v);
+}
+
+// Read run of texels for pixels [x; x + length[ of a rectangle row
+// returns: number of texels read (contiguous rows: stops at texture page / VRAM wrap-around) + texels in 'outTexels'
+template <unsigned long _Height>
+static inline long __readTexelRun(const Vram<_Height>& textures, const RasterState& state, const RectangleSetup& setup,
+                                  uint32_t v, long x, long length, uint16_t* buffer, const uint16_t*& outTexels) noexcept {
+  const int64_t u = setup.baseU + (int64_t)setup.stepU*(x - setup.originX);
+  if (setup.isContiguous) {
+    const long firstU = (long)((uint32_t)(u >> __ATTRIBUTE_FRACTION_BITS) & 0xFFu);
+    const bool isFlipped = (setup.stepU < 0);
+    const uint16_t* texelRow;
+    long firstIndex, maxLength;
+    if (state.decodedTexture != nullptr) {
+      texelRow = &state.decodedTexture[(v & 0xFFu) << 8];
+      firstIndex = firstU;
+      maxLength = isFlipped ? firstU + 1 : 256 - firstU;
+    }
+    else {
+      texelRow = textures.row((unsigned long)state.texpageY + v);
+      firstIndex = (long)(((unsigned long)state.texpageX + (unsigned long)firstU) & (vramWidth() - 1u));
+      maxLength = isFlipped ? ((firstU < firstIndex) ? firstU + 1 : firstIndex + 1)
+                            : ((256 - firstU < (long)vramWidth() - firstIndex) ? 256 - firstU : (long)vramWidth() - firstIndex);
+    }
+    if (length > maxLength)
+      length = maxLength;
+
+    if (isFlipped) {
+      copyVramSpanReversed(buffer, &texelRow[firstIndex - length + 1], (size_t)length);
+      outTexels = buffer;
+    }
+    else if (state.decodedTexture != nullptr)
+      outTexels = &texelRow[firstIndex]; // read-only page -> no copy
+    else {
+      memcpy((void*)buffer, (const void*)&texelRow[firstIndex], (size_t)length*sizeof(uint16_t)); // may be drawn over
+      outTexels = buffer;
+    }
+    return length;
+  }
+
+  switch (setup.texelSource | (setup.hasTextureWindow ? 0x4u : 0)) {
+    case 0x0u: __gatherTexels<_Height,0,false>(textures, state, u, setup.stepU, v, length, buffer); break;
+    case 0x1u: __gatherTexels<_Height,1,false>(textures, state, u, setup.stepU, v, length, buffer); break;
+    case 0x2u: __gatherTexels<_Height,2,false>(textures, state, u, setup.stepU, v, length, buffer); break;
+    case 0x3u: __gatherTexels<_Height,__SPAN_TEXEL_SOURCE_DECODED,false>(textures, state, u, setup.stepU, v, length, buffer); break;
+    case 0x4u: __gatherTexels<_Height,0,true>(textures, state, u, setup.stepU, v, length, buffer); break;
+    case 0x5u: __gatherTexels<_Height,1,true>(textures, state, u, setup.stepU, v, length, buffer); break;
+    case 0x6u: __gatherTexels<_Height,2,true>(textures, state, u, setup.stepU, v, length, buffer); break;
+    default:   __gatherTexels<_Height,__SPAN_TEXEL_SOURCE_DECODED,true>(textures, state, u, setup.stepU, v, length, buffer); break;
+  }
+  outTexels = buffer;
+  return length;
+}
+
+// Modulate texels with flat color: (texel * color) / 128 (+ dithering) -> colors + write mask (transparent texels: 0)
+template <bool _IsDithered>
+static __forceinline void __modulateTexels(const uint16_t* texels, const int16_t* dither, long length,
+                                           const RectangleSetup& setup, uint16_t* outColors, uint16_t* outWriteMask) noexcept {
+# if defined(__DISPLAY_SIMD_SSE2)
+    const __m128i componentMask = _mm_set1_epi16(0x1F);
+    const __m128i maxComponent = _mm_set1_epi16(0xFF);
+    const __m128i stpBit = _mm_set1_epi16((short)vramMaskBit());
+    const __m128i red = _mm_set1_epi16((short)setup.red);
+    const __m128i green = _mm_set1_epi16((short)setup.green);
+    const __m128i blue = _mm_set1_epi16((short)setup.blue);
+    const __m128i zero = _mm_setzero_si128();
+    for (; length >= 8; length -= 8, texels += 8, dither += (_IsDithered ? 8 : 0), outColors += 8, outWriteMask += 8) {
+      __m128i texel = _mm_loadu_si128((const __m128i*)texels);
+      __m128i offset = _IsDithered ? _mm_loadu_si128((const __m128i*)dither) : zero;
+      __m128i r = _mm_add_epi16(_mm_srli_epi16(_mm_mullo_epi16(_mm_and_si128(texel, componentMask), red), 4), offset);
+      __m128i g = _mm_add_epi16(_mm_srli_epi16(_mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(texel, 5), componentMask), green), 4), offset);
+      __m128i b = _mm_add_epi16(_mm_srli_epi16(_mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(texel, 10), componentMask), blue), 4), offset);
+      r = _mm_srli_epi16(_mm_min_epi16(_mm_max_epi16(r, zero), maxComponent), 3);
+      g = _mm_srli_epi16(_mm_min_epi16(_mm_max_epi16(g, zero), maxComponent), 3);
+      b = _mm_srli_epi16(_mm_min_epi16(_mm_max_epi16(b, zero), maxComponent), 3);
+      _mm_storeu_si128((__m128i*)outColors, _mm_or_si128(_mm_or_si128(r, _mm_slli_epi16(g, 5)),
+                                                         _mm_or_si128(_mm_slli_epi16(b, 10), _mm_and_si128(texel, stpBit))));
+      _mm_storeu_si128((__m128i*)outWriteMask, _mm_andnot_si128(_mm_cmpeq_epi16(texel, zero), _mm_set1_epi16(-1)));
+    }
+# elif defined(__DISPLAY_SIMD_NEON)
+    const uint16x8_t componentMask = vdupq_n_u16(0x1F);
+    const int16x8_t maxComponent = vdupq_n_s16(0xFF);
+    const uint16x8_t stpBit = vdupq_n_u16(vramMaskBit());
+    const uint16x8_t red = vdupq_n_u16((uint16_t)setup.red);
+    const uint16x8_t green = vdupq_n_u16((uint16_t)setup.green);
+    const uint16x8_t blue = vdupq_n_u16((uint16_t)setup.blue);
+    const int16x8_t zero = vdupq_n_s16(0);
+    for (; length >= 8; length -= 8, texels += 8, dither += (_IsDithered ? 8 : 0), outColors += 8, outWriteMask += 8) {
+      uint16x8_t texel = vld1q_u16(texels);
+      int16x8_t offset = _IsDithered ? vld1q_s16(dither) : zero;
+      int16x8_t r = vaddq_s16(vreinterpretq_s16_u16(vshrq_n_u16(vmulq_u16(vandq_u16(texel, componentMask), red), 4)), offset);
+      int16x8_t g = vaddq_s16(vreinterpretq_s16_u16(vshrq_n_u16(vmulq_u16(vandq_u16(vshrq_n_u16(texel, 5), componentMask), green), 4)), offset);
+      int16x8_t b = vaddq_s16(vreinterpretq_s16_u16(vshrq_n_u16(vmulq_u16(vandq_u16(vshrq_n_u16(texel, 10), componentMask), blue), 4)), offset);
+      uint16x8_t r15 = vshrq_n_u16(vreinterpretq_u16_s16(vminq_s16(vmaxq_s16(r, zero), maxComponent)), 3);
+      uint16x8_t g15 = vshrq_n_u16(vreinterpretq_u16_s16(vminq_s16(vmaxq_s16(g, zero), maxComponent)), 3);
+      uint16x8_t b15 = vshrq_n_u16(vreinterpretq_u16_s16(vminq_s16(vmaxq_s16(b, zero), maxComponent)), 3);
+      vst1q_u16(outColors, vorrq_u16(vorrq_u16(r15, vshlq_n_u16(g15, 5)), vorrq_u16(vshlq_n_u16(b15, 10), vandq_u16(texel, stpBit))));
+      vst1q_u16(outWriteMask, vmvnq_u16(vceqq_u16(texel, vdupq_n_u16(0))));
+    }
+# endif
+  for (; length > 0; --length, ++texels, ++outColors, ++outWriteMask) {
+    const uint16_t texel = *texels;
+    const int32_t offset = _IsDithered ? (int32_t)*(dither++) : 0;
+    *outColors = (uint16_t)(__toColor15bit((((int32_t)(texel & 0x1Fu) * setup.red) >> 4) + offset,
+                                           (((int32_t)((texel >> 5) & 0x1Fu) * setup.green) >> 4) + offset,
+                                           (((int32_t)((texel >> 10) & 0x1Fu) * setup.blue) >> 4) + offset)
+                          | (texel & vramMaskBit()));
+    *outWriteMask = (uint16_t)-(int16_t)(texel != 0); // texel 0 -> fully transparent
+  }
+}
+
+// Blit rectangle area (inclusive boundaries, target coords) -- specialized for each blitter ID
+template <unsigned long _Height, uint32_t _BlitId>
+static void __blitRectangle(const Vram<_Height>& textures, const RasterTarget& target, const RasterState& state,
+                            const RectangleSetup& setup, const Rectangle& area) noexcept {
+  constexpr bool isMaskChecked = __hasBlitPipelineBit(_BlitId, BlitPipelineBit::checkMask);
+  constexpr bool isBlended = __hasBlitPipelineBit(_BlitId, BlitPipelineBit::semiTransparent);
+  constexpr BlendingMode blendingMode = (BlendingMode)((_BlitId & (uint32_t)BlitPipelineBit::blendingMode) << __BLIT_BLENDING_MODE_SHIFT);
+  constexpr bool isTextured = __hasBlitPipelineBit(_BlitId, BlitPipelineBit::textured);
+  constexpr bool isRawTexture = __hasBlitPipelineBit(_BlitId, BlitPipelineBit::rawTexture);
+  constexpr bool isDithered = __hasBlitPipelineBit(_BlitId, BlitPipelineBit::dithered);
+  uint16_t colors[__BLIT_CHUNK_SIZE];
+
+  __if_constexpr (!isTextured) { // flat fill -> same colors for all rows
+    const uint16_t color = __toColor15bit(setup.red, setup.green, setup.blue);
+    const long maxLength = (area.rightX - area.leftX + 1 < __BLIT_CHUNK_SIZE) ? area.rightX - area.leftX + 1 : __BLIT_CHUNK_SIZE;
+    for (long i = 0; i < maxLength; ++i)
+      colors[i] = color;
+
+    for (long y = area.topY; y <= area.bottomY; ++y) {
+      uint16_t* destRow = target.pixels + (size_t)y*target.rowLength;
+      for (long x = area.leftX; x <= area.rightX; x += __BLIT_CHUNK_SIZE) {
+        const size_t length = (size_t)((area.rightX - x + 1 < __BLIT_CHUNK_SIZE) ? area.rightX - x + 1 : __BLIT_CHUNK_SIZE);
+        __if_constexpr (!isBlended && !isMaskChecked) {
+          copyVramSpan(&destRow[x], colors, length, state.forceMaskBit);
+        }
+        else {
+          writePixelSpan<blendingMode,isBlended,false,isMaskChecked,false>(&destRow[x], colors, nullptr, length, state.forceMaskBit);
+        }
+      }
+    }
+  }
+  else {
+    uint16_t texelBuffer[__BLIT_CHUNK_SIZE];
+    uint16_t writeMask[__BLIT_CHUNK_SIZE]; // transparent texels -> 0
+    int16_t dither[__BLIT_CHUNK_SIZE];
+
+    int64_t v = setup.baseV + (int64_t)setup.stepV*(area.topY - setup.originY);
+    for (long y = area.topY; y <= area.bottomY; ++y, v += setup.stepV) {
+      const uint32_t texV = (uint32_t)(v >> __ATTRIBUTE_FRACTION_BITS) & 0xFFu;
+      uint16_t* destRow = target.pixels + (size_t)y*target.rowLength;
+
+      // dithering based on native coords: pattern of 4*scaleX pixels
+      int16_t ditherLine[4*maxRasterScale()];
+      long ditherLength = 1;
+      __if_constexpr (isDithered) {
+        const int32_t* ditherRow = g_ditherMatrix[(y / target.scaleY) & 0x3];
+        ditherLength = 4*target.scaleX;
+        for (long i = 0; i < ditherLength; ++i)
+          ditherLine[i] = (int16_t)ditherRow[i / target.scaleX];
+      }
+
+      for (long x = area.leftX; x <= area.rightX; ) {
+        const uint16_t* texels;
+        const long length = __readTexelRun(textures, state, setup, texV, x,
+                                           (area.rightX - x + 1 < __BLIT_CHUNK_SIZE) ? area.rightX - x + 1 : __BLIT_CHUNK_SIZE,
+                                           texelBuffer, texels);
+        __if_constexpr (isRawTexture) { // 1:1 copy of texels (texel 0: transparent)
+          writePixelSpan<blendingMode,isBlended,true,isMaskChecked,false,true>(&destRow[x], texels, nullptr,
+                                                                              (size_t)length, state.forceMaskBit);
+        }
+        else {
+          __if_constexpr (isDithered) {
+            long ditherIndex = x % ditherLength;
+            for (long i = 0; i < length; ++i) {
+              dither[i] = ditherLine[ditherIndex];
+              ditherIndex = (ditherIndex + 1 < ditherLength) ? ditherIndex + 1 : 0;
+            }
+          }
+          __modulateTexels<isDithered>(texels, dither, length, setup, colors, writeMask);
+          writePixelSpan<blendingMode,isBlended,true,isMaskChecked,true>(&destRow[x], colors, writeMask,
+                                                                        (size_t)length, state.forceMaskBit);
+        }
+        x += length;
+      }
+    }
+  }
+}
+
+// ---
+
+template <unsigned long _Height>
+using BlitPipeline = void (*)(const Vram<_Height>&, const RasterTarget&, const RasterState&,
+                              const RectangleSetup&, const Rectangle&) noexcept;
+
+#define BLIT(id)      __blitRectangle<_Height, __toCanonicalBlitId(id)>
+#define BLIT_4X(id)   BLIT(id), BLIT((id)+1u), BLIT((id)+2u), BLIT((id)+3u)
+#define BLIT_16X(id)  BLIT_4X(id), BLIT_4X((id)+4u), BLIT_4X((id)+8u), BLIT_4X((id)+12u)
+
+// Specialized rectangle blitters, indexed by blitter ID (equivalent combinations share the same function)
+template <unsigned long _Height>
+static constexpr const BlitPipeline<_Height> g_blitPipelines[__BLIT_PIPELINE_COUNT] = {
+  BLIT_16X(0x00u), BLIT_16X(0x10u), BLIT_16X(0x20u), BLIT_16X(0x30u),
+  BLIT_16X(0x40u), BLIT_16X(0x50u), BLIT_16X(0x60u), BLIT_16X(0x70u)
+};
+
+// ---
+
+template <unsigned long _Height>
+bool Rasterizer::rasterizeRectangle(const Vram<_Height>& textures, const RasterTarget& target, const RasterState& state,
+                                    const RasterVertex& nativeTopLeft, long width, long height,
+                                    const Rectangle& targetArea, Rectangle& outArea) noexcept {
+  if (width <= 0 || height <= 0)
+    return false;
+  const RasterVertex topLeft = __scaleVertex(nativeTopLeft, target);
+
+  // covered area (right/bottom edges excluded), clipped to draw area (scaled) + target area
+  Rectangle area{ topLeft.x, (nativeTopLeft.x + width)*target.scaleX - 1, topLeft.y, (nativeTopLeft.y + height)*target.scaleY - 1 };
+  if (area.leftX < state.clipArea.leftX*target.scaleX)
+    area.leftX = state.clipArea.leftX*target.scaleX;
+  if (area.rightX > (state.clipArea.rightX + 1)*target.scaleX - 1)
+    area.rightX = (state.clipArea.rightX + 1)*target.scaleX - 1;
+  if (area.topY < state.clipArea.topY*target.scaleY)
+    area.topY = state.clipArea.topY*target.scaleY;
+  if (area.bottomY > (state.clipArea.bottomY + 1)*target.scaleY - 1)
+    area.bottomY = (state.clipArea.bottomY + 1)*target.scaleY - 1;
+  if (area.leftX < targetArea.leftX)
+    area.leftX = targetArea.leftX;
+  if (area.rightX > targetArea.rightX)
+    area.rightX = targetArea.rightX;
+  if (area.topY < targetArea.topY)
+    area.topY = targetArea.topY;
+  if (area.bottomY > targetArea.bottomY)
+    area.bottomY = targetArea.bottomY;
+  if (area.leftX < 0)
+    area.leftX = 0;
+  if (area.rightX >= target.width)
+    area.rightX = target.width - 1;
+  if (area.topY < 0)
+    area.topY = 0;
+  if (area.bottomY >= target.height)
+    area.bottomY = target.height - 1;
+  if (area.leftX > area.rightX || area.topY > area.bottomY)
+    return false;
+
+  // flat color + 1:1 texture mapping (one texel per native pixel) -> no edge functions, no attribute planes
+  RectangleSetup setup;
+  setup.originX = topLeft.x;
+  setup.originY = topLeft.y;
+  setup.red = __colorComponent(topLeft.color, Attribute::red);
+  setup.green = __colorComponent(topLeft.color, Attribute::green);
+  setup.blue = __colorComponent(topLeft.color, Attribute::blue);
+  setup.baseU = ((int64_t)topLeft.u << __ATTRIBUTE_FRACTION_BITS) + __ATTRIBUTE_HALF;
+  setup.baseV = ((int64_t)topLeft.v << __ATTRIBUTE_FRACTION_BITS) + __ATTRIBUTE_HALF;
+  setup.stepU = (int32_t)(((1L << __ATTRIBUTE_FRACTION_BITS) + target.scaleX/2) / target.scaleX);
+  setup.stepV = (int32_t)(((1L << __ATTRIBUTE_FRACTION_BITS) + target.scaleY/2) / target.scaleY);
+  if (state.isTextureFlipX)
+    setup.stepU = -setup.stepU;
+  if (state.isTextureFlipY)
+    setup.stepV = -setup.stepV;
+  setup.texelSource = state.isTextured ? __toTexelSource(state) : 0;
+  setup.hasTextureWindow = (state.isTextured && __hasTextureWindow(state.textureWindow));
+  setup.isContiguous = (state.isTextured && target.scaleX == 1 && !setup.hasTextureWindow
+                     && (setup.texelSource == __SPAN_TEXEL_SOURCE_DECODED || setup.texelSource == 2u));
+
+  const bool useDithering = (state.isDithered && state.isTextured && !state.isRawTexture);
+  g_blitPipelines<_Height>[__toBlitPipelineId(state, useDithering)](textures, target, state, setup, area);
+  outArea = area;
+  return true;
+}
+
+template bool Rasterizer::rasterizeRectangle<psxVramHeight()>(const Vram<psxVramHeight()>&, const RasterTarget&, const RasterState&,
+                                                              const RasterVertex&, long, long, const Rectangle&, Rectangle&) noexcept;
+template bool Rasterizer::rasterizeRectangle<znArcadeVramHeight()>(const Vram<znArcadeVramHeight()>&, const RasterTarget&, const RasterState&,
+                                                                   const RasterVertex&, long, long, const Rectangle&, Rectangle&) noexcept;
+
+// -- line rasterization -- ----------------------------------------------------
+
+#define __LINE_COORD_FRACTION_BITS 32
+#define __LINE_COORD_ONE           ((int64_t)1 << __LINE_COORD_FRACTION_BITS)
+#define __LINE_COLOR_FRACTION_BITS 12
+
+// Fixed-point line stepping (same precision and rounding as hardware)
+struct LineSetup final {
+  int64_t x;             // native coords of current pixel (32-bit fraction)
+  int64_t y;
+  int64_t stepX;         // coord increments per pixel
+  int64_t stepY;
+  int32_t colors[3];     // color components of first pixel (12-bit fraction)
+  int32_t colorSteps[3]; // color increments per pixel (0 if flat)
+  long length;           // number of pixels (both end points included)
+  bool isShallow;        // X major axis (not diagonal) -> several pixels per row
+};
+
+// Divide coord delta by number of steps (rounded away from zero)
+static inline int64_t __divideLineDelta(long delta, long stepCount) noexcept {
+  int64_t value = (int64_t)delta * __LINE_COORD_ONE;
+  if (value < 0)
+    value -= (int64_t)stepCount - 1;
+  else if (value > 0)
+    value += (int64_t)stepCount - 1;
+  return value / (int64_t)stepCount;
+}
+
+// Compute first pixel and increments along major axis
+static inline void __setupLine(const RasterState& state, const RasterVertex* v0, const RasterVertex* v1,
+                               LineSetup& outSetup) noexcept {
+  long deltaX = (v1->x >= v0->x) ? v1->x - v0->x : v0->x - v1->x;
+  long deltaY = (v1->y >= v0->y) ? v1->y - v0->y : v0->y - v1->y;
+  long stepCount = (deltaX > deltaY) ? deltaX : deltaY;
+  outSetup.isShallow = (deltaX > deltaY);
+  if (v0->x >= v1->x && stepCount) { // always drawn from left to right
+    const RasterVertex* swapped = v0;
+    v0 = v1;
+    v1 = swapped;
+  }
+  deltaX = v1->x - v0->x;
+  deltaY = v1->y - v0->y;
+
+  outSetup.x = (int64_t)v0->x * __LINE_COORD_ONE + (__LINE_COORD_ONE >> 1) - 1024;
+  outSetup.y = (int64_t)v0->y * __LINE_COORD_ONE + (__LINE_COORD_ONE >> 1) - ((deltaY < 0) ? 1024 : 0);
+  outSetup.stepX = stepCount ? __divideLineDelta(deltaX, stepCount) : 0;
+  outSetup.stepY = stepCount ? __divideLineDelta(deltaY, stepCount) : 0;
+  outSetup.length = stepCount + 1;
+
+  for (size_t i = 0; i <= (size_t)Attribute::blue; ++i) {
+    int32_t first = __colorComponent(v0->color, (Attribute)i);
+    outSetup.colors[i] = (first << __LINE_COLOR_FRACTION_BITS) | (1 << (__LINE_COLOR_FRACTION_BITS - 1));
+    outSetup.colorSteps[i] = (state.isShaded && stepCount)
+                           ? ((__colorComponent(v1->color, (Attribute)i) - first) * (1 << __LINE_COLOR_FRACTION_BITS)) / (int32_t)stepCount
+                           : 0;
+  }
+}
+
+// Number of consecutive pixels of a shallow line located on the same row as current pixel
+static inline long __getLineRunLength(const LineSetup& setup, int64_t y, long remainingLength) noexcept {
+  long runLength;
+  if (setup.stepY > 0) { // pixels until next row boundary
+    int64_t rowEnd = ((y >> __LINE_COORD_FRACTION_BITS) + 1) * __LINE_COORD_ONE;
+    runLength = (long)((rowEnd - y + setup.stepY - 1) / setup.stepY);
+  }
+  else if (setup.stepY < 0) { // pixels until current row boundary
+    int64_t rowStart = (y >> __LINE_COORD_FRACTION_BITS) * __LINE_COORD_ONE;
+    runLength = (long)((y - rowStart) / -setup.stepY) + 1;
+  }
+  else
+    return remainingLength; // horizontal line
+  return (runLength < remainingLength) ? runLength : remainingLength;
+}
+
+// Draw horizontal run of line pixels (native coords: first pixel at 'x', on row 'y')
+// - firstStep:   index of first pixel of the run in the line
+// - flatColors:  chunk of identical colors for flat lines (or nullptr to shade each pixel)
+static bool __drawLineRun(const RasterTarget& target, const RasterState& state, const LineSetup& setup,
+                          PixelSpanWriter writeSpan, const Rectangle& clipArea, const uint16_t* flatColors,
+                          bool useDithering, long x, long y, long runLength, long firstStep, Rectangle& drawnArea) noexcept {
+  long topY = y*target.scaleY, bottomY = topY + target.scaleY - 1;
+  long leftX = x*target.scaleX, rightX = (x + runLength)*target.scaleX - 1;
+  if (topY < clipArea.topY)
+    topY = clipArea.topY;
+  if (bottomY > clipArea.bottomY)
+    bottomY = clipArea.bottomY;
+  if (leftX < clipArea.leftX)
+    leftX = clipArea.leftX;
+  if (rightX > clipArea.rightX)
+    rightX = clipArea.rightX;
+  if (leftX > rightX || topY > bottomY)
+    return false;
+
+  uint16_t colors[__SPAN_CHUNK_SIZE];
+  const int32_t* ditherRow = g_ditherMatrix[y & 0x3];
+  for (long chunkX = leftX; chunkX <= rightX; chunkX += __SPAN_CHUNK_SIZE) {
+    const long chunkLength = (rightX - chunkX + 1 < __SPAN_CHUNK_SIZE) ? rightX - chunkX + 1 : __SPAN_CHUNK_SIZE;
+    if (flatColors == nullptr) { // colors interpolated along native pixels (each one repeated scaleX times)
+      long nativeX = chunkX / target.scaleX, subPixel = chunkX % target.scaleX;
+      const int32_t step = (int32_t)(firstStep + nativeX - x);
+      int32_t red = setup.colors[0] + setup.colorSteps[0]*step;
+      int32_t green = setup.colors[1] + setup.colorSteps[1]*step;
+      int32_t blue = setup.colors[2] + setup.colorSteps[2]*step;
+      for (long i = 0; i < chunkLength; ++i) {
+        const int32_t dither = useDithering ? ditherRow[nativeX & 0x3] : 0;
+        colors[i] = __toColor15bit((red >> __LINE_COLOR_FRACTION_BITS) + dither, (green >> __LINE_COLOR_FRACTION_BITS) + dither,
+                                   (blue >> __LINE_COLOR_FRACTION_BITS) + dither);
+        if (++subPixel == target.scaleX) {
+          subPixel = 0;
+          ++nativeX;
+          red += setup.colorSteps[0];
+          green += setup.colorSteps[1];
+          blue += setup.colorSteps[2];
+        }
+      }
+    }
+    const uint16_t* chunkColors = flatColors ? flatColors : colors;
+    for (long row = topY; row <= bottomY; ++row)
+      writeSpan(target.pixels + (size_t)row*target.rowLength + chunkX, chunkColors, nullptr, (size_t)chunkLength, state.forceMaskBit);
+  }
+
+  if (leftX < drawnArea.leftX)
+    drawnArea.leftX = leftX;
+  if (rightX > drawnArea.rightX)
+    drawnArea.rightX = rightX;
+  if (topY < drawnArea.topY)
+    drawnArea.topY = topY;
+  if (bottomY > drawnArea.bottomY)
+    drawnArea.bottomY = bottomY;
+  return true;
+}
+
+// Draw line with one pixel per step (steep/diagonal lines at native resolution)
+static bool __drawLinePixels(const RasterTarget& target, const RasterState& state, const LineSetup& setup,
+                             PixelSpanWriter writeSpan, const Rectangle& clipArea, uint16_t flatColor,
+                             bool useDithering, Rectangle& drawnArea) noexcept {
+  bool isDrawn = false;
+  int64_t x = setup.x, y = setup.y;
+  int32_t red = setup.colors[0], green = setup.colors[1], blue = setup.colors[2];
+  for (long step = 0; step < setup.length; ++step) {
+    const long pixelX = (long)(x >> __LINE_COORD_FRACTION_BITS), pixelY = (long)(y >> __LINE_COORD_FRACTION_BITS);
+    if (pixelX >= clipArea.leftX && pixelX <= clipArea.rightX && pixelY >= clipArea.topY && pixelY <= clipArea.bottomY) {
+      uint16_t color = flatColor;
+      if (state.isShaded) {
+        const int32_t dither = useDithering ? g_ditherMatrix[pixelY & 0x3][pixelX & 0x3] : 0;
+        color = __toColor15bit((red >> __LINE_COLOR_FRACTION_BITS) + dither, (green >> __LINE_COLOR_FRACTION_BITS) + dither,
+                               (blue >> __LINE_COLOR_FRACTION_BITS) + dither);
+      }
+      writeSpan(target.pixels + (size_t)pixelY*target.rowLength + pixelX, &color, nullptr, 1u, state.forceMaskBit);
+
+      if (pixelX < drawnArea.leftX)
+        drawnArea.leftX = pixelX;
+      if (pixelX > drawnArea.rightX)
+        drawnArea.rightX = pixelX;
+      if (pixelY < drawnArea.topY)
+        drawnArea.topY = pixelY;
+      if (pixelY > drawnArea.bottomY)
+        drawnArea.bottomY = pixelY;
+      isDrawn = true;
+    }
+    x += setup.stepX;
+    y += setup.stepY;
+    red += setup.colorSteps[0];
+    green += setup.colorSteps[1];
+    blue += setup.colorSteps[2];
+  }
+  return isDrawn;
+}
+
+bool Rasterizer::rasterizeLine(const RasterTarget& target, const RasterState& state, const RasterVertex& v0,
+                               const RasterVertex& v1, const Rectangle& targetArea, Rectangle& outArea) noexcept {
+  if (isLineTooLarge(v0, v1)) // size limit based on native coords
+    return false;
+
+  // clipping area: draw area (scaled) + target area
+  Rectangle clipArea{ state.clipArea.leftX*target.scaleX, (state.clipArea.rightX + 1)*target.scaleX - 1,
+                      state.clipArea.topY*target.scaleY, (state.clipArea.bottomY + 1)*target.scaleY - 1 };
+  if (clipArea.leftX < targetArea.leftX)
+    clipArea.leftX = targetArea.leftX;
+  if (clipArea.rightX > targetArea.rightX)
+    clipArea.rightX = targetArea.rightX;
+  if (clipArea.topY < targetArea.topY)
+    clipArea.topY = targetArea.topY;
+  if (clipArea.bottomY > targetArea.bottomY)
+    clipArea.bottomY = targetArea.bottomY;
+  if (clipArea.leftX < 0)
+    clipArea.leftX = 0;
+  if (clipArea.rightX >= target.width)
+    clipArea.rightX = target.width - 1;
+  if (clipArea.topY < 0)
+    clipArea.topY = 0;
+  if (clipArea.bottomY >= target.height)
+    clipArea.bottomY = target.height - 1;
+  if (clipArea.leftX > clipArea.rightX || clipArea.topY > clipArea.bottomY)
+    return false;
+
+  LineSetup setup;
+  __setupLine(state, &v0, &v1, setup);
+  const bool useDithering = (state.isDithered && state.isShaded);
+  const PixelSpanWriter writeSpan = getPixelSpanWriter(state.blendingMode, state.isSemiTransparent, false, state.checkMask, false);
+
+  uint16_t flatColors[__SPAN_CHUNK_SIZE] = { 0 };
+  if (!state.isShaded) {
+    const uint16_t color = __toColor15bit(setup.colors[0] >> __LINE_COLOR_FRACTION_BITS, setup.colors[1] >> __LINE_COLOR_FRACTION_BITS,
+                                          setup.colors[2] >> __LINE_COLOR_FRACTION_BITS);
+    for (long i = 0; i < __SPAN_CHUNK_SIZE; ++i)
+      flatColors[i] = color;
+  }
+
+  // shallow lines: draw runs of pixels located on the same row (one step per run) -- steep lines: one pixel per step
+  Rectangle drawnArea{ clipArea.rightX + 1, clipArea.leftX - 1, clipArea.bottomY + 1, clipArea.topY - 1 };
+  bool isDrawn = false;
+  if (!setup.isShallow && target.scaleX == 1 && target.scaleY == 1) {
+    isDrawn = __drawLinePixels(target, state, setup, writeSpan, clipArea, flatColors[0], useDithering, drawnArea);
+  }
+  else {
+    int64_t x = setup.x, y = setup.y;
+    for (long step = 0; step < setup.length; ) {
+      const long runLength = setup.isShallow ? __getLineRunLength(setup, y, setup.length - step) : 1;
+      if (__drawLineRun(target, state, setup, writeSpan, clipArea, state.isShaded ? nullptr : flatColors, useDithering,
+                        (long)(x >> __LINE_COORD_FRACTION_BITS), (long)(y >> __LINE_COORD_FRACTION_BITS),
+                        runLength, step, drawnArea)) {
+        isDrawn = true;
+      }
+      x += setup.stepX*runLength;
+      y += setup.stepY*runLength;
+      step += runLength;
+    }
+  }
+
+  if (isDrawn)
+    outArea = drawnArea;
+  return isDrawn;
+}
@@ -36,3 +36,44 @@ void Renderer::resize(const pandora::hardware::DisplayMode&, const Viewport&) {
 void Renderer::swapBuffers(bool) {
 
 }
+
+bool Renderer::clearRenderTarget(const Rectangle&, uint32_t) noexcept {
+  return false;
+}
+
+// ---
+
+void Renderer::drawPrimitives(DrawList& drawList) noexcept {
+  if (drawList.empty() && drawList.barrierCount() == 0)
+    return;
+  drawList.cullPrimitives(); // + vertex decoding
+  bool isBuilt = true;
+  try {
+    this->_batcher.build(drawList, DrawOrder::stateSorted);
+  }
+  catch (...) { isBuilt = false; } // allocation failure -> primitives not drawn (barriers still applied)
+
+  // batches/barriers in submission order (clears between primitives must not be moved)
+  const size_t batchCount = isBuilt ? this->_batcher.batches().size() : 0;
+  size_t batchIndex = 0;
+  for (size_t i = 0; i < drawList.barrierCount(); ++i) {
+    const size_t barrierBatch = isBuilt ? (size_t)this->_batcher.barrierBatches()[i] : 0;
+    if (barrierBatch > batchIndex) {
+      _drawBatches(drawList, batchIndex, barrierBatch);
+      batchIndex = barrierBatch;
+    }
+
+    const DrawBarrier& barrier = drawList.barrier(i);
+    if (barrier.type == DrawBarrierType::clear)
+      clearRenderTarget(barrier.area, barrier.color);
+    // VRAM write: area re-uploaded before next batches (textures read from it)
+  }
+  if (batchCount > batchIndex)
+    _drawBatches(drawList, batchIndex, batchCount);
+}
+
+// Draw range of batches [firstBatch; endBatch[
+void Renderer::_drawBatches(const DrawList&, size_t, size_t) noexcept {
+  // vertex streams (+ primitive depth) + index buffer upload, then one draw call per batch (render state bound on batch change only)
+  // -> depth buffer cleared at frame start + 'greater' depth test with depth write for all batches (painter's order)
+}
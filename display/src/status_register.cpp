@@ -138,6 +138,7 @@ void StatusRegister::resetGpu() noexcept {
   this->_isTextureFlipX = this->_isTextureFlipY = false;
   this->_isTextureDecodingIL = false;
   this->_textureWindow = TextureWindow{};
+  _resetAttributeHistory();
 }
 
 void StatusRegister::setDisplayMode(unsigned long params) noexcept {
@@ -171,6 +172,7 @@ void StatusRegister::setDisplayMode(unsigned long params) noexcept {
 // ---
 
 void StatusRegister::setTexturePageMode(unsigned long params) noexcept {
+  this->_attributeHistory[0] = (uint32_t)(params & 0xFFFFFFu);
   if (this->_gpuType != GpuVersion::arcadeGpu2) { // standard PS1 GPU / regular arcade GPUs
     this->_statusControlRegister &= ~(texturePageBits());
     this->_statusControlRegister |= (params & 0x7FFu)
@@ -198,7 +200,20 @@ void StatusRegister::setTexturePageMode(unsigned long params) noexcept {
   }
 }
 
+void StatusRegister::setPolygonTexturePage(unsigned long texpage) noexcept {
+  if (this->_gpuType != GpuVersion::arcadeGpu2) {
+    setTexturePageMode((texpage & 0x9FFu)
+                     | (this->_statusControlRegister & ((unsigned long)StatusBits::dithering | (unsigned long)StatusBits::drawToDisplay))
+                     | (this->_isTextureFlipX ? 0x1000u : 0) | (this->_isTextureFlipY ? 0x2000u : 0));
+  }
+  else {
+    setTexturePageMode((texpage & 0x7FFu) | (this->_statusControlRegister & 0x1800u)
+                     | (this->_isTextureDecodingIL ? 0x2000u : 0));
+  }
+}
+
 void StatusRegister::setTextureWindow(unsigned long params) noexcept {
+  this->_attributeHistory[1] = (uint32_t)(params & 0xFFFFFFu);
   // texture window width/height must be a power of 2 (or 0 for 256) -> multiplied by 8 for texels
   // -> params may be invalid: verify bit by bit
   if (params & 0x01)      // xxxx1
@@ -263,6 +278,7 @@ void StatusRegister::setVerticalDisplayRange(unsigned long params) noexcept {
 // ---
 
 void StatusRegister::setDrawAreaOrigin(unsigned long params) noexcept {
+  this->_attributeHistory[2] = (uint32_t)(params & 0xFFFFFFu);
   this->_displayState.drawArea.leftX = (params & 0x3FFu); // [0; 1023]
   if (this->_vramHeight == psxVramHeight())
     this->_displayState.drawArea.topY = ((params >> 10) & 0x1FFu); // [0; 511]
@@ -273,6 +289,7 @@ void StatusRegister::setDrawAreaOrigin(unsigned long params) noexcept {
 }
 
 void StatusRegister::setDrawAreaEnd(unsigned long params) noexcept {
+  this->_attributeHistory[3] = (uint32_t)(params & 0xFFFFFFu);
   this->_displayState.drawArea.rightX = (params & 0x3FFu); // [0; 1023]
   if (this->_vramHeight == psxVramHeight())
     this->_displayState.drawArea.bottomY = ((params >> 10) & 0x1FFu); // [0; 511]
@@ -283,6 +300,7 @@ void StatusRegister::setDrawAreaEnd(unsigned long params) noexcept {
 }
 
 void StatusRegister::setDrawOffset(unsigned long params) noexcept {
+  this->_attributeHistory[4] = (uint32_t)(params & 0xFFFFFFu);
   this->_displayState.drawOffset.x = (long)(params & 0x7FF); // [-1024; 1023]
   if (params & 0x400u) // negative
     this->_displayState.drawOffset.x |= ~(long)0x7FF;
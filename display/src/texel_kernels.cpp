@@ -0,0 +1,452 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include "display/texel_kernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+# define __TEXEL_KERNELS_X86 1
+# include <immintrin.h>
+# if defined(_MSC_VER) && !defined(__clang__)
+#   include <intrin.h>
+#   define __TARGET_SSSE3
+#   define __TARGET_AVX2
+# else
+#   define __TARGET_SSSE3 __attribute__((target("ssse3")))
+#   define __TARGET_AVX2  __attribute__((target("avx2")))
+# endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+# define __TEXEL_KERNELS_NEON 1
+# include <arm_neon.h>
+#endif
+
+using namespace display;
+
+
+// -- scalar kernels -- --------------------------------------------------------
+
+static void __expandLookupTable4bitScalar(const uint16_t* indexes, size_t length, const uint16_t* lookupTable, uint16_t* outTexels) noexcept {
+  for (const uint16_t* end = indexes + length; indexes < end; ++indexes, outTexels += 4) {
+    uint16_t packed = *indexes;
+    outTexels[0] = lookupTable[packed & 0xFu];
+    outTexels[1] = lookupTable[(packed >> 4) & 0xFu];
+    outTexels[2] = lookupTable[(packed >> 8) & 0xFu];
+    outTexels[3] = lookupTable[packed >> 12];
+  }
+}
+static void __expandLookupTable8bitScalar(const uint16_t* indexes, size_t length, const uint16_t* lookupTable, uint16_t* outTexels) noexcept {
+  for (const uint16_t* end = indexes + length; indexes < end; ++indexes, outTexels += 2) {
+    uint16_t packed = *indexes;
+    outTexels[0] = lookupTable[packed & 0xFFu];
+    outTexels[1] = lookupTable[packed >> 8];
+  }
+}
+
+static inline uint32_t __toRgba8888(uint32_t texel) noexcept {
+  return (((texel << 3) & 0xF8u) | ((texel >> 2) & 0x07u))               // red
+       | (((texel << 6) & 0xF800u) | ((texel << 1) & 0x0700u))           // green
+       | (((texel << 9) & 0xF80000u) | ((texel << 4) & 0x070000u))       // blue
+       | (texel ? 0xFF000000u : 0);                                     // alpha
+}
+static inline uint16_t __toRgba5551(uint32_t texel) noexcept {
+  return (uint16_t)(((texel & 0x1Fu) << 11) | ((texel & 0x3E0u) << 1) | ((texel >> 9) & 0x3Eu) | (texel ? 1u : 0));
+}
+
+static void __convertToRgba8888Scalar(const uint16_t* texels, size_t length, uint32_t* outPixels, uint8_t* outStpMask) noexcept {
+  for (size_t i = 0; i < length; ++i)
+    outPixels[i] = __toRgba8888(texels[i]);
+  if (outStpMask) {
+    for (size_t i = 0; i < length; ++i)
+      outStpMask[i] = (texels[i] & 0x8000u) ? 0xFFu : 0;
+  }
+}
+static void __convertToRgba5551Scalar(const uint16_t* texels, size_t length, uint16_t* outPixels, uint8_t* outStpMask) noexcept {
+  for (size_t i = 0; i < length; ++i)
+    outPixels[i] = __toRgba5551(texels[i]);
+  if (outStpMask) {
+    for (size_t i = 0; i < length; ++i)
+      outStpMask[i] = (texels[i] & 0x8000u) ? 0xFFu : 0;
+  }
+}
+
+
+// -- x86 kernels -- -----------------------------------------------------------
+
+#ifdef __TEXEL_KERNELS_X86
+  // Split 16-entry lookup table into low bytes / high bytes (1 register each -> byte shuffles)
+  __TARGET_SSSE3 static inline void __splitLookupTable4bit(const uint16_t* lookupTable, __m128i& outLowBytes, __m128i& outHighBytes) noexcept {
+    const __m128i byteSplit = _mm_setr_epi8(0,2,4,6,8,10,12,14, 1,3,5,7,9,11,13,15);
+    __m128i first = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)lookupTable), byteSplit);         // entries 0-7
+    __m128i second = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(lookupTable + 8)), byteSplit); // entries 8-15
+    outLowBytes = _mm_unpacklo_epi64(first, second);
+    outHighBytes = _mm_unpackhi_epi64(first, second);
+  }
+
+  // 8 VRAM texels -> 32 texels
+  __TARGET_SSSE3 static void __expandLookupTable4bitSsse3(const uint16_t* indexes, size_t length, const uint16_t* lookupTable,
+                                                          uint16_t* outTexels) noexcept {
+    __m128i tableLow, tableHigh;
+    __splitLookupTable4bit(lookupTable, tableLow, tableHigh);
+    const __m128i nibbleMask = _mm_set1_epi8(0x0F);
+
+    for (; length >= 8u; length -= 8u, indexes += 8, outTexels += 32) {
+      __m128i packed = _mm_loadu_si128((const __m128i*)indexes);
+      __m128i lowNibbles = _mm_and_si128(packed, nibbleMask);
+      __m128i highNibbles = _mm_and_si128(_mm_srli_epi16(packed, 4), nibbleMask);
+      __m128i firstIndexes = _mm_unpacklo_epi8(lowNibbles, highNibbles);  // texels 0-15
+      __m128i secondIndexes = _mm_unpackhi_epi8(lowNibbles, highNibbles); // texels 16-31
+
+      __m128i lowBytes = _mm_shuffle_epi8(tableLow, firstIndexes);
+      __m128i highBytes = _mm_shuffle_epi8(tableHigh, firstIndexes);
+      _mm_storeu_si128((__m128i*)outTexels, _mm_unpacklo_epi8(lowBytes, highBytes));
+      _mm_storeu_si128((__m128i*)(outTexels + 8), _mm_unpackhi_epi8(lowBytes, highBytes));
+      lowBytes = _mm_shuffle_epi8(tableLow, secondIndexes);
+      highBytes = _mm_shuffle_epi8(tableHigh, secondIndexes);
+      _mm_storeu_si128((__m128i*)(outTexels + 16), _mm_unpacklo_epi8(lowBytes, highBytes));
+      _mm_storeu_si128((__m128i*)(outTexels + 24), _mm_unpackhi_epi8(lowBytes, highBytes));
+    }
+    __expandLookupTable4bitScalar(indexes, length, lookupTable, outTexels);
+  }
+
+  // 16 VRAM texels -> 64 texels
+  __TARGET_AVX2 static void __expandLookupTable4bitAvx2(const uint16_t* indexes, size_t length, const uint16_t* lookupTable,
+                                                        uint16_t* outTexels) noexcept {
+    const __m128i byteSplit = _mm_setr_epi8(0,2,4,6,8,10,12,14, 1,3,5,7,9,11,13,15);
+    __m128i first = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)lookupTable), byteSplit);
+    __m128i second = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(lookupTable + 8)), byteSplit);
+    const __m256i tableLow = _mm256_broadcastsi128_si256(_mm_unpacklo_epi64(first, second)); // shuffles are lane-based
+    const __m256i tableHigh = _mm256_broadcastsi128_si256(_mm_unpackhi_epi64(first, second));
+    const __m256i nibbleMask = _mm256_set1_epi8(0x0F);
+
+    for (; length >= 16u; length -= 16u, indexes += 16, outTexels += 64) {
+      __m256i packed = _mm256_loadu_si256((const __m256i*)indexes);
+      __m256i lowNibbles = _mm256_and_si256(packed, nibbleMask);
+      __m256i highNibbles = _mm256_and_si256(_mm256_srli_epi16(packed, 4), nibbleMask);
+      __m256i firstIndexes = _mm256_unpacklo_epi8(lowNibbles, highNibbles);  // texels 0-15 | 32-47
+      __m256i secondIndexes = _mm256_unpackhi_epi8(lowNibbles, highNibbles); // texels 16-31 | 48-63
+
+      __m256i lowBytes = _mm256_shuffle_epi8(tableLow, firstIndexes);
+      __m256i highBytes = _mm256_shuffle_epi8(tableHigh, firstIndexes);
+      __m256i lowTexels = _mm256_unpacklo_epi8(lowBytes, highBytes);  // texels 0-7 | 32-39
+      __m256i highTexels = _mm256_unpackhi_epi8(lowBytes, highBytes); // texels 8-15 | 40-47
+      _mm256_storeu_si256((__m256i*)outTexels, _mm256_permute2x128_si256(lowTexels, highTexels, 0x20));
+      _mm256_storeu_si256((__m256i*)(outTexels + 32), _mm256_permute2x128_si256(lowTexels, highTexels, 0x31));
+
+      lowBytes = _mm256_shuffle_epi8(tableLow, secondIndexes);
+      highBytes = _mm256_shuffle_epi8(tableHigh, secondIndexes);
+      lowTexels = _mm256_unpacklo_epi8(lowBytes, highBytes);  // texels 16-23 | 48-55
+      highTexels = _mm256_unpackhi_epi8(lowBytes, highBytes); // texels 24-31 | 56-63
+      _mm256_storeu_si256((__m256i*)(outTexels + 16), _mm256_permute2x128_si256(lowTexels, highTexels, 0x20));
+      _mm256_storeu_si256((__m256i*)(outTexels + 48), _mm256_permute2x128_si256(lowTexels, highTexels, 0x31));
+    }
+    __expandLookupTable4bitScalar(indexes, length, lookupTable, outTexels);
+  }
+
+  // 8 VRAM texels -> 16 texels (gathers)
+  __TARGET_AVX2 static void __expandLookupTable8bitAvx2(const uint16_t* indexes, size_t length, const uint16_t* lookupTable,
+                                                        uint16_t* outTexels) noexcept {
+    uint16_t paddedTable[256 + 2]; // 32-bit gathers read 1 extra entry
+    memcpy(paddedTable, lookupTable, 256u*sizeof(uint16_t));
+    paddedTable[256] = paddedTable[257] = 0;
+    const __m256i entryMask = _mm256_set1_epi32(0xFFFF);
+
+    for (; length >= 8u; length -= 8u, indexes += 8, outTexels += 16) {
+      __m128i packed = _mm_loadu_si128((const __m128i*)indexes);
+      __m256i firstIndexes = _mm256_cvtepu8_epi32(packed);                     // texels 0-7
+      __m256i secondIndexes = _mm256_cvtepu8_epi32(_mm_srli_si128(packed, 8)); // texels 8-15
+      __m256i firstTexels = _mm256_and_si256(_mm256_i32gather_epi32((const int*)paddedTable, firstIndexes, 2), entryMask);
+      __m256i secondTexels = _mm256_and_si256(_mm256_i32gather_epi32((const int*)paddedTable, secondIndexes, 2), entryMask);
+      __m256i texels = _mm256_packus_epi32(firstTexels, secondTexels); // 0-3,8-11 | 4-7,12-15
+      _mm256_storeu_si256((__m256i*)outTexels, _mm256_permute4x64_epi64(texels, 0xD8));
+    }
+    __expandLookupTable8bitScalar(indexes, length, lookupTable, outTexels);
+  }
+
+  // ---
+
+  // 4 texels (zero-extended to 32-bit) -> RGBA8888
+  __TARGET_SSSE3 static inline __m128i __toRgba8888Sse(__m128i texels) noexcept {
+    __m128i red = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(texels, 3), _mm_set1_epi32(0xF8)),
+                               _mm_and_si128(_mm_srli_epi32(texels, 2), _mm_set1_epi32(0x07)));
+    __m128i green = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(texels, 6), _mm_set1_epi32(0xF800)),
+                                 _mm_and_si128(_mm_slli_epi32(texels, 1), _mm_set1_epi32(0x0700)));
+    __m128i blue = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(texels, 9), _mm_set1_epi32(0xF80000)),
+                                _mm_and_si128(_mm_slli_epi32(texels, 4), _mm_set1_epi32(0x070000)));
+    __m128i alpha = _mm_andnot_si128(_mm_cmpeq_epi32(texels, _mm_setzero_si128()), _mm_set1_epi32((int)0xFF000000u));
+    return _mm_or_si128(_mm_or_si128(red, green), _mm_or_si128(blue, alpha));
+  }
+  // 8 texels -> RGBA5551
+  __TARGET_SSSE3 static inline __m128i __toRgba5551Sse(__m128i texels) noexcept {
+    __m128i red = _mm_slli_epi16(_mm_and_si128(texels, _mm_set1_epi16(0x1F)), 11);
+    __m128i green = _mm_slli_epi16(_mm_and_si128(texels, _mm_set1_epi16(0x3E0)), 1);
+    __m128i blue = _mm_and_si128(_mm_srli_epi16(texels, 9), _mm_set1_epi16(0x3E));
+    __m128i alpha = _mm_andnot_si128(_mm_cmpeq_epi16(texels, _mm_setzero_si128()), _mm_set1_epi16(1));
+    return _mm_or_si128(_mm_or_si128(red, green), _mm_or_si128(blue, alpha));
+  }
+
+  __TARGET_SSSE3 static void __convertToRgba8888Ssse3(const uint16_t* texels, size_t length, uint32_t* outPixels,
+                                                      uint8_t* outStpMask) noexcept {
+    for (; length >= 8u; length -= 8u, texels += 8, outPixels += 8) {
+      __m128i values = _mm_loadu_si128((const __m128i*)texels);
+      _mm_storeu_si128((__m128i*)outPixels, __toRgba8888Sse(_mm_unpacklo_epi16(values, _mm_setzero_si128())));
+      _mm_storeu_si128((__m128i*)(outPixels + 4), __toRgba8888Sse(_mm_unpackhi_epi16(values, _mm_setzero_si128())));
+      if (outStpMask) {
+        __m128i stpBits = _mm_srai_epi16(values, 15);
+        _mm_storel_epi64((__m128i*)outStpMask, _mm_packs_epi16(stpBits, stpBits));
+        outStpMask += 8;
+      }
+    }
+    __convertToRgba8888Scalar(texels, length, outPixels, outStpMask);
+  }
+  __TARGET_SSSE3 static void __convertToRgba5551Ssse3(const uint16_t* texels, size_t length, uint16_t* outPixels,
+                                                      uint8_t* outStpMask) noexcept {
+    for (; length >= 8u; length -= 8u, texels += 8, outPixels += 8) {
+      __m128i values = _mm_loadu_si128((const __m128i*)texels);
+      _mm_storeu_si128((__m128i*)outPixels, __toRgba5551Sse(values));
+      if (outStpMask) {
+        __m128i stpBits = _mm_srai_epi16(values, 15);
+        _mm_storel_epi64((__m128i*)outStpMask, _mm_packs_epi16(stpBits, stpBits));
+        outStpMask += 8;
+      }
+    }
+    __convertToRgba5551Scalar(texels, length, outPixels, outStpMask);
+  }
+
+  // ---
+
+  // 8 texels (zero-extended to 32-bit) -> RGBA8888
+  __TARGET_AVX2 static inline __m256i __toRgba8888Avx2(__m256i texels) noexcept {
+    __m256i red = _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(texels, 3), _mm256_set1_epi32(0xF8)),
+                                  _mm256_and_si256(_mm256_srli_epi32(texels, 2), _mm256_set1_epi32(0x07)));
+    __m256i green = _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(texels, 6), _mm256_set1_epi32(0xF800)),
+                                    _mm256_and_si256(_mm256_slli_epi32(texels, 1), _mm256_set1_epi32(0x0700)));
+    __m256i blue = _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(texels, 9), _mm256_set1_epi32(0xF80000)),
+                                   _mm256_and_si256(_mm256_slli_epi32(texels, 4), _mm256_set1_epi32(0x070000)));
+    __m256i alpha = _mm256_andnot_si256(_mm256_cmpeq_epi32(texels, _mm256_setzero_si256()), _mm256_set1_epi32((int)0xFF000000u));
+    return _mm256_or_si256(_mm256_or_si256(red, green), _mm256_or_si256(blue, alpha));
+  }
+
+  __TARGET_AVX2 static void __convertToRgba8888Avx2(const uint16_t* texels, size_t length, uint32_t* outPixels,
+                                                    uint8_t* outStpMask) noexcept {
+    for (; length >= 16u; length -= 16u, texels += 16, outPixels += 16) {
+      __m128i low = _mm_loadu_si128((const __m128i*)texels);
+      __m128i high = _mm_loadu_si128((const __m128i*)(texels + 8));
+      _mm256_storeu_si256((__m256i*)outPixels, __toRgba8888Avx2(_mm256_cvtepu16_epi32(low)));
+      _mm256_storeu_si256((__m256i*)(outPixels + 8), __toRgba8888Avx2(_mm256_cvtepu16_epi32(high)));
+      if (outStpMask) {
+        _mm_storeu_si128((__m128i*)outStpMask, _mm_packs_epi16(_mm_srai_epi16(low, 15), _mm_srai_epi16(high, 15)));
+        outStpMask += 16;
+      }
+    }
+    __convertToRgba8888Scalar(texels, length, outPixels, outStpMask);
+  }
+  __TARGET_AVX2 static void __convertToRgba5551Avx2(const uint16_t* texels, size_t length, uint16_t* outPixels,
+                                                    uint8_t* outStpMask) noexcept {
+    for (; length >= 16u; length -= 16u, texels += 16, outPixels += 16) {
+      __m256i values = _mm256_loadu_si256((const __m256i*)texels);
+      __m256i red = _mm256_slli_epi16(_mm256_and_si256(values, _mm256_set1_epi16(0x1F)), 11);
+      __m256i green = _mm256_slli_epi16(_mm256_and_si256(values, _mm256_set1_epi16(0x3E0)), 1);
+      __m256i blue = _mm256_and_si256(_mm256_srli_epi16(values, 9), _mm256_set1_epi16(0x3E));
+      __m256i alpha = _mm256_andnot_si256(_mm256_cmpeq_epi16(values, _mm256_setzero_si256()), _mm256_set1_epi16(1));
+      _mm256_storeu_si256((__m256i*)outPixels, _mm256_or_si256(_mm256_or_si256(red, green), _mm256_or_si256(blue, alpha)));
+      if (outStpMask) {
+        __m256i stpBits = _mm256_srai_epi16(values, 15);
+        _mm_storeu_si128((__m128i*)outStpMask, _mm_packs_epi16(_mm256_castsi256_si128(stpBits), _mm256_extracti128_si256(stpBits, 1)));
+        outStpMask += 16;
+      }
+    }
+    __convertToRgba5551Scalar(texels, length, outPixels, outStpMask);
+  }
+#endif
+
+
+// -- ARM kernels -- -----------------------------------------------------------
+
+#ifdef __TEXEL_KERNELS_NEON
+  // 8 VRAM texels -> 32 texels
+  static void __expandLookupTable4bitNeon(const uint16_t* indexes, size_t length, const uint16_t* lookupTable,
+                                          uint16_t* outTexels) noexcept {
+    uint8x16x2_t entries = vld2q_u8((const uint8_t*)lookupTable); // de-interleave: low bytes / high bytes
+    const uint8x16_t nibbleMask = vdupq_n_u8(0x0F);
+
+    for (; length >= 8u; length -= 8u, indexes += 8, outTexels += 32) {
+      uint8x16_t packed = vld1q_u8((const uint8_t*)indexes);
+      uint8x16x2_t texelIndexes = vzipq_u8(vandq_u8(packed, nibbleMask), vshrq_n_u8(packed, 4)); // texels 0-15 / 16-31
+      for (int i = 0; i < 2; ++i) {
+        uint8x16x2_t texels;
+        texels.val[0] = vqtbl1q_u8(entries.val[0], texelIndexes.val[i]);
+        texels.val[1] = vqtbl1q_u8(entries.val[1], texelIndexes.val[i]);
+        vst2q_u8((uint8_t*)(outTexels + i*16), texels); // interleave low/high bytes
+      }
+    }
+    __expandLookupTable4bitScalar(indexes, length, lookupTable, outTexels);
+  }
+
+  // 8 texels -> 8 color components
+  static inline uint8x8_t __toColorComponent(uint16x8_t texels, int shift) noexcept {
+    uint16x8_t component = vandq_u16(vshlq_u16(texels, vdupq_n_s16((int16_t)-shift)), vdupq_n_u16(0x1F));
+    return vmovn_u16(vorrq_u16(vshlq_n_u16(component, 3), vshrq_n_u16(component, 2)));
+  }
+
+  static void __convertToRgba8888Neon(const uint16_t* texels, size_t length, uint32_t* outPixels, uint8_t* outStpMask) noexcept {
+    for (; length >= 8u; length -= 8u, texels += 8, outPixels += 8) {
+      uint16x8_t values = vld1q_u16(texels);
+      uint8x8x4_t pixels;
+      pixels.val[0] = __toColorComponent(values, 0);
+      pixels.val[1] = __toColorComponent(values, 5);
+      pixels.val[2] = __toColorComponent(values, 10);
+      pixels.val[3] = vmovn_u16(vmvnq_u16(vceqq_u16(values, vdupq_n_u16(0))));
+      vst4_u8((uint8_t*)outPixels, pixels); // interleave components
+      if (outStpMask) {
+        vst1_u8(outStpMask, vmovn_u16(vreinterpretq_u16_s16(vshrq_n_s16(vreinterpretq_s16_u16(values), 15))));
+        outStpMask += 8;
+      }
+    }
+    __convertToRgba8888Scalar(texels, length, outPixels, outStpMask);
+  }
+  static void __convertToRgba5551Neon(const uint16_t* texels, size_t length, uint16_t* outPixels, uint8_t* outStpMask) noexcept {
+    for (; length >= 8u; length -= 8u, texels += 8, outPixels += 8) {
+      uint16x8_t values = vld1q_u16(texels);
+      uint16x8_t red = vshlq_n_u16(vandq_u16(values, vdupq_n_u16(0x1F)), 11);
+      uint16x8_t green = vshlq_n_u16(vandq_u16(values, vdupq_n_u16(0x3E0)), 1);
+      uint16x8_t blue = vandq_u16(vshrq_n_u16(values, 9), vdupq_n_u16(0x3E));
+      uint16x8_t alpha = vandq_u16(vmvnq_u16(vceqq_u16(values, vdupq_n_u16(0))), vdupq_n_u16(1));
+      vst1q_u16(outPixels, vorrq_u16(vorrq_u16(red, green), vorrq_u16(blue, alpha)));
+      if (outStpMask) {
+        vst1_u8(outStpMask, vmovn_u16(vreinterpretq_u16_s16(vshrq_n_s16(vreinterpretq_s16_u16(values), 15))));
+        outStpMask += 8;
+      }
+    }
+    __convertToRgba5551Scalar(texels, length, outPixels, outStpMask);
+  }
+#endif
+
+
+// -- runtime dispatch -- ------------------------------------------------------
+
+struct TexelKernelTable final {
+  KernelInstructionSet instructionSet;
+  void (*expandLookupTable4bit)(const uint16_t*, size_t, const uint16_t*, uint16_t*) noexcept;
+  void (*expandLookupTable8bit)(const uint16_t*, size_t, const uint16_t*, uint16_t*) noexcept;
+  void (*convertToRgba8888)(const uint16_t*, size_t, uint32_t*, uint8_t*) noexcept;
+  void (*convertToRgba5551)(const uint16_t*, size_t, uint16_t*, uint8_t*) noexcept;
+};
+
+static const TexelKernelTable g_scalarKernels{ KernelInstructionSet::scalar,
+  __expandLookupTable4bitScalar, __expandLookupTable8bitScalar, __convertToRgba8888Scalar, __convertToRgba5551Scalar
+};
+#ifdef __TEXEL_KERNELS_X86
+  static const TexelKernelTable g_ssse3Kernels{ KernelInstructionSet::ssse3, // no gathers -> scalar 8-bit lookups
+    __expandLookupTable4bitSsse3, __expandLookupTable8bitScalar, __convertToRgba8888Ssse3, __convertToRgba5551Ssse3
+  };
+  static const TexelKernelTable g_avx2Kernels{ KernelInstructionSet::avx2,
+    __expandLookupTable4bitAvx2, __expandLookupTable8bitAvx2, __convertToRgba8888Avx2, __convertToRgba5551Avx2
+  };
+#endif
+#ifdef __TEXEL_KERNELS_NEON
+  static const TexelKernelTable g_neonKernels{ KernelInstructionSet::neon, // 256-entry tables too large for registers
+    __expandLookupTable4bitNeon, __expandLookupTable8bitScalar, __convertToRgba8888Neon, __convertToRgba5551Neon
+  };
+#endif
+
+// Verify CPU features
+#ifdef __TEXEL_KERNELS_X86
+  static bool __isCpuFeatureSupported(KernelInstructionSet instructionSet) noexcept {
+#   if defined(_MSC_VER) && !defined(__clang__)
+      int info[4];
+      __cpuid(info, 0);
+      int maxLeaf = info[0];
+      __cpuid(info, 1);
+      if (instructionSet == KernelInstructionSet::ssse3)
+        return (info[2] & (1 << 9)) != 0;
+      bool isAvxEnabled = ((info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 // OSXSAVE + AVX
+                        && (_xgetbv(0) & 0x6u) == 0x6u); // XMM/YMM states saved by OS
+      if (!isAvxEnabled || maxLeaf < 7)
+        return false;
+      __cpuidex(info, 7, 0);
+      return (info[1] & (1 << 5)) != 0;
+#   else
+      __builtin_cpu_init();
+      return (instructionSet == KernelInstructionSet::ssse3) ? (__builtin_cpu_supports("ssse3") != 0)
+                                                              : (__builtin_cpu_supports("avx2") != 0);
+#   endif
+  }
+#endif
+
+// Get kernels of an instruction set (or nullptr if not supported)
+static const TexelKernelTable* __getKernelTable(KernelInstructionSet instructionSet) noexcept {
+  switch (instructionSet) {
+    case KernelInstructionSet::scalar: return &g_scalarKernels;
+#   ifdef __TEXEL_KERNELS_X86
+      case KernelInstructionSet::ssse3: return __isCpuFeatureSupported(instructionSet) ? &g_ssse3Kernels : nullptr;
+      case KernelInstructionSet::avx2:  return __isCpuFeatureSupported(instructionSet) ? &g_avx2Kernels : nullptr;
+#   endif
+#   ifdef __TEXEL_KERNELS_NEON
+      case KernelInstructionSet::neon: return &g_neonKernels;
+#   endif
+    default: return nullptr;
+  }
+}
+
+// Select best instruction set supported
+static const TexelKernelTable* __selectKernelTable() noexcept {
+  const KernelInstructionSet candidates[] = { KernelInstructionSet::avx2, KernelInstructionSet::neon, KernelInstructionSet::ssse3 };
+  for (auto instructionSet : candidates) {
+    const TexelKernelTable* table = __getKernelTable(instructionSet);
+    if (table != nullptr)
+      return table;
+  }
+  return &g_scalarKernels;
+}
+
+// Selected kernel table: initialized on first use (thread-safe local static), atomic for 'setInstructionSet'
+// -> relaxed accesses are enough: tables are constant (nothing else to synchronize)
+static inline std::atomic<const TexelKernelTable*>& __selectedKernels() noexcept {
+  static std::atomic<const TexelKernelTable*> selection{ __selectKernelTable() };
+  return selection;
+}
+static inline const TexelKernelTable& __kernels() noexcept {
+  return *__selectedKernels().load(std::memory_order_relaxed);
+}
+
+// ---
+
+void TexelKernels::expandLookupTable4bit(const uint16_t* indexes, size_t length, const uint16_t* lookupTable, uint16_t* outTexels) noexcept {
+  __kernels().expandLookupTable4bit(indexes, length, lookupTable, outTexels);
+}
+void TexelKernels::expandLookupTable8bit(const uint16_t* indexes, size_t length, const uint16_t* lookupTable, uint16_t* outTexels) noexcept {
+  __kernels().expandLookupTable8bit(indexes, length, lookupTable, outTexels);
+}
+void TexelKernels::convertToRgba8888(const uint16_t* texels, size_t length, uint32_t* outPixels, uint8_t* outStpMask) noexcept {
+  __kernels().convertToRgba8888(texels, length, outPixels, outStpMask);
+}
+void TexelKernels::convertToRgba5551(const uint16_t* texels, size_t length, uint16_t* outPixels, uint8_t* outStpMask) noexcept {
+  __kernels().convertToRgba5551(texels, length, outPixels, outStpMask);
+}
+
+KernelInstructionSet TexelKernels::instructionSet() noexcept {
+  return __kernels().instructionSet;
+}
+bool TexelKernels::isSupported(KernelInstructionSet instructionSet) noexcept {
+  return (__getKernelTable(instructionSet) != nullptr);
+}
+bool TexelKernels::setInstructionSet(KernelInstructionSet instructionSet) noexcept {
+  const TexelKernelTable* table = __getKernelTable(instructionSet);
+  if (table == nullptr)
+    return false;
+  __selectedKernels().store(table, std::memory_order_relaxed);
+  return true;
+}
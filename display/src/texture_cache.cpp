@@ -0,0 +1,174 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "display/texel_kernels.h"
+#include "display/texture_cache.h"
+
+using namespace display;
+
+
+// -- decoding -- --------------------------------------------------------------
+
+// Get width of VRAM area covered by a texture page / lookup table
+static inline unsigned long __texturePageWidth(TextureColorMode colorMode) noexcept {
+  switch (colorMode) {
+    case TextureColorMode::lookupTable4bit: return decodedTextureSize() >> 2;
+    case TextureColorMode::lookupTable8bit: return decodedTextureSize() >> 1;
+    default: return decodedTextureSize();
+  }
+}
+static inline unsigned long __lookupTableWidth(TextureColorMode colorMode) noexcept {
+  switch (colorMode) {
+    case TextureColorMode::lookupTable4bit: return 16u;
+    case TextureColorMode::lookupTable8bit: return 256u;
+    default: return 0;
+  }
+}
+
+// Decode texture page: resolve color indexes (or copy direct colors) -> 256x256 texels
+template <unsigned long _Height>
+static void __decodeTexturePage(const Vram<_Height>& vram, long texpageX, long texpageY, TextureColorMode colorMode,
+                                long clutX, long clutY, uint16_t* outTexels) noexcept {
+  uint16_t lookupTable[256];
+  for (unsigned long i = 0; i < __lookupTableWidth(colorMode); ++i)
+    lookupTable[i] = vram.read((unsigned long)clutX + i, (unsigned long)clutY); // wraps around
+
+  const unsigned long pageWidth = __texturePageWidth(colorMode);
+  const bool isWrapped = ((unsigned long)texpageX + pageWidth > vramWidth());
+  uint16_t wrappedRow[decodedTextureSize()];
+  for (unsigned long v = 0; v < decodedTextureSize(); ++v) {
+    const uint16_t* srcRow = vram.row((unsigned long)texpageY + v);
+    uint16_t* destRow = &outTexels[v*decodedTextureSize()];
+
+    switch (colorMode) {
+      case TextureColorMode::lookupTable4bit:
+      case TextureColorMode::lookupTable8bit: {
+        const uint16_t* indexes = srcRow + texpageX;
+        if (isWrapped) { // page wraps around -> contiguous copy of row
+          for (unsigned long x = 0; x < pageWidth; ++x)
+            wrappedRow[x] = srcRow[((unsigned long)texpageX + x) & (vramWidth() - 1u)];
+          indexes = wrappedRow;
+        }
+        if (colorMode == TextureColorMode::lookupTable4bit)
+          TexelKernels::expandLookupTable4bit(indexes, pageWidth, lookupTable, destRow);
+        else
+          TexelKernels::expandLookupTable8bit(indexes, pageWidth, lookupTable, destRow);
+        break;
+      }
+      default: { // direct colors (wraps around)
+        unsigned long firstLength = vramWidth() - (unsigned long)texpageX;
+        if (firstLength >= pageWidth)
+          memcpy((void*)destRow, (const void*)(srcRow + texpageX), pageWidth*sizeof(uint16_t));
+        else {
+          memcpy((void*)destRow, (const void*)(srcRow + texpageX), firstLength*sizeof(uint16_t));
+          memcpy((void*)&destRow[firstLength], (const void*)srcRow, (pageWidth - firstLength)*sizeof(uint16_t));
+        }
+        break;
+      }
+    }
+  }
+}
+
+
+// -- cache entries -- ---------------------------------------------------------
+
+TextureCache::TextureCache(size_t budgetBytes)
+  : _maxEntries(budgetBytes / decodedTextureBytes()) {
+  if (this->_maxEntries == 0)
+    this->_maxEntries = 1;
+  this->_index.reserve(this->_maxEntries*2u);
+}
+
+void TextureCache::clear() noexcept {
+  this->_index.clear();
+  this->_entries.clear();
+}
+
+// ---
+
+// Verify if decoded texture is still up-to-date (texture page and lookup table not modified since decoding)
+// -> lookup table validated per 64x16 block: it's usually stored in the same page as the framebuffer (drawn every frame)
+template <unsigned long _Height>
+bool TextureCache::_isEntryValid(const Entry& entry, const Vram<_Height>& vram, long texpageX, long texpageY,
+                                 TextureColorMode colorMode, long clutX, long clutY) const noexcept {
+  if (entry.source != (const void*)&vram)
+    return false;
+  if (vram.regionGeneration((unsigned long)texpageX, (unsigned long)texpageY,
+                            __texturePageWidth(colorMode), decodedTextureSize()) > entry.generation)
+    return false;
+  unsigned long lookupTableWidth = __lookupTableWidth(colorMode);
+  return (lookupTableWidth == 0
+       || vram.regionBlockGeneration((unsigned long)clutX, (unsigned long)clutY, lookupTableWidth, 1u) <= entry.generation);
+}
+
+// Get decoded texture page (decode it if not cached or outdated)
+template <unsigned long _Height>
+const uint16_t* TextureCache::getTexture(const Vram<_Height>& vram, long texpageX, long texpageY, TextureColorMode colorMode,
+                                         long clutX, long clutY) {
+  if (colorMode == TextureColorMode::reserved)
+    colorMode = TextureColorMode::directColor15bit;
+  uint64_t key = toTextureKey(texpageX, texpageY, colorMode, clutX, clutY);
+
+  auto existing = this->_index.find(key);
+  if (existing != this->_index.end()) {
+    Entry& entry = *(existing->second);
+    if (existing->second != this->_entries.begin())
+      this->_entries.splice(this->_entries.begin(), this->_entries, existing->second); // most recently used
+    entry.batchId = this->_batchId;
+
+    if (_isEntryValid(entry, vram, texpageX, texpageY, colorMode, clutX, clutY)) {
+      ++(this->_stats.hits);
+      return entry.texels.get();
+    }
+    ++(this->_stats.invalidations);
+    ++(this->_stats.misses);
+    entry.generation = vram.generation();
+    entry.source = (const void*)&vram;
+    __decodeTexturePage(vram, texpageX, texpageY, colorMode, clutX, clutY, entry.texels.get());
+    return entry.texels.get();
+  }
+  ++(this->_stats.misses);
+
+  // budget reached -> evict least recently used entries (except those used by current batch) + recycle buffer
+  std::unique_ptr<uint16_t[]> texels = nullptr;
+  while (this->_entries.size() >= this->_maxEntries && this->_entries.back().batchId != this->_batchId) {
+    Entry& oldest = this->_entries.back();
+    if (texels == nullptr)
+      texels = std::move(oldest.texels);
+    this->_index.erase(oldest.key);
+    this->_entries.pop_back();
+    ++(this->_stats.evictions);
+  }
+  if (texels == nullptr)
+    texels.reset(new uint16_t[decodedTextureSize()*decodedTextureSize()]);
+
+  this->_entries.emplace_front();
+  Entry& entry = this->_entries.front();
+  entry.key = key;
+  entry.generation = vram.generation();
+  entry.batchId = this->_batchId;
+  entry.source = (const void*)&vram;
+  entry.texels = std::move(texels);
+  this->_index[key] = this->_entries.begin();
+
+  __decodeTexturePage(vram, texpageX, texpageY, colorMode, clutX, clutY, entry.texels.get());
+  return entry.texels.get();
+}
+
+template const uint16_t* TextureCache::getTexture<psxVramHeight()>(const Vram<psxVramHeight()>&, long, long,
+                                                                   TextureColorMode, long, long);
+template const uint16_t* TextureCache::getTexture<znArcadeVramHeight()>(const Vram<znArcadeVramHeight()>&, long, long,
+                                                                        TextureColorMode, long, long);
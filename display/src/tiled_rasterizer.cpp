@@ -0,0 +1,322 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#include <cstddef>
+#include <cstdint>
+#include "display/tiled_rasterizer.h"
+
+using namespace display;
+
+
+// -- helpers -- ---------------------------------------------------------------
+
+static inline bool __isEmptyArea(const Rectangle& area) noexcept {
+  return (area.rightX < area.leftX || area.bottomY < area.topY);
+}
+static inline bool __intersects(const Rectangle& a, const Rectangle& b) noexcept {
+  return (!__isEmptyArea(a) && !__isEmptyArea(b)
+       && a.leftX <= b.rightX && b.leftX <= a.rightX && a.topY <= b.bottomY && b.topY <= a.bottomY);
+}
+static inline void __mergeArea(Rectangle& inOutArea, const Rectangle& area) noexcept {
+  if (__isEmptyArea(inOutArea))
+    inOutArea = area;
+  else {
+    if (area.leftX < inOutArea.leftX)
+      inOutArea.leftX = area.leftX;
+    if (area.rightX > inOutArea.rightX)
+      inOutArea.rightX = area.rightX;
+    if (area.topY < inOutArea.topY)
+      inOutArea.topY = area.topY;
+    if (area.bottomY > inOutArea.bottomY)
+      inOutArea.bottomY = area.bottomY;
+  }
+}
+
+
+// -- worker pool -- -----------------------------------------------------------
+
+TiledRasterizer::TiledRasterizer(unsigned workerCount) {
+  this->_commands.reserve(1024);
+  this->_activeTiles.reserve(512);
+  for (unsigned i = 0; i < workerCount; ++i)
+    this->_workers.emplace_back([this]() { _runWorker(); });
+}
+
+TiledRasterizer::~TiledRasterizer() noexcept {
+  {
+    std::lock_guard<std::mutex> guard(this->_lock);
+    this->_isStopping = true;
+  }
+  this->_jobStarted.notify_all();
+  for (auto& worker : this->_workers)
+    worker.join();
+}
+
+unsigned TiledRasterizer::defaultWorkerCount() noexcept {
+  unsigned threadCount = std::thread::hardware_concurrency();
+  return (threadCount > 1u) ? threadCount - 1u : 0;
+}
+
+// ---
+
+// Worker thread loop: wait for new job -> process tiles -> report completion
+void TiledRasterizer::_runWorker() noexcept {
+  uint64_t lastJobId = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> guard(this->_lock);
+      this->_jobStarted.wait(guard, [this, lastJobId]() { return (this->_isStopping || this->_jobId != lastJobId); });
+      if (this->_isStopping)
+        return;
+      lastJobId = this->_jobId;
+    }
+    _processTiles();
+    {
+      std::lock_guard<std::mutex> guard(this->_lock);
+      if (--(this->_runningWorkers) == 0)
+        this->_jobFinished.notify_one();
+    }
+  }
+}
+
+// Process tiles until no tile is left (each tile rasterized by a single thread)
+void TiledRasterizer::_processTiles() noexcept {
+  for (size_t i = this->_nextTile.fetch_add(1u); i < this->_activeTiles.size(); i = this->_nextTile.fetch_add(1u))
+    this->_currentRasterizer(*this, (size_t)this->_activeTiles[i]);
+}
+
+// Distribute active tiles to worker threads + calling thread (blocking)
+void TiledRasterizer::_rasterizeTiles(TileRasterizer rasterizer, const void* textures) noexcept {
+  this->_nextTile.store(0);
+  if (this->_workers.empty() || this->_activeTiles.size() <= 1u) {
+    this->_currentRasterizer = rasterizer;
+    this->_currentTextures = textures;
+    _processTiles();
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(this->_lock);
+    this->_currentRasterizer = rasterizer;
+    this->_currentTextures = textures;
+    this->_runningWorkers = (unsigned)this->_workers.size();
+    ++(this->_jobId);
+  }
+  this->_jobStarted.notify_all();
+  _processTiles();
+
+  std::unique_lock<std::mutex> guard(this->_lock);
+  this->_jobFinished.wait(guard, [this]() { return (this->_runningWorkers == 0); });
+}
+
+
+// -- binning -- ---------------------------------------------------------------
+
+// Set new target + allocate tile bins
+void TiledRasterizer::_resizeBins(const RasterTarget& target) {
+  this->_target = target;
+  this->_tileCountX = (size_t)((target.width + tileSize() - 1) / tileSize());
+  this->_tileCountY = (size_t)((target.height + tileSize() - 1) / tileSize());
+
+  size_t tileCount = this->_tileCountX * this->_tileCountY;
+  this->_bins.resize(tileCount);
+  this->_drawnAreas.resize(tileCount);
+  this->_isTileDrawn.resize(tileCount);
+}
+
+// Verify if a primitive depends on pending primitives (or if pending primitives depend on it)
+// -> texture page and lookup table checked separately (a bounding box of both would overlap the framebuffer)
+bool TiledRasterizer::_isHazard(const RasterState& state, const Rectangle& nativeArea) const noexcept {
+  if (state.isTextured // read after write
+  && (__intersects(Rasterizer::getTexturePageArea(state), this->_pendingWriteArea)
+   || __intersects(Rasterizer::getLookupTableArea(state), this->_pendingWriteArea)))
+    return true;
+  return (__intersects(nativeArea, this->_pendingPageReadArea) || __intersects(nativeArea, this->_pendingClutReadArea)); // write after read
+}
+
+// Remove pending primitives
+void TiledRasterizer::_clear() noexcept {
+  for (auto tileIndex : this->_activeTiles)
+    this->_bins[tileIndex].clear();
+  this->_activeTiles.clear();
+  this->_commands.clear();
+  this->_pendingWriteArea = Rectangle{ 0,-1,0,-1 };
+  this->_pendingPageReadArea = Rectangle{ 0,-1,0,-1 };
+  this->_pendingClutReadArea = Rectangle{ 0,-1,0,-1 };
+}
+
+// ---
+
+template <unsigned long _Height>
+void TiledRasterizer::drawTriangle(Vram<_Height>& vram, const RasterTarget& target, const RasterState& state,
+                                   const RasterVertex& v0, const RasterVertex& v1, const RasterVertex& v2) {
+  if (Rasterizer::isTriangleTooLarge(v0, v1, v2))
+    return;
+
+  // bounding box (native coords), clipped to draw area
+  Rectangle area{ (v0.x < v1.x) ? ((v0.x < v2.x) ? v0.x : v2.x) : ((v1.x < v2.x) ? v1.x : v2.x),
+                  (v0.x > v1.x) ? ((v0.x > v2.x) ? v0.x : v2.x) : ((v1.x > v2.x) ? v1.x : v2.x),
+                  (v0.y < v1.y) ? ((v0.y < v2.y) ? v0.y : v2.y) : ((v1.y < v2.y) ? v1.y : v2.y),
+                  (v0.y > v1.y) ? ((v0.y > v2.y) ? v0.y : v2.y) : ((v1.y > v2.y) ? v1.y : v2.y) };
+  if (area.leftX < state.clipArea.leftX)
+    area.leftX = state.clipArea.leftX;
+  if (area.rightX > state.clipArea.rightX)
+    area.rightX = state.clipArea.rightX;
+  if (area.topY < state.clipArea.topY)
+    area.topY = state.clipArea.topY;
+  if (area.bottomY > state.clipArea.bottomY)
+    area.bottomY = state.clipArea.bottomY;
+  if (area.leftX < 0)
+    area.leftX = 0;
+  if (area.rightX >= (long)vramWidth())
+    area.rightX = (long)vramWidth() - 1;
+  if (area.topY < 0)
+    area.topY = 0;
+  if (area.bottomY >= (long)_Height)
+    area.bottomY = (long)_Height - 1;
+  if (__isEmptyArea(area))
+    return;
+
+  // target/VRAM change -> flush into previous VRAM / dependency with pending primitives -> flush
+  if (target.pixels != this->_target.pixels || target.width != this->_target.width || target.height != this->_target.height
+  || target.scaleX != this->_target.scaleX || target.scaleY != this->_target.scaleY || (void*)&vram != this->_boundVram) {
+    flush();
+    _resizeBins(target);
+    this->_boundVram = (void*)&vram;
+    this->_flushBoundVram = &TiledRasterizer::_flushVram<_Height>;
+  }
+  else if (_isHazard(state, area))
+    flush();
+
+  // textured primitive reading its own destination -> result depends on drawing order -> draw immediately (from VRAM)
+  Rectangle pageArea{ 0,-1,0,-1 }, clutArea{ 0,-1,0,-1 };
+  if (state.isTextured) {
+    pageArea = Rasterizer::getTexturePageArea(state);
+    clutArea = Rasterizer::getLookupTableArea(state);
+    if (__intersects(pageArea, area) || __intersects(clutArea, area)) {
+      flush();
+      RasterState liveState = state;
+      liveState.decodedTexture = nullptr;
+      Rectangle drawnArea;
+      if (Rasterizer::rasterizeTriangle(vram, target, liveState, v0, v1, v2, Rasterizer::fullTargetArea(target), drawnArea)
+      && target.pixels == vram.pixels()) {
+        vram.markDirty((unsigned long)drawnArea.leftX, (unsigned long)drawnArea.topY,
+                       (unsigned long)(drawnArea.rightX - drawnArea.leftX + 1), (unsigned long)(drawnArea.bottomY - drawnArea.topY + 1));
+      }
+      return;
+    }
+  }
+
+  // store primitive + add it to covered tiles
+  uint32_t commandIndex = (uint32_t)this->_commands.size();
+  this->_commands.push_back(TriangleCommand{ state, { v0, v1, v2 } });
+  this->_commands.back().state.decodedTexture = nullptr; // resolved on flush (cache entries may be replaced before)
+
+  size_t firstTileX = (size_t)(area.leftX*target.scaleX / tileSize());
+  size_t lastTileX = (size_t)(((area.rightX + 1)*target.scaleX - 1) / tileSize());
+  size_t firstTileY = (size_t)(area.topY*target.scaleY / tileSize());
+  size_t lastTileY = (size_t)(((area.bottomY + 1)*target.scaleY - 1) / tileSize());
+  if (lastTileX >= this->_tileCountX)
+    lastTileX = this->_tileCountX - 1u;
+  if (lastTileY >= this->_tileCountY)
+    lastTileY = this->_tileCountY - 1u;
+
+  try {
+    for (size_t tileY = firstTileY; tileY <= lastTileY; ++tileY) {
+      for (size_t tileX = firstTileX; tileX <= lastTileX; ++tileX) {
+        size_t tileIndex = tileY*this->_tileCountX + tileX;
+        auto& bin = this->_bins[tileIndex];
+        if (bin.empty())
+          this->_activeTiles.push_back((uint32_t)tileIndex);
+        bin.push_back(commandIndex);
+      }
+    }
+  }
+  catch (...) { // allocation failure -> remove partially binned primitive (never drawn twice by caller fallback)
+    for (size_t tileY = firstTileY; tileY <= lastTileY; ++tileY) {
+      for (size_t tileX = firstTileX; tileX <= lastTileX; ++tileX) {
+        auto& bin = this->_bins[tileY*this->_tileCountX + tileX];
+        if (!bin.empty() && bin.back() == commandIndex)
+          bin.pop_back();
+      }
+    }
+    while (!this->_activeTiles.empty() && this->_bins[this->_activeTiles.back()].empty())
+      this->_activeTiles.pop_back();
+    this->_commands.pop_back();
+    throw;
+  }
+
+  __mergeArea(this->_pendingWriteArea, area);
+  if (state.isTextured) {
+    __mergeArea(this->_pendingPageReadArea, pageArea);
+    if (!__isEmptyArea(clutArea))
+      __mergeArea(this->_pendingClutReadArea, clutArea);
+  }
+}
+
+
+// -- rasterization -- ---------------------------------------------------------
+
+// Rasterize primitives of a tile, in submission order
+template <unsigned long _Height>
+void TiledRasterizer::_rasterizeTile(TiledRasterizer& parent, size_t tileIndex) noexcept {
+  const Vram<_Height>& textures = *reinterpret_cast<const Vram<_Height>*>(parent._currentTextures);
+  long tileX = (long)(tileIndex % parent._tileCountX) * tileSize();
+  long tileY = (long)(tileIndex / parent._tileCountX) * tileSize();
+  Rectangle tileArea{ tileX, tileX + tileSize() - 1, tileY, tileY + tileSize() - 1 };
+
+  Rectangle drawnArea{ 0,-1,0,-1 };
+  for (auto commandIndex : parent._bins[tileIndex]) {
+    const TriangleCommand& command = parent._commands[commandIndex];
+    Rectangle area;
+    if (Rasterizer::rasterizeTriangle(textures, parent._target, command.state, command.vertices[0], command.vertices[1],
+                                      command.vertices[2], tileArea, area))
+      __mergeArea(drawnArea, area);
+  }
+  parent._drawnAreas[tileIndex] = drawnArea;
+  parent._isTileDrawn[tileIndex] = !__isEmptyArea(drawnArea);
+}
+
+template <unsigned long _Height>
+void TiledRasterizer::_flush(Vram<_Height>& vram) noexcept {
+  // resolve decoded textures (VRAM not modified since binning: dependencies cause earlier flushes)
+  if (this->_textureCache != nullptr) {
+    this->_textureCache->beginBatch();
+    try {
+      for (auto& command : this->_commands) {
+        if (command.state.isTextured) {
+          command.state.decodedTexture = this->_textureCache->getTexture(vram, command.state.texpageX, command.state.texpageY,
+                                                                         command.state.colorMode, command.state.clutX, command.state.clutY);
+        }
+      }
+    }
+    catch (...) {} // allocation failure -> remaining textures read in VRAM
+  }
+  _rasterizeTiles(&TiledRasterizer::_rasterizeTile<_Height>, (const void*)&vram);
+
+  if (this->_target.pixels == vram.pixels()) { // native target -> report modified areas
+    for (auto tileIndex : this->_activeTiles) {
+      if (this->_isTileDrawn[tileIndex]) {
+        const Rectangle& area = this->_drawnAreas[tileIndex];
+        vram.markDirty((unsigned long)area.leftX, (unsigned long)area.topY,
+                       (unsigned long)(area.rightX - area.leftX + 1), (unsigned long)(area.bottomY - area.topY + 1));
+      }
+    }
+  }
+  _clear();
+}
+
+template void TiledRasterizer::drawTriangle<psxVramHeight()>(Vram<psxVramHeight()>&, const RasterTarget&, const RasterState&,
+                                                             const RasterVertex&, const RasterVertex&, const RasterVertex&);
+template void TiledRasterizer::drawTriangle<znArcadeVramHeight()>(Vram<znArcadeVramHeight()>&, const RasterTarget&, const RasterState&,
+                                                                  const RasterVertex&, const RasterVertex&, const RasterVertex&);
@@ -0,0 +1,89 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#include "display/_private/_vram_kernels.h"
+#include "display/vram_transfer.h"
+
+using namespace display;
+
+
+// -- CPU -> VRAM transfer -- --------------------------------------------------
+
+void VramTransfer::start(unsigned long destination, unsigned long size, unsigned long vramHeight) noexcept {
+  this->_x = (destination & (vramWidth() - 1u));
+  this->_y = ((destination >> 16) & (vramHeight - 1u));
+  this->_width = ((size - 1u) & (vramWidth() - 1u)) + 1u;          // 0 -> max width
+  this->_height = (((size >> 16) - 1u) & (vramHeight - 1u)) + 1u;  // 0 -> max height
+  this->_row = this->_column = 0;
+  this->_remainingPixels = this->_width * this->_height;
+}
+
+// ---
+
+template <unsigned long _Height, bool _CheckMask>
+static inline void __writeTexels(Vram<_Height>& vram, const uint16_t* src, unsigned long length,
+                                 unsigned long areaX, unsigned long areaY, unsigned long areaWidth,
+                                 unsigned long& row, unsigned long& column, uint16_t forceMaskBit) noexcept {
+  // end of partially written line
+  if (column != 0) {
+    unsigned long segmentLength = areaWidth - column;
+    if (segmentLength > length)
+      segmentLength = length;
+    copyVramSpanWrapped<_CheckMask>(vram.row(areaY + row), (areaX + column) & (vramWidth() - 1u), src, segmentLength, forceMaskBit);
+
+    src += (intptr_t)segmentLength;
+    length -= segmentLength;
+    column += segmentLength;
+    if (column < areaWidth)
+      return;
+    column = 0;
+    ++row;
+  }
+  // full lines
+  for (; length >= areaWidth; length -= areaWidth, src += (intptr_t)areaWidth, ++row)
+    copyVramSpanWrapped<_CheckMask>(vram.row(areaY + row), areaX, src, areaWidth, forceMaskBit);
+
+  // beginning of next line
+  if (length) {
+    copyVramSpanWrapped<_CheckMask>(vram.row(areaY + row), areaX, src, length, forceMaskBit);
+    column = length;
+  }
+}
+
+template <unsigned long _Height>
+int VramTransfer::write(Vram<_Height>& vram, const uint32_t* mem, int size, uint16_t forceMaskBit, bool checkMask) noexcept {
+  if (this->_remainingPixels == 0 || size <= 0)
+    return 0;
+
+  // 2 texels per word (blocks always contain whole words -> transfers always resume at the beginning of a word)
+  unsigned long length = ((unsigned long)size << 1);
+  if (length > this->_remainingPixels)
+    length = this->_remainingPixels;
+  unsigned long firstRow = this->_row;
+
+  const uint16_t* src = reinterpret_cast<const uint16_t*>(mem);
+  if (checkMask)
+    __writeTexels<_Height,true>(vram, src, length, this->_x, this->_y, this->_width, this->_row, this->_column, forceMaskBit);
+  else
+    __writeTexels<_Height,false>(vram, src, length, this->_x, this->_y, this->_width, this->_row, this->_column, forceMaskBit);
+  this->_remainingPixels -= length;
+
+  // report modified lines (partial first/last lines are reported as full lines)
+  unsigned long lastRow = (this->_column != 0) ? this->_row : this->_row - 1u;
+  vram.markDirty(this->_x, this->_y + firstRow, this->_width, lastRow - firstRow + 1u);
+
+  return static_cast<int>((length + 1u) >> 1); // if total size is odd, last half-word is padding
+}
+
+template int VramTransfer::write<psxVramHeight()>(Vram<psxVramHeight()>&, const uint32_t*, int, uint16_t, bool) noexcept;
+template int VramTransfer::write<znArcadeVramHeight()>(Vram<znArcadeVramHeight()>&, const uint32_t*, int, uint16_t, bool) noexcept;
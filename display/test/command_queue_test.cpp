@@ -0,0 +1,166 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <vector>
+#include <display/command_queue.h>
+
+using namespace display;
+
+class CommandQueueTest : public testing::Test {
+public:
+protected:
+  //static void SetUpTestCase() {}
+  //static void TearDownTestCase() {}
+
+  void SetUp() override {}
+  void TearDown() override {}
+};
+
+// consumer storing received words (+ number of blocks)
+struct TestReceiver final {
+  std::vector<uint32_t> words;
+  size_t blockCount = 0;
+  size_t maxBlockSize = 0;
+};
+static void __receiveWords(void* context, uint32_t* words, int size) {
+  TestReceiver& receiver = *(TestReceiver*)context;
+  receiver.words.insert(receiver.words.end(), words, words + size);
+  ++receiver.blockCount;
+  if ((size_t)size > receiver.maxBlockSize)
+    receiver.maxBlockSize = (size_t)size;
+}
+
+
+// -- command queue -- ---------------------------------------------------------
+
+TEST_F(CommandQueueTest, createDestroy) {
+  TestReceiver receiver;
+  {
+    CommandQueue queue(__receiveWords, &receiver, 100u);
+    EXPECT_EQ((size_t)128u, queue.capacity());
+    EXPECT_TRUE(queue.isEmpty());
+    EXPECT_EQ((size_t)0, queue.pendingSize());
+    queue.sync(); // nothing to wait for
+  }
+  EXPECT_TRUE(receiver.words.empty());
+
+  {
+    CommandQueue queue(__receiveWords, &receiver, 1u);
+    EXPECT_EQ((size_t)64u, queue.capacity()); // min size
+  }
+  {
+    CommandQueue queue(__receiveWords, &receiver);
+    EXPECT_EQ(CommandQueue::defaultCapacity(), queue.capacity());
+  }
+}
+
+TEST_F(CommandQueueTest, pushSyncOrder) {
+  TestReceiver receiver;
+  CommandQueue queue(__receiveWords, &receiver, 256u);
+
+  uint32_t nextValue = 0;
+  std::vector<uint32_t> block;
+  for (size_t size = 1u; size <= 40u; ++size) {
+    block.clear();
+    for (size_t i = 0; i < size; ++i)
+      block.push_back(nextValue++);
+    queue.push(block.data(), block.size());
+
+    if ((size % 8u) == 0) { // sync point: everything received, in order
+      queue.sync();
+      EXPECT_TRUE(queue.isEmpty());
+      ASSERT_EQ((size_t)nextValue, receiver.words.size());
+    }
+  }
+  queue.sync();
+  ASSERT_EQ((size_t)nextValue, receiver.words.size()); // 820 words: ring wrapped around several times
+  for (uint32_t i = 0; i < nextValue; ++i) {
+    ASSERT_EQ(i, receiver.words[i]);
+  }
+  EXPECT_LE(receiver.maxBlockSize, queue.capacity());
+}
+
+TEST_F(CommandQueueTest, pushLargerThanCapacity) {
+  TestReceiver receiver;
+  std::vector<uint32_t> block(1000u);
+  for (size_t i = 0; i < block.size(); ++i)
+    block[i] = (uint32_t)(i * 7u + 3u);
+  {
+    CommandQueue queue(__receiveWords, &receiver, 64u);
+    queue.push(block.data(), block.size()); // ring full -> wait for worker
+    queue.push(block.data(), 5u);
+    queue.sync();
+    EXPECT_TRUE(queue.isEmpty());
+    ASSERT_EQ(block.size() + 5u, receiver.words.size());
+    EXPECT_LE(receiver.maxBlockSize, (size_t)64u);
+    EXPECT_GE(receiver.blockCount, (size_t)16u);
+
+    queue.push(block.data(), 300u); // no sync: processed on destruction
+  }
+  ASSERT_EQ(block.size() + 305u, receiver.words.size());
+  for (size_t i = 0; i < block.size(); ++i) {
+    ASSERT_EQ(block[i], receiver.words[i]);
+  }
+  for (size_t i = 0; i < 5u; ++i) {
+    ASSERT_EQ(block[i], receiver.words[block.size() + i]);
+  }
+  for (size_t i = 0; i < 300u; ++i) {
+    ASSERT_EQ(block[i], receiver.words[block.size() + 5u + i]);
+  }
+}
+
+// consumer storing received words + control words (marked with highest bit) in the same sequence
+static void __receiveControl(void* context, uint32_t value) {
+  TestReceiver& receiver = *(TestReceiver*)context;
+  receiver.words.push_back(value | 0x80000000u);
+}
+
+TEST_F(CommandQueueTest, pushControlOrder) {
+  TestReceiver receiver;
+  std::vector<uint32_t> expected;
+  {
+    CommandQueue queue(__receiveWords, __receiveControl, &receiver, 64u);
+    uint32_t nextValue = 0;
+    std::vector<uint32_t> block;
+    for (size_t size = 1u; size <= 40u; ++size) {
+      block.clear();
+      for (size_t i = 0; i < size; ++i)
+        block.push_back(nextValue++);
+      queue.push(block.data(), block.size()); // ring wraps around + blocks larger than capacity
+      expected.insert(expected.end(), block.begin(), block.end());
+
+      for (uint32_t control = 0; control < (uint32_t)(size % 3u); ++control) { // 0-2 consecutive control words
+        queue.pushControl((uint32_t)size*4u + control);
+        expected.push_back(((uint32_t)size*4u + control) | 0x80000000u);
+      }
+      if ((size % 8u) == 0) { // sync point: everything received, in order
+        queue.sync();
+        EXPECT_TRUE(queue.isEmpty());
+        ASSERT_EQ(expected.size(), receiver.words.size());
+      }
+    }
+
+    for (uint32_t control = 0; control < (uint32_t)(CommandQueue::controlCapacity()*2u + 1u); ++control) { // control list full
+      queue.pushControl(control);
+      expected.push_back(control | 0x80000000u);
+    }
+    EXPECT_EQ((size_t)0, queue.pendingSize());
+    // no sync: processed on destruction
+  }
+  ASSERT_EQ(expected.size(), receiver.words.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    ASSERT_EQ(expected[i], receiver.words[i]) << "index:" << i;
+  }
+}
@@ -35,6 +35,10 @@ TEST_F(DmaChainIteratorTest, accessorsTest) {
   DmaChainIterator<0x200000u> psxIt;
   EXPECT_EQ((unsigned long)0xFFFFFFu, psxIt.endIndexBits());
   EXPECT_EQ((unsigned long)0x1FFFFCu, psxIt.addressMask());
+  EXPECT_TRUE(psxIt.isEndIndex(0xFFFFFFu));
+  EXPECT_TRUE(psxIt.isEndIndex(0x03FFFFFFu)); // block size bits ignored
+  EXPECT_FALSE(psxIt.isEndIndex(0x1FFFFCu));
+  EXPECT_FALSE(psxIt.isEndIndex(0x02FFFFFCu));
   EXPECT_EQ((unsigned long)((0x200000u - psxBiosSize()) >> 2) + 1u, psxIt.maxCounter());
   EXPECT_FALSE(psxIt.readNext(&buffer, bufferSize));
 
@@ -63,7 +67,7 @@ TEST_F(DmaChainIteratorTest, singleItemChainTest) {
   EXPECT_TRUE(psxIt.readNext(&buffer, bufferSize));
   ASSERT_EQ((int)1, bufferSize);
   ASSERT_TRUE(buffer != nullptr);
-  EXPECT_EQ((unsigned long)42u, *buffer);
+  EXPECT_EQ((uint32_t)42u, *(uint32_t*)buffer); // block of 32-bit words (unsigned long may be 64-bit)
   EXPECT_FALSE(psxIt.readNext(&buffer, bufferSize));
 }
 
@@ -78,12 +82,12 @@ TEST_F(DmaChainIteratorTest, validChainTest) {
   EXPECT_TRUE(psxIt.readNext(&buffer, bufferSize));
   ASSERT_EQ((int)2, bufferSize);
   ASSERT_TRUE(buffer != nullptr);
-  EXPECT_EQ((unsigned long)42u, *buffer);
-  EXPECT_EQ((unsigned long)0, buffer[1]);
+  EXPECT_EQ((uint32_t)42u, *(uint32_t*)buffer);
+  EXPECT_EQ((uint32_t)0, ((uint32_t*)buffer)[1]);
   EXPECT_TRUE(psxIt.readNext(&buffer, bufferSize));
   ASSERT_EQ((int)1, bufferSize);
   ASSERT_TRUE(buffer != nullptr);
-  EXPECT_EQ((unsigned long)1, *buffer);
+  EXPECT_EQ((uint32_t)1, *(uint32_t*)buffer);
   EXPECT_FALSE(psxIt.readNext(&buffer, bufferSize));
 }
 
@@ -104,7 +108,7 @@ TEST_F(DmaChainIteratorTest, selfRefItemTest) {
   EXPECT_TRUE(psxIt.readNext(&buffer, bufferSize));
   ASSERT_EQ((int)1, bufferSize);
   ASSERT_TRUE(buffer != nullptr);
-  EXPECT_EQ((unsigned long)42u, *buffer);
+  EXPECT_EQ((uint32_t)42u, *(uint32_t*)buffer);
   EXPECT_FALSE(psxIt.readNext(&buffer, bufferSize));
 
   uint32_t chain2[] { 0x01000000u, 42u, 0x02000000u, 42u, 0 };
@@ -112,15 +116,77 @@ TEST_F(DmaChainIteratorTest, selfRefItemTest) {
   EXPECT_TRUE(psxIt2.readNext(&buffer, bufferSize));
   ASSERT_EQ((int)2, bufferSize);
   ASSERT_TRUE(buffer != nullptr);
-  EXPECT_EQ((unsigned long)42u, *buffer);
-  EXPECT_EQ((unsigned long)0, buffer[1]);
+  EXPECT_EQ((uint32_t)42u, *(uint32_t*)buffer);
+  EXPECT_EQ((uint32_t)0, ((uint32_t*)buffer)[1]);
   EXPECT_TRUE(psxIt2.readNext(&buffer, bufferSize));
   ASSERT_EQ((int)1, bufferSize);
   ASSERT_TRUE(buffer != nullptr);
-  EXPECT_EQ((unsigned long)42u, *buffer);
+  EXPECT_EQ((uint32_t)42u, *(uint32_t*)buffer);
   EXPECT_FALSE(psxIt2.readNext(&buffer, bufferSize));
 }
 
+TEST_F(DmaChainIteratorTest, readSpansTest) {
+  uint32_t chain[] { // ordering table: mostly empty nodes
+    0x00000008u, 99u, 0x02000014u, 11u, 12u, 0x00000018u, 0x0000001Cu, 0x03000030u,
+    31u, 32u, 33u, 99u, 0x00000034u, 0x01FFFFFFu, 21u
+  };
+  DmaChainSpan spans[4];
+
+  DmaChainIterator<0x200000u> psxIt((unsigned long*)chain, 0);
+  EXPECT_EQ((size_t)2u, psxIt.readSpans(spans, 2u));
+  ASSERT_TRUE(spans[0].data == &chain[3]);
+  EXPECT_EQ((int)2, spans[0].size);
+  EXPECT_EQ((uint32_t)12u, spans[0].data[1]);
+  ASSERT_TRUE(spans[1].data == &chain[8]);
+  EXPECT_EQ((int)3, spans[1].size);
+  EXPECT_EQ((uint32_t)31u, spans[1].data[0]);
+
+  EXPECT_EQ((size_t)1u, psxIt.readSpans(spans, 4u)); // end of chain reached
+  ASSERT_TRUE(spans[0].data == &chain[14]);
+  EXPECT_EQ((int)1, spans[0].size);
+  EXPECT_EQ((uint32_t)21u, spans[0].data[0]);
+  EXPECT_EQ((size_t)0, psxIt.readSpans(spans, 4u));
+
+  // same blocks as iterator
+  DmaChainIterator<0x200000u> spanIt((unsigned long*)chain, 0);
+  DmaChainIterator<0x200000u> nodeIt((unsigned long*)chain, 0);
+  unsigned long* buffer = nullptr;
+  int bufferSize = 0;
+  size_t spanCount = spanIt.readSpans(spans, 4u);
+  size_t spanIndex = 0;
+  while (nodeIt.readNext(&buffer, bufferSize)) {
+    if (bufferSize > 0) {
+      ASSERT_TRUE(spanIndex < spanCount);
+      EXPECT_TRUE((uint32_t*)buffer == spans[spanIndex].data);
+      EXPECT_EQ(bufferSize, spans[spanIndex].size);
+      ++spanIndex;
+    }
+  }
+  EXPECT_EQ(spanCount, spanIndex);
+
+  DmaChainIterator<0x200000u> nullIt(nullptr, 0);
+  EXPECT_EQ((size_t)0, nullIt.readSpans(spans, 4u));
+}
+
+TEST_F(DmaChainIteratorTest, readSpansEndlessChainTest) {
+  uint32_t chain[] {
+    0x00000008u, 99u, 0x01000010u, 42u, 0x00000008u
+  };
+  DmaChainSpan spans[8];
+
+  size_t totalCount = 0;
+  DmaChainIterator<0x200000u> psxIt((unsigned long*)chain, 0);
+  for (size_t count = psxIt.readSpans(spans, 8u); count; count = psxIt.readSpans(spans, 8u)) {
+    for (size_t i = 0; i < count; ++i) {
+      EXPECT_EQ((int)1, spans[i].size);
+      EXPECT_EQ((uint32_t)42u, spans[i].data[0]);
+    }
+    totalCount += count;
+    ASSERT_TRUE(totalCount < 30u);
+  }
+  EXPECT_TRUE(totalCount >= 1u);
+}
+
 TEST_F(DmaChainIteratorTest, endlessChain1Test_simple) {
   uint32_t chain[] { // easily detected with both techniques
     0x00000008u, 0x0000000Cu, 0x00000004u, 0x00000010u, 0x00000000u
@@ -210,3 +276,102 @@ TEST_F(DmaChainIteratorTest, endlessChain5Test_unorderedLongChain) {
   EXPECT_TRUE(itemsRead >= (int)chainSize);
   EXPECT_TRUE(itemsRead < 2*(int)chainSize);
 }
+
+
+// -- exact loop detection --
+
+TEST_F(DmaChainIteratorTest, visitMapTest) {
+  EXPECT_EQ((size_t)8192u, DmaChainVisitMap<0x200000u>::wordCount());   // 64 KB
+  EXPECT_EQ((size_t)32768u, DmaChainVisitMap<0x800000u>::wordCount()); // 256 KB
+
+  DmaChainVisitMap<0x200000u> visitMap;
+  EXPECT_EQ((size_t)0, visitMap.dirtyWordCount());
+  EXPECT_TRUE(visitMap.visit(0));
+  EXPECT_TRUE(visitMap.visit(4));
+  EXPECT_TRUE(visitMap.visit(0x1FFFFCu));
+  EXPECT_TRUE(visitMap.visit(0x100u));
+  EXPECT_EQ((size_t)3u, visitMap.dirtyWordCount()); // 0/4 in same word
+  EXPECT_FALSE(visitMap.visit(0));
+  EXPECT_FALSE(visitMap.visit(4));
+  EXPECT_FALSE(visitMap.visit(0x1FFFFCu));
+  EXPECT_FALSE(visitMap.visit(0x100u));
+  EXPECT_TRUE(visitMap.visit(8));
+
+  visitMap.clear();
+  EXPECT_EQ((size_t)0, visitMap.dirtyWordCount());
+  EXPECT_TRUE(visitMap.visit(0));
+  EXPECT_TRUE(visitMap.visit(8));
+  EXPECT_TRUE(visitMap.visit(0x1FFFFCu));
+}
+
+TEST_F(DmaChainIteratorTest, exactValidChainTest) {
+  uint32_t chain[] {
+    0x00000008u, 99u, 0x02000014u, 11u, 12u, 0x00000018u, 0x0000001Cu, 0x03000030u,
+    31u, 32u, 33u, 99u, 0x00000034u, 0x01FFFFFFu, 21u
+  };
+  DmaChainVisitMap<0x200000u> visitMap;
+  unsigned long* buffer = nullptr;
+  int bufferSize = 0;
+
+  for (int repeat = 0; repeat < 2; ++repeat) { // same map reused for next chain
+    int itemsRead = 0;
+    DmaChainIterator<0x200000u> psxIt((unsigned long*)chain, 0, visitMap);
+    while (psxIt.readNext(&buffer, bufferSize))
+      ++itemsRead;
+    EXPECT_EQ((int)7, itemsRead);
+  }
+
+  DmaChainSpan spans[4];
+  DmaChainIterator<0x200000u> spanIt((unsigned long*)chain, 0, visitMap);
+  EXPECT_EQ((size_t)3u, spanIt.readSpans(spans, 4u));
+  EXPECT_EQ((size_t)0, spanIt.readSpans(spans, 4u));
+
+  DmaChainIterator<0x200000u> nullIt(nullptr, 0, visitMap);
+  EXPECT_FALSE(nullIt.readNext(&buffer, bufferSize));
+}
+
+TEST_F(DmaChainIteratorTest, exactEndlessChainTest) {
+  DmaChainVisitMap<0x200000u> visitMap;
+  unsigned long* buffer = nullptr;
+  int bufferSize = 0;
+
+  uint32_t selfRef[] { 0x01000000u, 42u };
+  int itemsRead = 0;
+  DmaChainIterator<0x200000u> selfRefIt((unsigned long*)selfRef, 0, visitMap);
+  while (selfRefIt.readNext(&buffer, bufferSize))
+    ++itemsRead;
+  EXPECT_EQ((int)1, itemsRead);
+
+  uint32_t alternateMoves[] { // stops exactly on first revisited node (0x10)
+    0x00000008u, 0x0000000Cu, 0x00000004u, 0x00000010u, 0x00000018u, 0x0000001Cu, 0x00000014u, 0x00000010u
+  };
+  itemsRead = 0;
+  DmaChainIterator<0x200000u> alternateIt((unsigned long*)alternateMoves, 0, visitMap);
+  while (alternateIt.readNext(&buffer, bufferSize))
+    ++itemsRead;
+  EXPECT_EQ((int)8, itemsRead);
+
+  // long unordered loop: each node visited once
+  uint32_t chainSize = (__LONG_CHAIN_BYTE_SIZE >> 2);
+  std::vector<uint32_t> chain;
+  for (uint32_t i = sizeof(uint32_t); i <= __LONG_CHAIN_BYTE_SIZE/2; i += sizeof(uint32_t))
+    chain.push_back(__LONG_CHAIN_BYTE_SIZE - i);
+  chain.push_back(0);
+  for (uint32_t i = sizeof(uint32_t); i < __LONG_CHAIN_BYTE_SIZE/2; i += sizeof(uint32_t))
+    chain.push_back(__LONG_CHAIN_BYTE_SIZE/2 - i);
+
+  itemsRead = 0;
+  DmaChainIterator<0x200000u> psxIt((unsigned long*)&chain[0], 0, visitMap);
+  while (psxIt.readNext(&buffer, bufferSize))
+    ++itemsRead;
+  EXPECT_EQ((int)chainSize, itemsRead);
+  EXPECT_EQ((size_t)chainSize / 64u, visitMap.dirtyWordCount());
+
+  // ZN arcade map
+  DmaChainVisitMap<0x800000u> znVisitMap;
+  itemsRead = 0;
+  DmaChainIterator<0x800000u> znIt((unsigned long*)&chain[0], 0, znVisitMap);
+  while (znIt.readNext(&buffer, bufferSize))
+    ++itemsRead;
+  EXPECT_EQ((int)chainSize, itemsRead);
+}
@@ -0,0 +1,323 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <vector>
+#include <display/draw_list.h>
+#include <display/draw_batcher.h>
+
+using namespace display;
+
+class DrawBatcherTest : public testing::Test {
+public:
+protected:
+  //static void SetUpTestCase() {}
+  //static void TearDownTestCase() {}
+
+  void SetUp() override {}
+  void TearDown() override {}
+};
+
+static void __addPrimitive(DrawList& drawList, DrawPrimitiveType type, const RasterState& state) {
+  const uint32_t vertexCount = (type == DrawPrimitiveType::triangle) ? 3u
+                             : (type == DrawPrimitiveType::quad) ? 4u
+                             : (type == DrawPrimitiveType::line) ? 2u : 1u;
+  uint32_t index = drawList.addPrimitive(type, state, vertexCount, Point{}, 8, 8);
+  for (uint32_t i = 0; i < vertexCount; ++i)
+    drawList.setVertex(index + i, (uint32_t)(index + i), 0x808080u);
+}
+
+
+// -- render states -- ---------------------------------------------------------
+
+TEST_F(DrawBatcherTest, renderStateTest) {
+  RasterState state, other;
+  state.clipArea = other.clipArea = Rectangle{ 0, 319, 0, 239 };
+  EXPECT_TRUE(DrawBatcher::isSameRenderState(state, other));
+
+  // unused attributes ignored
+  other.texpageX = 64;
+  other.clutX = 16;
+  other.blendingMode = BlendingMode::add;
+  other.isShaded = true;
+  other.textureWindow.isEnabled = true;
+  EXPECT_TRUE(DrawBatcher::isSameRenderState(state, other));
+  other.isSemiTransparent = state.isSemiTransparent = true;
+  EXPECT_FALSE(DrawBatcher::isSameRenderState(state, other));
+  other.blendingMode = state.blendingMode;
+  EXPECT_TRUE(DrawBatcher::isSameRenderState(state, other));
+
+  // texture attributes
+  state.isTextured = other.isTextured = true;
+  state.textureWindow.isEnabled = true;
+  state.texpageX = 64;
+  state.colorMode = other.colorMode = TextureColorMode::directColor15bit;
+  EXPECT_TRUE(DrawBatcher::isSameRenderState(state, other)); // CLUT ignored for direct colors
+  state.colorMode = other.colorMode = TextureColorMode::lookupTable4bit;
+  EXPECT_FALSE(DrawBatcher::isSameRenderState(state, other));
+  state.clutX = 16;
+  EXPECT_TRUE(DrawBatcher::isSameRenderState(state, other));
+  state.textureWindow.maskWidth = 16;
+  EXPECT_FALSE(DrawBatcher::isSameRenderState(state, other));
+  state.textureWindow = other.textureWindow;
+  state.checkMask = true;
+  EXPECT_FALSE(DrawBatcher::isSameRenderState(state, other));
+  state.checkMask = false;
+  state.clipArea.rightX = 255;
+  EXPECT_FALSE(DrawBatcher::isSameRenderState(state, other));
+}
+
+
+// -- batching -- --------------------------------------------------------------
+
+TEST_F(DrawBatcherTest, buildBatchesTest) {
+  DrawList drawList;
+  DrawBatcher batcher;
+  batcher.build(drawList);
+  EXPECT_TRUE(batcher.batches().empty());
+  EXPECT_EQ((uint64_t)1u, batcher.stats().frameCount);
+
+  RasterState state;
+  state.clipArea = Rectangle{ 0, 319, 0, 239 };
+  RasterState sameRenderState = state;
+  sameRenderState.isShaded = true;   // new draw list state, same render state
+  sameRenderState.clutY = 200;
+  RasterState textured = state;
+  textured.isTextured = true;
+
+  __addPrimitive(drawList, DrawPrimitiveType::triangle, state);           // batch 0
+  __addPrimitive(drawList, DrawPrimitiveType::quad, state);
+  __addPrimitive(drawList, DrawPrimitiveType::triangle, sameRenderState);
+  __addPrimitive(drawList, DrawPrimitiveType::line, sameRenderState);     // batch 1 (topology)
+  __addPrimitive(drawList, DrawPrimitiveType::line, state);
+  __addPrimitive(drawList, DrawPrimitiveType::rectangle, state);          // batch 2 (topology)
+  __addPrimitive(drawList, DrawPrimitiveType::rectangle, state);
+  __addPrimitive(drawList, DrawPrimitiveType::rectangle, textured);       // batch 3 (state)
+  __addPrimitive(drawList, DrawPrimitiveType::quad, textured);            // batch 4 (topology)
+  __addPrimitive(drawList, DrawPrimitiveType::triangle, state);           // batch 5 (state)
+  EXPECT_EQ((size_t)5u, drawList.stateCount());
+
+  batcher.build(drawList);
+  const auto& batches = batcher.batches();
+  ASSERT_EQ((size_t)6u, batches.size());
+  const DrawTopology expectedTopologies[] = { DrawTopology::triangleList, DrawTopology::lineList,
+                                              DrawTopology::rectangleInstances, DrawTopology::rectangleInstances,
+                                              DrawTopology::triangleList, DrawTopology::triangleList };
+  const uint32_t expectedPrimitives[][2] = { { 0,3 }, { 3,2 }, { 5,2 }, { 7,1 }, { 8,1 }, { 9,1 } };
+  const uint32_t expectedRanges[][2] = { { 0,12 }, { 10,4 }, { 14,2 }, { 16,1 }, { 12,6 }, { 18,3 } };
+  for (size_t i = 0; i < batches.size(); ++i) {
+    EXPECT_EQ(expectedTopologies[i], batches[i].topology) << "batch:" << i;
+    EXPECT_EQ(expectedPrimitives[i][0], batches[i].firstPrimitive) << "batch:" << i;
+    EXPECT_EQ(expectedPrimitives[i][1], batches[i].primitiveCount) << "batch:" << i;
+    EXPECT_EQ(expectedRanges[i][0], batches[i].first) << "batch:" << i;
+    EXPECT_EQ(expectedRanges[i][1], batches[i].count) << "batch:" << i;
+  }
+  EXPECT_EQ((uint32_t)drawList.primitive(8).stateIndex, batches[4].stateIndex);
+
+  const uint32_t expectedIndices[] = { 0,1,2, 3,4,5,4,5,6, 7,8,9, 17,18,19,18,19,20, 21,22,23 };
+  ASSERT_EQ(sizeof(expectedIndices) / sizeof(*expectedIndices), batcher.indices().size());
+  for (size_t i = 0; i < batcher.indices().size(); ++i) {
+    EXPECT_EQ(expectedIndices[i], batcher.indices()[i]) << "index:" << i;
+  }
+
+  // statistics
+  const DrawBatchStats& stats = batcher.stats();
+  EXPECT_EQ((uint64_t)2u, stats.frameCount);
+  EXPECT_EQ((uint64_t)6u, stats.batchCount);
+  EXPECT_EQ((uint64_t)10u, stats.primitiveCount);
+  EXPECT_EQ((uint32_t)6u, stats.lastFrameBatchCount);
+  EXPECT_EQ((uint32_t)10u, stats.lastFramePrimitiveCount);
+  EXPECT_DOUBLE_EQ(3.0, stats.batchesPerFrame());
+  EXPECT_DOUBLE_EQ(10.0 / 6.0, stats.primitivesPerBatch());
+  batcher.resetStats();
+  EXPECT_EQ((uint64_t)0, batcher.stats().frameCount);
+  EXPECT_DOUBLE_EQ(0.0, batcher.stats().primitivesPerBatch());
+}
+
+TEST_F(DrawBatcherTest, stateSortedBatchesTest) {
+  DrawList drawList;
+  DrawBatcher batcher;
+  batcher.build(drawList, DrawOrder::stateSorted);
+  EXPECT_TRUE(batcher.batches().empty());
+  EXPECT_TRUE(batcher.order().empty());
+
+  RasterState stateA;
+  stateA.clipArea = Rectangle{ 0, 319, 0, 239 };
+  stateA.isTextured = true;
+  RasterState stateB = stateA;
+  stateB.texpageX = 64;
+  RasterState blended = stateA;
+  blended.isSemiTransparent = true;
+  RasterState masked = stateA;
+  masked.checkMask = true;
+  EXPECT_FALSE(DrawList::isOrderDependent(stateA));
+  EXPECT_TRUE(DrawList::isOrderDependent(blended));
+  EXPECT_TRUE(DrawList::isOrderDependent(masked));
+
+  __addPrimitive(drawList, DrawPrimitiveType::triangle, stateA);  // 0
+  __addPrimitive(drawList, DrawPrimitiveType::quad, stateB);      // 1
+  __addPrimitive(drawList, DrawPrimitiveType::triangle, blended); // 2
+  __addPrimitive(drawList, DrawPrimitiveType::triangle, stateA);  // 3
+  __addPrimitive(drawList, DrawPrimitiveType::rectangle, stateB); // 4
+  __addPrimitive(drawList, DrawPrimitiveType::quad, stateB);      // 5
+  __addPrimitive(drawList, DrawPrimitiveType::line, masked);      // 6
+  __addPrimitive(drawList, DrawPrimitiveType::triangle, stateA);  // 7
+  __addPrimitive(drawList, DrawPrimitiveType::rectangle, blended);// 8
+  for (uint32_t i = 0; i < (uint32_t)drawList.size(); ++i) {
+    EXPECT_EQ(i + 1u, drawList.primitive(i).depth); // painter's order
+  }
+  EXPECT_FLOAT_EQ(0.5f, DrawList::toNormalizedDepth(drawList.primitive(4).depth, drawList.size()));
+
+  // submission order: 9 batches
+  batcher.build(drawList);
+  EXPECT_EQ((size_t)9u, batcher.batches().size());
+  EXPECT_FALSE(batcher.batches()[1].isReordered);
+  EXPECT_FALSE(batcher.batches()[4].isIndexed);
+
+  // state-sorted order: opaque groups (A: 0,3,7 / B: quads 1,5 / B: rectangle 4) + order-dependent (2 / 6 / 8)
+  batcher.build(drawList, DrawOrder::stateSorted);
+  const uint32_t expectedOrder[] = { 0,3,7, 1,5, 4, 2,6,8 };
+  ASSERT_EQ(sizeof(expectedOrder) / sizeof(*expectedOrder), batcher.order().size());
+  for (size_t i = 0; i < batcher.order().size(); ++i) {
+    EXPECT_EQ(expectedOrder[i], batcher.order()[i]) << "order:" << i;
+  }
+
+  const auto& batches = batcher.batches();
+  ASSERT_EQ((size_t)6u, batches.size());
+  const DrawTopology expectedTopologies[] = { DrawTopology::triangleList, DrawTopology::triangleList,
+                                              DrawTopology::rectangleInstances, DrawTopology::triangleList,
+                                              DrawTopology::lineList, DrawTopology::rectangleInstances };
+  const uint32_t expectedPrimitives[][2] = { { 0,3 }, { 3,2 }, { 5,1 }, { 6,1 }, { 7,1 }, { 8,1 } };
+  const uint32_t expectedRanges[][2] = { { 0,9 }, { 9,12 }, { 21,1 }, { 22,3 }, { 25,2 }, { 27,1 } };
+  for (size_t i = 0; i < batches.size(); ++i) {
+    EXPECT_EQ(expectedTopologies[i], batches[i].topology) << "batch:" << i;
+    EXPECT_EQ(expectedPrimitives[i][0], batches[i].firstPrimitive) << "batch:" << i;
+    EXPECT_EQ(expectedPrimitives[i][1], batches[i].primitiveCount) << "batch:" << i;
+    EXPECT_EQ(expectedRanges[i][0], batches[i].first) << "batch:" << i;
+    EXPECT_EQ(expectedRanges[i][1], batches[i].count) << "batch:" << i;
+    EXPECT_TRUE(batches[i].isIndexed) << "batch:" << i;
+    EXPECT_EQ(i < 3u, batches[i].isReordered) << "batch:" << i;
+  }
+  // lines + rectangles indexed (non-contiguous vertices)
+  const uint32_t lineVertex = drawList.primitive(6).firstVertex;
+  EXPECT_EQ(lineVertex, batcher.indices()[25]);
+  EXPECT_EQ(lineVertex + 1u, batcher.indices()[26]);
+  EXPECT_EQ(drawList.primitive(8).firstVertex, batcher.indices()[27]);
+  EXPECT_EQ(drawList.primitive(4).firstVertex, batcher.indices()[21]);
+
+  EXPECT_EQ((uint64_t)6u, batcher.stats().reorderedPrimitiveCount);
+  EXPECT_EQ((uint64_t)3u, batcher.stats().frameCount);
+}
+
+TEST_F(DrawBatcherTest, culledSubmissionBatchesTest) {
+  DrawList drawList;
+  DrawBatcher batcher;
+  RasterState state;
+  state.clipArea = Rectangle{ 0, 319, 0, 239 };
+
+  // lines/rectangles with a culled primitive in the middle (outside of draw area: Y=300)
+  const uint32_t visibleCoords = 10u, outsideCoords = (300u << 16) | 10u;
+  for (int i = 0; i < 3; ++i) {
+    uint32_t index = drawList.addPrimitive(DrawPrimitiveType::line, state, 2u, Point{});
+    drawList.setVertex(index, (i == 1) ? outsideCoords : visibleCoords, 0x808080u);
+    drawList.setVertex(index + 1u, (i == 1) ? outsideCoords : visibleCoords + 20u, 0x808080u);
+  }
+  for (int i = 0; i < 4; ++i) {
+    uint32_t index = drawList.addPrimitive(DrawPrimitiveType::rectangle, state, 1u, Point{}, 8, 8);
+    drawList.setVertex(index, (i == 2) ? outsideCoords : visibleCoords, 0x808080u);
+  }
+  drawList.cullPrimitives();
+  ASSERT_EQ((size_t)5u, drawList.size());
+  EXPECT_EQ((uint32_t)4u, drawList.primitive(1).firstVertex);
+
+  // vertex ranges split at each gap in vertex streams
+  batcher.build(drawList);
+  const auto& batches = batcher.batches();
+  ASSERT_EQ((size_t)4u, batches.size());
+  const uint32_t expectedPrimitives[][2] = { { 0,1 }, { 1,1 }, { 2,2 }, { 4,1 } };
+  const uint32_t expectedRanges[][2] = { { 0,2 }, { 4,2 }, { 6,2 }, { 9,1 } };
+  for (size_t i = 0; i < batches.size(); ++i) {
+    EXPECT_FALSE(batches[i].isIndexed) << "batch:" << i;
+    EXPECT_EQ(expectedPrimitives[i][0], batches[i].firstPrimitive) << "batch:" << i;
+    EXPECT_EQ(expectedPrimitives[i][1], batches[i].primitiveCount) << "batch:" << i;
+    EXPECT_EQ(expectedRanges[i][0], batches[i].first) << "batch:" << i;
+    EXPECT_EQ(expectedRanges[i][1], batches[i].count) << "batch:" << i;
+  }
+  EXPECT_TRUE(batcher.indices().empty());
+
+  // state-sorted order: indexed (only drawn vertices referenced)
+  batcher.build(drawList, DrawOrder::stateSorted);
+  ASSERT_EQ((size_t)2u, batcher.batches().size());
+  const uint32_t expectedIndices[] = { 0,1, 4,5, 6,7,9 };
+  ASSERT_EQ(sizeof(expectedIndices) / sizeof(*expectedIndices), batcher.indices().size());
+  for (size_t i = 0; i < batcher.indices().size(); ++i) {
+    EXPECT_EQ(expectedIndices[i], batcher.indices()[i]) << "index:" << i;
+  }
+}
+
+TEST_F(DrawBatcherTest, barrierSegmentsTest) {
+  DrawList drawList;
+  DrawBatcher batcher;
+  RasterState stateA;
+  stateA.clipArea = Rectangle{ 0, 319, 0, 239 };
+  stateA.isTextured = true;
+  RasterState stateB = stateA;
+  stateB.texpageX = 64;
+  const Rectangle area{ 0, 63, 0, 255 };
+
+  __addPrimitive(drawList, DrawPrimitiveType::triangle, stateA); // 0
+  __addPrimitive(drawList, DrawPrimitiveType::quad, stateB);     // 1
+  drawList.addBarrier(DrawBarrierType::vramWrite, area);
+  __addPrimitive(drawList, DrawPrimitiveType::triangle, stateA); // 2
+  __addPrimitive(drawList, DrawPrimitiveType::quad, stateB);     // 3
+  drawList.addBarrier(DrawBarrierType::vramWrite, area);
+  drawList.addBarrier(DrawBarrierType::vramWrite, area);
+  __addPrimitive(drawList, DrawPrimitiveType::triangle, stateA); // 4
+  __addPrimitive(drawList, DrawPrimitiveType::triangle, stateA); // 5
+
+  // state-sorted order: groups only sorted within segments (without barriers: 2 batches)
+  batcher.build(drawList, DrawOrder::stateSorted);
+  const uint32_t expectedOrder[] = { 0,1, 2,3, 4,5 };
+  ASSERT_EQ(sizeof(expectedOrder) / sizeof(*expectedOrder), batcher.order().size());
+  for (size_t i = 0; i < batcher.order().size(); ++i) {
+    EXPECT_EQ(expectedOrder[i], batcher.order()[i]) << "order:" << i;
+  }
+  const uint32_t expectedPrimitives[][2] = { { 0,1 }, { 1,1 }, { 2,1 }, { 3,1 }, { 4,2 } };
+  ASSERT_EQ(sizeof(expectedPrimitives) / sizeof(*expectedPrimitives), batcher.batches().size());
+  for (size_t i = 0; i < batcher.batches().size(); ++i) {
+    EXPECT_EQ(expectedPrimitives[i][0], batcher.batches()[i].firstPrimitive) << "batch:" << i;
+    EXPECT_EQ(expectedPrimitives[i][1], batcher.batches()[i].primitiveCount) << "batch:" << i;
+  }
+  const uint32_t expectedBarrierBatches[] = { 2, 4, 4 };
+  ASSERT_EQ(drawList.barrierCount(), batcher.barrierBatches().size());
+  for (size_t i = 0; i < batcher.barrierBatches().size(); ++i) {
+    EXPECT_EQ(expectedBarrierBatches[i], batcher.barrierBatches()[i]) << "barrier:" << i;
+  }
+  EXPECT_EQ((uint64_t)6u, batcher.stats().reorderedPrimitiveCount);
+
+  // submission order: same-state primitives not merged across barriers
+  drawList.clear();
+  __addPrimitive(drawList, DrawPrimitiveType::triangle, stateA);
+  drawList.addBarrier(DrawBarrierType::vramWrite, area);
+  __addPrimitive(drawList, DrawPrimitiveType::triangle, stateA);
+  __addPrimitive(drawList, DrawPrimitiveType::triangle, stateA);
+  drawList.addBarrier(DrawBarrierType::vramWrite, area);
+  batcher.build(drawList);
+  ASSERT_EQ((size_t)2u, batcher.batches().size());
+  EXPECT_EQ((uint32_t)1u, batcher.batches()[0].primitiveCount);
+  EXPECT_EQ((uint32_t)2u, batcher.batches()[1].primitiveCount);
+  ASSERT_EQ((size_t)2u, batcher.barrierBatches().size());
+  EXPECT_EQ((uint32_t)1u, batcher.barrierBatches()[0]);
+  EXPECT_EQ((uint32_t)2u, batcher.barrierBatches()[1]);
+}
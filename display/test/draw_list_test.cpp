@@ -0,0 +1,439 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <display/status_register.h>
+#include <display/renderer.h>
+#include <display/vram.h>
+#include <display/primitives.h>
+#include <display/draw_list.h>
+
+using namespace display;
+
+class DrawListTest : public testing::Test {
+public:
+protected:
+  //static void SetUpTestCase() {}
+  //static void TearDownTestCase() {}
+
+  void SetUp() override {}
+  void TearDown() override {}
+};
+
+
+// -- vertex decoding -- -------------------------------------------------------
+
+TEST_F(DrawListTest, decodeVertexCoordsTest) {
+  const size_t lengths[] = { 0, 1, 3, 4, 7, 8, 9, 16, 17, 33 }; // vector sizes, remainders
+  const Point offsets[] = { Point{ 0, 0 }, Point{ 100, -24 }, Point{ -1024, 1023 } };
+  for (size_t length : lengths) {
+    std::vector<uint32_t> coords(length);
+    uint32_t seed = (uint32_t)length;
+    for (auto& value : coords) {
+      seed = seed * 1103515245u + 12345u;
+      value = seed; // unused bits set too
+    }
+    if (length >= 4u) {
+      coords[0] = 0x03FF07FFu; // x: -1 / y: -1
+      coords[1] = 0x04000400u; // x: -1024 / y: -1024
+      coords[2] = 0xF80003FFu; // x: 1023 / y: 0 (ignored bits)
+    }
+
+    for (const auto& offset : offsets) {
+      std::vector<int32_t> x(length + 1u, 0x7F7F7F7F), y(length + 1u, 0x7F7F7F7F); // +1: detect overflows
+      DrawList::decodeVertexCoords(coords.data(), length, offset, x.data(), y.data());
+      for (size_t i = 0; i < length; ++i) {
+        int32_t expectedX = (int32_t)(coords[i] & 0x7FFu) - ((coords[i] & 0x400u) ? 0x800 : 0) + (int32_t)offset.x;
+        int32_t expectedY = (int32_t)((coords[i] >> 16) & 0x7FFu) - ((coords[i] & 0x4000000u) ? 0x800 : 0) + (int32_t)offset.y;
+        ASSERT_EQ(expectedX, x[i]) << "length:" << length << " index:" << i;
+        ASSERT_EQ(expectedY, y[i]) << "length:" << length << " index:" << i;
+      }
+      EXPECT_EQ((int32_t)0x7F7F7F7F, x[length]);
+      EXPECT_EQ((int32_t)0x7F7F7F7F, y[length]);
+    }
+  }
+}
+
+TEST_F(DrawListTest, stateAndOffsetTest) {
+  DrawList drawList;
+  EXPECT_TRUE(drawList.empty());
+  RasterState state;
+  state.clipArea = Rectangle{ 0, 255, 0, 239 };
+
+  uint32_t index = drawList.addPrimitive(DrawPrimitiveType::triangle, state, 3, Point{ 10, 20 });
+  EXPECT_EQ((uint32_t)0, index);
+  for (uint32_t i = 0; i < 3u; ++i)
+    drawList.setVertex(index + i, (uint32_t)((i << 16) | i), 0xFF102030u, i, i + 1u);
+  index = drawList.addPrimitive(DrawPrimitiveType::line, state, 2, Point{ 10, 20 }); // same state -> shared
+  drawList.setVertex(index, 0x07FF07FFu, 0x405060u);
+  drawList.setVertex(index + 1u, 0u, 0x405060u);
+  EXPECT_FALSE(drawList.isDecoded());
+
+  state.isSemiTransparent = true; // new state + new offset -> previous vertices decoded with previous offset
+  index = drawList.addPrimitive(DrawPrimitiveType::rectangle, state, 1, Point{ -5, 0 }, 16, 8);
+  EXPECT_EQ((uint32_t)5, index);
+  drawList.setVertex(index, (uint32_t)((2u << 16) | 3u), 0x808080u, 64u, 32u);
+  drawList.decodeVertices();
+  ASSERT_TRUE(drawList.isDecoded());
+
+  ASSERT_EQ((size_t)3u, drawList.size());
+  ASSERT_EQ((size_t)6u, drawList.vertexCount());
+  EXPECT_EQ((size_t)2u, drawList.stateCount());
+  EXPECT_EQ((uint32_t)0, drawList.primitive(1).stateIndex);
+  EXPECT_EQ((uint32_t)1, drawList.primitive(2).stateIndex);
+  EXPECT_TRUE(drawList.state(1).isSemiTransparent);
+  EXPECT_EQ((uint16_t)16u, drawList.primitive(2).width);
+  EXPECT_EQ((uint16_t)8u, drawList.primitive(2).height);
+
+  const int32_t expectedX[] = { 10, 11, 12, 9, 10, -2 };
+  const int32_t expectedY[] = { 20, 21, 22, 19, 20, 2 };
+  for (size_t i = 0; i < 6u; ++i) {
+    EXPECT_EQ(expectedX[i], drawList.x()[i]);
+    EXPECT_EQ(expectedY[i], drawList.y()[i]);
+  }
+  EXPECT_EQ((uint32_t)0x102030u, drawList.colors()[2]);
+  EXPECT_EQ((uint8_t)2u, drawList.u()[2]);
+  EXPECT_EQ((uint8_t)3u, drawList.v()[2]);
+  RasterVertex vertex;
+  drawList.readVertex(5, vertex);
+  EXPECT_EQ((long)-2, vertex.x);
+  EXPECT_EQ((long)2, vertex.y);
+  EXPECT_EQ((uint32_t)64u, vertex.u);
+  EXPECT_EQ((uint32_t)32u, vertex.v);
+
+  drawList.clear();
+  EXPECT_TRUE(drawList.empty());
+  EXPECT_EQ((size_t)0, drawList.vertexCount());
+  EXPECT_EQ((size_t)0, drawList.stateCount());
+  EXPECT_TRUE(drawList.isDecoded());
+}
+
+
+// -- GP0 command recording -- -------------------------------------------------
+
+TEST_F(DrawListTest, recordedCommandsReplayTest) {
+  StatusRegister status;
+  Renderer renderer;
+  std::unique_ptr<Vram<psxVramHeight()> > vram(new Vram<psxVramHeight()>());
+  std::unique_ptr<Vram<psxVramHeight()> > replayVram(new Vram<psxVramHeight()>());
+  DrawList drawList;
+  Gp0Parser parser;
+  parser.setDrawList(&drawList);
+
+  uint32_t params[] = {
+    0xE3000000u, 0xE4000000u | (uint32_t)((255u << 10) | 255u), // draw area
+    0xE5000000u | (uint32_t)((4u << 11) | 8u),                   // draw offset: 8,4
+    0x20F8F8F8u, (uint32_t)(40u << 16), (uint32_t)((40u << 16) | 20u), (uint32_t)((60u << 16) | 10u), // flat triangle
+    0x30F80000u, (uint32_t)(70u << 16), 0x0000F800u, (uint32_t)((70u << 16) | 30u), 0x00F80000u, (uint32_t)(100u << 16), // shaded
+    0xE5000000u | (uint32_t)((0x7FFu << 11) | 0x7F0u),           // draw offset: -16,-1
+    0x2A808080u, (uint32_t)((110u << 16) | 20u), (uint32_t)((110u << 16) | 60u), // semi-transparent quad
+                 (uint32_t)((140u << 16) | 20u), (uint32_t)((140u << 16) | 60u),
+    0x40F8F8F8u, (uint32_t)((150u << 16) | 20u), (uint32_t)((180u << 16) | 90u), // line
+    0x58F80000u, (uint32_t)(200u << 16), 0x0000F800u, (uint32_t)((200u << 16) | 30u), // shaded poly-line
+                 0x00F80000u, (uint32_t)((230u << 16) | 30u), 0x55555555u
+  };
+  parser.runBuffer(status, renderer, *vram, params, (int)(sizeof(params) / sizeof(*params)), false);
+
+  ASSERT_EQ((size_t)6u, drawList.size());
+  const DrawPrimitiveType expectedTypes[] = { DrawPrimitiveType::triangle, DrawPrimitiveType::triangle, DrawPrimitiveType::quad,
+                                              DrawPrimitiveType::line, DrawPrimitiveType::line, DrawPrimitiveType::line };
+  for (size_t i = 0; i < 6u; ++i) {
+    EXPECT_EQ(expectedTypes[i], drawList.primitive(i).type);
+  }
+  EXPECT_EQ((size_t)16u, drawList.vertexCount());
+  drawList.decodeVertices();
+  EXPECT_EQ((int32_t)28, drawList.x()[1]);
+  EXPECT_EQ((int32_t)44, drawList.y()[1]);
+  EXPECT_EQ((int32_t)4, drawList.x()[6]);
+  EXPECT_EQ((int32_t)109, drawList.y()[6]);
+  EXPECT_EQ((uint32_t)0x00F800u, drawList.colors()[14]);
+
+  // software replay of recorded primitives -> same result as immediate rendering
+  drawList.rasterize(*replayVram, 0, drawList.size());
+  for (unsigned long y = 0; y < psxVramHeight(); ++y) {
+    ASSERT_EQ(0, memcmp(vram->row(y), replayVram->row(y), vramWidth()*sizeof(uint16_t))) << "line:" << y;
+  }
+}
+
+TEST_F(DrawListTest, recordedTilesTest) {
+  StatusRegister status;
+  Renderer renderer;
+  std::unique_ptr<Vram<psxVramHeight()> > vram(new Vram<psxVramHeight()>());
+  DrawList drawList;
+  Gp0Parser parser;
+  parser.setDrawList(&drawList);
+
+  uint32_t params[] = {
+    0x60102030u, (uint32_t)((5u << 16) | 6u), (uint32_t)((30u << 16) | 20u),                      // custom tile
+    0x64808080u, (uint32_t)((7u << 16) | 8u), (uint32_t)((0x7FC1u << 16) | (9u << 8) | 10u),      // textured custom tile
+                 (uint32_t)((0x1FFu << 16) | 0x3FFu),
+    0x68FFFFFFu, 0u,                                                                              // 1x1
+    0x74808080u, (uint32_t)(16u << 16), (uint32_t)((0x4002u << 16) | 0x0808u),                   // textured 8x8
+    0x7A000000u, (uint32_t)(32u << 16)                                                            // semi-transparent 16x16
+  };
+  parser.runBuffer(status, renderer, *vram, params, (int)(sizeof(params) / sizeof(*params)), false);
+
+  ASSERT_EQ((size_t)5u, drawList.size());
+  const uint16_t expectedSizes[][2] = { { 20,30 }, { 0x3FF,0x1FF }, { 1,1 }, { 8,8 }, { 16,16 } };
+  for (size_t i = 0; i < 5u; ++i) {
+    EXPECT_EQ(DrawPrimitiveType::rectangle, drawList.primitive(i).type);
+    EXPECT_EQ((uint32_t)i, drawList.primitive(i).firstVertex);
+    EXPECT_EQ(expectedSizes[i][0], drawList.primitive(i).width);
+    EXPECT_EQ(expectedSizes[i][1], drawList.primitive(i).height);
+  }
+  drawList.decodeVertices();
+  EXPECT_EQ((int32_t)8, drawList.x()[1]);
+  EXPECT_EQ((int32_t)7, drawList.y()[1]);
+  EXPECT_EQ((uint32_t)0x102030u, drawList.colors()[0]);
+  EXPECT_EQ((uint8_t)10u, drawList.u()[1]);
+  EXPECT_EQ((uint8_t)9u, drawList.v()[1]);
+
+  const RasterState& texturedState = drawList.state(drawList.primitive(1).stateIndex);
+  EXPECT_TRUE(texturedState.isTextured);
+  EXPECT_EQ((long)(0x01u << 4), texturedState.clutX);
+  EXPECT_EQ((long)(0x1FFu), texturedState.clutY);
+  const RasterState& tileState = drawList.state(drawList.primitive(3).stateIndex);
+  EXPECT_EQ((long)(0x02u << 4), tileState.clutX);
+  EXPECT_EQ((long)0x100, tileState.clutY);
+  EXPECT_TRUE(drawList.state(drawList.primitive(4).stateIndex).isSemiTransparent);
+  EXPECT_FALSE(drawList.state(drawList.primitive(4).stateIndex).isTextured);
+}
+
+TEST_F(DrawListTest, recordedVramWritesTest) {
+  StatusRegister status;
+  Renderer renderer;
+  std::unique_ptr<Vram<psxVramHeight()> > vram(new Vram<psxVramHeight()>());
+  DrawList drawList;
+  Gp0Parser parser;
+  parser.setDrawList(&drawList);
+
+  uint32_t params[] = {
+    0xE3000000u, 0xE4000000u | (uint32_t)((255u << 10) | 255u), // draw area
+    0x70102030u, (uint32_t)(8u << 16),                                                   // 8x8 tile
+    0x02102030u, 512u, (uint32_t)((16u << 16) | 16u),                                     // fill
+    0x70102030u, (uint32_t)((8u << 16) | 8u),                                             // 8x8 tile (adjacent)
+    0x80000000u, 512u, (uint32_t)((32u << 16) | 512u), (uint32_t)((4u << 16) | 4u),       // copy
+    0x70102030u, (uint32_t)((8u << 16) | 16u),                                            // 8x8 tile (adjacent)
+    0xA0000000u, (uint32_t)((64u << 16) | 600u), (uint32_t)((2u << 16) | 2u), 0x7FFF7FFFu, 0x7FFF7FFFu, // CPU->VRAM
+    0x70102030u, (uint32_t)((8u << 16) | 24u)                                             // 8x8 tile (adjacent)
+  };
+  parser.runBuffer(status, renderer, *vram, params, (int)(sizeof(params) / sizeof(*params)), false);
+
+  // VRAM writes recorded as barriers -> tiles not merged across them
+  ASSERT_EQ((size_t)4u, drawList.size());
+  EXPECT_EQ((size_t)0, drawList.mergedTileCount());
+  ASSERT_EQ((size_t)3u, drawList.barrierCount());
+  const Rectangle expectedAreas[] = { { 512,527,0,15 }, { 512,515,32,35 }, { 600,601,64,65 } };
+  for (size_t i = 0; i < drawList.barrierCount(); ++i) {
+    const DrawBarrier& barrier = drawList.barrier(i);
+    EXPECT_EQ((uint32_t)(i + 1u), barrier.primitiveIndex) << "barrier:" << i;
+    EXPECT_EQ(DrawBarrierType::vramWrite, barrier.type) << "barrier:" << i;
+    EXPECT_EQ(expectedAreas[i].leftX, barrier.area.leftX) << "barrier:" << i;
+    EXPECT_EQ(expectedAreas[i].rightX, barrier.area.rightX) << "barrier:" << i;
+    EXPECT_EQ(expectedAreas[i].topY, barrier.area.topY) << "barrier:" << i;
+    EXPECT_EQ(expectedAreas[i].bottomY, barrier.area.bottomY) << "barrier:" << i;
+  }
+
+  drawList.clear();
+  EXPECT_EQ((size_t)0, drawList.barrierCount());
+
+  // fill covering draw area -> clear recorded between primitives (not applied out of order)
+  uint32_t clearParams[] = {
+    0x70102030u, (uint32_t)(8u << 16),                          // 8x8 tile
+    0x02332211u, 0u, (uint32_t)((256u << 16) | 256u),           // fill draw area
+    0x70102030u, (uint32_t)((8u << 16) | 8u)                    // 8x8 tile (adjacent)
+  };
+  parser.runBuffer(status, renderer, *vram, clearParams, (int)(sizeof(clearParams) / sizeof(*clearParams)), false);
+  ASSERT_EQ((size_t)2u, drawList.size());
+  ASSERT_EQ((size_t)1u, drawList.barrierCount());
+  EXPECT_EQ((uint32_t)1u, drawList.barrier(0).primitiveIndex);
+  EXPECT_EQ(DrawBarrierType::clear, drawList.barrier(0).type);
+  EXPECT_EQ((uint32_t)0x332211u, drawList.barrier(0).color);
+  EXPECT_EQ(0L, drawList.barrier(0).area.leftX);
+  EXPECT_EQ(255L, drawList.barrier(0).area.rightX);
+  EXPECT_EQ(0L, drawList.barrier(0).area.topY);
+  EXPECT_EQ(255L, drawList.barrier(0).area.bottomY);
+}
+
+TEST_F(DrawListTest, tilemapRunsTest) {
+  StatusRegister status;
+  Renderer renderer;
+  std::unique_ptr<Vram<psxVramHeight()> > vram(new Vram<psxVramHeight()>());
+  std::unique_ptr<Vram<psxVramHeight()> > refVram(new Vram<psxVramHeight()>());
+  for (unsigned long y = 0; y < 256u; ++y) { // texture page (x: 640 / y: 256 / 15-bit colors)
+    for (unsigned long x = 0; x < 256u; ++x)
+      vram->row(256u + y)[640u + x] = refVram->row(256u + y)[640u + x] = (uint16_t)(((x * 7u) ^ (y * 13u)) | 1u);
+  }
+  DrawList drawList;
+  Gp0Parser parser;
+  parser.setDrawList(&drawList);
+
+  std::vector<uint32_t> params{ 0xE3000000u, 0xE4000000u | (uint32_t)((255u << 10) | 319u), 0xE100011Au };
+  // row of 8x8 tiles with contiguous texture coords (x: 0-79) + gap + 16x16 run + CLUT change + untextured run
+  for (uint32_t i = 0; i < 10u; ++i)
+    params.insert(params.end(), { 0x75808080u, (uint32_t)((8u << 16) | (i*8u)), (uint32_t)((16u << 8) | (i*8u)) });
+  params.insert(params.end(), { 0x75808080u, (uint32_t)((8u << 16) | 88u), (uint32_t)((16u << 8) | 88u) });          // gap
+  params.insert(params.end(), { 0x75808080u, (uint32_t)((8u << 16) | 96u), (uint32_t)((16u << 8) | 100u) });         // texture jump
+  params.insert(params.end(), { 0x75808080u, (uint32_t)((16u << 16) | 104u), (uint32_t)((24u << 8) | 104u) });       // other row
+  for (uint32_t i = 0; i < 4u; ++i)
+    params.insert(params.end(), { 0x7D808080u, (uint32_t)((40u << 16) | (i*16u)), (uint32_t)((32u << 8) | (i*16u)) });
+  params.insert(params.end(), { 0x7D808080u, (uint32_t)((40u << 16) | 64u), (uint32_t)((1u << 16) | (32u << 8) | 64u) }); // CLUT
+  for (uint32_t i = 0; i < 3u; ++i)
+    params.insert(params.end(), { 0x70102030u, (uint32_t)((60u << 16) | (i*8u)) });
+  params.insert(params.end(), { 0x70102031u, (uint32_t)((60u << 16) | 24u) });                                      // color
+  parser.runBuffer(status, renderer, *vram, params.data(), (int)params.size(), false);
+
+  const uint16_t expectedWidths[] = { 80, 8, 8, 8, 64, 16, 24, 8 };
+  ASSERT_EQ(sizeof(expectedWidths) / sizeof(*expectedWidths), drawList.size());
+  for (size_t i = 0; i < drawList.size(); ++i) {
+    EXPECT_EQ(expectedWidths[i], drawList.primitive(i).width) << "primitive:" << i;
+  }
+  EXPECT_EQ((size_t)(9u + 3u + 2u), drawList.mergedTileCount());
+
+  // merged runs -> same pixels as individual tiles
+  drawList.rasterize(*vram, 0, drawList.size());
+  RasterState state;
+  state.clipArea = Rectangle{ 0, 319, 0, 255 };
+  for (size_t i = 0; i + 1u < params.size(); ) {
+    const uint32_t command = params[i] >> 24;
+    if (command < 0x70u || command >= 0x80u) { // attributes
+      ++i;
+      continue;
+    }
+    const long size = (command >= 0x78u) ? 16 : 8;
+    const bool isTextured = (command & 0x4u) != 0;
+    state.isTextured = state.isRawTexture = isTextured;
+    state.texpageX = 640;
+    state.texpageY = 256;
+    state.colorMode = TextureColorMode::directColor15bit;
+    RasterVertex vertex;
+    vertex.x = (long)(params[i + 1u] & 0x7FFu);
+    vertex.y = (long)((params[i + 1u] >> 16) & 0x7FFu);
+    vertex.color = params[i] & 0xFFFFFFu;
+    vertex.u = isTextured ? (params[i + 2u] & 0xFFu) : 0;
+    vertex.v = isTextured ? ((params[i + 2u] >> 8) & 0xFFu) : 0;
+    Rasterizer::drawRectangle(*refVram, state, vertex, size, size);
+    i += isTextured ? 3u : 2u;
+  }
+  for (unsigned long y = 0; y < psxVramHeight(); ++y) {
+    ASSERT_EQ(0, memcmp(vram->row(y), refVram->row(y), vramWidth()*sizeof(uint16_t))) << "line:" << y;
+  }
+
+  drawList.clear();
+  EXPECT_EQ((size_t)0, drawList.mergedTileCount());
+}
+
+// -- culling -- ---------------------------------------------------------------
+
+static uint32_t __toVertexCoords(int32_t x, int32_t y) noexcept {
+  return (((uint32_t)x & 0x7FFu) | (((uint32_t)y & 0x7FFu) << 16));
+}
+static void __addCullPrimitive(DrawList& drawList, DrawPrimitiveType type, const RasterState& state,
+                               const int32_t (*vertices)[2], uint16_t width = 0, uint16_t height = 0) {
+  const uint32_t vertexCount = (type == DrawPrimitiveType::triangle) ? 3u
+                             : (type == DrawPrimitiveType::quad) ? 4u
+                             : (type == DrawPrimitiveType::line) ? 2u : 1u;
+  uint32_t index = drawList.addPrimitive(type, state, vertexCount, Point{}, width, height);
+  for (uint32_t i = 0; i < vertexCount; ++i)
+    drawList.setVertex(index + i, __toVertexCoords(vertices[i][0], vertices[i][1]), 0x808080u);
+}
+
+TEST_F(DrawListTest, cullPrimitivesTest) {
+  DrawList drawList;
+  drawList.cullPrimitives();
+  EXPECT_TRUE(drawList.empty());
+  EXPECT_EQ((uint64_t)0, drawList.cullStats().primitiveCount);
+
+  RasterState state;
+  state.clipArea = Rectangle{ 0, 319, 0, 239 };
+  const int32_t visibleTriangle[][2] = { { 10,10 }, { 50,10 }, { 10,50 } };
+  const int32_t collinearTriangle[][2] = { { 0,0 }, { 10,10 }, { 20,20 } };
+  const int32_t rightTriangle[][2] = { { 400,10 }, { 450,10 }, { 400,50 } };
+  const int32_t wideTriangle[][2] = { { -600,0 }, { 500,0 }, { 0,10 } };
+  const int32_t wideQuad[][2] = { { -600,0 }, { 0,0 }, { 0,100 }, { 600,100 } }; // both triangles within limits
+  const int32_t pointQuad[][2] = { { 5,5 }, { 5,5 }, { 5,5 }, { 5,5 } };
+  const int32_t wideLine[][2] = { { -600,0 }, { 500,0 } };
+  const int32_t pointLine[][2] = { { 5,5 }, { 5,5 } };
+  const int32_t rectangleCorner[][2] = { { -20,-20 } };
+  const int32_t oversizedQuad[][2] = { { -600,0 }, { 500,0 }, { -600,300 }, { 500,300 } };
+  const int32_t aboveTriangle[][2] = { { 10,-30 }, { 50,-30 }, { 10,-1 } };
+
+  for (int frame = 0; frame < 2; ++frame) {
+    drawList.clear();
+    __addCullPrimitive(drawList, DrawPrimitiveType::triangle, state, visibleTriangle);    // kept
+    __addCullPrimitive(drawList, DrawPrimitiveType::triangle, state, collinearTriangle);  // degenerate
+    __addCullPrimitive(drawList, DrawPrimitiveType::triangle, state, rightTriangle);      // outside
+    __addCullPrimitive(drawList, DrawPrimitiveType::triangle, state, wideTriangle);       // oversized
+    __addCullPrimitive(drawList, DrawPrimitiveType::quad, state, wideQuad);               // kept
+    __addCullPrimitive(drawList, DrawPrimitiveType::quad, state, pointQuad);              // degenerate
+    __addCullPrimitive(drawList, DrawPrimitiveType::line, state, wideLine);               // oversized
+    __addCullPrimitive(drawList, DrawPrimitiveType::line, state, pointLine);              // kept (1 pixel)
+    __addCullPrimitive(drawList, DrawPrimitiveType::rectangle, state, visibleTriangle, 0, 8); // degenerate
+    __addCullPrimitive(drawList, DrawPrimitiveType::rectangle, state, rectangleCorner, 10, 10); // outside
+    __addCullPrimitive(drawList, DrawPrimitiveType::rectangle, state, rectangleCorner, 30, 30); // kept
+    __addCullPrimitive(drawList, DrawPrimitiveType::quad, state, oversizedQuad);          // oversized
+    __addCullPrimitive(drawList, DrawPrimitiveType::triangle, state, aboveTriangle);      // outside
+    drawList.cullPrimitives();
+
+    const uint32_t expectedDepths[] = { 1, 5, 8, 11 };
+    ASSERT_EQ(sizeof(expectedDepths) / sizeof(*expectedDepths), drawList.size());
+    for (size_t i = 0; i < drawList.size(); ++i) {
+      EXPECT_EQ(expectedDepths[i], drawList.primitive(i).depth) << "primitive:" << i;
+    }
+    EXPECT_EQ((uint32_t)22u, drawList.primitive(2).firstVertex);
+    EXPECT_TRUE(drawList.isDecoded());
+
+    const DrawCullStats& stats = drawList.cullStats();
+    EXPECT_EQ((uint64_t)13u*(frame + 1), stats.primitiveCount);
+    EXPECT_EQ((uint64_t)3u*(frame + 1), stats.degenerateCount);
+    EXPECT_EQ((uint64_t)3u*(frame + 1), stats.outsideCount);
+    EXPECT_EQ((uint64_t)3u*(frame + 1), stats.oversizedCount);
+    EXPECT_EQ((uint64_t)9u*(frame + 1), stats.culledCount());
+  }
+  drawList.resetCullStats();
+  EXPECT_EQ((uint64_t)0, drawList.cullStats().culledCount());
+}
+
+TEST_F(DrawListTest, culledBarriersTest) {
+  DrawList drawList;
+  RasterState state;
+  state.clipArea = Rectangle{ 0, 319, 0, 239 };
+  const int32_t visibleTriangle[][2] = { { 10,10 }, { 50,10 }, { 10,50 } };
+  const int32_t collinearTriangle[][2] = { { 0,0 }, { 10,10 }, { 20,20 } };
+  const Rectangle area{ 0, 15, 0, 15 };
+
+  drawList.addBarrier(DrawBarrierType::vramWrite, area);                                // before 0
+  __addCullPrimitive(drawList, DrawPrimitiveType::triangle, state, visibleTriangle);    // 0: kept
+  __addCullPrimitive(drawList, DrawPrimitiveType::triangle, state, collinearTriangle);  // 1
+  drawList.addBarrier(DrawBarrierType::vramWrite, area);                                // before 2
+  __addCullPrimitive(drawList, DrawPrimitiveType::triangle, state, collinearTriangle);  // 2
+  drawList.addBarrier(DrawBarrierType::vramWrite, area);                                // before 3
+  __addCullPrimitive(drawList, DrawPrimitiveType::triangle, state, visibleTriangle);    // 3: kept
+  for (int i = 0; i < 6; ++i)
+    __addCullPrimitive(drawList, DrawPrimitiveType::triangle, state, collinearTriangle);// 4-9
+  drawList.addBarrier(DrawBarrierType::vramWrite, area);                                // before 10
+  __addCullPrimitive(drawList, DrawPrimitiveType::triangle, state, visibleTriangle);    // 10: kept
+  drawList.addBarrier(DrawBarrierType::vramWrite, area);                                // after last
+  drawList.cullPrimitives();
+
+  ASSERT_EQ((size_t)3u, drawList.size());
+  const uint32_t expectedIndexes[] = { 0, 1, 1, 2, 3 };
+  ASSERT_EQ(sizeof(expectedIndexes) / sizeof(*expectedIndexes), drawList.barrierCount());
+  for (size_t i = 0; i < drawList.barrierCount(); ++i) {
+    EXPECT_EQ(expectedIndexes[i], drawList.barrier(i).primitiveIndex) << "barrier:" << i;
+  }
+}
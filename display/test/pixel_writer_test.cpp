@@ -0,0 +1,123 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <vector>
+#include <display/vram.h>
+#include <display/pixel_writer.h>
+
+using namespace display;
+
+class PixelWriterTest : public testing::Test {
+public:
+protected:
+  //static void SetUpTestCase() {}
+  //static void TearDownTestCase() {}
+
+  void SetUp() override {}
+  void TearDown() override {}
+};
+
+static std::vector<uint16_t> __createRandomPixels(size_t length, uint32_t seed) {
+  std::vector<uint16_t> pixels(length);
+  for (size_t i = 0; i < length; ++i) {
+    seed = seed * 1103515245u + 12345u;
+    pixels[i] = (uint16_t)(seed >> 12);
+  }
+  return pixels;
+}
+
+// reference pixel write (same as hardware)
+static uint16_t __writePixel(uint16_t dest, uint16_t color, bool isWritten, const PixelWriteMode& mode) {
+  if (!isWritten || (mode.checkMask && (dest & 0x8000u)))
+    return dest;
+  uint16_t result = (uint16_t)(color & 0x7FFFu);
+  if (mode.isSemiTransparent && (!mode.isStpGated || (color & 0x8000u))) {
+    result = 0;
+    for (int shift = 0; shift < 15; shift += 5) {
+      int back = (dest >> shift) & 0x1F;
+      int front = (color >> shift) & 0x1F;
+      int value;
+      switch (mode.blendingMode) {
+        case BlendingMode::mean:     value = (back + front) / 2; break;
+        case BlendingMode::add:      value = back + front; break;
+        case BlendingMode::subtract: value = back - front; break;
+        default:                     value = back + front / 4; break;
+      }
+      if (value < 0) value = 0;
+      if (value > 31) value = 31;
+      result |= (uint16_t)(value << shift);
+    }
+  }
+  return (uint16_t)(result | (color & 0x8000u) | mode.forceMaskBit);
+}
+
+
+// -- blending -- --
+
+TEST_F(PixelWriterTest, blendingModesTest) {
+  PixelWriteMode mode;
+  mode.isSemiTransparent = true;
+  const uint16_t back = (uint16_t)(0x10u | (0x1Fu << 5) | (0x03u << 10));
+  const uint16_t front = (uint16_t)(0x0Bu | (0x1Fu << 5) | (0x08u << 10));
+  const BlendingMode modes[] = { BlendingMode::mean, BlendingMode::add, BlendingMode::subtract, BlendingMode::addQuarter };
+  const uint16_t expected[] = {
+    (uint16_t)(0x0Du | (0x1Fu << 5) | (0x05u << 10)), // mean: floor((a+b)/2)
+    (uint16_t)(0x1Bu | (0x1Fu << 5) | (0x0Bu << 10)), // add: saturated
+    (uint16_t)(0x05u | (0x00u << 5) | (0x00u << 10)), // subtract: saturated at 0
+    (uint16_t)(0x12u | (0x1Fu << 5) | (0x05u << 10))  // add quarter: saturated
+  };
+  for (int i = 0; i < 4; ++i) {
+    mode.blendingMode = modes[i];
+    uint16_t dest[9], colors[9];
+    for (int px = 0; px < 9; ++px) { // 9 pixels -> vector + scalar tail
+      dest[px] = back;
+      colors[px] = front;
+    }
+    PixelWriter::writeSpan(dest, colors, nullptr, 9, mode);
+    for (int px = 0; px < 9; ++px) {
+      EXPECT_EQ(expected[i], dest[px]) << "mode:" << (uint32_t)modes[i] << " px:" << px;
+    }
+  }
+}
+
+TEST_F(PixelWriterTest, allModesReferenceTest) {
+  const BlendingMode modes[] = { BlendingMode::mean, BlendingMode::add, BlendingMode::subtract, BlendingMode::addQuarter };
+  const size_t lengths[] = { 1, 7, 8, 15, 16, 17, 64, 100 };
+  for (size_t length : lengths) {
+    std::vector<uint16_t> initialDest = __createRandomPixels(length, (uint32_t)length);
+    std::vector<uint16_t> colors = __createRandomPixels(length, (uint32_t)length + 1000u);
+    std::vector<uint16_t> writeMask = __createRandomPixels(length, (uint32_t)length + 2000u);
+    for (auto& value : writeMask)
+      value = (value & 0x4u) ? 0xFFFFu : 0;
+
+    for (int flags = 0; flags < 32; ++flags) {
+      PixelWriteMode mode;
+      mode.isSemiTransparent = (flags & 0x1) != 0;
+      mode.isStpGated = (flags & 0x2) != 0;
+      mode.checkMask = (flags & 0x4) != 0;
+      mode.forceMaskBit = (flags & 0x8) ? vramMaskBit() : 0;
+      const bool hasWriteMask = (flags & 0x10) != 0;
+      for (auto blendingMode : modes) {
+        mode.blendingMode = blendingMode;
+        std::vector<uint16_t> dest = initialDest;
+        PixelWriter::writeSpan(dest.data(), colors.data(), hasWriteMask ? writeMask.data() : nullptr, length, mode);
+        for (size_t i = 0; i < length; ++i) {
+          ASSERT_EQ(__writePixel(initialDest[i], colors[i], !hasWriteMask || writeMask[i] != 0, mode), dest[i])
+            << "length:" << length << " index:" << i << " flags:" << flags << " mode:" << (uint32_t)blendingMode;
+        }
+      }
+    }
+  }
+}
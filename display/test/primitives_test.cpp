@@ -0,0 +1,667 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#include <gtest/gtest.h>
+#include <cstring>
+#include <display/status_register.h>
+#include <display/renderer.h>
+#include <display/vram.h>
+#include <display/texture_cache.h>
+#include <display/primitives.h>
+#include <display/draw_list.h>
+#include "test_pattern.h"
+
+using namespace display;
+
+class PrimitivesTest : public testing::Test {
+public:
+protected:
+  //static void SetUpTestCase() {}
+  //static void TearDownTestCase() {}
+
+  void SetUp() override {}
+  void TearDown() override {}
+
+  Gp0Parser parser;
+};
+
+template <unsigned long _Height>
+static int __copyVram(Gp0Parser& parser, StatusRegister& status, Vram<_Height>& vram, unsigned long srcX, unsigned long srcY,
+                      unsigned long destX, unsigned long destY, unsigned long width, unsigned long height) {
+  Renderer renderer;
+  uint32_t params[4] = { 0x80000000u, (uint32_t)((srcY << 16) | srcX),
+                         (uint32_t)((destY << 16) | destX), (uint32_t)((height << 16) | width) };
+  return parser.runCommand(status, renderer, vram, params, 4, false);
+}
+
+
+// -- VRAM -> VRAM copy -- -----------------------------------------------------
+
+TEST_F(PrimitivesTest, copyVramDistinctAreasTest) {
+  StatusRegister status;
+  Vram<psxVramHeight()> vram;
+  __fillTestPattern(vram);
+
+  EXPECT_EQ((int)4, __copyVram(parser, status, vram, 10, 20, 300, 200, 37, 5));
+  for (unsigned long y = 0; y < 5u; ++y) {
+    for (unsigned long x = 0; x < 37u; ++x) {
+      EXPECT_EQ(__testPatternValue(10u + x, 20u + y), vram.read(300u + x, 200u + y));
+    }
+    EXPECT_EQ(__testPatternValue(299u, 200u + y), vram.read(299u, 200u + y));
+    EXPECT_EQ(__testPatternValue(337u, 200u + y), vram.read(337u, 200u + y));
+  }
+  EXPECT_EQ(__testPatternValue(300u, 205u), vram.read(300u, 205u));
+  EXPECT_TRUE(vram.isRegionDirty(300, 200, 37, 5));
+  EXPECT_FALSE(vram.isRegionDirty(10, 20, 37, 5));
+  EXPECT_EQ((uint64_t)1u, vram.generation());
+}
+
+TEST_F(PrimitivesTest, copyVramOverlapTest) {
+  StatusRegister status;
+  Vram<psxVramHeight()> vram;
+
+  const long offsets[][2] = { { 0,5 }, { 0,-5 }, { 3,0 }, { -3,0 }, { 2,2 }, { -2,-2 }, { 7,-1 } };
+  for (const auto& offset : offsets) {
+    __fillTestPattern(vram);
+    __copyVram(parser, status, vram, 100, 100, (unsigned long)(100 + offset[0]), (unsigned long)(100 + offset[1]), 40, 30);
+    for (unsigned long y = 0; y < 30u; ++y) {
+      for (unsigned long x = 0; x < 40u; ++x) {
+        EXPECT_EQ(__testPatternValue(100u + x, 100u + y), vram.read((unsigned long)(100 + offset[0]) + x, (unsigned long)(100 + offset[1]) + y));
+      }
+    }
+  }
+}
+
+TEST_F(PrimitivesTest, copyVramWrapAroundTest) {
+  StatusRegister status;
+  Vram<psxVramHeight()> vram;
+  __fillTestPattern(vram);
+
+  __copyVram(parser, status, vram, 1000, 500, 10, 10, 40, 20); // source wraps around
+  for (unsigned long y = 0; y < 20u; ++y) {
+    for (unsigned long x = 0; x < 40u; ++x) {
+      EXPECT_EQ(__testPatternValue((1000u + x) & 1023u, (500u + y) & 511u), vram.read(10u + x, 10u + y));
+    }
+  }
+
+  __fillTestPattern(vram);
+  __copyVram(parser, status, vram, 10, 10, 1010, 505, 40, 20); // destination wraps around
+  for (unsigned long y = 0; y < 20u; ++y) {
+    for (unsigned long x = 0; x < 40u; ++x) {
+      EXPECT_EQ(__testPatternValue(10u + x, 10u + y), vram.read((1010u + x) & 1023u, (505u + y) & 511u));
+    }
+  }
+  EXPECT_TRUE(vram.isRegionDirty(0, 0, 8, 8));
+
+  __fillTestPattern(vram);
+  __copyVram(parser, status, vram, 1020, 0, 1000, 0, 30, 1); // overlapping line with wrap-around
+  for (unsigned long x = 0; x < 30u; ++x) {
+    EXPECT_EQ(__testPatternValue((1020u + x) & 1023u, 0), vram.read(1000u + x, 0));
+  }
+
+  __fillTestPattern(vram);
+  __copyVram(parser, status, vram, 0, 0, 0, 300, 16, 400); // vertical wrap-around overlapping at both ends
+  for (unsigned long y = 0; y < 400u; ++y) {
+    for (unsigned long x = 0; x < 16u; ++x) {
+      EXPECT_EQ(__testPatternValue(x, y), vram.read(x, (300u + y) & 511u)) << "y:" << y;
+    }
+  }
+  EXPECT_EQ(__testPatternValue(0, 200u), vram.read(0, 200u)); // outside of destination
+
+  Vram<znArcadeVramHeight()> znVram;
+  __fillTestPattern(znVram);
+  __copyVram(parser, status, znVram, 0, 1020, 0, 600, 8, 8);
+  for (unsigned long y = 0; y < 8u; ++y) {
+    EXPECT_EQ(__testPatternValue(0, (1020u + y) & 1023u), znVram.read(0, 600u + y));
+  }
+}
+
+TEST_F(PrimitivesTest, copyVramSizeTest) {
+  StatusRegister status;
+  Vram<psxVramHeight()> vram;
+  __fillTestPattern(vram);
+
+  __copyVram(parser, status, vram, 0, 0, 0, 0, 0, 0); // 0 -> max size (copy to itself: no change)
+  EXPECT_EQ((uint64_t)0, vram.generation());
+  EXPECT_EQ(__testPatternValue(1023u, 511u), vram.read(1023u, 511u));
+
+  __copyVram(parser, status, vram, 0, 0, 1, 0, 0, 1); // full line, shifted by 1 texel
+  for (unsigned long x = 0; x < 1024u; ++x) {
+    EXPECT_EQ(__testPatternValue(x, 0), vram.read(x + 1u, 0));
+  }
+  EXPECT_EQ(__testPatternValue(0, 1u), vram.read(0, 1u));
+}
+
+TEST_F(PrimitivesTest, copyVramMaskBitsTest) {
+  StatusRegister status;
+  Vram<psxVramHeight()> vram;
+  __fillTestPattern(vram);
+  for (unsigned long x = 0; x < 24u; x += 4u)
+    vram.row(50)[200u + x] |= 0x8000u; // protected texels
+
+  status.setMaskBit(0x2u); // check mask
+  __copyVram(parser, status, vram, 0, 0, 200, 50, 24, 1);
+  for (unsigned long x = 0; x < 24u; ++x) {
+    if (x % 4u == 0)
+      EXPECT_EQ((uint16_t)(__testPatternValue(200u + x, 50u) | 0x8000u), vram.read(200u + x, 50u));
+    else
+      EXPECT_EQ(__testPatternValue(x, 0), vram.read(200u + x, 50u));
+  }
+
+  status.setMaskBit(0x1u); // force mask bit
+  __copyVram(parser, status, vram, 0, 0, 200, 50, 24, 1);
+  for (unsigned long x = 0; x < 24u; ++x) {
+    EXPECT_EQ((uint16_t)(__testPatternValue(x, 0) | 0x8000u), vram.read(200u + x, 50u));
+  }
+
+  __copyVram(parser, status, vram, 0, 10, 0, 10, 24, 1); // copy to itself + force mask bit
+  for (unsigned long x = 0; x < 24u; ++x) {
+    EXPECT_EQ((uint16_t)(__testPatternValue(x, 10u) | 0x8000u), vram.read(x, 10u));
+  }
+}
+
+TEST_F(PrimitivesTest, copyVramTruncatedTest) {
+  StatusRegister status;
+  Renderer renderer;
+  Vram<psxVramHeight()> vram;
+  __fillTestPattern(vram);
+
+  uint32_t params[4] = { 0x80000000u, 0u, (uint32_t)((8u << 16) | 8u), (uint32_t)((2u << 16) | 2u) };
+  EXPECT_EQ((int)2, parser.runCommand(status, renderer, vram, params, 2, false));
+  EXPECT_EQ((uint64_t)0, vram.generation());
+  EXPECT_EQ((int)2, parser.runCommand(status, renderer, vram, &params[2], 2, false));
+  EXPECT_EQ(__testPatternValue(1u, 1u), vram.read(9u, 9u));
+  EXPECT_EQ((uint64_t)1u, vram.generation());
+}
+
+TEST_F(PrimitivesTest, parserInstancesTest) {
+  StatusRegister status, otherStatus;
+  Renderer renderer;
+  Vram<psxVramHeight()> vram, otherVram;
+  __fillTestPattern(vram);
+  __fillTestPattern(otherVram);
+  EXPECT_FALSE(parser.isCommandPending());
+
+  // partial commands of two streams -> independent states
+  Gp0Parser otherParser;
+  uint32_t params[4] = { 0x80000000u, 0u, (uint32_t)((8u << 16) | 8u), (uint32_t)((2u << 16) | 2u) };
+  uint32_t otherParams[4] = { 0x80000000u, (uint32_t)((4u << 16) | 4u), (uint32_t)((20u << 16) | 20u), (uint32_t)((1u << 16) | 1u) };
+  EXPECT_EQ((int)3, parser.runCommand(status, renderer, vram, params, 3, false));
+  EXPECT_EQ((int)1, otherParser.runCommand(otherStatus, renderer, otherVram, otherParams, 1, false));
+  EXPECT_TRUE(parser.isCommandPending());
+  EXPECT_TRUE(otherParser.isCommandPending());
+  EXPECT_EQ((int)3, otherParser.runCommand(otherStatus, renderer, otherVram, &otherParams[1], 3, false));
+  EXPECT_EQ((int)1, parser.runCommand(status, renderer, vram, &params[3], 1, false));
+  EXPECT_FALSE(parser.isCommandPending());
+  EXPECT_FALSE(otherParser.isCommandPending());
+  EXPECT_EQ(__testPatternValue(1u, 1u), vram.read(9u, 9u));
+  EXPECT_EQ(__testPatternValue(20u, 20u), vram.read(20u, 20u));
+  EXPECT_EQ(__testPatternValue(4u, 4u), otherVram.read(20u, 20u));
+  EXPECT_EQ(__testPatternValue(9u, 9u), otherVram.read(9u, 9u));
+
+  // clear partial command -> next word is a new command
+  EXPECT_EQ((int)2, parser.runCommand(status, renderer, vram, params, 2, false));
+  parser.clear();
+  EXPECT_FALSE(parser.isCommandPending());
+  uint32_t irqCommand = 0x1F000000u;
+  EXPECT_EQ((int)1, parser.runCommand(status, renderer, vram, &irqCommand, 1, false));
+  EXPECT_TRUE(status.readStatus<bool>(StatusBits::interruptReq1));
+}
+
+
+// -- data block dispatch -- ---------------------------------------------------
+
+// reference: one call per command / transfer
+template <unsigned long _Height>
+static void __runEachCommand(Gp0Parser& parser, StatusRegister& status, Renderer& renderer, Vram<_Height>& vram,
+                             uint32_t* mem, int size) {
+  while (size > 0) {
+    int usedSize = (status.getDataWriteMode() == DataTransfer::vramTransfer)
+                 ? parser.writeVramData(status, vram, mem, size)
+                 : parser.runCommand(status, renderer, vram, mem, size, false);
+    mem += usedSize;
+    size -= usedSize;
+  }
+}
+template <unsigned long _Height>
+static bool __isVramEqual(Vram<_Height>& vram, Vram<_Height>& otherVram) {
+  for (unsigned long y = 0; y < _Height; ++y) {
+    if (memcmp(vram.row(y), otherVram.row(y), vramWidth()*sizeof(uint16_t)) != 0)
+      return false;
+  }
+  return true;
+}
+
+TEST_F(PrimitivesTest, runBufferTest) {
+  uint32_t params[] = {
+    0xE3000000u, 0xE4000000u | (uint32_t)((255u << 10) | 255u), // draw area
+    0x02102030u, (uint32_t)((4u << 16) | 16u), (uint32_t)((4u << 16) | 16u), // fill
+    0, 0xF0000000u, // NOP + unknown command
+    0x20F8F8F8u, (uint32_t)(40u << 16), (uint32_t)((40u << 16) | 20u), (uint32_t)((60u << 16) | 10u), // triangle
+    0x48F80000u, (uint32_t)(100u << 16), (uint32_t)((100u << 16) | 30u), (uint32_t)((120u << 16) | 30u), 0x55555555u, // poly-line
+    0xA0000000u, (uint32_t)((200u << 16) | 200u), (uint32_t)((2u << 16) | 2u), 0x7FFF001Fu, 0x03E07C00u, // CPU -> VRAM
+    0x80000000u, (uint32_t)((200u << 16) | 200u), (uint32_t)((210u << 16) | 210u), (uint32_t)((2u << 16) | 2u), // copy
+    0x68F800F8u, (uint32_t)((5u << 16) | 5u), // tile 1x1
+    0x1F000000u // IRQ
+  };
+  const int length = (int)(sizeof(params) / sizeof(*params));
+
+  Renderer renderer;
+  StatusRegister expectedStatus;
+  Vram<psxVramHeight()> expectedVram;
+  Gp0Parser expectedParser;
+  __runEachCommand(expectedParser, expectedStatus, renderer, expectedVram, params, length);
+  ASSERT_EQ((uint16_t)0x7FFFu, expectedVram.read(211u, 210u));
+  ASSERT_TRUE(expectedStatus.readStatus<bool>(StatusBits::interruptReq1));
+
+  // same result with whole block, or with commands/transfers split between two blocks
+  for (int splitIndex = 0; splitIndex <= length; ++splitIndex) {
+    StatusRegister status;
+    Vram<psxVramHeight()> vram;
+    parser.clear();
+    parser.runBuffer(status, renderer, vram, params, splitIndex, false);
+    parser.runBuffer(status, renderer, vram, &params[splitIndex], length - splitIndex, false);
+    EXPECT_FALSE(parser.isCommandPending()) << "split:" << splitIndex;
+    EXPECT_EQ(DataTransfer::command, status.getDataWriteMode()) << "split:" << splitIndex;
+    EXPECT_TRUE(status.readStatus<bool>(StatusBits::interruptReq1)) << "split:" << splitIndex;
+    EXPECT_TRUE(__isVramEqual(expectedVram, vram)) << "split:" << splitIndex;
+  }
+}
+
+
+TEST_F(PrimitivesTest, redundantAttributesTest) {
+  StatusRegister status;
+  Renderer renderer;
+  Vram<psxVramHeight()> vram;
+
+  uint32_t params[] = {
+    0xE1000208u, 0xE3000000u, 0xE403BD3Fu, 0xE5000000u, 0xE6000000u, // initial state
+    0xE1000208u, 0xE3000000u, 0xE403BD3Fu, 0xE5000000u, 0xE6000000u, // redundant
+    0x20F8F8F8u, 0u, 16u, (uint32_t)(16u << 16),                      // triangle
+    0xE3000000u, 0xE403BD3Fu,                                         // redundant
+    0xE5000000u | (uint32_t)((2u << 11) | 4u),                        // new draw offset
+    0xE5000000u | (uint32_t)((2u << 11) | 4u),                        // redundant
+    0x24808080u, 0u, 0x00010000u, 16u, 0x00880010u, (uint32_t)(16u << 16), 0x1000u, // textured polygon: texpage 0x88
+    0xE1000208u,                                                      // not redundant anymore: restore texpage
+    0xE1000208u                                                       // redundant
+  };
+  parser.runBuffer(status, renderer, vram, params, (int)(sizeof(params) / sizeof(*params)), false);
+  EXPECT_EQ((uint64_t)16u, parser.stats().attributeCount);
+  EXPECT_EQ((uint64_t)9u, parser.stats().redundantAttributeCount);
+
+  // eliminated commands don't affect state
+  EXPECT_EQ((long)4, status.getDisplayState().drawOffset.x);
+  EXPECT_EQ((long)2, status.getDisplayState().drawOffset.y);
+  EXPECT_EQ((long)319, status.getDisplayState().drawArea.rightX);
+  EXPECT_EQ((long)239, status.getDisplayState().drawArea.bottomY);
+  EXPECT_EQ((long)(8 * 64), status.getTexpageBaseX());
+  EXPECT_TRUE(status.readStatus<bool>(StatusBits::dithering));
+
+  parser.resetStats();
+  EXPECT_EQ((uint64_t)0, parser.stats().attributeCount);
+  EXPECT_EQ((uint64_t)0, parser.stats().redundantAttributeCount);
+}
+
+// -- VRAM fill -- -------------------------------------------------------------
+
+TEST_F(PrimitivesTest, fillVramTest) {
+  StatusRegister status;
+  Renderer renderer;
+  Vram<psxVramHeight()> vram;
+  __fillTestPattern(vram);
+  status.setMaskBit(0x3u); // mask settings should be ignored
+  status.setDrawAreaOrigin(0);
+  status.setDrawAreaEnd(0x7FFFFu);
+
+  uint32_t params[3] = { 0x02FF8008u, (uint32_t)((100u << 16) | 37u), (uint32_t)((3u << 16) | 20u) }; // x -> 32, width -> 32
+  EXPECT_EQ((int)3, parser.runCommand(status, renderer, vram, params, 3, false));
+  const uint16_t expectedColor = (uint16_t)(0x01u | (0x10u << 5) | (0x1Fu << 10));
+  for (unsigned long y = 100u; y < 103u; ++y) {
+    EXPECT_EQ(__testPatternValue(31u, y), vram.read(31u, y));
+    for (unsigned long x = 32u; x < 64u; ++x) {
+      EXPECT_EQ(expectedColor, vram.read(x, y));
+    }
+    EXPECT_EQ(__testPatternValue(64u, y), vram.read(64u, y));
+  }
+  EXPECT_EQ(__testPatternValue(32u, 103u), vram.read(32u, 103u));
+  EXPECT_TRUE(vram.isRegionDirty(32, 100, 32, 3));
+  EXPECT_EQ((uint64_t)1u, vram.generation());
+
+  params[1] = (uint32_t)((200u << 16) | 1008u); // wrap-around
+  params[2] = (uint32_t)((2u << 16) | 48u);
+  parser.runCommand(status, renderer, vram, params, 3, false);
+  for (unsigned long x = 0; x < 48u; ++x) {
+    EXPECT_EQ(expectedColor, vram.read((1008u + x) & 1023u, 200u));
+    EXPECT_EQ(expectedColor, vram.read((1008u + x) & 1023u, 201u));
+  }
+  EXPECT_EQ(__testPatternValue(32u, 200u), vram.read(32u, 200u));
+
+  params[2] = (uint32_t)((2u << 16) | 0u); // empty
+  parser.runCommand(status, renderer, vram, params, 3, false);
+  EXPECT_EQ((uint64_t)2u, vram.generation());
+}
+
+TEST_F(PrimitivesTest, fillVramClearTest) {
+  StatusRegister status;
+  Renderer renderer;
+  Vram<psxVramHeight()> vram;
+  status.setDisplayAreaOrigin(0);
+  status.setDrawAreaOrigin((uint32_t)((16u << 10) | 0u));
+  status.setDrawAreaEnd((uint32_t)((255u << 10) | 319u));
+
+  // draw list: clear recorded -> no upload
+  DrawList drawList;
+  parser.setDrawList(&drawList);
+  uint32_t params[3] = { 0x02123456u, 0u, (uint32_t)((240u << 16) | 256u) }; // entire display area (256x240)
+  parser.runCommand(status, renderer, vram, params, 3, false);
+  EXPECT_EQ((uint64_t)1u, vram.generation());
+  EXPECT_EQ((uint64_t)0, vram.dirtyPages());
+  EXPECT_EQ((size_t)1u, drawList.barrierCount());
+  EXPECT_EQ((uint16_t)((0x56u >> 3) | ((0x34u >> 3) << 5) | ((0x12u >> 3) << 10)), vram.read(255u, 239u));
+
+  params[1] = (uint32_t)(16u << 16);
+  params[2] = (uint32_t)((240u << 16) | 320u); // entire draw area
+  parser.runCommand(status, renderer, vram, params, 3, false);
+  EXPECT_EQ((uint64_t)2u, vram.generation());
+  EXPECT_EQ((uint64_t)0, vram.dirtyPages());
+  EXPECT_EQ((uint64_t)2u, vram.regionGeneration(300, 200, 1, 1));
+  EXPECT_EQ((size_t)2u, drawList.barrierCount());
+
+  params[2] = (uint32_t)((200u << 16) | 320u); // partial
+  parser.runCommand(status, renderer, vram, params, 3, false);
+  EXPECT_EQ((uint64_t)3u, vram.generation());
+  EXPECT_TRUE(vram.isRegionDirty(0, 16, 320, 200));
+  parser.setDrawList(nullptr);
+
+  // no draw list: clear not applied by renderer -> uploaded
+  vram.clearDirtyFlags();
+  params[2] = (uint32_t)((240u << 16) | 320u);
+  parser.runCommand(status, renderer, vram, params, 3, false);
+  EXPECT_EQ((uint64_t)4u, vram.generation());
+  EXPECT_TRUE(vram.isRegionDirty(0, 16, 320, 240));
+}
+
+
+// -- polygons -- --------------------------------------------------------------
+
+TEST_F(PrimitivesTest, drawTriangleTest) {
+  StatusRegister status;
+  Renderer renderer;
+  Vram<psxVramHeight()> vram;
+  status.setDrawAreaOrigin(0);
+  status.setDrawAreaEnd((511u << 10) | 1023u);
+  status.setDrawOffset((uint32_t)((10u << 11) | 0x7FCu)); // x: -4 / y: 10
+
+  uint32_t params[4] = { 0x20F8F8F8u, 0u, (uint32_t)(20u), (uint32_t)(20u << 16) };
+  EXPECT_EQ((int)4, parser.runCommand(status, renderer, vram, params, 4, false));
+  EXPECT_EQ((uint16_t)0, vram.read(0, 9));
+  EXPECT_EQ((uint16_t)0x7FFFu, vram.read(0, 10));
+  EXPECT_EQ((uint16_t)0x7FFFu, vram.read(15, 10));
+  EXPECT_EQ((uint16_t)0, vram.read(16, 10));
+  EXPECT_EQ((uint16_t)0x7FFFu, vram.read(0, 25));
+
+  params[1] = 0x07FFu; // negative coords (-1)
+  params[0] = 0x201F0000u;
+  parser.runCommand(status, renderer, vram, params, 4, false);
+  EXPECT_EQ((uint16_t)(0x3u << 10), vram.read(0, 10));
+}
+
+TEST_F(PrimitivesTest, drawTexturedQuadTest) {
+  StatusRegister status;
+  Renderer renderer;
+  Vram<psxVramHeight()> vram;
+  status.setDrawAreaOrigin(0);
+  status.setDrawAreaEnd((511u << 10) | 1023u);
+  status.setTexturePageMode(0x200u); // dithering
+  for (unsigned long x = 0; x < 8u; ++x)
+    vram.row(256)[640u + x] = (uint16_t)(0x7C00u | x);
+
+  uint32_t texpage = 0x11Au; // x: 640 / y: 256 / 15-bit colors
+  uint32_t params[9] = { 0x2D000000u,
+                         (uint32_t)((100u << 16) | 100u), 0u,
+                         (uint32_t)((100u << 16) | 108u), (texpage << 16) | 8u,
+                         (uint32_t)((101u << 16) | 100u), (1u << 8),
+                         (uint32_t)((101u << 16) | 108u), (1u << 8) | 8u };
+  EXPECT_EQ((int)9, parser.runCommand(status, renderer, vram, params, 9, false));
+  EXPECT_EQ((long)640, status.getTexpageBaseX());
+  EXPECT_EQ((long)256, status.getTexpageBaseY());
+  EXPECT_EQ((unsigned long)TextureColorMode::directColor15bit, status.readStatus(StatusBits::texturePageColors));
+  EXPECT_TRUE(status.readStatus<bool>(StatusBits::dithering)); // not affected
+  for (unsigned long x = 0; x < 8u; ++x) {
+    EXPECT_EQ((uint16_t)(0x7C00u | x), vram.read(100u + x, 100u)); // raw texture
+  }
+  EXPECT_EQ((size_t)1, parser.textureCache().size()); // decoded texture page
+  Gp0Parser otherParser;
+  EXPECT_EQ((size_t)0, otherParser.textureCache().size()); // not shared between parsers
+}
+
+
+TEST_F(PrimitivesTest, spriteQuadTest) {
+  StatusRegister status, refStatus;
+  Renderer renderer;
+  Vram<psxVramHeight()> vram, refVram;
+  Gp0Parser refParser;
+  for (StatusRegister* reg : { &status, &refStatus }) {
+    reg->setDrawAreaOrigin(0);
+    reg->setDrawAreaEnd((300u << 10) | 200u);
+    reg->setTexturePageMode(0x200u); // dithering
+  }
+  __fillTestPattern(vram);
+  __fillTestPattern(refVram);
+
+  // quads (x,y,u,v) -> flat textured sprite path (0x2C/0x2D) compared with shaded textured polygons (0x3C/0x3D)
+  const uint32_t quads[][4][4] = {
+    { { 10,10, 0,0 }, { 42,10, 32,0 }, { 10,30, 0,20 }, { 42,30, 32,20 } },         // sprite
+    { { 50,10, 8,8 }, { 50,40, 8,38 }, { 90,10, 48,38 - 30 }, { 90,40, 48,38 } },     // sprite (other diagonal)
+    { { 180,90, 99,99 }, { 150,90, 69,99 }, { 180,60, 99,69 }, { 150,60, 69,69 } },   // sprite (mirrored corners), clipped
+    { { 10,50, 0,0 }, { 42,50, 31,0 }, { 10,70, 0,19 }, { 42,70, 31,19 } },          // scaled texture
+    { { 10,80, 0,0 }, { 42,82, 32,0 }, { 10,100, 0,20 }, { 42,102, 32,20 } },        // not axis-aligned
+    { { 50,80, 32,0 }, { 82,80, 0,0 }, { 50,100, 32,20 }, { 82,100, 0,20 } }         // flipped texture
+  };
+  const uint32_t texpage = 0x10Au; // x: 640 / y: 256 / 15-bit colors
+  for (uint32_t command = 0; command < 2u; ++command) {
+    for (const auto& quad : quads) {
+      uint32_t params[9] = { 0x2C808080u | (command << 24) };
+      uint32_t refParams[12];
+      for (uint32_t i = 0; i < 4u; ++i) {
+        uint32_t texCoords = (quad[i][3] << 8) | quad[i][2];
+        if (i == 1u)
+          texCoords |= (texpage << 16);
+        params[1u + 2u*i] = refParams[1u + 3u*i] = (quad[i][1] << 16) | quad[i][0];
+        params[2u + 2u*i] = refParams[2u + 3u*i] = texCoords;
+        refParams[3u*i] = 0x808080u;
+      }
+      refParams[0] |= 0x3C000000u | (command << 24);
+      EXPECT_EQ((int)9, parser.runCommand(status, renderer, vram, params, 9, false));
+      EXPECT_EQ((int)12, refParser.runCommand(refStatus, renderer, refVram, refParams, 12, false));
+    }
+  }
+  EXPECT_TRUE(__isVramEqual(vram, refVram));
+  EXPECT_EQ((uint64_t)12u, parser.stats().texturedQuadCount);
+  EXPECT_EQ((uint64_t)6u, parser.stats().spriteQuadCount);
+  EXPECT_EQ((uint64_t)0, refParser.stats().texturedQuadCount); // shaded quads not tested
+
+  // draw list: sprites recorded as rectangles
+  DrawList drawList;
+  parser.setDrawList(&drawList);
+  uint32_t params[9] = { 0x2D808080u, (uint32_t)((30u << 16) | 20u), 0u, (uint32_t)((30u << 16) | 28u), (texpage << 16) | 8u,
+                         (uint32_t)((34u << 16) | 20u), (4u << 8), (uint32_t)((34u << 16) | 28u), (4u << 8) | 8u };
+  parser.runCommand(status, renderer, vram, params, 9, false);
+  ASSERT_EQ((size_t)1u, drawList.size());
+  EXPECT_EQ(DrawPrimitiveType::rectangle, drawList.primitive(0).type);
+  EXPECT_EQ((uint16_t)8u, drawList.primitive(0).width);
+  EXPECT_EQ((uint16_t)4u, drawList.primitive(0).height);
+  parser.setDrawList(nullptr);
+}
+
+// -- rectangles -- ------------------------------------------------------------
+
+TEST_F(PrimitivesTest, drawTileTest) {
+  StatusRegister status;
+  Renderer renderer;
+  Vram<psxVramHeight()> vram;
+  __fillTestPattern(vram);
+  status.setDrawAreaOrigin(0);
+  status.setDrawAreaEnd((300u << 10) | 200u); // x: 200 / y: 300
+  status.setDrawOffset((uint32_t)((4u << 11) | 8u)); // x: 8 / y: 4
+
+  // flat tiles: custom size (clipped by draw area) + 8x8
+  uint32_t params[3] = { 0x600000F8u, (uint32_t)((10u << 16) | 190u), (uint32_t)((6u << 16) | 20u) };
+  EXPECT_EQ((int)3, parser.runCommand(status, renderer, vram, params, 3, false));
+  for (unsigned long y = 14u; y < 20u; ++y) {
+    for (unsigned long x = 198u; x <= 200u; ++x) {
+      EXPECT_EQ((uint16_t)0x001Fu, vram.read(x, y));
+    }
+    EXPECT_EQ(__testPatternValue(201u, y), vram.read(201u, y));
+  }
+  EXPECT_EQ(__testPatternValue(198u, 20u), vram.read(198u, 20u));
+  params[0] = 0x7000F800u;
+  params[1] = (uint32_t)(20u << 16);
+  EXPECT_EQ((int)2, parser.runCommand(status, renderer, vram, params, 2, false));
+  for (unsigned long y = 24u; y < 32u; ++y) {
+    for (unsigned long x = 8u; x < 16u; ++x) {
+      EXPECT_EQ((uint16_t)0x03E0u, vram.read(x, y));
+    }
+    EXPECT_EQ(__testPatternValue(16u, y), vram.read(16u, y));
+  }
+
+  // textured 16x16 sprites (raw texture), flipped horizontally and/or vertically
+  for (unsigned long y = 0; y < 16u; ++y) {
+    for (unsigned long x = 0; x < 16u; ++x)
+      vram.row(256u + y)[640u + x] = (uint16_t)(0x7C00u | (y << 5) | x);
+  }
+  for (uint32_t flip = 0; flip < 4u; ++flip) {
+    const bool isFlipX = (flip & 0x1u) != 0, isFlipY = (flip & 0x2u) != 0;
+    status.setTexturePageMode(0x11Au | (flip << 12)); // x: 640 / y: 256 / 15-bit colors
+    params[0] = 0x7D808080u;
+    params[1] = (uint32_t)((100u << 16) | (flip*20u));
+    params[2] = ((isFlipY ? 15u : 0) << 8) | (isFlipX ? 15u : 0);
+    EXPECT_EQ((int)3, parser.runCommand(status, renderer, vram, params, 3, false));
+    for (unsigned long y = 0; y < 16u; ++y) {
+      for (unsigned long x = 0; x < 16u; ++x) {
+        EXPECT_EQ((uint16_t)(0x7C00u | ((isFlipY ? 15u - y : y) << 5) | (isFlipX ? 15u - x : x)),
+                  vram.read(8u + flip*20u + x, 104u + y)) << "x:" << x << " y:" << y << " flip:" << flip;
+      }
+    }
+  }
+}
+
+// -- lines -- -----------------------------------------------------------------
+
+TEST_F(PrimitivesTest, drawLineTest) {
+  StatusRegister status;
+  Renderer renderer;
+  Vram<psxVramHeight()> vram;
+  status.setDrawAreaOrigin(0);
+  status.setDrawAreaEnd((511u << 10) | 1023u);
+  status.setDrawOffset((uint32_t)((2u << 11) | 1u)); // x: 1 / y: 2
+
+  uint32_t params[4] = { 0x40F8F8F8u, (uint32_t)((3u << 16) | 9u), (uint32_t)((3u << 16) | 19u), 0 };
+  EXPECT_EQ((int)3, parser.runCommand(status, renderer, vram, params, 4, false));
+  EXPECT_EQ((uint16_t)0, vram.read(9, 5));
+  for (unsigned long x = 10u; x <= 20u; ++x) {
+    EXPECT_EQ((uint16_t)0x7FFFu, vram.read(x, 5));
+  }
+  EXPECT_EQ((uint16_t)0, vram.read(21, 5));
+
+  uint32_t shadedParams[4] = { 0x500000F8u, (uint32_t)(20u << 16), 0x00F80000u, (uint32_t)((20u << 16) | 4u) }; // red -> blue
+  EXPECT_EQ((int)4, parser.runCommand(status, renderer, vram, shadedParams, 4, false));
+  EXPECT_EQ((uint16_t)0x1Fu, vram.read(1, 22));
+  EXPECT_EQ((uint16_t)(0x1Fu << 10), vram.read(5, 22));
+}
+
+TEST_F(PrimitivesTest, drawPolyLineTest) {
+  StatusRegister status;
+  Renderer renderer;
+  Vram<psxVramHeight()> vram;
+  status.setDrawAreaOrigin(0);
+  status.setDrawAreaEnd((511u << 10) | 1023u);
+
+  // flat poly-line received in several blocks -> segments drawn as soon as vertices are received
+  uint32_t params[8] = { 0x48F8F8F8u, 0u, 10u, (uint32_t)((10u << 16) | 10u), 0x55555555u, 0x02000000u, 0, 0 }; // empty fill
+  EXPECT_EQ((int)2, parser.runCommand(status, renderer, vram, params, 2, false));
+  EXPECT_EQ((uint64_t)0, vram.generation());
+  EXPECT_EQ((int)1, parser.runCommand(status, renderer, vram, &params[2], 2, false)); // end of first segment
+  EXPECT_EQ((uint16_t)0x7FFFu, vram.read(10, 0));
+  EXPECT_EQ((uint16_t)0, vram.read(10, 10));
+  EXPECT_EQ((int)1, parser.runCommand(status, renderer, vram, &params[3], 1, false));  // next vertex
+  EXPECT_EQ((uint16_t)0x7FFFu, vram.read(10, 5));
+  EXPECT_EQ((uint16_t)0x7FFFu, vram.read(10, 10));
+  EXPECT_EQ((int)1, parser.runCommand(status, renderer, vram, &params[4], 3, false));  // termination code
+  EXPECT_EQ((int)3, parser.runCommand(status, renderer, vram, &params[5], 3, false));  // next command: fill
+  EXPECT_EQ((unsigned long)21u, [&vram]() {
+    unsigned long count = 0;
+    for (unsigned long y = 0; y < 16u; ++y) { for (unsigned long x = 0; x < 16u; ++x) count += (vram.read(x, y) == 0x7FFFu) ? 1u : 0; }
+    return count;
+  }());
+
+  // shaded poly-line: termination code read instead of vertex colors only (not instead of coords)
+  uint32_t shadedParams[9] = { 0x580000F8u, (uint32_t)(100u << 16), 0x000000F8u, (uint32_t)((100u << 16) | 4u),
+                               0x000000F8u, (uint32_t)((0x5000u << 16) | 0x5008u), // coords matching termination mask
+                               0x55555555u, 0x02000000u, 0 };
+  EXPECT_EQ((int)7, [&]() {
+    int totalSize = 0;
+    while (totalSize < 7) // until termination code
+      totalSize += parser.runCommand(status, renderer, vram, &shadedParams[totalSize], 9 - totalSize, false);
+    return totalSize;
+  }());
+  EXPECT_EQ((uint16_t)0x1Fu, vram.read(4, 100));
+  EXPECT_EQ((uint16_t)0x1Fu, vram.read(8, 0)); // third vertex (x: 8, y: 0) not mistaken for termination code
+
+  // frame skipping: vertices ignored, termination code still detected
+  uint32_t skippedParams[6] = { 0x48F8F8F8u, (uint32_t)(200u << 16), (uint32_t)((200u << 16) | 8u),
+                                (uint32_t)((208u << 16) | 8u), 0x50005000u, 0 };
+  EXPECT_EQ((int)3, parser.runCommand(status, renderer, vram, skippedParams, 6, true));
+  EXPECT_EQ((int)2, parser.runCommand(status, renderer, vram, &skippedParams[3], 3, true));
+  EXPECT_EQ((uint16_t)0, vram.read(0, 200));
+  EXPECT_EQ((uint16_t)0, vram.read(8, 204));
+}
+
+TEST_F(PrimitivesTest, polyLineTerminationTest) {
+  StatusRegister status;
+  Renderer renderer;
+  Vram<psxVramHeight()> vram;
+  status.setDrawAreaOrigin(0);
+  status.setDrawAreaEnd((511u << 10) | 1023u);
+
+  // termination code at every position (vector blocks + remainders), received in one or two blocks
+  uint32_t params[64];
+  for (int isShaded = 0; isShaded < 2; ++isShaded) {
+    const int firstLength = isShaded ? 4 : 3;
+    for (int vertexCount = 0; vertexCount < 20; ++vertexCount) {
+      int length = 0;
+      params[length++] = isShaded ? 0x58102030u : 0x48102030u;
+      for (int i = 0; i < vertexCount + 2; ++i) {
+        if (isShaded && i > 0)
+          params[length++] = 0x00405060u;
+        params[length++] = isShaded ? 0x50005000u : (uint32_t)((300u << 16) | (uint32_t)i); // shaded: looks like termination code
+      }
+      params[length++] = 0x55555555u;
+      const int endLength = length;
+      while (length < 64)
+        params[length++] = 0x5A5A5A5Au; // next commands (also looks like termination code)
+
+      for (int isSkipped = 0; isSkipped < 2; ++isSkipped) {
+        for (int splitIndex = firstLength; splitIndex < endLength; ++splitIndex) {
+          ASSERT_EQ(firstLength, parser.runCommand(status, renderer, vram, params, 64, isSkipped != 0));
+          int usedLength = firstLength + parser.runCommand(status, renderer, vram, &params[firstLength],
+                                                                   splitIndex - firstLength, isSkipped != 0);
+          if (usedLength < endLength)
+            usedLength += parser.runCommand(status, renderer, vram, &params[usedLength], 64 - usedLength, isSkipped != 0);
+          ASSERT_EQ(endLength, usedLength) << "shaded:" << isShaded << " vertices:" << vertexCount
+                                           << " skipped:" << isSkipped << " split:" << splitIndex;
+        }
+      }
+    }
+  }
+}
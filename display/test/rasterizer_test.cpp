@@ -0,0 +1,612 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <memory>
+#include <utility>
+#include <display/vram.h>
+#include <display/rasterizer.h>
+
+using namespace display;
+
+class RasterizerTest : public testing::Test {
+public:
+protected:
+  //static void SetUpTestCase() {}
+  //static void TearDownTestCase() {}
+
+  void SetUp() override {}
+  void TearDown() override {}
+};
+
+static RasterState __createState() {
+  RasterState state;
+  state.clipArea = Rectangle{ 0, 1023, 0, 511 };
+  return state;
+}
+static RasterVertex __createVertex(long x, long y, uint32_t color = 0xF8F8F8u, uint32_t u = 0, uint32_t v = 0) {
+  RasterVertex vertex;
+  vertex.x = x;
+  vertex.y = y;
+  vertex.color = color;
+  vertex.u = u;
+  vertex.v = v;
+  return vertex;
+}
+template <unsigned long _Height>
+static unsigned long __countPixels(const Vram<_Height>& vram, uint16_t value) {
+  unsigned long count = 0;
+  for (unsigned long i = 0; i < vramWidth()*_Height; ++i) {
+    if (vram.pixels()[i] == value)
+      ++count;
+  }
+  return count;
+}
+
+// reference coverage test: pixel inside all edges (top-left rule)
+static bool __isPixelCovered(long x, long y, RasterVertex v0, RasterVertex v1, RasterVertex v2) {
+  long area = (v1.x - v0.x)*(v2.y - v0.y) - (v2.x - v0.x)*(v1.y - v0.y);
+  if (area == 0)
+    return false;
+  if (area < 0)
+    std::swap(v1, v2);
+  const RasterVertex* vertices[4] = { &v0, &v1, &v2, &v0 };
+  for (int i = 0; i < 3; ++i) {
+    long a = -(vertices[i+1]->y - vertices[i]->y);
+    long b = vertices[i+1]->x - vertices[i]->x;
+    long value = a*(x - vertices[i]->x) + b*(y - vertices[i]->y);
+    bool isTopLeft = (a > 0 || (a == 0 && b > 0));
+    if (value < 0 || (value == 0 && !isTopLeft))
+      return false;
+  }
+  return true;
+}
+
+
+// -- coverage -- --------------------------------------------------------------
+
+TEST_F(RasterizerTest, fillRuleTest) {
+  Vram<psxVramHeight()> vram;
+  RasterState state = __createState();
+  Rasterizer::drawTriangle(vram, state, __createVertex(0, 0), __createVertex(10, 0), __createVertex(0, 10));
+
+  const uint16_t white = 0x7FFFu;
+  EXPECT_EQ((unsigned long)55u, __countPixels(vram, white)); // x+y < 10 (diagonal edge excluded)
+  EXPECT_EQ(white, vram.read(0, 0));
+  EXPECT_EQ(white, vram.read(9, 0));
+  EXPECT_EQ(white, vram.read(0, 9));
+  EXPECT_EQ(white, vram.read(4, 5));
+  EXPECT_EQ((uint16_t)0, vram.read(10, 0));
+  EXPECT_EQ((uint16_t)0, vram.read(5, 5));
+  EXPECT_TRUE(vram.isRegionDirty(0, 0, 10, 10));
+
+  memset(vram.pixels(), 0, vram.sizeInBytes()); // clockwise -> same result
+  Rasterizer::drawTriangle(vram, state, __createVertex(0, 0), __createVertex(0, 10), __createVertex(10, 0));
+  EXPECT_EQ((unsigned long)55u, __countPixels(vram, white));
+}
+
+TEST_F(RasterizerTest, sharedEdgesTest) {
+  Vram<psxVramHeight()> vram;
+  RasterState state = __createState();
+  state.isSemiTransparent = true;
+  state.blendingMode = BlendingMode::add; // pixels drawn twice would have a value of 2
+
+  RasterVertex quad[4] = { __createVertex(3, 2, 0x08u), __createVertex(40, 5, 0x08u),
+                           __createVertex(1, 30, 0x08u), __createVertex(37, 33, 0x08u) };
+  Rasterizer::drawQuad(vram, state, quad);
+  EXPECT_EQ((unsigned long)0, __countPixels(vram, 2u));
+  unsigned long expectedCount = 0;
+  for (long y = 0; y < 40; ++y) {
+    for (long x = 0; x < 50; ++x) {
+      if (__isPixelCovered(x, y, quad[0], quad[1], quad[2]) || __isPixelCovered(x, y, quad[1], quad[2], quad[3]))
+        ++expectedCount;
+    }
+  }
+  EXPECT_EQ(expectedCount, __countPixels(vram, 1u));
+
+  memset(vram.pixels(), 0, vram.sizeInBytes()); // axis-aligned rectangle
+  RasterVertex rect[4] = { __createVertex(10, 10, 0x08u), __createVertex(20, 10, 0x08u),
+                           __createVertex(10, 20, 0x08u), __createVertex(20, 20, 0x08u) };
+  Rasterizer::drawQuad(vram, state, rect);
+  EXPECT_EQ((unsigned long)100u, __countPixels(vram, 1u));
+  EXPECT_EQ((unsigned long)0, __countPixels(vram, 2u));
+  EXPECT_EQ((uint16_t)1u, vram.read(10, 10));
+  EXPECT_EQ((uint16_t)1u, vram.read(19, 19));
+  EXPECT_EQ((uint16_t)0, vram.read(20, 19));
+}
+
+TEST_F(RasterizerTest, coverageReferenceTest) {
+  Vram<psxVramHeight()> vram;
+  RasterState state = __createState();
+  uint32_t seed = 12345u;
+  auto random = [&seed](long range) -> long {
+    seed = seed * 1103515245u + 12345u;
+    return (long)((seed >> 8) % (uint32_t)range);
+  };
+
+  for (int iteration = 0; iteration < 200; ++iteration) {
+    memset(vram.pixels(), 0, vram.sizeInBytes());
+    RasterVertex v0 = __createVertex(random(120) - 10, random(120) - 10);
+    RasterVertex v1 = __createVertex(random(120) - 10, random(120) - 10);
+    RasterVertex v2 = __createVertex(random(120) - 10, random(120) - 10);
+    Rasterizer::drawTriangle(vram, state, v0, v1, v2);
+
+    for (long y = 0; y < 112; ++y) {
+      for (long x = 0; x < 112; ++x) {
+        ASSERT_EQ(__isPixelCovered(x, y, v0, v1, v2), vram.read((unsigned long)x, (unsigned long)y) != 0)
+          << "x:" << x << " y:" << y << " iteration:" << iteration;
+      }
+    }
+  }
+}
+
+TEST_F(RasterizerTest, clippingTest) {
+  Vram<psxVramHeight()> vram;
+  RasterState state = __createState();
+  state.clipArea = Rectangle{ 5, 14, 3, 7 };
+  Rasterizer::drawTriangle(vram, state, __createVertex(-20, -20), __createVertex(100, -20), __createVertex(-20, 100));
+  EXPECT_EQ((unsigned long)50u, __countPixels(vram, 0x7FFFu));
+  EXPECT_EQ((uint16_t)0x7FFFu, vram.read(5, 3));
+  EXPECT_EQ((uint16_t)0x7FFFu, vram.read(14, 7));
+  EXPECT_EQ((uint16_t)0, vram.read(4, 3));
+  EXPECT_EQ((uint16_t)0, vram.read(15, 7));
+  EXPECT_EQ((uint16_t)0, vram.read(5, 8));
+  EXPECT_FALSE(vram.isRegionDirty(100, 100, 64, 64));
+
+  state.clipArea = Rectangle{ 20, 10, 0, 511 }; // empty draw area
+  Rasterizer::drawTriangle(vram, state, __createVertex(0, 0), __createVertex(100, 0), __createVertex(0, 100));
+  EXPECT_EQ((unsigned long)50u, __countPixels(vram, 0x7FFFu));
+}
+
+TEST_F(RasterizerTest, sizeLimitTest) {
+  Vram<psxVramHeight()> vram;
+  RasterState state = __createState();
+  EXPECT_FALSE(Rasterizer::isTriangleTooLarge(__createVertex(0, 0), __createVertex(1023, 0), __createVertex(0, 511)));
+  EXPECT_TRUE(Rasterizer::isTriangleTooLarge(__createVertex(0, 0), __createVertex(1024, 0), __createVertex(0, 10)));
+  EXPECT_TRUE(Rasterizer::isTriangleTooLarge(__createVertex(0, 0), __createVertex(10, 0), __createVertex(0, 512)));
+  EXPECT_TRUE(Rasterizer::isTriangleTooLarge(__createVertex(-600, 0), __createVertex(10, 0), __createVertex(500, 5)));
+
+  Rasterizer::drawTriangle(vram, state, __createVertex(0, 0), __createVertex(1024, 0), __createVertex(0, 10));
+  EXPECT_EQ((uint64_t)0, vram.generation());
+  Rasterizer::drawTriangle(vram, state, __createVertex(0, 0), __createVertex(1023, 0), __createVertex(0, 511));
+  EXPECT_EQ((uint16_t)0x7FFFu, vram.read(0, 0));
+  EXPECT_EQ((uint16_t)0x7FFFu, vram.read(1021, 0));
+  EXPECT_EQ((uint16_t)0x7FFFu, vram.read(0, 510));
+}
+
+
+// -- shading -- ---------------------------------------------------------------
+
+TEST_F(RasterizerTest, gouraudShadingTest) {
+  Vram<psxVramHeight()> vram;
+  RasterState state = __createState();
+  state.isShaded = true;
+  Rasterizer::drawTriangle(vram, state, __createVertex(0, 0, 0x0000FFu), __createVertex(64, 0, 0x00FF00u),
+                           __createVertex(0, 64, 0xFF0000u));
+  EXPECT_EQ((uint16_t)0x1Fu, vram.read(0, 0));      // red vertex
+  EXPECT_EQ((uint16_t)(0x1Fu << 10), (uint16_t)(vram.read(0, 63) & 0x7C00u)); // near blue vertex
+  EXPECT_TRUE((vram.read(0, 63) & 0x1Fu) == 0);
+  uint16_t middle = vram.read(21, 21); // ~ 1/3 of each color
+  EXPECT_NEAR(10, (int)(middle & 0x1Fu), 1);
+  EXPECT_NEAR(10, (int)((middle >> 5) & 0x1Fu), 1);
+  EXPECT_NEAR(10, (int)((middle >> 10) & 0x1Fu), 1);
+
+  // dithering
+  state.isDithered = true;
+  memset(vram.pixels(), 0, vram.sizeInBytes());
+  Rasterizer::drawTriangle(vram, state, __createVertex(0, 0, 0x050505u), __createVertex(64, 0, 0x050505u),
+                           __createVertex(0, 64, 0x050505u));
+  EXPECT_EQ((uint16_t)0, vram.read(0, 0));                                   // 5 - 4
+  EXPECT_EQ((uint16_t)(0x1u | (0x1u << 5) | (0x1u << 10)), vram.read(2, 1)); // 5 + 3
+}
+
+TEST_F(RasterizerTest, texturedTest) {
+  Vram<psxVramHeight()> vram;
+  RasterState state = __createState();
+  state.isTextured = true;
+  state.isRawTexture = true;
+  state.colorMode = TextureColorMode::directColor15bit;
+  state.texpageX = 512;
+  state.texpageY = 256;
+  for (unsigned long y = 0; y < 32u; ++y) {
+    for (unsigned long x = 0; x < 32u; ++x)
+      vram.row(256u + y)[512u + x] = (uint16_t)(1u + x + (y << 5));
+  }
+  vram.row(256u + 4u)[512u + 4u] = 0; // transparent texel
+
+  RasterVertex quad[4] = { __createVertex(100, 100, 0, 0, 0), __createVertex(132, 100, 0, 32, 0),
+                           __createVertex(100, 132, 0, 0, 32), __createVertex(132, 132, 0, 32, 32) };
+  vram.row(104)[104] = 0x1234u;
+  Rasterizer::drawQuad(vram, state, quad);
+  for (unsigned long y = 0; y < 32u; ++y) {
+    for (unsigned long x = 0; x < 32u; ++x) {
+      if (x == 4u && y == 4u)
+        EXPECT_EQ((uint16_t)0x1234u, vram.read(104, 104));
+      else
+        EXPECT_EQ((uint16_t)(1u + x + (y << 5)), vram.read(100u + x, 100u + y));
+    }
+  }
+
+  // 4-bit lookup table + modulation (0x80 == x1.0) + texture window
+  state.isRawTexture = false;
+  state.colorMode = TextureColorMode::lookupTable4bit;
+  state.clutX = 0;
+  state.clutY = 300;
+  for (unsigned long i = 0; i < 16u; ++i)
+    vram.row(300)[i] = (uint16_t)(i | 0x8000u);
+  for (unsigned long x = 0; x < 8u; ++x)
+    vram.row(256)[512u + x] = (uint16_t)(0x3210u + 0x4444u*(x & 0x3u));
+  state.textureWindow.maskWidth = 8;
+  state.textureWindow.maskHeight = 8;
+  RasterVertex strip[4] = { __createVertex(0, 200, 0x808080u, 0, 0), __createVertex(16, 200, 0x808080u, 16, 0),
+                            __createVertex(0, 201, 0x808080u, 0, 1), __createVertex(16, 201, 0x808080u, 16, 1) };
+  Rasterizer::drawQuad(vram, state, strip);
+  EXPECT_EQ((uint16_t)0x8000u, vram.read(0, 200)); // index 0 -> texel 0x8000 (black, not transparent)
+  EXPECT_EQ((uint16_t)0x8001u, vram.read(1, 200)); // STP bit kept
+  EXPECT_EQ((uint16_t)0x8007u, vram.read(7, 200));
+  EXPECT_EQ((uint16_t)0x8001u, vram.read(9, 200)); // texture window: u & 7
+}
+
+TEST_F(RasterizerTest, blendingAndMaskTest) {
+  Vram<psxVramHeight()> vram;
+  RasterState state = __createState();
+  for (unsigned long x = 0; x < 16u; ++x)
+    vram.row(0)[x] = (uint16_t)(0x10u | (0x10u << 5) | (0x10u << 10) | ((x & 1u) ? 0x8000u : 0));
+
+  RasterVertex quad[4] = { __createVertex(0, 0, 0x404040u), __createVertex(16, 0, 0x404040u),
+                           __createVertex(0, 1, 0x404040u), __createVertex(16, 1, 0x404040u) };
+  state.isSemiTransparent = true;
+  state.blendingMode = BlendingMode::subtract;
+  state.checkMask = true;
+  state.forceMaskBit = vramMaskBit();
+  Rasterizer::drawQuad(vram, state, quad);
+  for (unsigned long x = 0; x < 16u; ++x) {
+    if (x & 1u)
+      EXPECT_EQ((uint16_t)(0x8000u | 0x10u | (0x10u << 5) | (0x10u << 10)), vram.read(x, 0)); // protected
+    else
+      EXPECT_EQ((uint16_t)(0x8000u | 0x8u | (0x8u << 5) | (0x8u << 10)), vram.read(x, 0));    // 16 - 8
+  }
+}
+
+TEST_F(RasterizerTest, pipelineVariantsTest) {
+  // same pixels with texels read in VRAM or in decoded texture page (for each combination of options)
+  Vram<psxVramHeight()> textures;
+  for (unsigned long y = 0; y < psxVramHeight(); ++y) {
+    for (unsigned long x = 0; x < vramWidth(); ++x)
+      textures.row(y)[x] = (uint16_t)((x * 0x9E37u + y * 0x79B9u) ^ (x >> 3));
+  }
+  const TextureColorMode colorModes[] = { TextureColorMode::lookupTable4bit, TextureColorMode::lookupTable8bit,
+                                          TextureColorMode::directColor15bit };
+  const BlendingMode blendingModes[] = { BlendingMode::mean, BlendingMode::add, BlendingMode::subtract, BlendingMode::addQuarter };
+  RasterVertex quad[4] = { __createVertex(3, 5, 0x20C040u, 0, 0), __createVertex(77, 2, 0xF08010u, 255, 10),
+                           __createVertex(9, 70, 0x104080u, 20, 240), __createVertex(80, 81, 0x80FF80u, 250, 255) };
+
+  for (auto colorMode : colorModes) {
+    RasterState state = __createState();
+    state.isTextured = true;
+    state.colorMode = colorMode;
+    state.texpageX = 320;
+    state.texpageY = 256;
+    state.clutX = 16;
+    state.clutY = 480;
+    std::unique_ptr<uint16_t[]> decodedTexture(new uint16_t[256*256]);
+    for (uint32_t v = 0; v < 256u; ++v) {
+      for (uint32_t u = 0; u < 256u; ++u) {
+        uint16_t texel;
+        if (colorMode == TextureColorMode::lookupTable4bit)
+          texel = textures.read(16u + ((textures.read(320u + (u >> 2), 256u + v) >> ((u & 3u) << 2)) & 0xFu), 480u);
+        else if (colorMode == TextureColorMode::lookupTable8bit)
+          texel = textures.read(16u + ((textures.read(320u + (u >> 1), 256u + v) >> ((u & 1u) << 3)) & 0xFFu), 480u);
+        else
+          texel = textures.read(320u + u, 256u + v);
+        decodedTexture[(v << 8) | u] = texel;
+      }
+    }
+
+    for (uint32_t options = 0; options < 64u; ++options) {
+      state.isRawTexture = (options & 0x1u) != 0;
+      state.isShaded = (options & 0x2u) != 0;
+      state.isDithered = (options & 0x4u) != 0;
+      state.checkMask = (options & 0x8u) != 0;
+      state.forceMaskBit = (options & 0x10u) ? vramMaskBit() : 0;
+      state.textureWindow.maskWidth = (options & 0x20u) ? 32 : 256;
+      state.textureWindow.offsetX = (options & 0x20u) ? 64 : 0;
+      for (int blending = -1; blending < 4; ++blending) {
+        state.isSemiTransparent = (blending >= 0);
+        state.blendingMode = (blending >= 0) ? blendingModes[blending] : BlendingMode::mean;
+
+        Vram<psxVramHeight()> vramReads, decodedReads;
+        for (unsigned long y = 0; y < 128u; ++y) {
+          for (unsigned long x = 0; x < 128u; ++x)
+            vramReads.row(y)[x] = decodedReads.row(y)[x] = (uint16_t)(x*y*0x1234u + x);
+        }
+        Rectangle area;
+        state.decodedTexture = nullptr;
+        Rasterizer::rasterizeTriangle(textures, Rasterizer::nativeTarget(vramReads), state, quad[0], quad[1], quad[2],
+                                      Rasterizer::fullTargetArea(Rasterizer::nativeTarget(vramReads)), area);
+        state.decodedTexture = decodedTexture.get();
+        Rasterizer::rasterizeTriangle(textures, Rasterizer::nativeTarget(decodedReads), state, quad[0], quad[1], quad[2],
+                                      Rasterizer::fullTargetArea(Rasterizer::nativeTarget(decodedReads)), area);
+        for (unsigned long y = 0; y < 128u; ++y) {
+          for (unsigned long x = 0; x < 128u; ++x) {
+            ASSERT_EQ(vramReads.read(x, y), decodedReads.read(x, y))
+              << "x:" << x << " y:" << y << " mode:" << (uint32_t)colorMode << " options:" << options << " blending:" << blending;
+          }
+        }
+      }
+    }
+  }
+}
+
+
+// -- rectangles -- ------------------------------------------------------------
+
+TEST_F(RasterizerTest, rectangleReferenceTest) {
+  // same pixels as quad with 1:1 texture mapping (native + upscaled targets, for each combination of options)
+  Vram<psxVramHeight()> textures;
+  for (unsigned long y = 0; y < psxVramHeight(); ++y) {
+    for (unsigned long x = 0; x < vramWidth(); ++x)
+      textures.row(y)[x] = (uint16_t)((x * 0x9E37u + y * 0x79B9u) ^ (x >> 3));
+  }
+  const TextureColorMode colorModes[] = { TextureColorMode::lookupTable4bit, TextureColorMode::lookupTable8bit,
+                                          TextureColorMode::directColor15bit };
+  RasterVertex quad[4] = { __createVertex(13, 7, 0x20C040u, 100, 50), __createVertex(58, 7, 0x20C040u, 145, 50),
+                           __createVertex(13, 37, 0x20C040u, 100, 80), __createVertex(58, 37, 0x20C040u, 145, 80) };
+  const long scales[] = { 1, 2 };
+
+  for (long scale : scales) {
+    const long targetSize = 64*scale;
+    std::unique_ptr<uint16_t[]> quadPixels(new uint16_t[targetSize*targetSize]);
+    std::unique_ptr<uint16_t[]> rectanglePixels(new uint16_t[targetSize*targetSize]);
+    RasterTarget quadTarget, rectangleTarget;
+    quadTarget.pixels = quadPixels.get();
+    rectangleTarget.pixels = rectanglePixels.get();
+    quadTarget.rowLength = rectangleTarget.rowLength = (size_t)targetSize;
+    quadTarget.width = quadTarget.height = rectangleTarget.width = rectangleTarget.height = targetSize;
+    quadTarget.scaleX = quadTarget.scaleY = rectangleTarget.scaleX = rectangleTarget.scaleY = scale;
+
+    for (int colorMode = -1; colorMode < 3; ++colorMode) {
+      RasterState state = __createState();
+      state.clipArea = Rectangle{ 20, 50, 0, 30 };
+      state.isTextured = (colorMode >= 0);
+      state.colorMode = (colorMode >= 0) ? colorModes[colorMode] : TextureColorMode::directColor15bit;
+      state.texpageX = 320;
+      state.texpageY = 256;
+      state.clutX = 16;
+      state.clutY = 480;
+
+      for (uint32_t options = 0; options < 64u; ++options) {
+        state.isRawTexture = (options & 0x1u) != 0;
+        state.isDithered = (options & 0x2u) != 0;
+        state.checkMask = (options & 0x4u) != 0;
+        state.forceMaskBit = (options & 0x8u) ? vramMaskBit() : 0;
+        state.textureWindow.maskWidth = (options & 0x10u) ? 32 : 256;
+        state.textureWindow.offsetX = (options & 0x10u) ? 64 : 0;
+        state.isSemiTransparent = (options & 0x20u) != 0;
+        state.blendingMode = BlendingMode::add;
+
+        for (long i = 0; i < targetSize*targetSize; ++i)
+          quadPixels[i] = rectanglePixels[i] = (uint16_t)(i*0x1234 + (i >> 5));
+        Rectangle quadArea, rectangleArea;
+        bool isQuadDrawn = Rasterizer::rasterizeTriangle(textures, quadTarget, state, quad[0], quad[1], quad[2],
+                                                         Rasterizer::fullTargetArea(quadTarget), quadArea);
+        isQuadDrawn |= Rasterizer::rasterizeTriangle(textures, quadTarget, state, quad[1], quad[2], quad[3],
+                                                     Rasterizer::fullTargetArea(quadTarget), quadArea);
+        EXPECT_TRUE(isQuadDrawn);
+        EXPECT_TRUE(Rasterizer::rasterizeRectangle(textures, rectangleTarget, state, quad[0], 45, 30,
+                                                   Rasterizer::fullTargetArea(rectangleTarget), rectangleArea));
+        EXPECT_EQ(20*scale, rectangleArea.leftX);
+        EXPECT_EQ(51*scale - 1, rectangleArea.rightX);
+        EXPECT_EQ(7*scale, rectangleArea.topY);
+        EXPECT_EQ(31*scale - 1, rectangleArea.bottomY);
+        for (long i = 0; i < targetSize*targetSize; ++i) {
+          ASSERT_EQ(quadPixels[i], rectanglePixels[i]) << "x:" << (i % targetSize) << " y:" << (i / targetSize)
+                                                      << " scale:" << scale << " mode:" << colorMode << " options:" << options;
+        }
+      }
+    }
+  }
+
+  // empty/clipped rectangles
+  Vram<psxVramHeight()> vram;
+  RasterState state = __createState();
+  Rectangle area;
+  EXPECT_FALSE(Rasterizer::rasterizeRectangle(vram, Rasterizer::nativeTarget(vram), state, quad[0], 0, 8,
+                                              Rasterizer::fullTargetArea(Rasterizer::nativeTarget(vram)), area));
+  state.clipArea = Rectangle{ 100, 200, 100, 200 };
+  EXPECT_FALSE(Rasterizer::rasterizeRectangle(vram, Rasterizer::nativeTarget(vram), state, quad[0], 45, 30,
+                                              Rasterizer::fullTargetArea(Rasterizer::nativeTarget(vram)), area));
+  EXPECT_EQ((unsigned long)vramWidth()*psxVramHeight(), __countPixels(vram, 0));
+}
+
+TEST_F(RasterizerTest, rectangleFlipWrapTest) {
+  // raw texels copied 1:1: texture coords wrap around (8-bit), decremented if flipped (contiguous rows + gathered texels)
+  std::unique_ptr<Vram<psxVramHeight()> > textures(new Vram<psxVramHeight()>());
+  std::unique_ptr<Vram<psxVramHeight()> > vram(new Vram<psxVramHeight()>());
+  for (unsigned long y = 0; y < psxVramHeight(); ++y) {
+    for (unsigned long x = 0; x < vramWidth(); ++x)
+      textures->row(y)[x] = (uint16_t)((x * 0x9E37u + y * 0x79B9u) ^ (x >> 3));
+  }
+  const long texpages[] = { 320, 960 }; // 960: texture rows wrap around VRAM width
+  const uint32_t firstCoords[] = { 5u, 250u };
+
+  for (long texpageX : texpages) {
+    for (int colorMode = 0; colorMode < 2; ++colorMode) {
+      for (uint32_t options = 0; options < 8u; ++options) {
+        for (uint32_t firstU : firstCoords) {
+          RasterState state = __createState();
+          state.isTextured = state.isRawTexture = true;
+          state.colorMode = colorMode ? TextureColorMode::directColor15bit : TextureColorMode::lookupTable4bit;
+          state.texpageX = texpageX;
+          state.texpageY = 256;
+          state.clutX = 16;
+          state.clutY = 480;
+          state.isTextureFlipX = (options & 0x1u) != 0;
+          state.isTextureFlipY = (options & 0x2u) != 0;
+          state.textureWindow.maskWidth = (options & 0x4u) ? 16 : 256;
+          state.textureWindow.offsetX = (options & 0x4u) ? 32 : 0;
+
+          for (unsigned long y = 0; y < psxVramHeight(); ++y) {
+            for (unsigned long x = 0; x < vramWidth(); ++x)
+              vram->row(y)[x] = (uint16_t)(x ^ (y << 4));
+          }
+          Rectangle area;
+          EXPECT_TRUE(Rasterizer::rasterizeRectangle(*textures, Rasterizer::nativeTarget(*vram), state,
+                                                     __createVertex(100, 50, 0x808080u, firstU, 3u), 40, 12,
+                                                     Rasterizer::fullTargetArea(Rasterizer::nativeTarget(*vram)), area));
+          for (long y = 50; y < 62; ++y) {
+            for (long x = 100; x < 140; ++x) {
+              uint32_t u = (firstU + (uint32_t)(state.isTextureFlipX ? 100 - x : x - 100)) & 0xFFu;
+              uint32_t v = (3u + (uint32_t)(state.isTextureFlipY ? 50 - y : y - 50)) & 0xFFu;
+              u = (u & (uint32_t)(state.textureWindow.maskWidth - 1)) | (uint32_t)state.textureWindow.offsetX;
+              uint16_t texel = textures->read((unsigned long)texpageX + (colorMode ? u : (u >> 2)), 256u + v);
+              if (colorMode == 0)
+                texel = textures->read(16u + ((texel >> ((u & 0x3u) << 2)) & 0xFu), 480u);
+              const uint16_t expected = texel ? texel : (uint16_t)((unsigned long)x ^ ((unsigned long)y << 4));
+              ASSERT_EQ(expected, vram->row((unsigned long)y)[x]) << "x:" << x << " y:" << y << " texpage:" << texpageX
+                                                                  << " mode:" << colorMode << " options:" << options << " u:" << firstU;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// -- lines -- -----------------------------------------------------------------
+
+// reference line drawing: one pixel per step (same fixed-point rules as hardware)
+template <unsigned long _Height>
+static void __drawReferenceLine(Vram<_Height>& vram, const RasterState& state, RasterVertex v0, RasterVertex v1) {
+  static const int32_t ditherMatrix[4][4] = { { -4, 0, -3, 1 }, { 2, -2, 3, -1 }, { -3, 1, -4, 0 }, { 3, -1, 2, -2 } };
+  int64_t deltaX = std::abs(v1.x - v0.x), deltaY = std::abs(v1.y - v0.y);
+  int64_t stepCount = (deltaX > deltaY) ? deltaX : deltaY;
+  if (deltaX > 1023 || deltaY > 511)
+    return;
+  if (v0.x >= v1.x && stepCount)
+    std::swap(v0, v1);
+  deltaX = v1.x - v0.x;
+  deltaY = v1.y - v0.y;
+  auto divide = [stepCount](int64_t delta) -> int64_t {
+    delta *= ((int64_t)1 << 32);
+    if (delta < 0) delta -= stepCount - 1;
+    else if (delta > 0) delta += stepCount - 1;
+    return delta / stepCount;
+  };
+  int64_t x = (int64_t)v0.x * ((int64_t)1 << 32) + ((int64_t)1 << 31) - 1024;
+  int64_t y = (int64_t)v0.y * ((int64_t)1 << 32) + ((int64_t)1 << 31) - ((deltaY < 0) ? 1024 : 0);
+  int64_t stepX = stepCount ? divide(deltaX) : 0, stepY = stepCount ? divide(deltaY) : 0;
+  int32_t colors[3], colorSteps[3];
+  for (int i = 0; i < 3; ++i) {
+    int32_t first = (int32_t)((v0.color >> (8*i)) & 0xFFu);
+    colors[i] = (first << 12) | 0x800;
+    colorSteps[i] = (state.isShaded && stepCount) ? (((int32_t)((v1.color >> (8*i)) & 0xFFu) - first) * 4096) / (int32_t)stepCount : 0;
+  }
+
+  for (int64_t step = 0; step <= stepCount; ++step, x += stepX, y += stepY) {
+    long pixelX = (long)(x >> 32), pixelY = (long)(y >> 32);
+    if (pixelX < state.clipArea.leftX || pixelX > state.clipArea.rightX || pixelY < state.clipArea.topY || pixelY > state.clipArea.bottomY)
+      continue;
+    int32_t dither = (state.isShaded && state.isDithered) ? ditherMatrix[pixelY & 3][pixelX & 3] : 0;
+    uint16_t color = 0;
+    for (int i = 0; i < 3; ++i) {
+      int32_t component = ((colors[i] + colorSteps[i]*(int32_t)step) >> 12) + dither;
+      component = (component < 0) ? 0 : ((component > 255) ? 255 : component);
+      color |= (uint16_t)((component >> 3) << (5*i));
+    }
+    vram.row((unsigned long)pixelY)[pixelX] = color;
+  }
+}
+
+TEST_F(RasterizerTest, lineEndPointsTest) {
+  Vram<psxVramHeight()> vram;
+  RasterState state = __createState();
+  Rasterizer::drawLine(vram, state, __createVertex(10, 5), __createVertex(20, 5)); // both end points drawn
+  EXPECT_EQ((unsigned long)11u, __countPixels(vram, 0x7FFFu));
+  EXPECT_EQ((uint16_t)0x7FFFu, vram.read(10, 5));
+  EXPECT_EQ((uint16_t)0x7FFFu, vram.read(20, 5));
+  EXPECT_TRUE(vram.isRegionDirty(10, 5, 11, 1));
+  Rasterizer::drawLine(vram, state, __createVertex(30, 9), __createVertex(30, 9)); // single point
+  EXPECT_EQ((uint16_t)0x7FFFu, vram.read(30, 9));
+  EXPECT_EQ((unsigned long)12u, __countPixels(vram, 0x7FFFu));
+
+  Rasterizer::drawLine(vram, state, __createVertex(0, 100), __createVertex(8, 102)); // shallow: rows 0-1 / 2-5 / 6-8
+  const long expectedRows[9] = { 100, 100, 101, 101, 101, 101, 102, 102, 102 };
+  for (long x = 0; x < 9; ++x) {
+    EXPECT_EQ((uint16_t)0x7FFFu, vram.read((unsigned long)x, (unsigned long)expectedRows[x])) << x;
+  }
+  EXPECT_EQ((unsigned long)21u, __countPixels(vram, 0x7FFFu));
+
+  Rasterizer::drawLine(vram, state, __createVertex(0, 0), __createVertex(1024, 0)); // size limit
+  Rasterizer::drawLine(vram, state, __createVertex(0, 0), __createVertex(0, 512));
+  EXPECT_EQ((unsigned long)21u, __countPixels(vram, 0x7FFFu));
+  EXPECT_TRUE(Rasterizer::isLineTooLarge(__createVertex(-600, 0), __createVertex(500, 5)));
+  EXPECT_FALSE(Rasterizer::isLineTooLarge(__createVertex(0, 0), __createVertex(1023, 511)));
+}
+
+TEST_F(RasterizerTest, lineReferenceTest) {
+  // runs of pixels (shallow lines) must give the same result as one pixel per step
+  uint32_t seed = 77u;
+  auto random = [&seed](long range) -> long {
+    seed = seed * 1103515245u + 12345u;
+    return (long)((seed >> 8) % (uint32_t)range);
+  };
+  for (int options = 0; options < 4; ++options) {
+    RasterState state = __createState();
+    state.clipArea = Rectangle{ 16, 200, 8, 120 };
+    state.isShaded = (options & 0x1) != 0;
+    state.isDithered = (options & 0x2) != 0;
+    Vram<psxVramHeight()> vram, expected;
+    for (int i = 0; i < 200; ++i) {
+      RasterVertex v0 = __createVertex(random(240) - 20, random(150) - 20, (uint32_t)random(0x1000000));
+      RasterVertex v1 = (i & 1) ? __createVertex(v0.x + random(9) - 4, random(150) - 20, (uint32_t)random(0x1000000))  // steep
+                                : __createVertex(random(240) - 20, v0.y + random(9) - 4, (uint32_t)random(0x1000000)); // shallow
+      Rasterizer::drawLine(vram, state, v0, v1);
+      __drawReferenceLine(expected, state, v0, v1);
+    }
+    for (unsigned long y = 0; y < 160u; ++y) {
+      for (unsigned long x = 0; x < 256u; ++x) {
+        ASSERT_EQ(expected.read(x, y), vram.read(x, y)) << "x:" << x << " y:" << y << " options:" << options;
+      }
+    }
+  }
+}
+
+TEST_F(RasterizerTest, upscaledLineTest) {
+  Vram<psxVramHeight()> vram;
+  RasterState state = __createState();
+  state.isShaded = true;
+  state.isDithered = true;
+  Rasterizer::drawLine(vram, state, __createVertex(3, 2, 0x0000FFu), __createVertex(40, 13, 0xFF8000u));
+
+  std::unique_ptr<uint16_t[]> pixels(new uint16_t[128*64]());
+  RasterTarget target;
+  target.pixels = pixels.get();
+  target.rowLength = 128;
+  target.width = 128;
+  target.height = 64;
+  target.scaleX = target.scaleY = 2;
+  Rectangle area;
+  EXPECT_TRUE(Rasterizer::rasterizeLine(target, state, __createVertex(3, 2, 0x0000FFu), __createVertex(40, 13, 0xFF8000u),
+                                        Rasterizer::fullTargetArea(target), area));
+  EXPECT_EQ((long)6, area.leftX);
+  EXPECT_EQ((long)81, area.rightX);
+  EXPECT_EQ((long)4, area.topY);
+  EXPECT_EQ((long)27, area.bottomY);
+  for (long y = 0; y < 64; ++y) {
+    for (long x = 0; x < 128; ++x) {
+      ASSERT_EQ(vram.read((unsigned long)x/2u, (unsigned long)y/2u), pixels[y*128 + x]) << "x:" << x << " y:" << y;
+    }
+  }
+}
@@ -704,3 +704,45 @@ TEST_F(StatusRegisterTest, statusGp0MaskBitTest) {
   EXPECT_TRUE(reg.readStatus<bool>(StatusBits::forceSetMaskBit));
   EXPECT_TRUE(reg.readStatus<bool>(StatusBits::enableMask));
 }
+
+TEST_F(StatusRegisterTest, statusGp0RedundantAttributeTest) {
+  StatusRegister reg;
+  EXPECT_FALSE(reg.isRedundantAttribute(0xE1000000u)); // no history
+  EXPECT_FALSE(reg.isRedundantAttribute(0xE6000000u));
+
+  reg.setTexturePageMode(0xE1000215u);
+  reg.setTextureWindow(0xE2000421u);
+  reg.setDrawAreaOrigin(0xE3000000u);
+  reg.setDrawAreaEnd(0xE403BD3Fu);
+  reg.setDrawOffset(0xE5000000u | (8u << 11) | 16u);
+  reg.setMaskBit(0xE6000002u);
+  EXPECT_TRUE(reg.isRedundantAttribute(0xE1000215u));
+  EXPECT_TRUE(reg.isRedundantAttribute(0xE2000421u));
+  EXPECT_TRUE(reg.isRedundantAttribute(0xE3000000u));
+  EXPECT_TRUE(reg.isRedundantAttribute(0xE403BD3Fu));
+  EXPECT_TRUE(reg.isRedundantAttribute(0xE5000000u | (8u << 11) | 16u));
+  EXPECT_TRUE(reg.isRedundantAttribute(0xE6000002u));
+  EXPECT_FALSE(reg.isRedundantAttribute(0xE1000216u));
+  EXPECT_FALSE(reg.isRedundantAttribute(0xE6000003u));
+  EXPECT_FALSE(reg.isRedundantAttribute(0xE3000215u)); // same params, other attribute
+  EXPECT_FALSE(reg.isRedundantAttribute(0xE0000000u)); // not an attribute command
+  EXPECT_FALSE(reg.isRedundantAttribute(0xE7000000u));
+  EXPECT_FALSE(reg.isRedundantAttribute(0x02000000u));
+
+  // texture page of textured polygon -> recorded as equivalent GP0(E1)
+  reg.setPolygonTexturePage(0x0008u);
+  EXPECT_FALSE(reg.isRedundantAttribute(0xE1000215u));
+  EXPECT_TRUE(reg.isRedundantAttribute(0xE1000208u)); // dithering bit kept from previous texture page mode
+  EXPECT_TRUE(reg.isRedundantAttribute(0xE2000421u));
+
+  // state modified by other means -> history reset
+  reg.setStatusControlRegister(reg.readStatus((StatusBits)0xFFFFFFFFu));
+  EXPECT_FALSE(reg.isRedundantAttribute(0xE1000208u));
+  EXPECT_FALSE(reg.isRedundantAttribute(0xE6000002u));
+  reg.setMaskBit(0xE6000002u);
+  reg.resetGpu();
+  EXPECT_FALSE(reg.isRedundantAttribute(0xE6000002u));
+  reg.setDrawOffset(0u);
+  reg.setGpuType(GpuVersion::arcadeGpu1, znArcadeVramHeight());
+  EXPECT_FALSE(reg.isRedundantAttribute(0xE5000000u));
+}
@@ -0,0 +1,35 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <display/vram.h>
+
+// -- shared VRAM test pattern (VRAM copies, rasterizers, texture decoding) -- --
+
+/// @brief Test pattern value of a texel: all color bits vary between neighbours (texture indexes), mask bit cleared
+static inline uint16_t __testPatternValue(unsigned long x, unsigned long y) {
+  return (uint16_t)(((y * 1024u + x) * 7u) & 0x7FFFu);
+}
+
+/// @brief Fill entire VRAM with test pattern
+/// @param withMaskBits  Set mask bit of some texels (every other group of 4 texels, alternating per line)
+template <unsigned long _Height>
+static inline void __fillTestPattern(display::Vram<_Height>& vram, bool withMaskBits = false) {
+  for (unsigned long y = 0; y < _Height; ++y) {
+    uint16_t* row = vram.row(y);
+    for (unsigned long x = 0; x < display::vramWidth(); ++x)
+      row[x] = (uint16_t)(__testPatternValue(x, y) | ((withMaskBits && ((x ^ (y << 2)) & 0x4u)) ? display::vramMaskBit() : 0));
+  }
+}
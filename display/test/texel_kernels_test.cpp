@@ -0,0 +1,136 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <vector>
+#include <display/texel_kernels.h>
+
+using namespace display;
+
+class TexelKernelsTest : public testing::Test {
+public:
+protected:
+  //static void SetUpTestCase() {}
+  //static void TearDownTestCase() {}
+
+  void SetUp() override { this->_initialSet = TexelKernels::instructionSet(); }
+  void TearDown() override { TexelKernels::setInstructionSet(this->_initialSet); }
+
+private:
+  KernelInstructionSet _initialSet = KernelInstructionSet::scalar;
+};
+
+static const KernelInstructionSet g_instructionSets[] = {
+  KernelInstructionSet::scalar, KernelInstructionSet::ssse3, KernelInstructionSet::avx2, KernelInstructionSet::neon
+};
+static const size_t g_lengths[] = { 0, 1, 7, 8, 15, 16, 17, 33, 64, 255 }; // vector sizes, remainders
+
+static std::vector<uint16_t> __createRandomTexels(size_t length, uint32_t seed) {
+  std::vector<uint16_t> texels(length);
+  for (size_t i = 0; i < length; ++i) {
+    seed = seed * 1103515245u + 12345u;
+    texels[i] = (uint16_t)(seed >> 12);
+  }
+  if (length > 2) {
+    texels[0] = 0;      // transparent
+    texels[1] = 0x8000; // black + STP
+  }
+  return texels;
+}
+
+
+// -- reference values -- --
+
+TEST_F(TexelKernelsTest, scalarReferenceTest) {
+  ASSERT_TRUE(TexelKernels::isSupported(KernelInstructionSet::scalar));
+  ASSERT_TRUE(TexelKernels::setInstructionSet(KernelInstructionSet::scalar));
+  EXPECT_EQ(KernelInstructionSet::scalar, TexelKernels::instructionSet());
+
+  uint16_t lookupTable[256];
+  for (uint16_t i = 0; i < 256u; ++i)
+    lookupTable[i] = (uint16_t)(0x100u + i);
+  uint16_t indexes[2] = { 0x3210u, 0xFEDCu };
+  uint16_t texels[8];
+  TexelKernels::expandLookupTable4bit(indexes, 2, lookupTable, texels);
+  const uint16_t expected4bit[] = { 0x100u,0x101u,0x102u,0x103u, 0x10Cu,0x10Du,0x10Eu,0x10Fu };
+  for (int i = 0; i < 8; ++i) { EXPECT_EQ(expected4bit[i], texels[i]); }
+  TexelKernels::expandLookupTable8bit(indexes, 2, lookupTable, texels);
+  const uint16_t expected8bit[] = { 0x110u,0x132u, 0x1DCu,0x1FEu };
+  for (int i = 0; i < 4; ++i) { EXPECT_EQ(expected8bit[i], texels[i]); }
+
+  const uint16_t colors[] = { 0x0000u, 0x8000u, 0x001Fu, 0x03E0u, 0xFC00u, 0x7FFFu };
+  uint32_t pixels8888[6];
+  uint16_t pixels5551[6];
+  uint8_t stpMask[6];
+  TexelKernels::convertToRgba8888(colors, 6, pixels8888, stpMask);
+  const uint32_t expected8888[] = { 0x00000000u, 0xFF000000u, 0xFF0000FFu, 0xFF00FF00u, 0xFFFF0000u, 0xFFFFFFFFu };
+  const uint8_t expectedStp[] = { 0, 0xFF, 0, 0, 0xFF, 0 };
+  for (int i = 0; i < 6; ++i) {
+    EXPECT_EQ(expected8888[i], pixels8888[i]);
+    EXPECT_EQ(expectedStp[i], stpMask[i]);
+  }
+  TexelKernels::convertToRgba5551(colors, 6, pixels5551, nullptr);
+  const uint16_t expected5551[] = { 0x0000u, 0x0001u, 0xF801u, 0x07C1u, 0x003Fu, 0xFFFFu };
+  for (int i = 0; i < 6; ++i) { EXPECT_EQ(expected5551[i], pixels5551[i]); }
+}
+
+
+// -- vectorized kernels -- --
+
+TEST_F(TexelKernelsTest, lookupTableExpansionTest) {
+  std::vector<uint16_t> lookupTable = __createRandomTexels(256, 42);
+  for (size_t length : g_lengths) {
+    std::vector<uint16_t> indexes = __createRandomTexels(length, (uint32_t)length);
+    std::vector<uint16_t> expected4bit(length*4u + 1u, 0xCDCDu), expected8bit(length*2u + 1u, 0xCDCDu);
+    TexelKernels::setInstructionSet(KernelInstructionSet::scalar);
+    TexelKernels::expandLookupTable4bit(indexes.data(), length, lookupTable.data(), expected4bit.data());
+    TexelKernels::expandLookupTable8bit(indexes.data(), length, lookupTable.data(), expected8bit.data());
+
+    for (auto instructionSet : g_instructionSets) {
+      if (!TexelKernels::setInstructionSet(instructionSet))
+        continue;
+      std::vector<uint16_t> texels4bit(length*4u + 1u, 0xCDCDu), texels8bit(length*2u + 1u, 0xCDCDu); // +1: detect overflows
+      TexelKernels::expandLookupTable4bit(indexes.data(), length, lookupTable.data(), texels4bit.data());
+      TexelKernels::expandLookupTable8bit(indexes.data(), length, lookupTable.data(), texels8bit.data());
+      EXPECT_EQ(expected4bit, texels4bit) << "set:" << (uint32_t)instructionSet << " length:" << length;
+      EXPECT_EQ(expected8bit, texels8bit) << "set:" << (uint32_t)instructionSet << " length:" << length;
+    }
+  }
+}
+
+TEST_F(TexelKernelsTest, colorConversionTest) {
+  for (size_t length : g_lengths) {
+    std::vector<uint16_t> texels = __createRandomTexels(length, (uint32_t)length + 7u);
+    std::vector<uint32_t> expected8888(length + 1u, 0xCDCDCDCDu);
+    std::vector<uint16_t> expected5551(length + 1u, 0xCDCDu);
+    std::vector<uint8_t> expectedStp(length + 1u, 0xCD);
+    TexelKernels::setInstructionSet(KernelInstructionSet::scalar);
+    TexelKernels::convertToRgba8888(texels.data(), length, expected8888.data(), expectedStp.data());
+    TexelKernels::convertToRgba5551(texels.data(), length, expected5551.data());
+
+    for (auto instructionSet : g_instructionSets) {
+      if (!TexelKernels::setInstructionSet(instructionSet))
+        continue;
+      std::vector<uint32_t> pixels8888(length + 1u, 0xCDCDCDCDu);
+      std::vector<uint16_t> pixels5551(length + 1u, 0xCDCDu);
+      std::vector<uint8_t> stpMask8888(length + 1u, 0xCD), stpMask5551(length + 1u, 0xCD);
+      TexelKernels::convertToRgba8888(texels.data(), length, pixels8888.data(), stpMask8888.data());
+      TexelKernels::convertToRgba5551(texels.data(), length, pixels5551.data(), stpMask5551.data());
+      EXPECT_EQ(expected8888, pixels8888) << "set:" << (uint32_t)instructionSet << " length:" << length;
+      EXPECT_EQ(expected5551, pixels5551) << "set:" << (uint32_t)instructionSet << " length:" << length;
+      EXPECT_EQ(expectedStp, stpMask8888) << "set:" << (uint32_t)instructionSet << " length:" << length;
+      EXPECT_EQ(expectedStp, stpMask5551) << "set:" << (uint32_t)instructionSet << " length:" << length;
+    }
+  }
+}
@@ -0,0 +1,212 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#include <gtest/gtest.h>
+#include <display/vram.h>
+#include <display/texture_cache.h>
+#include "test_pattern.h"
+
+using namespace display;
+
+class TextureCacheTest : public testing::Test {
+public:
+protected:
+  //static void SetUpTestCase() {}
+  //static void TearDownTestCase() {}
+
+  void SetUp() override {}
+  void TearDown() override {}
+};
+
+// reference texel read (same as hardware)
+template <unsigned long _Height>
+static uint16_t __readTexel(const Vram<_Height>& vram, long texpageX, long texpageY, TextureColorMode colorMode,
+                            long clutX, long clutY, unsigned long u, unsigned long v) {
+  switch (colorMode) {
+    case TextureColorMode::lookupTable4bit: {
+      uint16_t indexes = vram.read((unsigned long)texpageX + (u >> 2), (unsigned long)texpageY + v);
+      return vram.read((unsigned long)clutX + ((indexes >> ((u & 0x3u) << 2)) & 0xFu), (unsigned long)clutY);
+    }
+    case TextureColorMode::lookupTable8bit: {
+      uint16_t indexes = vram.read((unsigned long)texpageX + (u >> 1), (unsigned long)texpageY + v);
+      return vram.read((unsigned long)clutX + ((indexes >> ((u & 0x1u) << 3)) & 0xFFu), (unsigned long)clutY);
+    }
+    default:
+      return vram.read((unsigned long)texpageX + u, (unsigned long)texpageY + v);
+  }
+}
+
+
+// -- decoding -- --
+
+TEST_F(TextureCacheTest, decodingTest) {
+  Vram<psxVramHeight()> vram;
+  __fillTestPattern(vram);
+  TextureCache cache;
+
+  const TextureColorMode colorModes[] = { TextureColorMode::lookupTable4bit, TextureColorMode::lookupTable8bit,
+                                          TextureColorMode::directColor15bit, TextureColorMode::reserved };
+  const long texpages[][2] = { { 0, 0 }, { 320, 256 }, { 960, 256 } }; // last one: wraps around
+  const long luts[][2] = { { 0, 480 }, { 1008, 511 } }; // last one: wraps around (8-bit)
+  for (auto colorMode : colorModes) {
+    for (auto texpage : texpages) {
+      for (auto lut : luts) {
+        const uint16_t* texels = cache.getTexture(vram, texpage[0], texpage[1], colorMode, lut[0], lut[1]);
+        ASSERT_TRUE(texels != nullptr);
+        for (unsigned long v = 0; v < decodedTextureSize(); ++v) {
+          for (unsigned long u = 0; u < decodedTextureSize(); ++u) {
+            ASSERT_EQ(__readTexel(vram, texpage[0], texpage[1], colorMode, lut[0], lut[1], u, v), texels[v*decodedTextureSize() + u])
+              << "u:" << u << " v:" << v << " mode:" << (uint32_t)colorMode << " x:" << texpage[0];
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST_F(TextureCacheTest, textureKeyTest) {
+  EXPECT_NE(TextureCache::toTextureKey(64, 0, TextureColorMode::lookupTable4bit, 0, 480),
+            TextureCache::toTextureKey(64, 0, TextureColorMode::lookupTable8bit, 0, 480));
+  EXPECT_NE(TextureCache::toTextureKey(64, 0, TextureColorMode::lookupTable4bit, 0, 480),
+            TextureCache::toTextureKey(64, 0, TextureColorMode::lookupTable4bit, 16, 480));
+  EXPECT_NE(TextureCache::toTextureKey(64, 0, TextureColorMode::lookupTable4bit, 0, 480),
+            TextureCache::toTextureKey(64, 256, TextureColorMode::lookupTable4bit, 0, 480));
+  EXPECT_EQ(TextureCache::toTextureKey(64, 0, TextureColorMode::directColor15bit, 0, 480), // lookup table ignored
+            TextureCache::toTextureKey(64, 0, TextureColorMode::directColor15bit, 16, 500));
+}
+
+
+// -- cache management -- --
+
+TEST_F(TextureCacheTest, hitAndInvalidationTest) {
+  Vram<psxVramHeight()> vram;
+  __fillTestPattern(vram);
+  TextureCache cache;
+
+  const uint16_t* texels = cache.getTexture(vram, 128, 0, TextureColorMode::lookupTable4bit, 0, 480);
+  EXPECT_EQ((uint64_t)0, cache.stats().hits);
+  EXPECT_EQ((uint64_t)1, cache.stats().misses);
+  EXPECT_EQ(texels, cache.getTexture(vram, 128, 0, TextureColorMode::lookupTable4bit, 0, 480));
+  EXPECT_EQ((uint64_t)1, cache.stats().hits);
+  EXPECT_EQ((size_t)1, cache.size());
+  EXPECT_EQ(decodedTextureBytes(), cache.memoryUsage());
+
+  // unrelated write -> still valid
+  vram.markDirty(512, 0, 64, 64);
+  cache.getTexture(vram, 128, 0, TextureColorMode::lookupTable4bit, 0, 480);
+  EXPECT_EQ((uint64_t)2, cache.stats().hits);
+  EXPECT_EQ((uint64_t)0, cache.stats().invalidations);
+
+  // texture page modified -> re-decoded
+  vram.row(10)[130] = 0x1234u;
+  vram.markDirty(130, 10, 1, 1);
+  texels = cache.getTexture(vram, 128, 0, TextureColorMode::lookupTable4bit, 0, 480);
+  EXPECT_EQ((uint64_t)2, cache.stats().misses);
+  EXPECT_EQ((uint64_t)1, cache.stats().invalidations);
+  EXPECT_EQ(vram.read(0u + 4u, 480), texels[10u*decodedTextureSize() + 8u]);
+
+  // lookup table modified -> re-decoded
+  vram.row(480)[4] = 0x4321u;
+  vram.markDirty(4, 480, 1, 1);
+  texels = cache.getTexture(vram, 128, 0, TextureColorMode::lookupTable4bit, 0, 480);
+  EXPECT_EQ((uint64_t)3, cache.stats().misses);
+  EXPECT_EQ((uint64_t)2, cache.stats().invalidations);
+  EXPECT_EQ((uint16_t)0x4321u, texels[10u*decodedTextureSize() + 8u]);
+
+  // other VRAM instance -> re-decoded
+  Vram<psxVramHeight()> otherVram;
+  texels = cache.getTexture(otherVram, 128, 0, TextureColorMode::lookupTable4bit, 0, 480);
+  EXPECT_EQ((uint64_t)4, cache.stats().misses);
+  EXPECT_EQ((uint16_t)0, texels[10u*decodedTextureSize() + 8u]);
+
+  cache.resetStats();
+  EXPECT_EQ((uint64_t)0, cache.stats().misses);
+  cache.clear();
+  EXPECT_EQ((size_t)0, cache.size());
+}
+
+TEST_F(TextureCacheTest, lookupTableUnderFramebufferTest) {
+  Vram<psxVramHeight()> vram;
+  __fillTestPattern(vram);
+  TextureCache cache;
+
+  // usual layout: double-buffered framebuffers (0,0 / 0,240 - 320x240), lookup table below them (0,480)
+  cache.getTexture(vram, 640, 0, TextureColorMode::lookupTable4bit, 0, 480);
+  for (int frame = 0; frame < 4; ++frame) {
+    vram.markDirty(0, (frame & 1) ? 0 : 240, 320, 240); // frame drawn in same page as lookup table
+    cache.beginBatch();
+    cache.getTexture(vram, 640, 0, TextureColorMode::lookupTable4bit, 0, 480);
+  }
+  vram.markDirty(512, 480, 64, 8); // other lookup tables uploaded in same lines
+  cache.getTexture(vram, 640, 0, TextureColorMode::lookupTable4bit, 0, 480);
+  EXPECT_EQ((uint64_t)1, cache.stats().misses);
+  EXPECT_EQ((uint64_t)5, cache.stats().hits);
+  EXPECT_EQ((uint64_t)0, cache.stats().invalidations);
+
+  // lookup table modified -> re-decoded
+  unsigned long index = (unsigned long)(vram.read(640, 0) & 0xFu); // color index of texel (0,0)
+  vram.row(480)[index] = 0x1234u;
+  vram.markDirty(0, 480, 16, 1);
+  const uint16_t* texels = cache.getTexture(vram, 640, 0, TextureColorMode::lookupTable4bit, 0, 480);
+  EXPECT_EQ((uint64_t)1, cache.stats().invalidations);
+  EXPECT_EQ((uint16_t)0x1234u, texels[0]);
+}
+
+TEST_F(TextureCacheTest, lruEvictionTest) {
+  Vram<znArcadeVramHeight()> vram;
+  __fillTestPattern(vram);
+  TextureCache cache(decodedTextureBytes()*3u);
+  EXPECT_EQ((size_t)3, cache.capacity());
+
+  for (long i = 0; i < 3; ++i) {
+    cache.beginBatch();
+    cache.getTexture(vram, i*64, 0, TextureColorMode::directColor15bit, 0, 0);
+  }
+  cache.beginBatch();
+  cache.getTexture(vram, 0, 0, TextureColorMode::directColor15bit, 0, 0); // texture 0 -> most recently used
+  cache.beginBatch();
+  cache.getTexture(vram, 192, 0, TextureColorMode::directColor15bit, 0, 0); // evicts texture 1
+  EXPECT_EQ((uint64_t)1, cache.stats().evictions);
+  EXPECT_EQ((size_t)3, cache.size());
+
+  cache.beginBatch();
+  cache.getTexture(vram, 0, 0, TextureColorMode::directColor15bit, 0, 0);
+  cache.getTexture(vram, 128, 0, TextureColorMode::directColor15bit, 0, 0);
+  EXPECT_EQ((uint64_t)3, cache.stats().hits);
+  cache.getTexture(vram, 64, 0, TextureColorMode::directColor15bit, 0, 0); // evicted previously
+  EXPECT_EQ((uint64_t)5, cache.stats().misses);
+  EXPECT_EQ((uint64_t)2, cache.stats().evictions); // texture 3 evicted
+}
+
+TEST_F(TextureCacheTest, batchPinningTest) {
+  Vram<psxVramHeight()> vram;
+  __fillTestPattern(vram);
+  TextureCache cache(decodedTextureBytes()*2u);
+
+  // all textures used by current batch -> budget exceeded, but pointers remain valid
+  const uint16_t* textures[4];
+  cache.beginBatch();
+  for (long i = 0; i < 4; ++i)
+    textures[i] = cache.getTexture(vram, i*256, 0, TextureColorMode::directColor15bit, 0, 0);
+  EXPECT_EQ((size_t)4, cache.size());
+  EXPECT_EQ((uint64_t)0, cache.stats().evictions);
+  for (long i = 0; i < 4; ++i) {
+    EXPECT_EQ(vram.read((unsigned long)i*256u + 5u, 7u), textures[i][7u*decodedTextureSize() + 5u]);
+  }
+
+  // next batch -> back to budget
+  cache.beginBatch();
+  cache.getTexture(vram, 0, 256, TextureColorMode::directColor15bit, 0, 0);
+  EXPECT_EQ((size_t)2, cache.size());
+  EXPECT_EQ((uint64_t)3, cache.stats().evictions);
+}
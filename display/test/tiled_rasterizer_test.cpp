@@ -0,0 +1,281 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#include <gtest/gtest.h>
+#include <cstring>
+#include <vector>
+#include <display/vram.h>
+#include <display/rasterizer.h>
+#include <display/texture_cache.h>
+#include <display/tiled_rasterizer.h>
+#include "test_pattern.h"
+
+using namespace display;
+
+class TiledRasterizerTest : public testing::Test {
+public:
+protected:
+  //static void SetUpTestCase() {}
+  //static void TearDownTestCase() {}
+
+  void SetUp() override {}
+  void TearDown() override {}
+};
+
+// pseudo-random generator (deterministic)
+struct TestRandom final {
+  uint32_t seed = 12345u;
+  inline long operator()(long range) {
+    seed = seed * 1103515245u + 12345u;
+    return (long)((seed >> 8) % (uint32_t)range);
+  }
+};
+
+// random triangle with random attributes (textures + lookup tables in bottom-right area of VRAM)
+static void __createRandomTriangle(TestRandom& random, RasterState& outState, RasterVertex* outVertices) {
+  outState = RasterState{};
+  outState.clipArea = Rectangle{ random(32), 420 + random(64), random(32), 300 + random(64) };
+  outState.texpageX = 640;
+  outState.texpageY = 256;
+  outState.clutX = 512;
+  outState.clutY = 500;
+  const TextureColorMode colorModes[] = { TextureColorMode::lookupTable4bit, TextureColorMode::lookupTable8bit,
+                                          TextureColorMode::directColor15bit };
+  outState.colorMode = colorModes[random(3)];
+  outState.blendingMode = (BlendingMode)random(4);
+  outState.forceMaskBit = random(4) ? 0 : vramMaskBit();
+  outState.checkMask = (random(4) == 0);
+  outState.isTextured = (random(2) != 0);
+  outState.isRawTexture = (random(3) == 0);
+  outState.isShaded = (random(2) != 0);
+  outState.isSemiTransparent = (random(3) == 0);
+  outState.isDithered = (random(2) != 0);
+
+  for (int i = 0; i < 3; ++i) {
+    outVertices[i].x = random(520) - 40;
+    outVertices[i].y = random(420) - 40;
+    outVertices[i].color = (uint32_t)random(0x1000000);
+    outVertices[i].u = (uint32_t)random(256);
+    outVertices[i].v = (uint32_t)random(256);
+  }
+}
+
+
+// -- native target -- --
+
+TEST_F(TiledRasterizerTest, bitIdenticalTest) {
+  TextureCache textureCache;
+  for (unsigned workerCount = 0; workerCount <= 3u; workerCount += 3u) {
+    Vram<psxVramHeight()> reference;
+    Vram<psxVramHeight()> vram;
+    __fillTestPattern(reference, true);
+    __fillTestPattern(vram, true);
+    TiledRasterizer tiledRasterizer(workerCount);
+    EXPECT_EQ(workerCount, tiledRasterizer.workerCount());
+    if (workerCount != 0) // decoded textures
+      tiledRasterizer.setTextureCache(&textureCache);
+
+    TestRandom random;
+    RasterState state;
+    RasterVertex vertices[3];
+    for (int i = 0; i < 300; ++i) {
+      __createRandomTriangle(random, state, vertices);
+      Rasterizer::drawTriangle(reference, state, vertices[0], vertices[1], vertices[2]);
+      tiledRasterizer.drawTriangle(vram, Rasterizer::nativeTarget(vram), state, vertices[0], vertices[1], vertices[2]);
+    }
+    EXPECT_FALSE(tiledRasterizer.isEmpty());
+    tiledRasterizer.flush();
+    EXPECT_TRUE(tiledRasterizer.isEmpty());
+    EXPECT_EQ((size_t)0, tiledRasterizer.pendingCount());
+
+    EXPECT_EQ(0, memcmp(reference.pixels(), vram.pixels(), vram.sizeInBytes()));
+    EXPECT_TRUE(vram.isRegionDirty(100, 100, 64, 64));
+  }
+  EXPECT_EQ((uint64_t)3, textureCache.stats().misses); // 1 texture page per color mode
+  EXPECT_NE((uint64_t)0, textureCache.stats().hits);
+}
+
+TEST_F(TiledRasterizerTest, textureHazardTest) {
+  Vram<psxVramHeight()> reference;
+  Vram<psxVramHeight()> vram;
+  __fillTestPattern(reference, true);
+  __fillTestPattern(vram, true);
+  TiledRasterizer tiledRasterizer(2);
+
+  RasterState writeState;
+  writeState.clipArea = Rectangle{ 0, 1023, 0, 511 };
+  writeState.isShaded = true;
+  RasterVertex writeVertices[4];
+  for (int i = 0; i < 4; ++i) {
+    writeVertices[i].x = 640 + (i & 1)*128;
+    writeVertices[i].y = 256 + (i >> 1)*128;
+    writeVertices[i].color = 0x10F080u + (uint32_t)i*0x204010u;
+  }
+  RasterState readState = writeState;
+  readState.isTextured = true;
+  readState.isRawTexture = true;
+  readState.colorMode = TextureColorMode::directColor15bit;
+  readState.texpageX = 640;
+  readState.texpageY = 256;
+  RasterVertex readVertices[4];
+  for (int i = 0; i < 4; ++i) {
+    readVertices[i] = writeVertices[i];
+    readVertices[i].x -= 600; // draw texture in other area
+    readVertices[i].u = (uint32_t)(i & 1)*128u;
+    readVertices[i].v = (uint32_t)(i >> 1)*128u;
+  }
+  RasterVertex overwriteVertices[4];
+  for (int i = 0; i < 4; ++i) {
+    overwriteVertices[i] = writeVertices[i];
+    overwriteVertices[i].color = 0x203040u;
+  }
+
+  // write texture -> read texture (read after write) -> overwrite texture (write after read)
+  Rasterizer::drawQuad(reference, writeState, writeVertices);
+  Rasterizer::drawQuad(reference, readState, readVertices);
+  Rasterizer::drawQuad(reference, writeState, overwriteVertices);
+  tiledRasterizer.drawQuad(vram, Rasterizer::nativeTarget(vram), writeState, writeVertices);
+  tiledRasterizer.drawQuad(vram, Rasterizer::nativeTarget(vram), readState, readVertices);
+  tiledRasterizer.drawQuad(vram, Rasterizer::nativeTarget(vram), writeState, overwriteVertices);
+  tiledRasterizer.flush();
+  EXPECT_EQ(0, memcmp(reference.pixels(), vram.pixels(), vram.sizeInBytes()));
+
+  // textured primitive drawn over its own texture
+  readState.texpageX = 0;
+  readState.texpageY = 0;
+  Rasterizer::drawQuad(reference, readState, readVertices);
+  tiledRasterizer.drawQuad(vram, Rasterizer::nativeTarget(vram), readState, readVertices);
+  tiledRasterizer.flush();
+  EXPECT_EQ(0, memcmp(reference.pixels(), vram.pixels(), vram.sizeInBytes()));
+}
+
+
+TEST_F(TiledRasterizerTest, lookupTableUnderFramebufferTest) {
+  Vram<psxVramHeight()> reference;
+  Vram<psxVramHeight()> vram;
+  __fillTestPattern(reference, true);
+  __fillTestPattern(vram, true);
+  TiledRasterizer tiledRasterizer(2);
+
+  // usual layout: framebuffer (0,0 - 320x240), texture page on the right (640,0), lookup table below framebuffer (0,480)
+  RasterState state;
+  state.clipArea = Rectangle{ 0, 319, 0, 239 };
+  state.isTextured = true;
+  state.colorMode = TextureColorMode::lookupTable4bit;
+  state.texpageX = 640;
+  state.texpageY = 0;
+  state.clutX = 0;
+  state.clutY = 480;
+  RasterVertex vertices[4];
+  for (int quad = 0; quad < 4; ++quad) {
+    for (int i = 0; i < 4; ++i) {
+      vertices[i].x = quad*60 + (i & 1)*100;
+      vertices[i].y = quad*40 + (i >> 1)*100;
+      vertices[i].u = (uint32_t)(i & 1)*64u;
+      vertices[i].v = (uint32_t)(i >> 1)*64u;
+      vertices[i].color = 0x808080u;
+    }
+    Rasterizer::drawQuad(reference, state, vertices);
+    tiledRasterizer.drawQuad(vram, Rasterizer::nativeTarget(vram), state, vertices);
+  }
+  EXPECT_EQ((size_t)8, tiledRasterizer.pendingCount()); // no hazard -> not flushed
+
+  // primitive overwriting lookup table -> pending primitives flushed first
+  RasterState clutState;
+  clutState.clipArea = Rectangle{ 0, 1023, 0, 511 };
+  RasterVertex clutVertices[3];
+  clutVertices[0].x = 0;
+  clutVertices[0].y = 478;
+  clutVertices[1].x = 40;
+  clutVertices[1].y = 478;
+  clutVertices[2].x = 0;
+  clutVertices[2].y = 486;
+  for (int i = 0; i < 3; ++i)
+    clutVertices[i].color = 0x3050F0u;
+  Rasterizer::drawTriangle(reference, clutState, clutVertices[0], clutVertices[1], clutVertices[2]);
+  tiledRasterizer.drawTriangle(vram, Rasterizer::nativeTarget(vram), clutState, clutVertices[0], clutVertices[1], clutVertices[2]);
+  EXPECT_EQ((size_t)1, tiledRasterizer.pendingCount());
+
+  // textured primitive reading modified lookup table -> flushed first
+  Rasterizer::drawQuad(reference, state, vertices);
+  tiledRasterizer.drawQuad(vram, Rasterizer::nativeTarget(vram), state, vertices);
+  EXPECT_EQ((size_t)2, tiledRasterizer.pendingCount());
+  tiledRasterizer.flush();
+  EXPECT_EQ(0, memcmp(reference.pixels(), vram.pixels(), vram.sizeInBytes()));
+}
+
+TEST_F(TiledRasterizerTest, vramChangeTest) {
+  Vram<psxVramHeight()> reference;
+  Vram<psxVramHeight()> vram;
+  Vram<psxVramHeight()> otherVram; // blank
+  __fillTestPattern(reference, true);
+  __fillTestPattern(vram, true);
+  TiledRasterizer tiledRasterizer(2);
+
+  TestRandom random;
+  RasterState state;
+  RasterVertex vertices[3];
+  do {
+    __createRandomTriangle(random, state, vertices);
+  } while (!state.isTextured);
+  Rasterizer::drawTriangle(reference, state, vertices[0], vertices[1], vertices[2]);
+  tiledRasterizer.drawTriangle(vram, Rasterizer::nativeTarget(vram), state, vertices[0], vertices[1], vertices[2]);
+  vram.clearDirtyFlags();
+
+  // other VRAM -> pending primitive flushed into VRAM used to draw it (textures read from same VRAM)
+  tiledRasterizer.drawTriangle(otherVram, Rasterizer::nativeTarget(otherVram), state, vertices[0], vertices[1], vertices[2]);
+  EXPECT_EQ((size_t)1, tiledRasterizer.pendingCount());
+  EXPECT_EQ(0, memcmp(reference.pixels(), vram.pixels(), vram.sizeInBytes()));
+  EXPECT_NE((uint64_t)0, vram.dirtyPages());
+  EXPECT_EQ((uint64_t)0, otherVram.dirtyPages());
+
+  tiledRasterizer.flush();
+  EXPECT_TRUE(tiledRasterizer.isEmpty());
+  tiledRasterizer.flush(); // nothing pending
+}
+
+// -- upscaled target -- --
+
+TEST_F(TiledRasterizerTest, upscaledTargetTest) {
+  Vram<znArcadeVramHeight()> textures;
+  __fillTestPattern(textures, true);
+  const long scaleX = 2, scaleY = 3;
+  std::vector<uint16_t> referencePixels(vramWidth()*scaleX * znArcadeVramHeight()*scaleY, 0);
+  std::vector<uint16_t> pixels(referencePixels.size(), 0);
+
+  RasterTarget referenceTarget;
+  referenceTarget.pixels = referencePixels.data();
+  referenceTarget.rowLength = vramWidth()*scaleX;
+  referenceTarget.width = (long)vramWidth()*scaleX;
+  referenceTarget.height = (long)znArcadeVramHeight()*scaleY;
+  referenceTarget.scaleX = scaleX;
+  referenceTarget.scaleY = scaleY;
+  RasterTarget target = referenceTarget;
+  target.pixels = pixels.data();
+
+  TiledRasterizer tiledRasterizer(3);
+  TestRandom random;
+  RasterState state;
+  RasterVertex vertices[3];
+  for (int i = 0; i < 100; ++i) {
+    __createRandomTriangle(random, state, vertices);
+    Rectangle drawnArea;
+    Rasterizer::rasterizeTriangle(textures, referenceTarget, state, vertices[0], vertices[1], vertices[2],
+                                  Rasterizer::fullTargetArea(referenceTarget), drawnArea);
+    tiledRasterizer.drawTriangle(textures, target, state, vertices[0], vertices[1], vertices[2]);
+  }
+  tiledRasterizer.flush();
+
+  EXPECT_EQ(0, memcmp(referencePixels.data(), pixels.data(), pixels.size()*sizeof(uint16_t)));
+  EXPECT_FALSE(textures.isRegionDirty(0, 0, 512, 400)); // upscaled target -> VRAM not modified
+}
@@ -0,0 +1,200 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#include <gtest/gtest.h>
+#include <display/vram.h>
+
+using namespace display;
+
+class VramTest : public testing::Test {
+public:
+protected:
+  //static void SetUpTestCase() {}
+  //static void TearDownTestCase() {}
+
+  void SetUp() override {}
+  void TearDown() override {}
+};
+
+
+TEST_F(VramTest, accessorsTest) {
+  Vram<psxVramHeight()> psxVram;
+  EXPECT_EQ((unsigned long)1024u, psxVram.width());
+  EXPECT_EQ((unsigned long)512u, psxVram.height());
+  EXPECT_EQ((size_t)1024u*512u*2u, psxVram.sizeInBytes());
+  EXPECT_EQ((unsigned long)16u, psxVram.pageColumns());
+  EXPECT_EQ((unsigned long)2u, psxVram.pageRows());
+  EXPECT_EQ((unsigned long)32u, psxVram.pageCount());
+  EXPECT_EQ((unsigned long)32u, psxVram.rowBandCount());
+  ASSERT_TRUE(psxVram.pixels() != nullptr);
+  EXPECT_EQ((uintptr_t)0, (uintptr_t)psxVram.pixels() & (vramAlignment() - 1u));
+  EXPECT_EQ((uint16_t)0, psxVram.read(0, 0));
+  EXPECT_EQ((uint16_t)0, psxVram.read(1023, 511));
+  EXPECT_EQ((uint64_t)0, psxVram.generation());
+  EXPECT_EQ((uint64_t)0, psxVram.dirtyPages());
+  EXPECT_EQ((uint64_t)0, psxVram.dirtyRowBands());
+
+  Vram<znArcadeVramHeight()> znVram;
+  EXPECT_EQ((unsigned long)1024u, znVram.width());
+  EXPECT_EQ((unsigned long)1024u, znVram.height());
+  EXPECT_EQ((size_t)1024u*1024u*2u, znVram.sizeInBytes());
+  EXPECT_EQ((unsigned long)4u, znVram.pageRows());
+  EXPECT_EQ((unsigned long)64u, znVram.pageCount());
+  EXPECT_EQ((unsigned long)64u, znVram.rowBandCount());
+  ASSERT_TRUE(znVram.pixels() != nullptr);
+  EXPECT_EQ((uintptr_t)0, (uintptr_t)znVram.pixels() & (vramAlignment() - 1u));
+}
+
+TEST_F(VramTest, pixelAccessTest) {
+  Vram<psxVramHeight()> vram;
+  vram.row(2)[5] = 0x7FFFu;
+  EXPECT_EQ((uint16_t)0x7FFFu, vram.read(5, 2));
+  EXPECT_EQ((uint16_t)0x7FFFu, vram.pixels()[2*1024 + 5]);
+  EXPECT_EQ((uint16_t)0x7FFFu, vram.read(1024 + 5, 512 + 2)); // wrap-around
+  EXPECT_EQ(vram.row(2), vram.row(514));
+
+  Vram<psxVramHeight()> moved(std::move(vram));
+  EXPECT_EQ((uint16_t)0x7FFFu, moved.read(5, 2));
+  EXPECT_TRUE(vram.pixels() == nullptr);
+}
+
+TEST_F(VramTest, pageIndexTest) {
+  EXPECT_EQ((unsigned long)0, Vram<psxVramHeight()>::pageIndex(0, 0));
+  EXPECT_EQ((unsigned long)0, Vram<psxVramHeight()>::pageIndex(63, 255));
+  EXPECT_EQ((unsigned long)1, Vram<psxVramHeight()>::pageIndex(64, 0));
+  EXPECT_EQ((unsigned long)15, Vram<psxVramHeight()>::pageIndex(1023, 0));
+  EXPECT_EQ((unsigned long)16, Vram<psxVramHeight()>::pageIndex(0, 256));
+  EXPECT_EQ((unsigned long)31, Vram<psxVramHeight()>::pageIndex(1023, 511));
+  EXPECT_EQ((unsigned long)0, Vram<psxVramHeight()>::pageIndex(1024, 512));
+  EXPECT_EQ((unsigned long)63, Vram<znArcadeVramHeight()>::pageIndex(1023, 1023));
+  EXPECT_EQ((unsigned long)32, Vram<znArcadeVramHeight()>::pageIndex(0, 512));
+}
+
+TEST_F(VramTest, regionBitsTest) {
+  using PsxVram = Vram<psxVramHeight()>;
+  EXPECT_EQ((uint64_t)0x1u, PsxVram::regionPageBits(0, 0, 1, 1));
+  EXPECT_EQ((uint64_t)0x1u, PsxVram::regionPageBits(0, 0, 64, 256));
+  EXPECT_EQ((uint64_t)0x3u, PsxVram::regionPageBits(0, 0, 65, 256));
+  EXPECT_EQ((uint64_t)0x10001u, PsxVram::regionPageBits(0, 0, 64, 257));
+  EXPECT_EQ((uint64_t)0x6u, PsxVram::regionPageBits(127, 0, 2, 1));
+  EXPECT_EQ((uint64_t)0xFFFFFFFFu, PsxVram::regionPageBits(0, 0, 1024, 512));
+  EXPECT_EQ((uint64_t)0xFFFFFFFFu, PsxVram::regionPageBits(5, 3, 2048, 2048));
+  EXPECT_EQ((uint64_t)0x8001u, PsxVram::regionPageBits(1020, 0, 8, 1));        // horizontal wrap-around
+  EXPECT_EQ((uint64_t)0x80000001u, PsxVram::regionPageBits(1020, 510, 8, 4) & 0x80000001u); // vertical wrap-around
+  EXPECT_EQ((uint64_t)0x80018001u, PsxVram::regionPageBits(1020, 510, 8, 4));
+
+  EXPECT_EQ((uint64_t)0x1u, PsxVram::regionRowBandBits(0, 16));
+  EXPECT_EQ((uint64_t)0x3u, PsxVram::regionRowBandBits(15, 2));
+  EXPECT_EQ((uint64_t)0x80000001u, PsxVram::regionRowBandBits(510, 4));
+  EXPECT_EQ((uint64_t)0xFFFFFFFFu, PsxVram::regionRowBandBits(0, 512));
+  EXPECT_EQ((uint64_t)0, PsxVram::regionRowBandBits(0, 0));
+
+  using ZnVram = Vram<znArcadeVramHeight()>;
+  EXPECT_EQ(~(uint64_t)0, ZnVram::regionPageBits(0, 0, 1024, 1024));
+  EXPECT_EQ(~(uint64_t)0, ZnVram::regionRowBandBits(0, 1024));
+  EXPECT_EQ((uint64_t)0x8000000000000001uLL, ZnVram::regionRowBandBits(1020, 8));
+  EXPECT_EQ((uint64_t)0x0001000000000000uLL, ZnVram::regionPageBits(0, 768, 1, 1));
+}
+
+TEST_F(VramTest, dirtyTrackingTest) {
+  Vram<psxVramHeight()> vram;
+  EXPECT_FALSE(vram.isRegionDirty(0, 0, 1024, 512));
+
+  vram.markDirty(70, 20, 10, 10);
+  EXPECT_EQ((uint64_t)1u, vram.generation());
+  EXPECT_EQ((uint64_t)0x2u, vram.dirtyPages());
+  EXPECT_EQ((uint64_t)0x2u, vram.dirtyRowBands());
+  EXPECT_TRUE(vram.isPageDirty(1, 0));
+  EXPECT_FALSE(vram.isPageDirty(0, 0));
+  EXPECT_TRUE(vram.isRegionDirty(64, 0, 64, 256));
+  EXPECT_TRUE(vram.isRegionDirty(75, 25, 1, 1));
+  EXPECT_FALSE(vram.isRegionDirty(0, 0, 64, 256));    // other page
+  EXPECT_FALSE(vram.isRegionDirty(64, 100, 64, 100)); // other row bands
+  EXPECT_FALSE(vram.isRegionDirty(70, 20, 0, 0));     // empty region
+
+  vram.markDirty(70, 20, 0, 5); // empty -> ignored
+  EXPECT_EQ((uint64_t)1u, vram.generation());
+
+  vram.clearDirtyFlags();
+  EXPECT_EQ((uint64_t)0, vram.dirtyPages());
+  EXPECT_EQ((uint64_t)0, vram.dirtyRowBands());
+  EXPECT_FALSE(vram.isRegionDirty(0, 0, 1024, 512));
+  EXPECT_EQ((uint64_t)1u, vram.pageGeneration(1)); // stamps not cleared
+
+  vram.markAllDirty();
+  EXPECT_EQ((uint64_t)2u, vram.generation());
+  EXPECT_EQ((uint64_t)0xFFFFFFFFu, vram.dirtyPages());
+  EXPECT_EQ((uint64_t)0xFFFFFFFFu, vram.dirtyRowBands());
+  for (unsigned long i = 0; i < vram.pageCount(); ++i) {
+    EXPECT_EQ((uint64_t)2u, vram.pageGeneration(i));
+  }
+}
+
+TEST_F(VramTest, synchronizedRegionTest) {
+  Vram<psxVramHeight()> vram;
+  vram.markSynchronized(70, 20, 10, 10);
+  EXPECT_EQ((uint64_t)1u, vram.generation());
+  EXPECT_EQ((uint64_t)1u, vram.pageGeneration(1));
+  EXPECT_EQ((uint64_t)0, vram.dirtyPages());
+  EXPECT_EQ((uint64_t)0, vram.dirtyRowBands());
+  EXPECT_FALSE(vram.isRegionDirty(70, 20, 10, 10));
+
+  vram.markSynchronized(70, 20, 0, 10); // empty -> ignored
+  EXPECT_EQ((uint64_t)1u, vram.generation());
+}
+
+TEST_F(VramTest, generationStampsTest) {
+  Vram<znArcadeVramHeight()> vram;
+  EXPECT_EQ((uint64_t)0, vram.regionGeneration(0, 0, 256, 256));
+
+  vram.markDirty(0, 0, 64, 1);     // page 0
+  vram.markDirty(128, 0, 64, 1);   // page 2
+  vram.markDirty(0, 768, 1, 1);    // page 48
+  EXPECT_EQ((uint64_t)3u, vram.generation());
+  EXPECT_EQ((uint64_t)1u, vram.pageGeneration(0));
+  EXPECT_EQ((uint64_t)0, vram.pageGeneration(1));
+  EXPECT_EQ((uint64_t)2u, vram.pageGeneration(2));
+  EXPECT_EQ((uint64_t)3u, vram.pageGeneration(48));
+
+  EXPECT_EQ((uint64_t)1u, vram.regionGeneration(0, 0, 128, 256));
+  EXPECT_EQ((uint64_t)2u, vram.regionGeneration(0, 0, 256, 256));
+  EXPECT_EQ((uint64_t)0, vram.regionGeneration(64, 0, 64, 256));
+  EXPECT_EQ((uint64_t)3u, vram.regionGeneration(0, 512, 64, 512));
+  EXPECT_EQ((uint64_t)3u, vram.regionGeneration(0, 0, 1024, 1024));
+  EXPECT_EQ((uint64_t)1u, vram.blockGeneration(0, 0));
+  EXPECT_EQ((uint64_t)0, vram.blockGeneration(1, 0));
+  EXPECT_EQ((uint64_t)2u, vram.blockGeneration(2, 0));
+  EXPECT_EQ((uint64_t)0, vram.blockGeneration(0, 1));
+  EXPECT_EQ((uint64_t)3u, vram.blockGeneration(0, 48));
+}
+
+TEST_F(VramTest, blockGenerationStampsTest) {
+  Vram<psxVramHeight()> vram;
+  EXPECT_EQ((uint64_t)0, vram.regionBlockGeneration(0, 480, 16, 1));
+
+  vram.markDirty(0, 240, 320, 240);  // framebuffer: same page as lookup table (0,480), other row bands
+  EXPECT_EQ((uint64_t)1u, vram.regionGeneration(0, 480, 16, 1));
+  EXPECT_EQ((uint64_t)0, vram.regionBlockGeneration(0, 480, 16, 1));
+  vram.markDirty(640, 480, 64, 16); // same row band, other page
+  EXPECT_EQ((uint64_t)0, vram.regionBlockGeneration(0, 480, 16, 1));
+  EXPECT_EQ((uint64_t)2u, vram.regionBlockGeneration(0, 480, 1024, 1));
+
+  vram.markDirty(1016, 490, 16, 1); // wraps around -> same block
+  EXPECT_EQ((uint64_t)3u, vram.regionBlockGeneration(0, 480, 16, 1));
+  EXPECT_EQ((uint64_t)3u, vram.blockGeneration(15, 30));
+  vram.markAllDirty();
+  EXPECT_EQ((uint64_t)4u, vram.regionBlockGeneration(64, 0, 1, 1));
+
+  Vram<psxVramHeight()> movedVram(std::move(vram));
+  EXPECT_EQ((uint64_t)4u, movedVram.regionBlockGeneration(0, 480, 16, 1));
+}
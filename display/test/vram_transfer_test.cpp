@@ -0,0 +1,170 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+*******************************************************************************/
+#include <gtest/gtest.h>
+#include <vector>
+#include <display/vram_transfer.h>
+
+using namespace display;
+
+class VramTransferTest : public testing::Test {
+public:
+protected:
+  //static void SetUpTestCase() {}
+  //static void TearDownTestCase() {}
+
+  void SetUp() override {}
+  void TearDown() override {}
+};
+
+// pack texels as 32-bit words (2 texels per word, last one padded)
+static std::vector<uint32_t> __packTexels(const std::vector<uint16_t>& texels) {
+  std::vector<uint32_t> words((texels.size() + 1u) >> 1, 0);
+  for (size_t i = 0; i < texels.size(); ++i)
+    words[i >> 1] |= ((uint32_t)texels[i] << ((i & 1u) ? 16 : 0));
+  return words;
+}
+static std::vector<uint16_t> __createTexels(size_t length) {
+  std::vector<uint16_t> texels(length);
+  for (size_t i = 0; i < length; ++i)
+    texels[i] = (uint16_t)((i * 37u + 1u) & 0x7FFFu);
+  return texels;
+}
+
+
+TEST_F(VramTransferTest, startTest) {
+  VramTransfer transfer;
+  EXPECT_FALSE(transfer.isActive());
+
+  transfer.start(0x00200010u, 0x00400020u, psxVramHeight());
+  EXPECT_TRUE(transfer.isActive());
+  EXPECT_EQ((unsigned long)0x10u, transfer.x());
+  EXPECT_EQ((unsigned long)0x20u, transfer.y());
+  EXPECT_EQ((unsigned long)0x20u, transfer.width());
+  EXPECT_EQ((unsigned long)0x40u, transfer.height());
+  EXPECT_EQ((unsigned long)0, transfer.currentRow());
+  EXPECT_EQ((unsigned long)0, transfer.currentColumn());
+  EXPECT_EQ((unsigned long)0x20u*0x40u, transfer.remainingPixels());
+
+  transfer.start(0xFFFFFFFFu, 0, psxVramHeight()); // out of range coords + size 0 (max size)
+  EXPECT_EQ((unsigned long)1023u, transfer.x());
+  EXPECT_EQ((unsigned long)511u, transfer.y());
+  EXPECT_EQ((unsigned long)1024u, transfer.width());
+  EXPECT_EQ((unsigned long)512u, transfer.height());
+  transfer.start(0xFFFFFFFFu, 0, znArcadeVramHeight());
+  EXPECT_EQ((unsigned long)1023u, transfer.y());
+  EXPECT_EQ((unsigned long)1024u, transfer.height());
+
+  transfer.cancel();
+  EXPECT_FALSE(transfer.isActive());
+}
+
+TEST_F(VramTransferTest, singleBlockTest) {
+  Vram<psxVramHeight()> vram;
+  auto texels = __createTexels(7*3);
+  auto words = __packTexels(texels);
+  words.push_back(0xA5A5A5A5u); // next command
+
+  VramTransfer transfer;
+  transfer.start((5u << 16) | 3u, (3u << 16) | 7u, psxVramHeight()); // odd width + odd total size
+  EXPECT_EQ((int)11, transfer.write(vram, words.data(), (int)words.size(), 0, false));
+  EXPECT_FALSE(transfer.isActive());
+
+  for (unsigned long y = 0; y < 3u; ++y) {
+    for (unsigned long x = 0; x < 7u; ++x) {
+      EXPECT_EQ(texels[y*7u + x], vram.read(3u + x, 5u + y));
+    }
+    EXPECT_EQ((uint16_t)0, vram.read(2u, 5u + y));
+    EXPECT_EQ((uint16_t)0, vram.read(10u, 5u + y));
+  }
+  EXPECT_EQ((uint16_t)0, vram.read(3u, 8u));
+  EXPECT_TRUE(vram.isRegionDirty(3, 5, 7, 3));
+  EXPECT_EQ((uint64_t)1u, vram.generation());
+
+  EXPECT_EQ((int)0, transfer.write(vram, words.data(), (int)words.size(), 0, false)); // no transfer pending
+}
+
+TEST_F(VramTransferTest, splitBlocksTest) {
+  Vram<psxVramHeight()> vram;
+  auto texels = __createTexels(13*9);
+  auto words = __packTexels(texels);
+
+  for (int blockSize = 1; blockSize <= 8; ++blockSize) {
+    VramTransfer transfer;
+    transfer.start((100u << 16) | 200u, (9u << 16) | 13u, psxVramHeight());
+    int totalSize = 0;
+    for (size_t i = 0; i < words.size(); i += (size_t)blockSize) {
+      EXPECT_TRUE(transfer.isActive());
+      int currentSize = (i + (size_t)blockSize <= words.size()) ? blockSize : (int)(words.size() - i);
+      totalSize += transfer.write(vram, &words[i], currentSize, 0, false);
+    }
+    EXPECT_FALSE(transfer.isActive());
+    EXPECT_EQ((int)words.size(), totalSize);
+
+    for (unsigned long y = 0; y < 9u; ++y) {
+      for (unsigned long x = 0; x < 13u; ++x) {
+        EXPECT_EQ(texels[y*13u + x], vram.read(200u + x, 100u + y));
+      }
+    }
+    memset(vram.pixels(), 0, vram.sizeInBytes());
+  }
+}
+
+TEST_F(VramTransferTest, wrapAroundTest) {
+  Vram<psxVramHeight()> vram;
+  auto texels = __createTexels(40*4);
+  auto words = __packTexels(texels);
+
+  VramTransfer transfer;
+  transfer.start((510u << 16) | 1000u, (4u << 16) | 40u, psxVramHeight());
+  EXPECT_EQ((int)words.size(), transfer.write(vram, words.data(), (int)words.size(), 0, false));
+  for (unsigned long y = 0; y < 4u; ++y) {
+    for (unsigned long x = 0; x < 40u; ++x) {
+      EXPECT_EQ(texels[y*40u + x], vram.read((1000u + x) & 1023u, (510u + y) & 511u));
+    }
+  }
+  EXPECT_TRUE(vram.isRegionDirty(0, 0, 16, 2));
+  EXPECT_TRUE(vram.isRegionDirty(1000, 510, 24, 2));
+}
+
+TEST_F(VramTransferTest, maskBitsTest) {
+  Vram<psxVramHeight()> vram;
+  auto texels = __createTexels(24*2);
+  auto words = __packTexels(texels);
+  for (unsigned long x = 0; x < 24u; x += 3u)
+    vram.row(0)[x] = 0x8001u; // protected texels
+
+  VramTransfer transfer;
+  transfer.start(0, (2u << 16) | 24u, psxVramHeight());
+  EXPECT_EQ((int)words.size(), transfer.write(vram, words.data(), (int)words.size(), 0, true)); // check mask
+  for (unsigned long x = 0; x < 24u; ++x) {
+    if (x % 3u == 0)
+      EXPECT_EQ((uint16_t)0x8001u, vram.read(x, 0));
+    else
+      EXPECT_EQ(texels[x], vram.read(x, 0));
+    EXPECT_EQ(texels[24u + x], vram.read(x, 1));
+  }
+
+  transfer.start(0, (2u << 16) | 24u, psxVramHeight());
+  EXPECT_EQ((int)words.size(), transfer.write(vram, words.data(), (int)words.size(), vramMaskBit(), false)); // force mask
+  for (unsigned long x = 0; x < 24u; ++x) {
+    EXPECT_EQ((uint16_t)(texels[x] | 0x8000u), vram.read(x, 0));
+    EXPECT_EQ((uint16_t)(texels[24u + x] | 0x8000u), vram.read(x, 1));
+  }
+
+  transfer.start(0, (2u << 16) | 24u, psxVramHeight());
+  EXPECT_EQ((int)words.size(), transfer.write(vram, words.data(), (int)words.size(), vramMaskBit(), true)); // all protected
+  for (unsigned long x = 0; x < 24u; ++x) {
+    EXPECT_EQ((uint16_t)(texels[x] | 0x8000u), vram.read(x, 0));
+  }
+}
@@ -0,0 +1,411 @@
+/*******************************************************************************
+Pandora GS - PSEmu-compatible GPU driver
+Copyright (C) 2021  Romain Vinders
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details (LICENSE file).
+--------------------------------------------------------------------------------
+Description : GPU benchmark
+              This tool measures the throughput of software rendering kernels.
+Note : Should be built in release mode to obtain meaningful results.
+*******************************************************************************/
+#include <cstdio>
+#include <cstdint>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <display/types.h>
+#include <display/status_register.h>
+#include <display/renderer.h>
+#include <display/vram.h>
+#include <display/primitives.h>
+#include <display/draw_list.h>
+#include <display/rasterizer.h>
+#include <display/texel_kernels.h>
+#include <display/_private/_command_scan.h>
+
+using namespace display;
+
+#define __MIN_DURATION_MS 200
+
+// run benchmark function until min duration is reached -> returns millions of items per second
+template <typename _Function>
+static double __measureThroughput(size_t itemsPerRun, _Function&& function, int minDurationMs = __MIN_DURATION_MS) {
+  function(); // warm-up (caches, lazy initialization)
+
+  uint64_t runCount = 0;
+  auto start = std::chrono::steady_clock::now();
+  std::chrono::steady_clock::duration elapsed;
+  do {
+    for (int i = 0; i < 16; ++i)
+      function();
+    runCount += 16u;
+    elapsed = std::chrono::steady_clock::now() - start;
+  } while (elapsed < std::chrono::milliseconds(minDurationMs));
+
+  double seconds = std::chrono::duration<double>(elapsed).count();
+  return (double)(runCount*itemsPerRun) / seconds / 1000000.0;
+}
+
+// prevent optimizer from removing benchmarked code
+static volatile uint32_t g_sink = 0;
+
+
+// -- texel kernels -- ---------------------------------------------------------
+
+static const char* __toInstructionSetName(KernelInstructionSet instructionSet) {
+  switch (instructionSet) {
+    case KernelInstructionSet::ssse3: return "SSSE3";
+    case KernelInstructionSet::avx2:  return "AVX2";
+    case KernelInstructionSet::neon:  return "NEON";
+    default: return "scalar";
+  }
+}
+
+// measure each texel kernel with each supported instruction set (texture page rows: 256 texels)
+static void __runTexelKernelBenchmarks() {
+  printf("Texel kernels (Mtexels/s):\n"
+         "  %-8s %12s %12s %12s %12s\n", "ISA", "4-bit CLUT", "8-bit CLUT", "RGBA8888", "RGBA5551");
+
+  const size_t texelCount = 256u*256u;
+  std::vector<uint16_t> indexes(texelCount);
+  std::vector<uint16_t> lookupTable(256);
+  for (size_t i = 0; i < texelCount; ++i)
+    indexes[i] = (uint16_t)(i * 0x9E37u);
+  for (size_t i = 0; i < lookupTable.size(); ++i)
+    lookupTable[i] = (uint16_t)(i * 0x0421u);
+  std::vector<uint16_t> texels(texelCount);
+  std::vector<uint32_t> pixels8888(texelCount);
+  std::vector<uint8_t> stpMask(texelCount);
+
+  const KernelInstructionSet initialSet = TexelKernels::instructionSet();
+  const KernelInstructionSet instructionSets[] = { KernelInstructionSet::scalar, KernelInstructionSet::ssse3,
+                                                   KernelInstructionSet::avx2, KernelInstructionSet::neon };
+  for (auto instructionSet : instructionSets) {
+    if (!TexelKernels::setInstructionSet(instructionSet))
+      continue;
+
+    double lookupTable4bit = __measureThroughput(texelCount, [&]() {
+      for (size_t row = 0; row < texelCount; row += 256u)
+        TexelKernels::expandLookupTable4bit(&indexes[row >> 2], 64u, lookupTable.data(), &texels[row]);
+      g_sink = g_sink + texels[77];
+    });
+    double lookupTable8bit = __measureThroughput(texelCount, [&]() {
+      for (size_t row = 0; row < texelCount; row += 256u)
+        TexelKernels::expandLookupTable8bit(&indexes[row >> 1], 128u, lookupTable.data(), &texels[row]);
+      g_sink = g_sink + texels[77];
+    });
+    double rgba8888 = __measureThroughput(texelCount, [&]() {
+      TexelKernels::convertToRgba8888(indexes.data(), texelCount, pixels8888.data(), stpMask.data());
+      g_sink = g_sink + pixels8888[77] + stpMask[77];
+    });
+    double rgba5551 = __measureThroughput(texelCount, [&]() {
+      TexelKernels::convertToRgba5551(indexes.data(), texelCount, texels.data(), stpMask.data());
+      g_sink = g_sink + texels[77] + stpMask[77];
+    });
+    printf("  %-8s %12.1f %12.1f %12.1f %12.1f%s\n", __toInstructionSetName(instructionSet),
+           lookupTable4bit, lookupTable8bit, rgba8888, rgba5551, (instructionSet == initialSet) ? "  (default)" : "");
+  }
+  TexelKernels::setInstructionSet(initialSet);
+}
+
+
+// -- span pipelines -- --------------------------------------------------------
+
+#define __PIPELINE_DURATION_MS 20
+#define __PIPELINE_QUAD_SIZE   256
+
+// measure per-pixel cost of each span pipeline variant (256x256 quads drawn in VRAM)
+static void __runSpanPipelineBenchmarks() {
+  printf("\nSpan pipelines (ns/pixel):\n"
+         "  %-40s %7s %7s %7s %7s %7s | %7s %7s %7s %7s %7s\n", "variant",
+         "opaque", "mean", "add", "sub", "quarter", "opaque", "mean", "add", "sub", "quarter");
+  printf("  %-40s %-39s | %s\n", "", "  (no mask check)", "  (mask check)");
+
+  std::unique_ptr<Vram<psxVramHeight()> > vram(new Vram<psxVramHeight()>());
+  for (unsigned long y = 0; y < psxVramHeight(); ++y) {
+    for (unsigned long x = 0; x < vramWidth(); ++x)
+      vram->row(y)[x] = (uint16_t)((x * 0x9E37u + y * 0x79B9u) ^ (x >> 3));
+  }
+  std::unique_ptr<uint16_t[]> decodedTexture(new uint16_t[256*256]);
+  for (size_t i = 0; i < (size_t)256*256; ++i)
+    decodedTexture[i] = vram->pixels()[i];
+
+  RasterVertex quad[4];
+  for (int i = 0; i < 4; ++i) {
+    quad[i].x = (i & 1) ? 512 + __PIPELINE_QUAD_SIZE : 512;
+    quad[i].y = (i & 2) ? __PIPELINE_QUAD_SIZE : 0;
+    quad[i].u = (i & 1) ? 255 : 0;
+    quad[i].v = (i & 2) ? 255 : 0;
+    quad[i].color = 0x406080u + 0x102010u*(uint32_t)i;
+  }
+  const RasterTarget target = Rasterizer::nativeTarget(*vram);
+  const Rectangle targetArea = Rasterizer::fullTargetArea(target);
+
+  const char* sourceNames[] = { "untextured", "4-bit", "8-bit", "15-bit", "decoded" };
+  const TextureColorMode colorModes[] = { TextureColorMode::lookupTable4bit, TextureColorMode::lookupTable4bit,
+                                          TextureColorMode::lookupTable8bit, TextureColorMode::directColor15bit,
+                                          TextureColorMode::lookupTable4bit };
+  const BlendingMode blendingModes[] = { BlendingMode::mean, BlendingMode::add, BlendingMode::subtract, BlendingMode::addQuarter };
+  for (int source = 0; source < 5; ++source) {
+    for (int variant = 0; variant < 16; ++variant) { // window | raw | shaded | dithered
+      const bool hasWindow = (variant & 0x8) != 0, isRaw = (variant & 0x4) != 0;
+      const bool isShaded = (variant & 0x2) != 0, isDithered = (variant & 0x1) != 0;
+      if ((source == 0 && (hasWindow || isRaw || (isDithered && !isShaded))) || (isRaw && (isShaded || isDithered)))
+        continue; // options without effect -> same pipeline as another variant
+
+      RasterState state;
+      state.clipArea = Rectangle{ 0, 1023, 0, 511 };
+      state.isTextured = (source != 0);
+      state.colorMode = colorModes[source];
+      state.decodedTexture = (source == 4) ? decodedTexture.get() : nullptr;
+      state.texpageX = 256;
+      state.clutY = 480;
+      state.isRawTexture = isRaw;
+      state.isShaded = isShaded;
+      state.isDithered = isDithered;
+      if (hasWindow) {
+        state.textureWindow.maskWidth = state.textureWindow.maskHeight = 64;
+        state.textureWindow.isEnabled = true;
+      }
+      char label[64];
+      snprintf(label, sizeof(label), "%s%s%s%s%s", sourceNames[source], isRaw ? " raw" : (source ? " modulated" : ""),
+               isShaded ? " gouraud" : "", isDithered ? " dither" : "", hasWindow ? " window" : "");
+      printf("  %-40s", label);
+
+      for (int maskCheck = 0; maskCheck < 2; ++maskCheck) {
+        state.checkMask = (maskCheck != 0);
+        for (int blending = -1; blending < 4; ++blending) {
+          state.isSemiTransparent = (blending >= 0);
+          state.blendingMode = (blending >= 0) ? blendingModes[blending] : BlendingMode::mean;
+          double pixelRate = __measureThroughput((size_t)__PIPELINE_QUAD_SIZE*__PIPELINE_QUAD_SIZE, [&]() {
+            Rectangle drawnArea;
+            Rasterizer::rasterizeTriangle(*vram, target, state, quad[0], quad[1], quad[2], targetArea, drawnArea);
+            Rasterizer::rasterizeTriangle(*vram, target, state, quad[1], quad[2], quad[3], targetArea, drawnArea);
+          }, __PIPELINE_DURATION_MS);
+          printf(" %7.2f", 1000.0 / pixelRate);
+        }
+        printf(maskCheck ? "\n" : " |");
+      }
+    }
+  }
+}
+
+
+// -- lines -- -----------------------------------------------------------------
+
+// measure per-pixel cost of lines (shallow lines: runs of pixels / steep lines: one pixel per step)
+static void __runLineBenchmarks() {
+  printf("\nLines (ns/pixel):\n"
+         "  %-40s %7s %7s %7s\n", "variant", "flat", "gouraud", "dither");
+
+  std::unique_ptr<Vram<psxVramHeight()> > vram(new Vram<psxVramHeight()>());
+  RasterState state;
+  state.clipArea = Rectangle{ 0, 1023, 0, 511 };
+  RasterVertex from, to;
+  from.color = 0x2040F0u;
+  to.color = 0xF08020u;
+
+  const char* labels[] = { "horizontal (1000 px)", "shallow (1000 px, slope 1/10)", "diagonal (500 px)", "steep (500 px, slope 10)" };
+  const long endPoints[][2] = { { 1000, 0 }, { 1000, 100 }, { 500, 500 }, { 50, 500 } };
+  for (int line = 0; line < 4; ++line) {
+    to.x = endPoints[line][0];
+    to.y = endPoints[line][1];
+    const size_t pixelCount = (size_t)((to.x > to.y) ? to.x : to.y) + 1u;
+    printf("  %-40s", labels[line]);
+    for (int variant = 0; variant < 3; ++variant) {
+      state.isShaded = (variant >= 1);
+      state.isDithered = (variant == 2);
+      double pixelRate = __measureThroughput(pixelCount, [&]() {
+        Rasterizer::drawLine(*vram, state, from, to);
+      }, __PIPELINE_DURATION_MS);
+      printf(" %7.2f", 1000.0 / pixelRate);
+    }
+    printf("\n");
+  }
+}
+
+
+// -- GP0 command stream -- ----------------------------------------------------
+
+#define __SCAN_BLOCK_LENGTH 0x10000
+
+// measure poly-line termination scan over long DMA blocks (termination code at the end of each block)
+static void __runCommandScanBenchmarks() {
+  printf("\nPoly-line termination scan (Mwords/s):\n"
+         "  %-40s %10s %10s\n", "variant", "scalar", "vector");
+
+  std::vector<uint32_t> block(__SCAN_BLOCK_LENGTH);
+  const char* labels[] = { "flat poly-line (stride 1)", "shaded poly-line (stride 2)" };
+  for (int stride = 1; stride <= 2; ++stride) {
+    for (size_t i = 0; i < block.size(); ++i) { // colors in odd slots, vertices in even slots
+      block[i] = (i & 1u) ? 0x00406080u
+                          : ((stride == 2) ? 0x50005000u : (uint32_t)(i * 0x00010003u) & 0x01FF03FFu); // shaded: ignored slots
+    }
+    block.back() = 0x55555555u;
+    const int firstIndex = (stride == 2) ? 1 : 0; // shaded: block ends with termination code in color slot
+    double scalar = __measureThroughput(block.size(), [&]() {
+      g_sink = g_sink + (uint32_t)findPolyLineTerminationScalar(block.data(), (int)block.size(), firstIndex, stride);
+    });
+    double vectorized = __measureThroughput(block.size(), [&]() {
+      g_sink = g_sink + (uint32_t)findPolyLineTermination(block.data(), (int)block.size(), firstIndex, stride);
+    });
+    printf("  %-40s %10.1f %10.1f\n", labels[stride - 1], scalar, vectorized);
+  }
+}
+
+
+#define __DISPATCH_COMMAND_COUNT 0x1000
+
+// DMA block of small commands (rendering attributes, NOPs, 1x1 tiles, fills outside of display)
+static std::vector<uint32_t> __createCommandBlock() {
+  std::vector<uint32_t> block;
+  block.reserve(__DISPATCH_COMMAND_COUNT * 2);
+  for (uint32_t i = 0; i < __DISPATCH_COMMAND_COUNT; ++i) {
+    switch (i & 0x7u) {
+      case 0: block.push_back(0xE1000000u | (i & 0x1FFu)); break; // texture page
+      case 1: block.push_back(0xE2000000u); break;                // texture window
+      case 2: block.push_back(0xE5000000u | (i & 0x3FFu)); break; // draw offset
+      case 3: block.push_back(0); break;                          // NOP
+      case 4: block.push_back(0x02102030u);                       // small fill
+              block.push_back((uint32_t)((500u << 16) | ((i >> 3) & 0x3F0u)));
+              block.push_back((uint32_t)((1u << 16) | 16u)); break;
+      default: block.push_back(0x68F8F8F8u);                      // 1x1 tile
+               block.push_back((uint32_t)(((i >> 3) & 0xFFu) << 16 | (i & 0xFFu))); break;
+    }
+  }
+  return block;
+}
+
+// synthetic command handlers (dispatch cost only)
+struct __DispatchState final {
+  uint32_t attributes[8];
+  uint32_t drawCount;
+};
+static void __dispatchNop(__DispatchState&, const uint32_t*) noexcept {}
+static void __dispatchAttribute(__DispatchState& state, const uint32_t* params) noexcept {
+  state.attributes[(*params >> 24) & 0x7u] = *params;
+}
+static void __dispatchDraw(__DispatchState& state, const uint32_t* params) noexcept {
+  state.drawCount += (params[1] & 0xFFu) + 1u;
+}
+struct __DispatchCommand final {
+  void (*handler)(__DispatchState&, const uint32_t*) noexcept;
+  int length;
+};
+
+// measure per-command overhead of GP0 dispatch: one call per command / one call per DMA block,
+// function-pointer table / switch (handlers inlined)
+static void __runCommandDispatchBenchmarks() {
+  printf("\nGP0 command dispatch (Mcommands/s):\n"
+         "  %-40s %10s\n", "variant", "rate");
+
+  std::vector<uint32_t> block = __createCommandBlock();
+  std::unique_ptr<Vram<psxVramHeight()> > vram(new Vram<psxVramHeight()>());
+  StatusRegister status;
+  Renderer renderer;
+  Gp0Parser parser;
+  status.setDrawAreaOrigin(0);
+  status.setDrawAreaEnd((255u << 10) | 255u);
+
+  double rate = __measureThroughput(__DISPATCH_COMMAND_COUNT, [&]() {
+    uint32_t* mem = block.data();
+    int size = (int)block.size();
+    while (size > 0) {
+      int commandSize = parser.runCommand(status, renderer, *vram, mem, size, false);
+      mem += commandSize;
+      size -= commandSize;
+    }
+  });
+  printf("  %-40s %10.1f\n", "parser: one call per command", rate);
+  rate = __measureThroughput(__DISPATCH_COMMAND_COUNT, [&]() {
+    parser.runBuffer(status, renderer, *vram, block.data(), (int)block.size(), false);
+  });
+  printf("  %-40s %10.1f\n", "parser: one call per DMA block", rate);
+
+  __DispatchCommand commandTable[0x100];
+  for (int i = 0; i < 0x100; ++i)
+    commandTable[i] = __DispatchCommand{ __dispatchNop, 1 };
+  commandTable[0x02] = __DispatchCommand{ __dispatchDraw, 3 };
+  commandTable[0x68] = __DispatchCommand{ __dispatchDraw, 2 };
+  for (int i = 0xE1; i <= 0xE6; ++i)
+    commandTable[i] = __DispatchCommand{ __dispatchAttribute, 1 };
+  __DispatchState state{};
+
+  rate = __measureThroughput(__DISPATCH_COMMAND_COUNT, [&]() {
+    const uint32_t* mem = block.data();
+    const uint32_t* end = mem + block.size();
+    while (mem < end) {
+      const __DispatchCommand& command = commandTable[*mem >> 24];
+      command.handler(state, mem);
+      mem += command.length;
+    }
+  });
+  printf("  %-40s %10.1f\n", "synthetic: function-pointer table", rate);
+  rate = __measureThroughput(__DISPATCH_COMMAND_COUNT, [&]() {
+    const uint32_t* mem = block.data();
+    const uint32_t* end = mem + block.size();
+    while (mem < end) {
+      switch (*mem >> 24) {
+        case 0x02: __dispatchDraw(state, mem); mem += 3; break;
+        case 0x68: __dispatchDraw(state, mem); mem += 2; break;
+        case 0xE1: case 0xE2: case 0xE3: case 0xE4: case 0xE5: case 0xE6:
+          __dispatchAttribute(state, mem); ++mem; break;
+        default: ++mem; break;
+      }
+    }
+  });
+  printf("  %-40s %10.1f\n", "synthetic: switch", rate);
+  g_sink = g_sink + state.drawCount;
+}
+
+// -- draw lists -- ------------------------------------------------------------
+
+#define __DECODE_VERTEX_COUNT 0x4000
+
+// measure vertex coords decoding (11-bit sign extension + draw offset): one vertex at a time / vertex streams
+static void __runVertexDecodeBenchmarks() {
+  printf("\nVertex coords decoding (Mvertices/s):\n"
+         "  %-40s %10s %10s\n", "variant", "scalar", "vector");
+
+  std::vector<uint32_t> coords(__DECODE_VERTEX_COUNT);
+  for (size_t i = 0; i < coords.size(); ++i)
+    coords[i] = (uint32_t)(i * 0x00370013u);
+  std::vector<int32_t> x(coords.size()), y(coords.size());
+  const Point drawOffset{ 64, -16 };
+
+  double scalar = __measureThroughput(coords.size(), [&]() {
+    for (size_t i = 0; i < coords.size(); ++i) {
+      x[i] = ((int32_t)(coords[i] << 21) >> 21) + (int32_t)drawOffset.x;
+      y[i] = ((int32_t)(coords[i] << 5) >> 21) + (int32_t)drawOffset.y;
+    }
+    g_sink = g_sink + (uint32_t)x[coords.size() - 1u];
+  });
+  double vectorized = __measureThroughput(coords.size(), [&]() {
+    DrawList::decodeVertexCoords(coords.data(), coords.size(), drawOffset, x.data(), y.data());
+    g_sink = g_sink + (uint32_t)x[coords.size() - 1u];
+  });
+  printf("  %-40s %10.1f %10.1f\n", "draw offset + sign extension", scalar, vectorized);
+}
+
+// ---
+
+int main() {
+  printf("____________________________________________________________\n"
+         "\n GPU BENCHMARK\n"
+         "____________________________________________________________\n\n");
+
+  __runTexelKernelBenchmarks();
+  __runSpanPipelineBenchmarks();
+  __runLineBenchmarks();
+  __runCommandScanBenchmarks();
+  __runCommandDispatchBenchmarks();
+  __runVertexDecodeBenchmarks();
+  return 0;
+}
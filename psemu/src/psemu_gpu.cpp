@@ -14,6 +14,7 @@ GNU General Public License for more details (LICENSE file).
 PSEmu Plugin Developer Kit Header definition - (C)1998 Vision Thing
 This file can be used only to develop PSEmu Plugins. Other usage is highly prohibited.
 *******************************************************************************/
+#include <atomic>
 #include <video/screensaver.h>
 #include <video/message_box.h>
 #include "_generated/library_info.h"
@@ -23,7 +24,11 @@ This file can be used only to develop PSEmu Plugins. Other usage is highly prohi
 #include "display/status_register.h"
 #include "display/status_lock.h"
 #include "display/primitives.h"
+#include "display/draw_list.h"
+#include "display/tiled_rasterizer.h"
+#include "display/command_queue.h"
 #include "display/dma_chain_iterator.h"
+#include "display/vram.h"
 #include "display/window_builder.h"
 #include "display/renderer.h"
 #include "utils/syslog.h"
@@ -46,7 +51,15 @@ display::WindowBuilder g_windowConfigurator = nullptr;
 std::unique_ptr<pandora::video::Window> g_window = nullptr;
 display::Renderer g_renderer;
 display::StatusRegister g_statusRegister;
+display::Gp0Parser g_gp0Parser;
+display::DrawList g_drawList; // primitives of current frame (hardware renderer)
+std::unique_ptr<display::Vram<display::psxVramHeight()> > g_vram = nullptr;
+std::unique_ptr<display::Vram<display::znArcadeVramHeight()> > g_arcadeVram = nullptr; // only allocated with ZiNc interface
+std::unique_ptr<display::DmaChainVisitMap<display::psxRamSize()> > g_dmaVisitMap = nullptr; // DMA chain loop detection
+std::unique_ptr<display::DmaChainVisitMap<display::znArcadeRamSize()> > g_arcadeDmaVisitMap = nullptr; // only allocated with ZiNc interface
 unsigned long g_statusControlHistory[display::controlCommandNumber()];
+std::unique_ptr<display::CommandQueue> g_commandQueue = nullptr; // GP0 worker thread (only if 'enableGpuThread')
+std::atomic<unsigned long> g_statusSnapshot{ 0 }; // copy of GPUSTAT readable while GPU thread processes commands
 Timer g_timer;
 uint32_t g_delayToStart = 0;
 
@@ -89,6 +102,58 @@ extern "C" unsigned long CALLBACK PSEgetLibVersion() {
 #endif
 
 
+// -- GPU thread -- ------------------------------------------------------------
+
+// Process GP0 commands (primitives/attributes) + CPU -> VRAM transfer data
+static void runGp0Commands(uint32_t* mem, int size) noexcept {
+  display::GpuBusyStatusLock gpuBusyLock(g_statusRegister);
+  display::Gp0CommandStatusLock gp0CommandLock(g_statusRegister);
+
+  if (g_statusRegister.getGpuVramHeight() == display::psxVramHeight())
+    g_gp0Parser.runBuffer(g_statusRegister, g_renderer, *g_vram, mem, size, false);
+  else
+    g_gp0Parser.runBuffer(g_statusRegister, g_renderer, *g_arcadeVram, mem, size, false);
+}
+static void runGp1Command(unsigned long gdata) noexcept;
+
+// Store copy of GPUSTAT for emulator thread (not getStatusControlRegister -> avoid triggering 'GPU busy')
+// -> called by GPU thread, or by emulator thread while GPU thread is idle
+static inline void publishStatus() noexcept {
+  g_statusSnapshot.store(g_statusRegister.readStatus((display::StatusBits)0xFFFFFFFFu), std::memory_order_release);
+}
+
+// Process GP0 command block in GPU thread
+static void runQueuedGp0Commands(void*, uint32_t* mem, int size) noexcept {
+  runGp0Commands(mem, size);
+  publishStatus();
+}
+// Process GP1 command in GPU thread (in order with GP0 commands)
+static void runQueuedGp1Command(void*, uint32_t gdata) noexcept {
+  runGp1Command((unsigned long)gdata);
+  publishStatus();
+}
+
+// Copy GP0 words / GP1 command into command queue
+// -> if GPU thread is idle, status register is owned by emulator thread: publish it first (read while commands are pending)
+static inline void pushGpuThreadCommands(const uint32_t* mem, size_t size) noexcept {
+  if (g_commandQueue->isEmpty())
+    publishStatus();
+  g_commandQueue->push(mem, size);
+}
+static inline void pushGpuThreadControl(unsigned long gdata) noexcept {
+  if (g_commandQueue->isEmpty())
+    publishStatus();
+  g_commandQueue->pushControl((uint32_t)gdata);
+}
+
+// Sync point: wait until GPU thread has processed all commands
+// -> required before any access to GPU state (status register, VRAM, parser, draw list) from the emulator thread
+static inline void syncGpuThread() noexcept {
+  if (g_commandQueue != nullptr)
+    g_commandQueue->sync();
+}
+
+
 // -- driver base interface -- -------------------------------------------------
 
 // Driver init (called once)
@@ -116,8 +181,20 @@ extern "C" long CALLBACK GPUinit() {
     loadGlobalConfig(g_configDir, g_videoConfig, g_windowConfigurator.windowConfig(), g_inputConfig);
 
     g_statusRegister = display::StatusRegister{}; // reset status
+    if (g_vram == nullptr && g_arcadeVram == nullptr) {
+      g_vram.reset(new display::Vram<display::psxVramHeight()>());
+      g_dmaVisitMap.reset(new display::DmaChainVisitMap<display::psxRamSize()>());
+    }
     display::StatusRegister::resetControlCommandHistory(g_statusControlHistory);
-    display::Primitives::clearCommandBuffer();
+    g_gp0Parser.clear();
+    if (g_videoConfig.enableTiledRasterizer) {
+      try {
+        g_gp0Parser.enableTiledRasterizer(display::TiledRasterizer::defaultWorkerCount());
+      }
+      catch (const std::exception& exc) { // threads not available -> single-threaded rasterization
+        SysLog::logError(__FILE_NAME__, __LINE__, exc.what());
+      }
+    }
     return PSE_INIT_SUCCESS;
   }
   catch (const std::exception& exc) {
@@ -131,6 +208,13 @@ extern "C" long CALLBACK GPUshutdown() {
   SysLog::logDebug(__FILE_NAME__, __LINE__, "GPUshutdown");
   //TODO: save game/profile association
 
+  g_commandQueue.reset();
+  g_gp0Parser.disableTiledRasterizer();
+  g_gp0Parser.textureCache().clear();
+  g_vram.reset();
+  g_arcadeVram.reset();
+  g_dmaVisitMap.reset();
+  g_arcadeDmaVisitMap.reset();
   SysLog::close();
   return PSE_SUCCESS;
 }
@@ -144,6 +228,7 @@ extern "C" long CALLBACK GPUopen(HWND window) {
 extern "C" long CALLBACK GPUopen(unsigned long* displayId, char* caption, char* configFile) {
 #endif
   SysLog::logDebug(__FILE_NAME__, __LINE__, "GPUopen");
+  g_commandQueue.reset(); // re-opened without GPUclose -> stop previous GPU thread
   try {
     config::RendererProfile rendererConfig;
 
@@ -181,6 +266,8 @@ extern "C" long CALLBACK GPUopen(unsigned long* displayId, char* caption, char*
                                                    g_windowConfigurator.windowConfig().isWideSource);
     g_window->setMinClientAreaSize(viewport.minWindowWidth(), viewport.minWindowHeight());
     g_renderer = display::Renderer(g_window->handle(), displayMode, viewport, rendererConfig);
+    g_drawList.clear();
+    g_gp0Parser.setDrawList(&g_drawList);
 
     // configure sync timer
     g_timer.setSpeedMode(g_videoConfig.enableFramerateLimit ? SpeedMode::normal : SpeedMode::none);
@@ -188,6 +275,16 @@ extern "C" long CALLBACK GPUopen(unsigned long* displayId, char* caption, char*
     if (g_videoConfig.framerateLimit != config::autodetectFramerate())
       g_timer.setFrequency(g_videoConfig.framerateLimit);
 
+    // threaded mode: GP0 commands processed by worker thread
+    if (g_videoConfig.enableGpuThread) {
+      try {
+        g_commandQueue.reset(new display::CommandQueue(runQueuedGp0Commands, runQueuedGp1Command, nullptr));
+      }
+      catch (const std::exception& exc) { // threads not available -> process commands in emulator thread
+        SysLog::logError(__FILE_NAME__, __LINE__, exc.what());
+      }
+    }
+
     // set event handlers
     /*g_window->setWindowHandler(...);
     g_window->setPositionHandler(...);
@@ -204,6 +301,9 @@ extern "C" long CALLBACK GPUopen(unsigned long* displayId, char* caption, char*
 // Close driver (game stopped)
 extern "C" long CALLBACK GPUclose() {
   SysLog::logDebug(__FILE_NAME__, __LINE__, "GPUclose");
+  g_commandQueue.reset(); // process remaining commands + stop GPU thread
+  g_gp0Parser.setDrawList(nullptr);
+  g_drawList.clear();
   g_renderer = display::Renderer{};
 
   pandora::video::restoreScreenSaver();
@@ -217,8 +317,17 @@ extern "C" long CALLBACK GPUclose() {
 
 // ---
 
+// Rasterize pending primitives (before VRAM content is read/displayed)
+static inline void flushPrimitives() noexcept {
+  g_gp0Parser.flushPrimitives();
+}
+
 // Display update (called on every vsync)
 extern "C" void CALLBACK GPUupdateLace() {
+  syncGpuThread();
+  flushPrimitives();
+  g_renderer.drawPrimitives(g_drawList);
+  g_drawList.clear();
   if (g_delayToStart) {
     --g_delayToStart;
     if (g_delayToStart == 0) {
@@ -237,17 +346,41 @@ extern "C" void CALLBACK GPUupdateLace() {
 
 // Read data from GPU status register
 extern "C" unsigned long CALLBACK GPUreadStatus() {
-  return g_statusRegister.getStatusControlRegister();
+  // threaded mode: commands still pending -> GPU busy (no need to wait): last status published by GPU thread
+  if (g_commandQueue != nullptr && !g_commandQueue->isEmpty()) {
+    return g_statusSnapshot.load(std::memory_order_acquire)
+         & ~((unsigned long)display::StatusBits::readyForCommands | (unsigned long)display::StatusBits::readyForDmaBlock);
+  }
+  return g_statusRegister.getStatusControlRegister(); // settled state (GPU thread idle)
+}
+
+// GP1 commands processed by GPU thread in threaded mode (no emulator thread state modified, result not read immediately)
+// -> other commands (reset, display changes...) need a settled state: GPU thread synchronized first
+static constexpr inline bool isGpuThreadGp1Command(display::ControlCommandId commandId) noexcept {
+  return (commandId == display::ControlCommandId::ackIrq1 || commandId == display::ControlCommandId::dmaMode
+       || commandId == display::ControlCommandId::requestGpuInfo || display::StatusRegister::isGpuInfoRequestMirror(commandId));
 }
 
 // Process data sent to GPU status register - GP1 commands
 extern "C" void CALLBACK GPUwriteStatus(unsigned long gdata) {
+  if (g_commandQueue != nullptr) {
+    if (isGpuThreadGp1Command(display::StatusRegister::getGp1CommandId(gdata))) {
+      pushGpuThreadControl(gdata); // processed in order with GP0 commands (no sync)
+      return;
+    }
+    g_commandQueue->sync();
+  }
+  runGp1Command(gdata);
+}
+
+// Run GP1 command (emulator thread, or GPU thread in threaded mode, see 'isGpuThreadGp1Command')
+static void runGp1Command(unsigned long gdata) noexcept {
   auto commandId = display::StatusRegister::getGp1CommandId(gdata);
   switch (commandId) {
     // general GPU status
     case display::ControlCommandId::resetGpu: {
       SysLog::logDebug(__FILE_NAME__, __LINE__, "GP1(00): reset");
-      display::Primitives::clearCommandBuffer();
+      g_gp0Parser.clear();
       g_statusRegister.resetGpu();
       display::StatusRegister::resetControlCommandHistory(g_statusControlHistory);
 
@@ -256,7 +389,7 @@ extern "C" void CALLBACK GPUwriteStatus(unsigned long gdata) {
       break;
     }
     case display::ControlCommandId::clearCommandFifo: {
-      display::Primitives::clearCommandBuffer();
+      g_gp0Parser.clear();
       g_statusRegister.clearPendingCommands();
       break;
     }
@@ -338,6 +471,7 @@ extern "C" void CALLBACK GPUwriteStatus(unsigned long gdata) {
 
 // Get data transfer mode
 extern "C" long CALLBACK GPUgetMode() {
+  syncGpuThread();
   return ((long)g_statusRegister.getDataWriteMode() | ((long)g_statusRegister.getDataReadMode() << 1));
 }
 // Set data transfer mode (emulator initiates data transfer)
@@ -354,8 +488,10 @@ extern "C" unsigned long CALLBACK GPUreadData() {
 
 // Read entire chunk of data from video memory (VRAM)
 extern "C" void CALLBACK GPUreadDataMem(unsigned long* mem, int size) {
+  syncGpuThread();
   if (g_statusRegister.getDataReadMode() == display::DataTransfer::vramTransfer) {
     display::GpuBusyStatusLock gpuBusyLock(g_statusRegister);
+    flushPrimitives();
 
     //...
     //g_statusRegister.setGpuReadBuffer(...);
@@ -374,60 +510,48 @@ extern "C" void CALLBACK GPUwriteData(unsigned long gdata) {
 
 // Process and send chunk of data to video data register - GP0 commands
 extern "C" void CALLBACK GPUwriteDataMem(unsigned long* mem, int size) {
-  display::GpuBusyStatusLock gpuBusyLock(g_statusRegister);
-  display::Gp0CommandStatusLock gp0CommandLock(g_statusRegister);
-
-  while (size > 0) {
-    // VRAM transfer (continuous DMA)
-    if (g_statusRegister.getDataWriteMode() == display::DataTransfer::vramTransfer) {
-      if (display::Primitives::imgHeight__TMP) {
-        size -= (display::Primitives::imgWidth__TMP * display::Primitives::imgHeight__TMP + 1) >> 1;
-        if (size < 0) {
-          display::Primitives::imgHeight__TMP = -size;//TMP
-          display::Primitives::imgWidth__TMP = 1;
-          return;
-        }
-        mem += (display::Primitives::imgWidth__TMP * display::Primitives::imgHeight__TMP + 1) >> 1;
-
-        //while cols/rows remaining
-          //if size == 0 before end of cols/rows, return;
-          //copy data as a texture ???
-          //watch out for alignement (if odd width -> padded or mis-aligned ???)
-      }
+  if (g_commandQueue != nullptr) { // threaded mode: copy data (processed by GPU thread)
+    if (size > 0)
+      pushGpuThreadCommands((const uint32_t*)mem, (size_t)size);
+  }
+  else
+    runGp0Commands((uint32_t*)mem, size);
+}
 
-      // stop vram transfer
-      display::Primitives::imgWidth__TMP = display::Primitives::imgHeight__TMP = 0;
-      g_statusRegister.setDataWriteMode(display::DataTransfer::command);
-    }
-    // GP0 command (primitive/attribute)
-    else {
-      int cmdSize = display::Primitives::runGp0Command(g_statusRegister, g_renderer, (uint32_t*)mem, size, false);
-      size -= cmdSize;
-      mem += (intptr_t)cmdSize;
+#define __DMA_SPAN_BATCH_SIZE 256 // max non-empty blocks collected before dispatch
+
+// Process all blocks of a linked-list DMA chain: non-empty blocks are collected by batches, then dispatched in a single loop
+// -> no per-block status locks / VRAM type checks, empty ordering table nodes skipped by the iterator
+template <unsigned long _RamSize, unsigned long _VramHeight>
+static void runDmaChain(display::Vram<_VramHeight>& vram, display::DmaChainVisitMap<_RamSize>* visitMap,
+                        unsigned long* baseAddress, unsigned long index) noexcept {
+  display::DmaChainSpan spans[__DMA_SPAN_BATCH_SIZE];
+  display::DmaChainIterator<_RamSize> it = (visitMap != nullptr)
+                                         ? display::DmaChainIterator<_RamSize>(baseAddress, index, *visitMap) // exact loop detection
+                                         : display::DmaChainIterator<_RamSize>(baseAddress, index);
+
+  if (g_commandQueue != nullptr) { // threaded mode: copy blocks to command queue (status register owned by GPU thread)
+    for (size_t count = it.readSpans(spans, __DMA_SPAN_BATCH_SIZE); count; count = it.readSpans(spans, __DMA_SPAN_BATCH_SIZE)) {
+      for (const display::DmaChainSpan* span = spans; span < &spans[count]; ++span)
+        pushGpuThreadCommands(span->data, (size_t)span->size);
     }
+    return;
+  }
+
+  display::GpuBusyStatusLock gpuBusyLock(g_statusRegister);
+  display::Gp0CommandStatusLock gp0CommandLock(g_statusRegister);
+  for (size_t count = it.readSpans(spans, __DMA_SPAN_BATCH_SIZE); count; count = it.readSpans(spans, __DMA_SPAN_BATCH_SIZE)) {
+    for (const display::DmaChainSpan* span = spans; span < &spans[count]; ++span)
+      g_gp0Parser.runBuffer(g_statusRegister, g_renderer, vram, span->data, span->size, false);
   }
 }
 
 // Direct memory chain transfer to GPU driver (linked-list DMA)
 extern "C" long CALLBACK GPUdmaChain(unsigned long* baseAddress, unsigned long index) {
-  display::GpuBusyStatusLock gpuBusyLock(g_statusRegister);
-  unsigned long* dmaBlock = nullptr;
-  int blockSize = 0;
-
-  if (g_statusRegister.getGpuVramHeight() == display::psxVramHeight()) {
-    display::DmaChainIterator<display::psxRamSize()> it(baseAddress, index);
-    while (it.readNext(&dmaBlock, blockSize)) {
-      if (blockSize > 0)
-        GPUwriteDataMem(dmaBlock, blockSize);
-    }
-  }
-  else {
-    display::DmaChainIterator<display::znArcadeRamSize()> it(baseAddress, index);
-    while (it.readNext(&dmaBlock, blockSize)) {
-      if (blockSize > 0)
-        GPUwriteDataMem(dmaBlock, blockSize);
-    }
-  }
+  if (g_statusRegister.getGpuVramHeight() == display::psxVramHeight())
+    runDmaChain(*g_vram, g_dmaVisitMap.get(), baseAddress, index);
+  else
+    runDmaChain(*g_arcadeVram, g_arcadeDmaVisitMap.get(), baseAddress, index);
   return PSE_SUCCESS;
 }
 
@@ -453,6 +577,8 @@ extern "C" long CALLBACK GPUfreeze(unsigned long dataMode, GPUFreeze_t* state) {
   else {
     if (state->freezeVersion != 1)
       return SAVESTATE_ERR;
+    syncGpuThread();
+    flushPrimitives();
 
     // save status + vram
     if (dataMode == PSE_SAVE_STATE) {
@@ -462,12 +588,25 @@ extern "C" long CALLBACK GPUfreeze(unsigned long dataMode, GPUFreeze_t* state) {
       memcpy(state->control, g_statusControlHistory, display::controlCommandNumber()*sizeof(unsigned long));
       state->control[0x11] = g_statusRegister.getGpuReadBuffer();
 
-      //memcpy(state->psxVram, g_vram, 1024*g_statusRegister.getGpuVramHeight()*2);//TODO
+      if (g_statusRegister.getGpuVramHeight() == display::psxVramHeight()) {
+        if (g_vram != nullptr)
+          memcpy(state->psxVram, g_vram->pixels(), g_vram->sizeInBytes());
+      }
+      else if (g_arcadeVram != nullptr)
+        memcpy(state->psxVram, g_arcadeVram->pixels(), g_arcadeVram->sizeInBytes());
     }
     // load status + vram
     else if (dataMode == PSE_LOAD_STATE) {
-      //memcpy(g_vram, state->psxVram, 1024*g_statusRegister.getGpuVramHeight()*2);//TODO
-      //reset texture area//TODO
+      if (g_statusRegister.getGpuVramHeight() == display::psxVramHeight()) {
+        if (g_vram != nullptr) {
+          memcpy(g_vram->pixels(), state->psxVram, g_vram->sizeInBytes());
+          g_vram->markAllDirty(); // invalidate everything based on previous VRAM content
+        }
+      }
+      else if (g_arcadeVram != nullptr) {
+        memcpy(g_arcadeVram->pixels(), state->psxVram, g_arcadeVram->sizeInBytes());
+        g_arcadeVram->markAllDirty();
+      }
 
       GPUwriteStatus(state->control[(size_t)display::ControlCommandId::resetGpu]);
       GPUwriteStatus(state->control[(size_t)display::ControlCommandId::clearCommandFifo]);
@@ -481,6 +620,7 @@ extern "C" long CALLBACK GPUfreeze(unsigned long dataMode, GPUFreeze_t* state) {
       else if (state->control[(size_t)display::ControlCommandId::arcadeTextureDisable]) // avoid reset if empty
         GPUwriteStatus(state->control[(size_t)display::ControlCommandId::arcadeTextureDisable]);
       GPUwriteStatus(state->control[(size_t)display::ControlCommandId::dmaMode]);
+      syncGpuThread(); // threaded mode: DMA mode processed by GPU thread
 
       g_statusRegister.setStatusControlRegister(state->status);
       g_statusRegister.setGpuReadBuffer(state->control[0x11]);
@@ -553,6 +693,7 @@ extern "C" void CALLBACK GPUdisplayFlags(unsigned long flags) {
   SysLog::logDebug(__FILE_NAME__, __LINE__, "GPUdisplayFlags: 0x%x", flags);
 
   g_inputConfig.hintMenuOnMouseMove = (flags & 0x202); // don't display menu on mouse move, if mouse input (or lightgun)
+  syncGpuThread();
   if ((flags & 0x0F00) == 0x300 && g_statusRegister.getActiveLightgunsMap() == 0)
     g_statusRegister.setLightgunCursor(0,0,0); // report lightgun in status register (if not yet registered)
 
@@ -579,6 +720,7 @@ extern "C" void CALLBACK GPUsetframelimit(unsigned long option) {
 //  0x0001 = GPU busy hack
 extern "C" void CALLBACK GPUsetfix(unsigned long fixBits) {
   SysLog::logDebug(__FILE_NAME__, __LINE__, "GPUsetfix: 0x%x", fixBits);
+  syncGpuThread();
   g_statusRegister.enableBusyGpuHack(fixBits & 0x0001);
 }
 
@@ -617,6 +759,7 @@ extern "C" void CALLBACK GPUdisplayText(char* message) {
 
 // Set gun cursor display and position: player=0-7, x=0-511, y=0-255
 extern "C" void CALLBACK GPUcursor(int player, int x, int y) {
+  syncGpuThread();
   g_statusRegister.setLightgunCursor((unsigned long)player, (long)x, (long)y);
 }
 
@@ -19,6 +19,11 @@ This file can be used only to develop PSEmu Plugins. Other usage is highly prohi
 
 #ifndef __DECLARE_GLOBALS
   extern display::StatusRegister g_statusRegister;
+  extern display::Gp0Parser g_gp0Parser;
+  extern std::unique_ptr<display::Vram<display::psxVramHeight()> > g_vram;
+  extern std::unique_ptr<display::Vram<display::znArcadeVramHeight()> > g_arcadeVram;
+  extern std::unique_ptr<display::DmaChainVisitMap<display::psxRamSize()> > g_dmaVisitMap;
+  extern std::unique_ptr<display::DmaChainVisitMap<display::znArcadeRamSize()> > g_arcadeDmaVisitMap;
 #endif
 
 /// @brief ZiNc config structure
@@ -37,8 +42,21 @@ typedef struct GPUOTAG {
 // ZiNc driver init (called once)
 extern "C" long CALLBACK ZN_GPUinit() // always set VRAM size to 2MB if ZN interface is used
 {
-	//...
-	return GPUinit();
+  long result = GPUinit();
+  if (result == PSE_INIT_SUCCESS) {
+    try {
+      if (g_arcadeVram == nullptr) {
+        g_arcadeVram.reset(new display::Vram<display::znArcadeVramHeight()>());
+        g_arcadeDmaVisitMap.reset(new display::DmaChainVisitMap<display::znArcadeRamSize()>());
+      }
+      g_vram.reset(); // standard VRAM not used with ZiNc interface
+      g_dmaVisitMap.reset();
+      g_gp0Parser.textureCache().clear();
+      g_statusRegister.setGpuType(display::GpuVersion::arcadeGpu1, display::znArcadeVramHeight()); // real version set in ZN_GPUopen
+    }
+    catch (const std::exception&) { return PSE_ERR_FATAL; }
+  }
+  return result;
 }
 // ZiNc driver shutdown (called once)
 extern "C" long CALLBACK ZN_GPUshutdown() { return GPUshutdown(); }